@@ -0,0 +1,193 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Elementwise matrix kernels: the gsl_matrix_get/set loop the operators
+// used before against simd_kernels under every instruction set this CPU
+// has. Each result is also compared bit for bit with the get/set loop.
+// Build and run with `make bench`; pass an element count with BENCH_ARGS=...
+
+#define _POSIX_C_SOURCE 200809L
+#include <gsl/gsl_complex_math.h>           // for gsl_complex_add, gsl_complex_mul
+#include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_get
+#include <gsl/gsl_matrix_double.h>          // for gsl_matrix_get, gsl_matrix_set
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for printf
+#include <stdlib.h>     // for atoi
+#include <string.h>     // for memcmp
+#include <time.h>       // for clock_gettime, CLOCK_MONOTONIC
+#include "simd_kernels.h"
+
+#define DEFAULT_COUNT 1000000
+#define REPEATS 20
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static double next_value(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (double)(int64_t)(rng_state % 2000001 - 1000000) / 997.0;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static double real_add(double x, double y) { return x + y; }
+static double real_mul(double x, double y) { return x * y; }
+static double real_div(double x, double y) { return x / y; }
+
+typedef struct {
+  const char* name;
+  simd_op op;
+  int kind;                       // see run_simd
+  double (*real_fn)(double, double);
+  gsl_complex (*complex_fn)(gsl_complex, gsl_complex);
+} bench_case;
+
+static const bench_case cases[] = {
+  { "real + real",        SIMD_ADD, 0, real_add, NULL },
+  { "real .* real",       SIMD_MUL, 0, real_mul, NULL },
+  { "real ./ real",       SIMD_DIV, 0, real_div, NULL },
+  { "real * scalar",      SIMD_MUL, 1, real_mul, NULL },
+  { "complex + complex",  SIMD_ADD, 2, NULL, gsl_complex_add },
+  { "complex .* complex", SIMD_MUL, 2, NULL, gsl_complex_mul },
+  { "complex * scalar",   SIMD_MUL, 3, NULL, gsl_complex_mul },
+  { "real + complex sc.", SIMD_ADD, 4, NULL, gsl_complex_add },
+};
+
+static gsl_complex zs;          // the complex scalar operand, set in main
+
+// The per-element path the operators took before
+static void run_get_set(const bench_case* c, const gsl_matrix* x, const gsl_matrix* y,
+                        const gsl_matrix_complex* cx, const gsl_matrix_complex* cy,
+                        gsl_matrix* out, gsl_matrix_complex* cout) {
+  size_t rows = x->size1, cols = x->size2;
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t j = 0; j < cols; ++j)
+      switch (c->kind) {
+      case 0:
+        gsl_matrix_set(out, i, j, c->real_fn(gsl_matrix_get(x, i, j), gsl_matrix_get(y, i, j)));
+        break;
+      case 1:
+        gsl_matrix_set(out, i, j, c->real_fn(gsl_matrix_get(x, i, j), GSL_REAL(zs)));
+        break;
+      case 2:
+        gsl_matrix_complex_set(cout, i, j, c->complex_fn(gsl_matrix_complex_get(cx, i, j),
+                                                         gsl_matrix_complex_get(cy, i, j)));
+        break;
+      case 3:
+        gsl_matrix_complex_set(cout, i, j, c->complex_fn(gsl_matrix_complex_get(cx, i, j), zs));
+        break;
+      default:
+        gsl_matrix_complex_set(cout, i, j,
+                               c->complex_fn(gsl_complex_rect(gsl_matrix_get(x, i, j), 0.0), zs));
+        break;
+      }
+}
+
+static void run_simd(const bench_case* c, const gsl_matrix* x, const gsl_matrix* y,
+                     const gsl_matrix_complex* cx, const gsl_matrix_complex* cy,
+                     gsl_matrix* out, gsl_matrix_complex* cout) {
+  size_t n = x->size1 * x->size2;
+  switch (c->kind) {
+  case 0: simd_real(c->op, x->data, y->data, out->data, n); break;
+  case 1: simd_real_scalar(c->op, x->data, GSL_REAL(zs), out->data, n, 0); break;
+  case 2: simd_complex(c->op, cx->data, cy->data, cout->data, n); break;
+  case 3: simd_complex_scalar(c->op, cx->data, zs, cout->data, n, 0); break;
+  default:
+    simd_real_to_complex(x->data, cout->data, n);
+    simd_complex_scalar(c->op, cout->data, zs, cout->data, n, 0);
+    break;
+  }
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+  if (count <= 0) count = DEFAULT_COUNT;
+  // An odd column count leaves a tail for every vector width
+  size_t cols = 1001;
+  size_t rows = ((size_t)count + cols - 1) / cols;
+
+  gsl_matrix* x = gsl_matrix_alloc(rows, cols);
+  gsl_matrix* y = gsl_matrix_alloc(rows, cols);
+  gsl_matrix* out = gsl_matrix_alloc(rows, cols);
+  gsl_matrix* ref = gsl_matrix_alloc(rows, cols);
+  gsl_matrix_complex* cx = gsl_matrix_complex_alloc(rows, cols);
+  gsl_matrix_complex* cy = gsl_matrix_complex_alloc(rows, cols);
+  gsl_matrix_complex* cout = gsl_matrix_complex_alloc(rows, cols);
+  gsl_matrix_complex* cref = gsl_matrix_complex_alloc(rows, cols);
+  if (!x || !y || !out || !ref || !cx || !cy || !cout || !cref) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+  size_t n = rows * cols;
+  zs = gsl_complex_rect(1.25, -0.5);
+  for (size_t i = 0; i < n; i++) {
+    x->data[i] = next_value();
+    y->data[i] = next_value();
+    cx->data[2 * i] = next_value();
+    cx->data[2 * i + 1] = next_value();
+    cy->data[2 * i] = next_value();
+    cy->data[2 * i + 1] = next_value();
+  }
+
+  const char* isas[] = { "scalar", "sse2", "avx2", "avx512" };
+  printf("%zu elements, best instruction set: %s\n", n, simd_isa_name());
+  printf("  %-20s %10s", "", "get/set");
+  for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    if (simd_select(isas[k]) == 0) printf(" %10s", isas[k]);
+  printf("   (ns/element)\n");
+
+  int mismatches = 0;
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    const bench_case* bc = &cases[c];
+    int complex_out = bc->kind >= 2;
+    double t0 = now();
+    for (int r = 0; r < REPEATS; r++) run_get_set(bc, x, y, cx, cy, ref, cref);
+    printf("  %-20s %10.3f", bc->name, 1e9 * (now() - t0) / REPEATS / (double)n);
+
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+      if (simd_select(isas[k]) != 0) continue;
+      t0 = now();
+      for (int r = 0; r < REPEATS; r++) run_simd(bc, x, y, cx, cy, out, cout);
+      printf(" %10.3f", 1e9 * (now() - t0) / REPEATS / (double)n);
+      int same = complex_out
+        ? memcmp(cout->data, cref->data, 2 * n * sizeof(double)) == 0
+        : memcmp(out->data, ref->data, n * sizeof(double)) == 0;
+      if (!same) {
+        printf("*");
+        mismatches++;
+      }
+    }
+    printf("\n");
+  }
+  printf("results differing from get/set (marked *): %d\n", mismatches);
+
+  gsl_matrix_free(x);
+  gsl_matrix_free(y);
+  gsl_matrix_free(out);
+  gsl_matrix_free(ref);
+  gsl_matrix_complex_free(cx);
+  gsl_matrix_complex_free(cy);
+  gsl_matrix_complex_free(cout);
+  gsl_matrix_complex_free(cref);
+  return mismatches != 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Vectorized elementary functions: speed of simd_math under every
+// instruction set this CPU has against the libm/GSL loop ("scalar"), and
+// the worst error of each in ulps against a long double reference. The
+// instruction sets must agree bit for bit.
+// Build and run with `make bench`; pass an element count with BENCH_ARGS=...
+
+#define _POSIX_C_SOURCE 200809L
+#include <float.h>      // for DBL_MIN
+#include <math.h>       // for nextafter, fabsl, expl, erfcl
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for printf
+#include <stdlib.h>     // for atoi, malloc
+#include <string.h>     // for memcmp
+#include <time.h>       // for clock_gettime, CLOCK_MONOTONIC
+#include "simd_kernels.h"
+#include "simd_math.h"
+
+#define DEFAULT_COUNT 1000000
+#define REPEATS 5
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static double uniform(double lo, double hi) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return lo + (hi - lo) * (double)(rng_state >> 11) * 0x1p-53;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static long double npdf_l(long double x) {
+  return expl(-0.5L * x * x) * 0.398942280401432677939946059934L;
+}
+
+static long double ncdf_l(long double x) {
+  return 0.5L * erfcl(-x * 0.707106781186547524400844362104849L);
+}
+
+typedef struct {
+  const char* name;
+  simd_math_fn fn;
+  long double (*ref)(long double);
+  double lo, hi;                // argument range
+  int log_scale;                // spread exponents evenly over [lo, hi]
+} bench_case;
+
+static const bench_case cases[] = {
+  { "sin",   MATH_SIN,   sinl,   -1e5, 1e5, 0 },
+  { "cos",   MATH_COS,   cosl,   -1e5, 1e5, 0 },
+  { "tan",   MATH_TAN,   tanl,   -1e5, 1e5, 0 },
+  { "exp",   MATH_EXP,   expl,   -708, 709, 0 },
+  { "ln",    MATH_LN,    logl,   DBL_MIN, 1e300, 1 },
+  { "log",   MATH_LOG10, log10l, DBL_MIN, 1e300, 1 },
+  { "sqrt",  MATH_SQRT,  sqrtl,  DBL_MIN, 1e300, 1 },
+  { "sinh",  MATH_SINH,  sinhl,  -709, 709, 0 },
+  { "cosh",  MATH_COSH,  coshl,  -709, 709, 0 },
+  { "tanh",  MATH_TANH,  tanhl,  -25, 25, 0 },
+  { "npdf",  MATH_NPDF,  npdf_l, -37, 37, 0 },
+  { "ncdf",  MATH_NCDF,  ncdf_l, -37.5, 9, 0 },
+};
+
+// |got - want| in units of the last place of want rounded to double
+static double ulp_error(double got, long double want) {
+  double w = fabs((double)want);
+  double ulp = w < DBL_MIN ? 0x1p-1074 : nextafter(w, INFINITY) - w;
+  return (double)(fabsl((long double)got - want) / ulp);
+}
+
+static double max_error(const bench_case* c, const double* x, const double* y, size_t n) {
+  double worst = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    double e = ulp_error(y[i], c->ref(x[i]));
+    if (e > worst) worst = e;
+  }
+  return worst;
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+  if (count <= 0) count = DEFAULT_COUNT;
+  size_t n = (size_t)count + 3;   // leave a tail for every vector width
+  double* x = malloc(n * sizeof(double));
+  double* out = malloc(n * sizeof(double));
+  double* first = malloc(n * sizeof(double));
+  if (!x || !out || !first) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+
+  const char* isas[] = { "scalar", "sse2", "avx2", "avx512" };
+  const char* best = simd_isa_name();
+  printf("%zu elements, best instruction set: %s\n", n, best);
+  printf("  %-6s", "");
+  for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++)
+    if (simd_select(isas[k]) == 0) printf(" %10s", isas[k]);
+  printf("   (ns/element)  max ulp: scalar  vector\n");
+
+  int mismatches = 0;
+  for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+    const bench_case* bc = &cases[c];
+    for (size_t i = 0; i < n; i++)
+      x[i] = bc->log_scale ? exp(uniform(log(bc->lo), log(bc->hi))) : uniform(bc->lo, bc->hi);
+    printf("  %-6s", bc->name);
+
+    double scalar_error = 0.0, vector_error = 0.0;
+    int have_vector = 0;
+    for (size_t k = 0; k < sizeof(isas) / sizeof(isas[0]); k++) {
+      if (simd_select(isas[k]) != 0) continue;
+      double t0 = now();
+      for (int r = 0; r < REPEATS; r++) simd_math_real(bc->fn, x, out, n);
+      printf(" %10.3f", 1e9 * (now() - t0) / REPEATS / (double)n);
+      if (k == 0) {
+        scalar_error = max_error(bc, x, out, n);
+      } else if (!have_vector) {
+        vector_error = max_error(bc, x, out, n);
+        memcpy(first, out, n * sizeof(double));
+        have_vector = 1;
+      } else if (memcmp(first, out, n * sizeof(double)) != 0) {
+        printf("*");
+        mismatches++;
+      }
+    }
+    printf("  %22.2f", scalar_error);
+    if (have_vector) printf("  %6.2f", vector_error);
+    printf("\n");
+  }
+  printf("instruction sets disagreeing (marked *): %d\n", mismatches);
+  simd_select(best);
+
+  free(x);
+  free(out);
+  free(first);
+  return mismatches != 0;
+}
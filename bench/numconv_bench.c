@@ -0,0 +1,138 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Throughput of numconv against the libc conversions it replaces.
+// Build and run with `make bench`.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>     // for uint64_t
+#include <stdio.h>      // for printf, snprintf
+#include <stdlib.h>     // for malloc, free, strtod, atoi
+#include <string.h>     // for memcpy, strlen
+#include <time.h>       // for clock_gettime, CLOCK_MONOTONIC
+#include "numconv.h"
+
+#define DEFAULT_COUNT 1000000
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// A mix of what ends up in matrix files: arbitrary doubles, short decimals
+// and small integers
+static double sample(int i) {
+  switch (i % 3) {
+  case 0: {
+    double x;
+    do {
+      uint64_t bits = next_random();
+      memcpy(&x, &bits, sizeof(x));
+    } while (x != x || x - x != 0);
+    return x;
+  }
+  case 1:
+    return (double)(int64_t)(next_random() % 2000001 - 1000000) / 1000.0;
+  default:
+    return (double)(next_random() % 10000);
+  }
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+static void report(const char* what, double seconds, int count, size_t bytes) {
+  printf("  %-28s %8.1f ns/number %8.1f MB/s\n", what,
+         1e9 * seconds / count, (double)bytes / seconds / 1e6);
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+  if (count <= 0) count = DEFAULT_COUNT;
+
+  double* values = malloc(sizeof(double) * (size_t)count);
+  char* text = malloc((size_t)count * DOUBLE_BUF_SIZE);
+  char* libc_text = malloc((size_t)count * DOUBLE_BUF_SIZE);
+  if (!values || !text || !libc_text) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+  for (int i = 0; i < count; i++) values[i] = sample(i);
+
+  printf("%d numbers\n", count);
+  printf("format:\n");
+
+  double t0 = now();
+  size_t libc_bytes = 0;
+  for (int i = 0; i < count; i++)
+    libc_bytes += (size_t)snprintf(libc_text + libc_bytes, DOUBLE_BUF_SIZE, "%.17g ", values[i]);
+  double t_libc = now() - t0;
+
+  t0 = now();
+  size_t bytes = 0;
+  for (int i = 0; i < count; i++) {
+    bytes += (size_t)format_double(values[i], text + bytes);
+    text[bytes++] = ' ';
+  }
+  text[bytes] = '\0';
+  double t_fast = now() - t0;
+
+  report("snprintf(\"%.17g\")", t_libc, count, libc_bytes);
+  report("format_double", t_fast, count, bytes);
+  printf("  output size %zu vs %zu bytes\n", bytes, libc_bytes);
+
+  printf("parse:\n");
+  double* parsed = malloc(sizeof(double) * (size_t)count);
+  if (!parsed) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+
+  t0 = now();
+  char* p = text;
+  for (int i = 0; i < count; i++) parsed[i] = strtod(p, &p);
+  double t_strtod = now() - t0;
+
+  t0 = now();
+  const char* q = text;
+  const char* end = text + bytes;
+  for (int i = 0; i < count; i++) q = parse_double(q, end, &parsed[i]);
+  double t_parse = now() - t0;
+
+  report("strtod", t_strtod, count, bytes);
+  report("parse_double", t_parse, count, bytes);
+
+  // Everything format_double wrote must read back bit for bit
+  int mismatches = 0;
+  for (int i = 0; i < count; i++)
+    if (memcmp(&parsed[i], &values[i], sizeof(double)) != 0) mismatches++;
+  printf("round-trip mismatches: %d\n", mismatches);
+
+  free(parsed);
+  free(values);
+  free(text);
+  free(libc_text);
+  return mismatches != 0;
+}
@@ -33,6 +33,7 @@ void div_top_two(Stack* stack);
 void pow_top_two(Stack* stack);
 void join_2_reals(Stack *s);
 int kronecker_top_two(Stack* stack);
+gsl_matrix* kronecker_real(const gsl_matrix* a, const gsl_matrix* b);  // NULL if out of memory
 void dot_div_top_two(Stack* stack);
 void dot_mult_top_two(Stack* stack);
 void dot_pow_top_two(Stack* stack);
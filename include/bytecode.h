@@ -0,0 +1,75 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "eval_fun.h"
+#include "lexer.h"
+#include "stack.h"
+
+#define LINE_CACHE_SIZE 256   // compiled lines kept by run_line_cached
+
+struct user_word;
+
+// === Types ===
+typedef enum {
+  CODE_PUSH_REAL,     // push a pre-parsed real literal
+  CODE_PUSH_CONST,    // push a copy of a pre-built complex/string/matrix
+  CODE_BUILTIN,       // call a builtin through its resolved handler
+  CODE_BINARY,        // arithmetic operator (+ - * / ^ .* ./ .^)
+  CODE_CALL,          // user word or macro, linked through its symbol
+  CODE_FUSED,         // superinstruction from the peephole pass
+  CODE_TOKEN          // anything else, replayed through evaluate_one_token
+} code_type;
+
+typedef struct {
+  code_type type;
+  int opcode;                 // builtin opcode for CODE_BUILTIN
+  union {
+    double real;
+    stack_element constant;
+    builtin_func func;
+    token_type op;
+    Token* token;
+    int symbol;               // interned name for CODE_CALL
+    int fusion;               // superinstruction for CODE_FUSED
+  };
+} compiled_instr;
+
+typedef struct compiled_line {
+  compiled_instr* code;
+  int count;
+  int capacity;
+  int refs;             // owners: the word it belongs to plus running callers
+} compiled_line;
+
+// Compile once, run many times
+compiled_line* compile_line(const char* line);
+void execute_compiled(Stack* stack, compiled_line* cl);
+compiled_line* retain_compiled_line(compiled_line* cl);
+void free_compiled_line(compiled_line* cl);
+
+// User words and macros; calls run on an explicit return stack, not in C
+void run_user_word(Stack* stack, struct user_word* w);
+
+// LRU cache of compiled lines keyed by the line text
+void run_line_cached(Stack* stack, const char* line);
+void clear_line_cache(void);
+
+#endif // BYTECODE_H
@@ -22,7 +22,19 @@
 #include "lexer.h"
 #include "stack.h"
 
+typedef void (*builtin_func)(Stack *stack);
+
 void evaluate_line(Stack *stack, char * line);
-void evaluate_one_token(Stack *stack, Token tok);
+void evaluate_one_token(Stack *stack, const Token* tok);
+void evaluate_identifier(Stack *stack, const char* name);
+builtin_func builtin_handler(int opcode);
+
+// How many elements from the top the builtin may pop or overwrite, or -1
+// if it may reach anywhere in the stack
+int builtin_reach(int opcode);
+
+// How many elements from the top lazy mode has to force before the builtin
+// runs: none for stack shuffles, otherwise its reach (-1 for all)
+int builtin_lazy_depth(int opcode);
 
 #endif // EVAL_FUN_H
@@ -19,6 +19,15 @@
 #ifndef FUNCTION_LIST_H
 #define FUNCTION_LIST_H
 
+#include <stddef.h>   // for size_t
+
+#define OPCODE_NONE (-1)
+
 extern const char* const function_names[];
 
+// Builtin lookup: the opcode of a builtin is its index in function_names
+int function_count(void);
+int function_opcode(const char* name);
+int function_opcode_n(const char* name, size_t len);
+
 #endif
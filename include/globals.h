@@ -60,6 +60,7 @@ extern double intg_tolerance;
 extern double fsolve_tolerance;
 
 int set_print_precision(Stack* stack);
+int set_thread_count(Stack* stack);
 void swap_fixed_scientific(void);
 void save_config(const char* filename);
 int load_config(const char* filename);
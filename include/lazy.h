@@ -0,0 +1,77 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAZY_H
+#define LAZY_H
+
+#include <stdbool.h>             // for bool
+#include "lexer.h"               // for token_type
+#include "stack.h"               // for Stack, stack_element
+
+// Lazy mode: + - * / .* ./ .^ on real matrices and real scalars push a
+// TYPE_LAZY element holding the expression instead of its value. Chained
+// operators extend the expression, and it is computed in one blocked pass,
+// every operator applied to a cache-sized block before the next block is
+// read, when anything else needs the value. execute_compiled forces the
+// stack before every instruction that is not an operator or a literal and
+// at the end of the line, so nothing outside this file sees TYPE_LAZY.
+// kron of two real matrices is kept lazily too, for the product with a
+// matrix that follows it. In any mode, ' and tran of a real matrix push a
+// transposed view of it, which a product passes to BLAS as CblasTrans.
+
+// Most steps (operands and operators) in one expression; a longer chain
+// forces its operand and starts a new expression on the result
+#define LAZY_MAX_STEPS 16
+
+extern bool lazy_mode;
+extern int lazy_live;         // lazy expressions in existence
+
+typedef struct lazy_expr lazy_expr;
+
+void toggle_lazy_mode(void);
+
+// kron of two real matrices: push A ⊗ B as its factors. Forced, it is the
+// product; times a matrix X, (A ⊗ B) X comes straight from the factors.
+// Returns 1 if it did, 0 (with the stack untouched) for other operands.
+int lazy_kron(Stack* stack);
+
+// ' or tran run from compiled code: push a view of the real matrix on top
+// as its transpose. Returns 1 if it did, 0 for other opcodes and operands.
+int lazy_builtin(Stack* stack, int opcode);
+
+// * with a Kronecker product or a transposed view among the top two,
+// computed from the matrices they hold. Returns 1 if it did, 0 (with the
+// stack untouched) if the operands or operator do not qualify.
+int lazy_product(Stack* stack, token_type op);
+
+// Apply the operator to the top two elements lazily. Returns 1 if it did,
+// 0 (with the stack untouched) if the operands or operator do not qualify.
+int lazy_binary(Stack* stack, token_type op);
+
+// Replace a TYPE_LAZY element with its real matrix. Returns 0, or -1 (with
+// a message, the element still lazy) if the result cannot be allocated.
+int lazy_force(stack_element* e);
+
+// Force the top n elements, or all of them when n is larger than the stack
+void lazy_force_top(Stack* stack, int n);
+
+// For stack_element_free and stack_element_clone
+void lazy_free(lazy_expr* e);
+lazy_expr* lazy_clone(const lazy_expr* e);
+
+#endif // LAZY_H
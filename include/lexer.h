@@ -27,8 +27,9 @@
 #include <math.h>
 #include <readline/history.h>
 #include <readline/readline.h>
+#include "function_list.h"   // for OPCODE_NONE
+#include "symbols.h"         // for SYMBOL_NONE
 
-#define MAX_TOKEN_LEN 1024
 #define MAX_INPUT_LEN 4096
 #define MAX_SUBTOKEN_LEN 100
 
@@ -59,9 +60,17 @@ typedef enum {
   TOK_UNKNOWN,
 } token_type;
 
+// A token is a slice of the input: text is NOT NUL-terminated and stays
+// valid only as long as the input line does. A token that has to outlive
+// its line keeps a heap copy of the text in owned, which free_token
+// releases.
 typedef struct {
   token_type type;
-  char text[MAX_TOKEN_LEN];
+  int opcode;               // builtin opcode for TOK_FUNCTION, else OPCODE_NONE
+  int symbol;               // interned name for TOK_FUNCTION/TOK_IDENTIFIER
+  const char* text;
+  size_t len;
+  char* owned;
 } Token;
 
 typedef struct {
@@ -74,6 +83,9 @@ char peek(Lexer* lexer);
 char advance(Lexer* lexer);
 bool match(Lexer* lexer, char expected);
 Token make_token(token_type type, const char* text);
+Token make_slice(token_type type, const char* start, size_t len);
+char* token_strdup(const Token* tok);
+void free_token(Token* tok);
 bool is_function_name(const char* name);
 Token lex_number(Lexer* lexer);
 Token lex_identifier(Lexer* lexer);
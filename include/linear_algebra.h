@@ -26,8 +26,11 @@ int matrix_frobenius_norm(Stack *stack);
 int solve_linear_system(Stack* stack);
 int matrix_eigen_decompose(Stack* stack);
 int matrix_transpose(Stack* stack);
+// A new matrix holding mᵀ, or NULL (with a message) if it cannot be allocated
+gsl_matrix* transpose_real(const gsl_matrix* m);
 int matrix_cholesky(Stack* stack);
 int matrix_svd(Stack* stack);
+int matrix_singular_values(Stack* stack);
 void gsl_matrix_pseudoinverse(const gsl_matrix* A, gsl_matrix* A_pinv);
 int matrix_pseudoinverse(Stack* stack);
 
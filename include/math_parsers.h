@@ -39,7 +39,6 @@
 
 int read_complex(const char* input, gsl_complex* z);
 void read_matrix_from_file(Stack *stack, char *input);
-gsl_matrix* parse_matrix_literal(const char* input);
-gsl_matrix_complex* parse_complex_matrix_literal(const char* input);
+int parse_inline_matrix(const char* text, size_t len, stack_element* out);
 
 #endif // MATH_FUN_H
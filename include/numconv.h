@@ -0,0 +1,41 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef NUMCONV_H
+#define NUMCONV_H
+
+#include <stddef.h>
+
+#define DOUBLE_BUF_SIZE 32    // enough for any format_double result + NUL
+
+// === Parsing ===
+// Parse a decimal number starting at s (after optional whitespace), reading
+// no further than end. Accepts what strtod accepts for decimal input.
+// Returns a pointer just past the number, or NULL when there is none.
+const char* parse_double(const char* s, const char* end, double* out);
+
+// Drop-in for strtod on NUL-terminated text
+double str_to_double(const char* s, char** endptr);
+
+// === Formatting ===
+// Round-trip digit string that reads back as exactly x, printf %g style,
+// at most one digit longer than the shortest such string.
+// Writes at most DOUBLE_BUF_SIZE bytes including the NUL; returns the length.
+int format_double(double x, char* buf);
+
+#endif // NUMCONV_H
@@ -0,0 +1,62 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>              // for size_t
+
+#define PARALLEL_MIN_ELEMENTS_DEFAULT 65536
+#define PARALLEL_MAX_THREADS 256
+
+// Slices handed to a body are a multiple of this many elements (but the
+// last), so neighbouring threads never write the same cache line of doubles
+#define PARALLEL_GRAIN 64
+
+extern int thread_count;            // threads for large operations; 0 = one per core
+extern int parallel_min_elements;   // smaller operations stay on the calling thread
+
+typedef void (*parallel_body)(size_t begin, size_t end, void* arg);
+
+// Run body over [0, n) in slices, on a pool of worker threads and the
+// calling thread together, when n is at least parallel_min_elements and
+// more than one thread is configured; otherwise as body(0, n, arg). Slices
+// are multiples of grain. Returns once every slice is done. A body must
+// only write its own slice; parallel_for inside a body runs serially.
+void parallel_for(size_t n, size_t grain, parallel_body body, void* arg);
+
+// Reductions whose rounding depends on where the data is cut (column sums
+// and variances, cumulative sums down columns) split a matrix into parts of
+// whole rows that depend only on its shape, never on the thread count, and
+// merge the parts in part order, so every run gives the same answer. This
+// is the number of rows in each part but the last.
+size_t parallel_part_rows(size_t rows, size_t cols);
+
+typedef void (*parallel_part_body)(size_t part, void* arg);
+
+// Run body for parts 0 .. parts - 1 through parallel_for, each part
+// counting as weight elements
+void parallel_for_parts(size_t parts, size_t weight, parallel_part_body body, void* arg);
+
+// The number of threads parallel_for uses, the caller included
+int parallel_threads(void);
+
+// Stop and join the workers; the next parallel_for starts them again
+void free_parallel(void);
+
+#endif // PARALLEL_H
@@ -0,0 +1,41 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "stack.h"
+
+struct compiled_line;
+
+// Rewrites known instruction sequences in a compiled body into single
+// superinstructions (CODE_FUSED)
+void optimize_compiled_line(struct compiled_line* cl);
+
+// Runs one superinstruction; falls back to the original sequence whenever
+// the operands are not ones the fused version handles
+void run_fusion(Stack* stack, int fusion);
+
+// How many elements from the top a superinstruction may pop or overwrite,
+// or -1 if it may reach anywhere (see builtin_reach)
+int fusion_reach(int fusion);
+
+// Prints every superinstruction with how often it was fused and run
+void list_fusions(void);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex
+#include <gsl/gsl_matrix_double.h>          // for gsl_matrix
+
+#define POOL_RETAIN_MB_DEFAULT 64
+
+extern int pool_retain_mb;    // most memory the free lists may hold on to
+
+// Drop-in replacements for gsl_matrix_alloc/calloc/free and their complex
+// versions. Data blocks are 64-byte aligned and come in size classes four to
+// a power of two; freed matrices go on a per-class free list and are handed out
+// again to the next request of that class. The objects stay ordinary GSL
+// matrices, so one that ends up in gsl_matrix_free is still freed correctly.
+gsl_matrix* pool_matrix_alloc(size_t n1, size_t n2);
+gsl_matrix* pool_matrix_calloc(size_t n1, size_t n2);
+void pool_matrix_free(gsl_matrix* m);
+
+gsl_matrix_complex* pool_matrix_complex_alloc(size_t n1, size_t n2);
+gsl_matrix_complex* pool_matrix_complex_calloc(size_t n1, size_t n2);
+void pool_matrix_complex_free(gsl_matrix_complex* m);
+
+// Hit rate, retained bytes and the occupancy of each size class
+void print_pool_stats(void);
+
+void free_pool(void);
+
+#endif // POOL_H
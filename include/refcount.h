@@ -0,0 +1,40 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef REFCOUNT_H
+#define REFCOUNT_H
+
+// Owner counts for matrix and string payloads shared between stack slots,
+// registers and undo snapshots. Only shared payloads are tracked: a pointer
+// that is not in the table has exactly one owner, so releasing it means
+// freeing it.
+
+// One more owner for p. Returns -1 if the table cannot grow, in which case
+// the caller should fall back to a private copy.
+int payload_retain(const void* p);
+
+// 1 if more than one owner holds p
+int payload_shared(const void* p);
+
+// Drops one owner. Returns 1 if the caller was the last one and has to free
+// p itself, 0 if other owners remain.
+int payload_release(const void* p);
+
+void free_payload_refs(void);
+
+#endif // REFCOUNT_H
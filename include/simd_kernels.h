@@ -0,0 +1,75 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_KERNELS_H
+#define SIMD_KERNELS_H
+
+#include <stddef.h>              // for size_t
+#include <gsl/gsl_complex.h>     // for gsl_complex
+
+// Elementwise arithmetic on contiguous buffers of doubles. Complex buffers
+// are interleaved (re, im) pairs, the layout of gsl_matrix_complex data,
+// and n counts complex elements. out may be the same buffer as an input.
+// Results are bit for bit those of the scalar operators and of
+// gsl_complex_add/sub/mul/div/pow: no fused multiply-add, same formulas.
+// Matrices keep GSL's interleaved layout for BLAS, LAPACK and everything
+// else; simd_split and simd_join convert where separate planes are wanted.
+
+typedef enum {
+  SIMD_ADD,
+  SIMD_SUB,
+  SIMD_MUL,
+  SIMD_DIV,
+  SIMD_MIN,     // x < y ? x : y, real buffers only
+  SIMD_MAX,     // x > y ? x : y, real buffers only
+  SIMD_POW      // calls pow/gsl_complex_pow per element, never vectorized
+} simd_op;
+
+// out[i] = x[i] op y[i]
+void simd_real(simd_op op, const double* x, const double* y, double* out, size_t n);
+
+// out[i] = x[i] op s, or s op x[i] if scalar_first
+void simd_real_scalar(simd_op op, const double* x, double s, double* out, size_t n,
+                      int scalar_first);
+
+void simd_complex(simd_op op, const double* x, const double* y, double* out, size_t n);
+void simd_complex_scalar(simd_op op, const double* x, gsl_complex z, double* out,
+                         size_t n, int scalar_first);
+
+// An interleaved buffer to separate planes and back: re[i] and im[i] are
+// the parts of element i. split skips a NULL plane; join reads a NULL im
+// as zeros. The planes may not overlap z.
+void simd_split(const double* z, double* re, double* im, size_t n);
+void simd_join(const double* re, const double* im, double* z, size_t n);
+
+// dst[j * ldd + i] = src[i * lds + j] for a rows x cols block, lds and ldd
+// being the row strides. Meant for blocks that fit in cache; callers tile
+// whole matrices with it.
+void simd_transpose(const double* src, size_t lds, double* dst, size_t ldd,
+                    size_t rows, size_t cols);
+
+// out[2i] = x[i], out[2i+1] = 0: a real buffer promoted to complex
+void simd_real_to_complex(const double* x, double* out, size_t n);
+
+// The instruction set in use: "avx512", "avx2", "sse2" or "scalar". The
+// best one the CPU supports is picked on first use; simd_select can pick
+// another by name (for benchmarks) and returns -1 if it is not available.
+const char* simd_isa_name(void);
+int simd_select(const char* name);
+
+#endif // SIMD_KERNELS_H
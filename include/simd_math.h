@@ -0,0 +1,76 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include <stddef.h>              // for size_t
+
+// Elementary functions over contiguous buffers of doubles, a vector at a
+// time, using the instruction set simd_kernels picked (simd_select applies
+// here too; under "scalar" every element goes to libm/GSL). out may be x.
+//
+// The vector kernels are polynomial and rational approximations (fdlibm's
+// for exp, log, sin and cos, Cody's for the normal cdf) without fused
+// multiply-add, so every instruction set returns the same bits. A block
+// with any argument outside a kernel's range below (or NaN) is computed by
+// libm/GSL instead. Worst error seen against a long double reference over
+// 10^7 arguments spread across each range (bench/math_bench.c):
+//
+//   function       vector range             max error (ulp)
+//   sin cos        |x| <= 1e5               0.8
+//   tan            |x| <= 1e5               2.2
+//   exp            -708 <= x <= 709         0.9
+//   ln             normal x > 0             0.8
+//   log            normal x > 0             1.8
+//   sqrt           all x                    0.5 (correctly rounded)
+//   sinh cosh      |x| <= 709               1.6
+//   tanh           all x                    2.7
+//   npdf           |x| <= 37                2.9
+//   ncdf           all x                    7.5, in the lower tail; the
+//                                           same as GSL's Cody code
+//
+// GSL's npdf loses up to x^2/2 ulp squaring x, which the vector kernel
+// avoids by splitting the square.
+
+typedef enum {
+  MATH_SIN,
+  MATH_COS,
+  MATH_TAN,
+  MATH_EXP,
+  MATH_LN,
+  MATH_LOG10,
+  MATH_SQRT,
+  MATH_SINH,
+  MATH_COSH,
+  MATH_TANH,
+  MATH_NPDF,
+  MATH_NCDF,
+  MATH_COUNT
+} simd_math_fn;
+
+// out[i] = fn(x[i])
+void simd_math_real(simd_math_fn fn, const double* x, double* out, size_t n);
+
+// The same on interleaved (re, im) buffers, n complex elements, for
+// MATH_EXP, MATH_SIN, MATH_COS, MATH_SINH and MATH_COSH, built from the
+// real kernels with the formulas of gsl_complex_exp and friends. Returns
+// -1, writing nothing, for any other function.
+int simd_math_complex(simd_math_fn fn, const double* x, double* out, size_t n);
+
+#endif // SIMD_MATH_H
@@ -24,7 +24,15 @@
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_complex_math.h>
 
-#define STACK_SIZE 100
+// The stack grows on demand. Capacity doubles up to the hard limit; past the
+// soft limit a warning is printed once, and stack_trim() gives memory back
+// after the depth drops well below the capacity.
+#define STACK_INITIAL_CAPACITY 16
+#define STACK_SOFT_LIMIT_DEFAULT 10000
+#define STACK_HARD_LIMIT_DEFAULT 1000000
+
+extern int stack_soft_limit;
+extern int stack_hard_limit;
 
 #define GUARANTEE_STACK(stack, n)					\
   do {									\
@@ -39,9 +47,15 @@ typedef enum {
   TYPE_COMPLEX,
   TYPE_STRING,
   TYPE_MATRIX_REAL,
-  TYPE_MATRIX_COMPLEX
+  TYPE_MATRIX_COMPLEX,
+  TYPE_LAZY           // pending elementwise expression, see lazy.h
 } value_type;
 
+// Types operators and builtins see; TYPE_LAZY is forced before they run
+#define VALUE_TYPE_COUNT (TYPE_MATRIX_COMPLEX + 1)
+
+struct lazy_expr;
+
 typedef struct {
   value_type type;
   union {
@@ -50,25 +64,61 @@ typedef struct {
     char* string;
     gsl_matrix* matrix_real;
     gsl_matrix_complex* matrix_complex;
+    struct lazy_expr* lazy;
   };
 } stack_element;
 
 typedef struct {
-  stack_element items[STACK_SIZE];
+  stack_element* items;
   int top;
+  int capacity;
+  int warned;                 // soft limit warning already printed
 } Stack;
 
-/* Element-level resource management.
- * stack_element_free: release any heap memory owned by *e (matrix/string) and
+/* Element-level resource management. Matrix and string payloads are shared
+ * between clones and counted in refcount.c; they are copied only when an
+ * owner is about to write to a shared one.
+ * stack_element_free: drop this owner's reference to the payload of *e and
  *               leave it in a safe, NULL/zeroed state. Scalars are no-ops.
- * stack_element_clone: deep-copy src into dst (independent matrix/string storage).
+ * stack_element_clone: make dst another owner of src's payload.
  *               Returns 0 on success, -1 on allocation/unknown-type failure.
+ * stack_element_unshare: give *e a private payload before writing to it in
+ *               place; a no-op when *e is the only owner. Returns 0 or -1.
+ * take_matrix_real, take_matrix_complex: detach the matrix of an operand
+ *               that is about to be consumed, so an operator can write its
+ *               result there. NULL (and *e untouched) unless *e holds a matrix
+ *               of that type with no other owner.
+ * matrix_release, matrix_complex_release, string_release: drop one
+ *               reference, freeing the payload with its last owner. Use them
+ *               instead of gsl_matrix_free/free on anything that came from a
+ *               stack element or register.
+ *
+ * Two rules keep the undo journal (undo.c) cheap and correct. Whatever
+ * writes into an element's payload in place unshares it first, so a saved
+ * clone keeps the old value. And a builtin pops or overwrites at most as
+ * many elements from the top as its entry in the builtin table (eval_fun.c)
+ * declares, since only those are saved before it runs.
  */
 void stack_element_free(stack_element* e);
 int  stack_element_clone(stack_element* dst, const stack_element* src);
+int  stack_element_unshare(stack_element* e);
+gsl_matrix* take_matrix_real(stack_element* e);
+gsl_matrix_complex* take_matrix_complex(stack_element* e);
+void matrix_release(gsl_matrix* m);
+void matrix_complex_release(gsl_matrix_complex* m);
+void string_release(char* s);
 
 void init_stack(Stack* stack);
 int stack_size(const Stack* stack);
+/* stack_reserve: make room for n more elements above top. Returns 0 on
+ *               success, -1 (after printing "Stack overflow") if that would
+ *               pass the hard limit or the allocation fails. Growing may move
+ *               items, so pointers into the stack must be taken afterwards.
+ * stack_trim: shrink the capacity after a large drop. Only call it where no
+ *               pointer into items is live (between lines, not inside ops).
+ */
+int stack_reserve(Stack* stack, int n);
+void stack_trim(Stack* stack);
 void push_real(Stack* stack, double value);
 void push_complex(Stack* stack, gsl_complex value);
 void push_string(Stack* stack, const char* str);
@@ -24,4 +24,8 @@ double standard_normal_cdf(double x);
 double standard_normal_quantile(double p);
 void matrix_column_means(Stack* stack);
 void matrix_reduce(Stack* stack, const char* axis, const char* op);
+
+// Column statistics of a real matrix in one pass: a 5 x cols matrix whose
+// rows are the sum, mean, variance, min and max of each column
+void matrix_describe(Stack* stack);
 #endif // STAT_FUN_H
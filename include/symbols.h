@@ -0,0 +1,53 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stddef.h>   // for size_t
+
+#define SYMBOL_NONE (-1)
+
+struct user_word;
+
+// Every identifier the lexer sees is interned once and referred to by its
+// id from then on. Builtins are interned up front; words and macros bind
+// to the symbol of their name.
+int intern_symbol(const char* name, size_t len);
+int lookup_symbol(const char* name, size_t len);
+const char* symbol_name(int id);
+
+// What a symbol is bound to; OPCODE_NONE / NULL when it is not
+int symbol_opcode(int id);
+struct user_word* symbol_word(int id);
+struct user_word* symbol_macro(int id);
+int symbol_is_bound(int id);
+
+// Words and macros live in arrays that shift on delete, so words.c
+// rebinds all of them after every change
+void unbind_user_symbols(void);
+void bind_word_symbol(struct user_word* w);
+void bind_macro_symbol(struct user_word* w);
+
+// Bound names starting with prefix, in sorted order. Start with
+// *cursor = 0 and call until it returns NULL.
+const char* next_symbol_with_prefix(const char* prefix, int* cursor);
+
+void free_symbols(void);
+
+#endif // SYMBOLS_H
@@ -29,6 +29,7 @@ void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double));
 void complex_matrix_real_part(Stack *s);
 void complex_matrix_imag_part(Stack *s);
 void complex_matrix_abs_by_element(Stack *s);
+void complex_matrix_arg_by_element(Stack *s);
 void real2complex(Stack *s);
 void split_complex(Stack *s);
 #endif // UNARY_FUN_H
@@ -0,0 +1,49 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNDO_H
+#define UNDO_H
+
+#include "stack.h"
+
+#define UNDO_LEVELS_DEFAULT 1000
+#define UNDO_BUDGET_MB_DEFAULT 256
+
+extern int undo_levels;       // most lines that can be undone
+extern int undo_budget_mb;    // most memory the journal may hold on to
+
+// The REPL brackets every line with these. Only the elements a line popped
+// or overwrote are kept, and they are moved into the journal, not copied.
+void undo_begin_line(const Stack* stack);
+void undo_end_line(Stack* stack);
+
+// Elements from here up are saved for the line in progress; 0 when no
+// line is being recorded or all of it is saved. While it is positive, the
+// interpreter calls undo_save before each instruction with how many
+// elements from the top that instruction may pop or overwrite, -1 for any.
+extern int undo_unsaved;
+void undo_save(const Stack* stack, int reach);
+
+// Step back or forward one recorded line. Return 0, or -1 (with a message)
+// when there is nothing to undo or redo.
+int undo_line(Stack* stack);
+int redo_line(Stack* stack);
+
+void clear_undo_journal(void);
+
+#endif // UNDO_H
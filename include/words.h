@@ -25,9 +25,12 @@
 #include <stdbool.h>
 #include "stack.h"
 
-typedef struct {
+struct compiled_line;
+
+typedef struct user_word {
   char name[MAX_WORD_NAME];
   char body[MAX_WORD_BODY];
+  struct compiled_line* code;   // body compiled at definition/load time
 } user_word;
 
 extern user_word words[MAX_WORDS];
@@ -39,7 +42,7 @@ extern int macro_count;
 // Macros functions
 void list_macros(void);
 int load_macros_from_file(void);
-user_word* find_macro(char* name);
+user_word* find_macro(const char* name);
 
 // Words functions
 void list_words(void);
@@ -48,7 +51,7 @@ int delete_word_by_index(int index);
 void clear_words(void);
 int save_words_to_file(void);
 int load_words_from_file(void);
-user_word* find_word(char* name);
+user_word* find_word(const char* name);
 void word_select(Stack *stack);
 int is_word_definition(const char *s);
 
@@ -25,8 +25,11 @@
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_alloc
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix_get, gsl_matri...
 #include <gsl/gsl_permutation.h>            // for gsl_permutation_alloc
-#include <math.h>                           // for pow
+#include <math.h>                           // for pow, fabs, floor
 #include <stdio.h>                          // for size_t, fprintf, stderr
+#include "parallel.h"                       // for parallel_for, PARALLEL_GRAIN
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_kernels.h"                   // for simd_real, simd_complex, simd_join
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "math_helpers.h"                   // for is_zero_comple
 #include "binary_fun.h"                     // for add_top_two, add_top_two_...
@@ -63,30 +66,44 @@ void add_top_two_matrices(Stack* stack) {
     if (a.matrix_real->size1 != b.matrix_real->size1
 	|| a.matrix_real->size2 != b.matrix_real->size2) {
       fprintf(stderr,"Matrix dimensions must match\n");
-      gsl_matrix_free(a.matrix_real);
-      gsl_matrix_free(b.matrix_real);
+      matrix_release(a.matrix_real);
+      matrix_release(b.matrix_real);
       return;
     }
-    gsl_matrix* result = gsl_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
-    gsl_matrix_memcpy(result, b.matrix_real);
-    gsl_matrix_add(result, a.matrix_real);
-    gsl_matrix_free(a.matrix_real);
-    gsl_matrix_free(b.matrix_real);
+    // Add into whichever operand nobody else holds; copy only if both are shared
+    gsl_matrix* result;
+    if ((result = take_matrix_real(&b))) {
+      gsl_matrix_add(result, a.matrix_real);
+    } else if ((result = take_matrix_real(&a))) {
+      gsl_matrix_add(result, b.matrix_real);
+    } else {
+      result = pool_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
+      gsl_matrix_memcpy(result, b.matrix_real);
+      gsl_matrix_add(result, a.matrix_real);
+    }
+    matrix_release(a.matrix_real);
+    matrix_release(b.matrix_real);
     push_matrix_real(stack, result);
   } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
     if (a.matrix_complex->size1 != b.matrix_complex->size1
 	|| a.matrix_complex->size2 != b.matrix_complex->size2) {
       fprintf(stderr,"Matrix dimensions must match\n");
-      gsl_matrix_complex_free(a.matrix_complex);
-      gsl_matrix_complex_free(b.matrix_complex);
+      matrix_complex_release(a.matrix_complex);
+      matrix_complex_release(b.matrix_complex);
       return;
     }
-    gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result, b.matrix_complex);
-    gsl_matrix_complex_add(result, a.matrix_complex);
-    gsl_matrix_complex_free(a.matrix_complex);
-    gsl_matrix_complex_free(b.matrix_complex);
+    gsl_matrix_complex* result;
+    if ((result = take_matrix_complex(&b))) {
+      gsl_matrix_complex_add(result, a.matrix_complex);
+    } else if ((result = take_matrix_complex(&a))) {
+      gsl_matrix_complex_add(result, b.matrix_complex);
+    } else {
+      result = pool_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
+      gsl_matrix_complex_memcpy(result, b.matrix_complex);
+      gsl_matrix_complex_add(result, a.matrix_complex);
+    }
+    matrix_complex_release(a.matrix_complex);
+    matrix_complex_release(b.matrix_complex);
     push_matrix_complex(stack, result);
   } else {
     fprintf(stderr,"Unsupported matrix types for addition\n");
@@ -173,22 +190,45 @@ void subtract_top_two_matrices(Stack* stack) {
     if (a.matrix_real->size1 != b.matrix_real->size1
 	|| a.matrix_real->size2 != b.matrix_real->size2) {
       fprintf(stderr,"Matrix size mismatch\n");
+      matrix_release(a.matrix_real);
+      matrix_release(b.matrix_real);
       return;
     }
-    gsl_matrix* result = gsl_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
-    gsl_matrix_memcpy(result, a.matrix_real);
-    gsl_matrix_sub(result, b.matrix_real);
+    gsl_matrix* result;
+    if ((result = take_matrix_real(&a))) {
+      gsl_matrix_sub(result, b.matrix_real);
+    } else if ((result = take_matrix_real(&b))) {
+      gsl_matrix_scale(result, -1.0);     // -b + a
+      gsl_matrix_add(result, a.matrix_real);
+    } else {
+      result = pool_matrix_alloc(a.matrix_real->size1, a.matrix_real->size2);
+      gsl_matrix_memcpy(result, a.matrix_real);
+      gsl_matrix_sub(result, b.matrix_real);
+    }
+    matrix_release(a.matrix_real);
+    matrix_release(b.matrix_real);
     push_matrix_real(stack, result);
   } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
     if (a.matrix_complex->size1 != b.matrix_complex->size1
 	|| a.matrix_complex->size2 != b.matrix_complex->size2) {
       fprintf(stderr,"Matrix size mismatch\n");
+      matrix_complex_release(a.matrix_complex);
+      matrix_complex_release(b.matrix_complex);
       return;
     }
-    gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result, a.matrix_complex);
-    gsl_matrix_complex_sub(result, b.matrix_complex);
+    gsl_matrix_complex* result;
+    if ((result = take_matrix_complex(&a))) {
+      gsl_matrix_complex_sub(result, b.matrix_complex);
+    } else if ((result = take_matrix_complex(&b))) {
+      gsl_matrix_complex_scale(result, gsl_complex_rect(-1.0, 0.0));
+      gsl_matrix_complex_add(result, a.matrix_complex);
+    } else {
+      result = pool_matrix_complex_alloc(a.matrix_complex->size1, a.matrix_complex->size2);
+      gsl_matrix_complex_memcpy(result, a.matrix_complex);
+      gsl_matrix_complex_sub(result, b.matrix_complex);
+    }
+    matrix_complex_release(a.matrix_complex);
+    matrix_complex_release(b.matrix_complex);
     push_matrix_complex(stack, result);
   } else {
     fprintf(stderr,"Unsupported matrix types for subtraction\n");
@@ -209,7 +249,7 @@ void multiply_top_two_matrices(Stack* stack) {
       return;
     }
     gsl_matrix* result =
-      gsl_matrix_alloc(a.matrix_real->size1, b.matrix_real->size2);
+      pool_matrix_alloc(a.matrix_real->size1, b.matrix_real->size2);
     gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a.matrix_real, b.matrix_real, 0.0, result);
     push_matrix_real(stack, result);
   } else if (a.type == TYPE_MATRIX_COMPLEX && b.type == TYPE_MATRIX_COMPLEX) {
@@ -218,7 +258,7 @@ void multiply_top_two_matrices(Stack* stack) {
       return;
     }
     gsl_matrix_complex* result =
-      gsl_matrix_complex_alloc(a.matrix_complex->size1, b.matrix_complex->size2);
+      pool_matrix_complex_alloc(a.matrix_complex->size1, b.matrix_complex->size2);
     gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
 		   GSL_COMPLEX_ONE, a.matrix_complex, b.matrix_complex,
 		   GSL_COMPLEX_ZERO, result);
@@ -228,136 +268,38 @@ void multiply_top_two_matrices(Stack* stack) {
   }
 }
 
-void add_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in add_top_two.\n");
-    return;
-  }
-
-  stack_element* a = &stack->items[stack->top - 1]; // second from top
-  stack_element* b = &stack->items[stack->top];     // top
-  stack_element result = {0};                       // temp result
-
-  // Dispatch begins here
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real + b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_COMPLEX;
-    result.complex_val =
-      gsl_complex_add((a->type == TYPE_REAL ? gsl_complex_rect(a->real, 0.0) : a->complex_val),
-		      (b->type == TYPE_REAL ? gsl_complex_rect(b->real,0.0) : b->complex_val));
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_add(a->complex_val, b->complex_val);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
-    gsl_matrix_add_constant(result.matrix_real, val);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-
-    gsl_complex z = gsl_complex_rect(val, 0.0);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex old = gsl_matrix_complex_get(result.matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_add(old, z));
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	double val = gsl_matrix_get(mat_real, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j,
-			       gsl_complex_add(z, gsl_complex_rect(val, 0.0)));
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex old = gsl_matrix_complex_get(result.matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_add(old, z));
-      }
-  }
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size1 != b->matrix_real->size1 ||
-	a->matrix_real->size2 != b->matrix_real->size2) {
-      fprintf(stderr, "Matrix size mismatch.\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_memcpy(result.matrix_real, a->matrix_real);
-    gsl_matrix_add(result.matrix_real, b->matrix_real);
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
-	a->matrix_complex->size2 != b->matrix_complex->size2) {
-      fprintf(stderr, "Matrix size mismatch.\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result.matrix_complex, a->matrix_complex);
-    gsl_matrix_complex_add(result.matrix_complex, b->matrix_complex);
-  }
-  else {
-    fprintf(stderr, "Unsupported operand types in add_top_two.\n");
-    return;
-  }
-
-  // Free any heap-allocated matrix in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
-
-  // Overwrite a with result and reduce stack
-  *a = result;
-  stack->top--; // pop one element
-}
-
-void sub_top_two(Stack* stack) {
+// **************** Arithmetic operators ****************
+// Each operator is a table of kernels indexed by the types of its operands
+// (second from top, top). A kernel fills in the result, or prints why the
+// operands cannot be combined and returns -1, in which case the stack is
+// left alone. Scalar and elementwise kernels are shared by all operators and
+// call back into the operator's real and complex functions; only matrix
+// products, matrix division and matrix powers need kernels of their own.
+// Elementwise kernels run the simd_kernels loops when the matrices are
+// contiguous, which they are unless they came from a view, split across
+// the thread pool when the matrices are large.
+// Both operands are consumed, so an elementwise kernel whose operand holds
+// the only reference to a matrix of the result's type and shape writes the
+// result straight into it instead of allocating a new one.
+// Two real scalars never reach the table: every operator handles them
+// inline before dispatching.
+
+typedef struct binary_op binary_op;
+
+typedef int (*binary_kernel)(stack_element* a, stack_element* b,
+			     stack_element* result, const binary_op* op);
+
+struct binary_op {
+  const char* name;
+  double (*real_fn)(double, double);
+  gsl_complex (*complex_fn)(gsl_complex, gsl_complex);
+  simd_op simd;                       // the same operation on whole buffers
+  binary_kernel kernel[VALUE_TYPE_COUNT][VALUE_TYPE_COUNT];
+};
+
+static void apply_binary_op(Stack* stack, const binary_op* op) {
   if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in sub_top_two.\n");
+    fprintf(stderr, "Stack underflow in %s.\n", op->name);
     return;
   }
 
@@ -365,576 +307,597 @@ void sub_top_two(Stack* stack) {
   stack_element* b = &stack->items[stack->top];     // top
   stack_element result = {0};
 
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real - b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_COMPLEX;
-    gsl_complex za = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0) : a->complex_val;
-    gsl_complex zb = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0) : b->complex_val;
-    result.complex_val = gsl_complex_sub(za, zb);
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    //    result.complex_val = gsl_complex_sub(a->complex_val, b->complex_val);
-    result.complex_val = gsl_complex_sub(a->complex_val, b->complex_val);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    int scalar_first = (a->type == TYPE_REAL);
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
-
-    if (scalar_first) {
-      // scalar - matrix
-      gsl_matrix_scale(result.matrix_real, -1.0);
-      gsl_matrix_add_constant(result.matrix_real, val);
-    } else {
-      // matrix - scalar
-      gsl_matrix_add_constant(result.matrix_real, -val);
-    }
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
-    int scalar_first = (a->type == TYPE_REAL);
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-
-    if (scalar_first) {
-      // scalar - matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // matrix - scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    if (scalar_first) {
-      // complex scalar - real matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // real matrix - complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    if (scalar_first) {
-      // complex scalar - complex matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(z, v));
-	}
-    } else {
-      // complex matrix - complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_sub(v, z));
-	}
-    }
-  }
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size1 != b->matrix_real->size1 ||
-	a->matrix_real->size2 != b->matrix_real->size2) {
-      fprintf(stderr, "Matrix size mismatch in sub_top_two (real matrices).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_memcpy(result.matrix_real, a->matrix_real);
-    gsl_matrix_sub(result.matrix_real, b->matrix_real);
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
-	a->matrix_complex->size2 != b->matrix_complex->size2) {
-      fprintf(stderr, "Matrix size mismatch in sub_top_two (complex matrices).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_memcpy(result.matrix_complex, a->matrix_complex);
-    gsl_matrix_complex_sub(result.matrix_complex, b->matrix_complex);
-  }
-  else {
-    fprintf(stderr, "Unsupported operand types in sub_top_two.\n");
+  // A lazy operand that could not be forced has no kernel
+  binary_kernel kernel = (a->type < VALUE_TYPE_COUNT && b->type < VALUE_TYPE_COUNT)
+    ? op->kernel[a->type][b->type] : NULL;
+  if (!kernel) {
+    fprintf(stderr, "Unsupported operand types in %s.\n", op->name);
     return;
   }
+  if (kernel(a, b, &result, op) != 0) return;
 
-  // Free memory in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
+  // Release both consumed operands, then store the result in place of a
   stack_element_free(a);
   stack_element_free(b);
-
-  // Store result and pop
   *a = result;
   stack->top--;
 }
 
+// TYPE_REAL is 0, so one comparison covers both operands
+static inline int top_two_real(const Stack* stack) {
+  return stack->top >= 1 &&
+    (stack->items[stack->top].type | stack->items[stack->top - 1].type) == TYPE_REAL;
+}
 
-void mul_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in mul_top_two.\n");
-    return;
-  }
+#define REAL_FAST_PATH(stack, x, y, expr)			\
+  do {								\
+    if (top_two_real(stack)) {					\
+      double x = (stack)->items[(stack)->top - 1].real;		\
+      double y = (stack)->items[(stack)->top].real;		\
+      (stack)->items[--(stack)->top].real = (expr);		\
+      return;							\
+    }								\
+  } while (0)
+
+// ---- Scalar functions ----
+static double real_add(double x, double y) { return x + y; }
+static double real_sub(double x, double y) { return x - y; }
+static double real_mul(double x, double y) { return x * y; }
+static double real_div(double x, double y) { return x / y; }
+
+// ^ on complex scalars is exp(log(base) * exponent)
+static gsl_complex complex_pow_log(gsl_complex base, gsl_complex exponent) {
+  return gsl_complex_exp(gsl_complex_mul(gsl_complex_log(base), exponent));
+}
 
-  stack_element* a = &stack->items[stack->top - 1]; // second from top
-  stack_element* b = &stack->items[stack->top];     // top
-  stack_element result = {0};
+static gsl_complex as_complex(const stack_element* e) {
+  return (e->type == TYPE_REAL) ? gsl_complex_rect(e->real, 0.0) : e->complex_val;
+}
 
-  // Scalar * Scalar
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real * b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_COMPLEX;
-    gsl_complex za = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0) : a->complex_val;
-    gsl_complex zb = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0) : b->complex_val;
-    result.complex_val = gsl_complex_mul(za, zb);
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_mul(a->complex_val, b->complex_val);
-  }
+static gsl_complex matrix_element_complex(const stack_element* m, size_t i, size_t j) {
+  return (m->type == TYPE_MATRIX_REAL)
+    ? gsl_complex_rect(gsl_matrix_get(m->matrix_real, i, j), 0.0)
+    : gsl_matrix_complex_get(m->matrix_complex, i, j);
+}
 
-  // Real scalar * Real matrix
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    double scalar = (a->type == TYPE_REAL) ? a->real : b->real;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    gsl_matrix_memcpy(result.matrix_real, mat);
-    gsl_matrix_scale(result.matrix_real, scalar);
-  }
+static int contiguous(const stack_element* m) {
+  return (m->type == TYPE_MATRIX_REAL)
+    ? m->matrix_real->tda == m->matrix_real->size2
+    : m->matrix_complex->tda == m->matrix_complex->size2;
+}
 
-  // Real scalar * Complex matrix
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    double scalar = (a->type == TYPE_REAL) ? a->real : b->real;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    gsl_matrix_complex_memcpy(result.matrix_complex, mat);
-    gsl_matrix_complex_scale(result.matrix_complex, gsl_complex_rect(scalar, 0.0));
+static void matrix_dims(const stack_element* m, size_t* rows, size_t* cols) {
+  if (m->type == TYPE_MATRIX_REAL) {
+    *rows = m->matrix_real->size1;
+    *cols = m->matrix_real->size2;
+  } else {
+    *rows = m->matrix_complex->size1;
+    *cols = m->matrix_complex->size2;
   }
+}
 
-  // Complex scalar * Real matrix -> Complex matrix
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	double val = gsl_matrix_get(mat_real, i, j);
-	gsl_complex val_c = gsl_complex_rect(val, 0.0);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, val_c));
-      }
-    }
-  }
+// ---- Buffer slices ----
+// One simd_kernels call over the whole of a dense operand, cut into slices
+// by parallel_for. y is NULL when the other operand is the scalar s or z.
+typedef struct {
+  simd_op op;
+  const double* x;
+  const double* y;
+  double s;
+  gsl_complex z;
+  int scalar_first;
+  int widen;                          // x is real, to be read as (x, 0)
+  double* out;
+} buffer_job;
+
+static void real_slice(size_t begin, size_t end, void* arg) {
+  const buffer_job* job = arg;
+  if (job->y)
+    simd_real(job->op, job->x + begin, job->y + begin, job->out + begin, end - begin);
+  else
+    simd_real_scalar(job->op, job->x + begin, job->s, job->out + begin, end - begin,
+		     job->scalar_first);
+}
 
-  // Complex scalar * Complex matrix
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
-    }
-  }
+static void complex_slice(size_t begin, size_t end, void* arg) {
+  const buffer_job* job = arg;
+  double* out = job->out + 2 * begin;
+  const double* x = job->x + 2 * begin;
+  if (job->widen) {
+    simd_real_to_complex(job->x + begin, out, end - begin);
+    x = out;
+  }
+  if (job->y)
+    simd_complex(job->op, x, job->y + 2 * begin, out, end - begin);
+  else
+    simd_complex_scalar(job->op, x, job->z, out, end - begin, job->scalar_first);
+}
 
-  // Real matrix * Real matrix
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size2 != b->matrix_real->size1) {
-      fprintf(stderr, "Dimension mismatch for real matrix multiplication.\n");
-      return;
-    }
+// ---- Shared kernels ----
+static int real_scalars(stack_element* a, stack_element* b,
+			stack_element* result, const binary_op* op) {
+  result->type = TYPE_REAL;
+  result->real = op->real_fn(a->real, b->real);
+  return 0;
+}
 
-    result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, b->matrix_real->size2);
-    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans,
-		   1.0, a->matrix_real, b->matrix_real,
-		   0.0, result.matrix_real);
-  }
+static int complex_scalars(stack_element* a, stack_element* b,
+			   stack_element* result, const binary_op* op) {
+  result->type = TYPE_COMPLEX;
+  result->complex_val = op->complex_fn(as_complex(a), as_complex(b));
+  return 0;
+}
 
-  // Complex matrix * Complex matrix
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size2 != b->matrix_complex->size1) {
-      fprintf(stderr, "Dimension mismatch for complex matrix multiplication.\n");
-      return;
+// Real scalar with a real matrix, in either order
+static int real_matrix_scalar(stack_element* a, stack_element* b,
+			      stack_element* result, const binary_op* op) {
+  int scalar_first = (a->type == TYPE_REAL);
+  const gsl_matrix* mat = scalar_first ? b->matrix_real : a->matrix_real;
+  double val = scalar_first ? a->real : b->real;
+
+  size_t rows = mat->size1, cols = mat->size2;
+  int dense = contiguous(scalar_first ? b : a);
+  gsl_matrix* dst = take_matrix_real(scalar_first ? b : a);
+  if (!dst) dst = pool_matrix_alloc(rows, cols);
+  result->type = TYPE_MATRIX_REAL;
+  result->matrix_real = dst;
+  if (dense) {
+    buffer_job job = { .op = op->simd, .x = mat->data, .s = val,
+		       .scalar_first = scalar_first, .out = dst->data };
+    parallel_for(rows * cols, PARALLEL_GRAIN, real_slice, &job);
+    return 0;
+  }
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t j = 0; j < cols; ++j) {
+      double m = gsl_matrix_get(mat, i, j);
+      gsl_matrix_set(dst, i, j, scalar_first ? op->real_fn(val, m) : op->real_fn(m, val));
     }
+  return 0;
+}
 
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, b->matrix_complex->size2);
-    gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
-		   GSL_COMPLEX_ONE, a->matrix_complex, b->matrix_complex,
-		   GSL_COMPLEX_ZERO, result.matrix_complex);
-  }
-
-  else {
-    fprintf(stderr, "Unsupported operand types in mul_top_two.\n");
-    return;
-  }
-
-  // Free memory in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
+// Any scalar with any matrix where one of them is complex, in either order
+static int complex_matrix_scalar(stack_element* a, stack_element* b,
+				 stack_element* result, const binary_op* op) {
+  int scalar_first = (a->type == TYPE_REAL || a->type == TYPE_COMPLEX);
+  stack_element* mat = scalar_first ? b : a;
+  gsl_complex z = as_complex(scalar_first ? a : b);
+
+  size_t rows, cols;
+  matrix_dims(mat, &rows, &cols);
+  // Only a complex matrix operand can hold the result; reading through
+  // src keeps working after its matrix has been taken
+  stack_element src = *mat;
+  gsl_matrix_complex* dst = take_matrix_complex(mat);
+  if (!dst) dst = pool_matrix_complex_alloc(rows, cols);
+  result->type = TYPE_MATRIX_COMPLEX;
+  result->matrix_complex = dst;
+  if (contiguous(&src)) {
+    // A real matrix is widened to (x, 0) first, which is the operand the
+    // per-element path hands to the complex function as well
+    int widen = (src.type == TYPE_MATRIX_REAL);
+    buffer_job job = { .op = op->simd, .z = z, .scalar_first = scalar_first,
+		       .widen = widen, .out = dst->data,
+		       .x = widen ? src.matrix_real->data : src.matrix_complex->data };
+    parallel_for(rows * cols, PARALLEL_GRAIN, complex_slice, &job);
+    return 0;
+  }
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t j = 0; j < cols; ++j) {
+      gsl_complex v = matrix_element_complex(&src, i, j);
+      gsl_matrix_complex_set(dst, i, j,
+			     scalar_first ? op->complex_fn(z, v) : op->complex_fn(v, z));
+    }
+  return 0;
+}
 
-  // Store result in-place and pop b
-  *a = result;
-  stack->top--;
+static int real_matrices(stack_element* a, stack_element* b,
+			 stack_element* result, const binary_op* op) {
+  const gsl_matrix* x = a->matrix_real;
+  const gsl_matrix* y = b->matrix_real;
+  if (x->size1 != y->size1 || x->size2 != y->size2) {
+    fprintf(stderr, "Matrix size mismatch in %s (real).\n", op->name);
+    return -1;
+  }
+  int dense = contiguous(a) && contiguous(b);
+  gsl_matrix* dst = take_matrix_real(a);
+  if (!dst) dst = take_matrix_real(b);
+  if (!dst) dst = pool_matrix_alloc(x->size1, x->size2);
+  result->type = TYPE_MATRIX_REAL;
+  result->matrix_real = dst;
+  if (dense) {
+    buffer_job job = { .op = op->simd, .x = x->data, .y = y->data, .out = dst->data };
+    parallel_for(x->size1 * x->size2, PARALLEL_GRAIN, real_slice, &job);
+    return 0;
+  }
+  for (size_t i = 0; i < x->size1; ++i)
+    for (size_t j = 0; j < x->size2; ++j)
+      gsl_matrix_set(dst, i, j, op->real_fn(gsl_matrix_get(x, i, j), gsl_matrix_get(y, i, j)));
+  return 0;
 }
 
+static int complex_matrices(stack_element* a, stack_element* b,
+			    stack_element* result, const binary_op* op) {
+  const gsl_matrix_complex* x = a->matrix_complex;
+  const gsl_matrix_complex* y = b->matrix_complex;
+  if (x->size1 != y->size1 || x->size2 != y->size2) {
+    fprintf(stderr, "Matrix size mismatch in %s (complex).\n", op->name);
+    return -1;
+  }
+  int dense = contiguous(a) && contiguous(b);
+  gsl_matrix_complex* dst = take_matrix_complex(a);
+  if (!dst) dst = take_matrix_complex(b);
+  if (!dst) dst = pool_matrix_complex_alloc(x->size1, x->size2);
+  result->type = TYPE_MATRIX_COMPLEX;
+  result->matrix_complex = dst;
+  if (dense) {
+    buffer_job job = { .op = op->simd, .x = x->data, .y = y->data, .out = dst->data };
+    parallel_for(x->size1 * x->size2, PARALLEL_GRAIN, complex_slice, &job);
+    return 0;
+  }
+  for (size_t i = 0; i < x->size1; ++i)
+    for (size_t j = 0; j < x->size2; ++j)
+      gsl_matrix_complex_set(dst, i, j,
+			     op->complex_fn(gsl_matrix_complex_get(x, i, j),
+					 gsl_matrix_complex_get(y, i, j)));
+  return 0;
+}
 
-void div_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in div_top_two.\n");
-    return;
-  }
+// ---- Matrix product ----
+static int real_matrix_product(stack_element* a, stack_element* b,
+			       stack_element* result, const binary_op* op) {
+  (void)op;
+  if (a->matrix_real->size2 != b->matrix_real->size1) {
+    fprintf(stderr, "Dimension mismatch for real matrix multiplication.\n");
+    return -1;
+  }
+  result->type = TYPE_MATRIX_REAL;
+  result->matrix_real = pool_matrix_alloc(a->matrix_real->size1, b->matrix_real->size2);
+  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans,
+		 1.0, a->matrix_real, b->matrix_real,
+		 0.0, result->matrix_real);
+  return 0;
+}
 
-  stack_element* a = &stack->items[stack->top - 1]; // numerator
-  stack_element* b = &stack->items[stack->top];     // denominator
-  stack_element result = {0};
+static int complex_matrix_product(stack_element* a, stack_element* b,
+				  stack_element* result, const binary_op* op) {
+  (void)op;
+  if (a->matrix_complex->size2 != b->matrix_complex->size1) {
+    fprintf(stderr, "Dimension mismatch for complex matrix multiplication.\n");
+    return -1;
+  }
+  result->type = TYPE_MATRIX_COMPLEX;
+  result->matrix_complex =
+    pool_matrix_complex_alloc(a->matrix_complex->size1, b->matrix_complex->size2);
+  gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
+		 GSL_COMPLEX_ONE, a->matrix_complex, b->matrix_complex,
+		 GSL_COMPLEX_ZERO, result->matrix_complex);
+  return 0;
+}
 
-  // ---- Scalar ÷ Scalar ----
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real / b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    gsl_complex za = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0) : a->complex_val;
-    gsl_complex zb = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0) : b->complex_val;
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_div(za, zb);
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    //    result.complex_val = gsl_complex_div(a->complex_val, b->complex_val);
-    result.complex_val = gsl_complex_div(a->complex_val, b->complex_val);
-  }
+// ---- Matrix division: A * inv(B) ----
+static int real_matrix_quotient(stack_element* a, stack_element* b,
+				stack_element* result, const binary_op* op) {
+  (void)op;
+  const gsl_matrix* B = b->matrix_real;
+  if (B->size1 != B->size2) {
+    fprintf(stderr, "Matrix divisor must be square for inversion.\n");
+    return -1;
+  }
+  gsl_matrix* binv = pool_matrix_alloc(B->size1, B->size2);
+  gsl_permutation* p = gsl_permutation_alloc(B->size1);
+  int signum;
+  gsl_matrix* bcopy = pool_matrix_alloc(B->size1, B->size2);
+  gsl_matrix_memcpy(bcopy, B);
+  gsl_linalg_LU_decomp(bcopy, p, &signum);
+  gsl_linalg_LU_invert(bcopy, p, binv);
+
+  result->type = TYPE_MATRIX_REAL;
+  result->matrix_real = pool_matrix_alloc(a->matrix_real->size1, binv->size2);
+  gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a->matrix_real, binv, 0.0, result->matrix_real);
+
+  pool_matrix_free(binv);
+  pool_matrix_free(bcopy);
+  gsl_permutation_free(p);
+  return 0;
+}
 
-  // ---- Matrix ÷ Scalar (real or complex) ----
-  else if ((a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL) ||
-	   (a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double scalar = (a->type == TYPE_REAL) ? a->real : b->real;
+static int complex_matrix_quotient(stack_element* a, stack_element* b,
+				   stack_element* result, const binary_op* op) {
+  (void)op;
+  const gsl_matrix_complex* B = b->matrix_complex;
+  if (B->size1 != B->size2) {
+    fprintf(stderr, "Matrix divisor must be square for inversion.\n");
+    return -1;
+  }
+  gsl_matrix_complex* binv = pool_matrix_complex_alloc(B->size1, B->size2);
+  gsl_permutation* p = gsl_permutation_alloc(B->size1);
+  int signum;
+  gsl_matrix_complex* bcopy = pool_matrix_complex_alloc(B->size1, B->size2);
+  gsl_matrix_complex_memcpy(bcopy, B);
+  gsl_linalg_complex_LU_decomp(bcopy, p, &signum);
+  gsl_linalg_complex_LU_invert(bcopy, p, binv);
+
+  result->type = TYPE_MATRIX_COMPLEX;
+  result->matrix_complex = pool_matrix_complex_alloc(a->matrix_complex->size1, binv->size2);
+  gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
+		 GSL_COMPLEX_ONE, a->matrix_complex, binv,
+		 GSL_COMPLEX_ZERO, result->matrix_complex);
+
+  pool_matrix_complex_free(binv);
+  pool_matrix_complex_free(bcopy);
+  gsl_permutation_free(p);
+  return 0;
+}
 
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
+// ---- Matrix ^ integer ----
+// Binary exponentiation: the base is squared once per bit of |n| and
+// multiplied into the result for each set bit, at most 2 log2(n) products.
+// Each product goes to a spare buffer that then swaps with the one it
+// replaces, so the loop allocates nothing. A negative power raises the
+// inverse, from a single LU factorization.
+
+// The exponent as a count of products, or -1 (with a message) if it is
+// not an integer a matrix can be raised to
+static long long matrix_exponent(const stack_element* a, const stack_element* b) {
+  size_t rows, cols;
+  matrix_dims(a, &rows, &cols);
+  if (rows != cols) {
+    fprintf(stderr, "Matrix exponent needs a square matrix.\n");
+    return -1;
+  }
+  double e = b->real;
+  if (e != floor(e) || fabs(e) >= 0x1p62) {
+    fprintf(stderr, "Matrix exponent must be an integer.\n");
+    return -1;
+  }
+  return (long long)fabs(e);
+}
 
-    if (a->type == TYPE_MATRIX_REAL) {
-      // Matrix ÷ scalar
-      gsl_matrix_memcpy(result.matrix_real, mat);
-      gsl_matrix_scale(result.matrix_real, 1.0 / scalar);
-    } else {
-      // Scalar ÷ Matrix: scalar divided by each element
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat, i, j);
-	  gsl_matrix_set(result.matrix_real, i, j, scalar / val);
-	}
-    }
-  }
-  else if ((a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex scalar = (a->type == TYPE_COMPLEX)
-      ? a->complex_val
-      : gsl_complex_div(gsl_complex_rect(1.0, 0.0), b->complex_val);
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    if (a->type == TYPE_MATRIX_REAL) {
-      // Real matrix ÷ complex scalar
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat_real, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j,
-				 gsl_complex_div(gsl_complex_rect(val, 0.0), scalar));
-	}
-    } else {
-      // Complex scalar ÷ real matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  double val = gsl_matrix_get(mat_real, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j,
-				 gsl_complex_div(scalar, gsl_complex_rect(val, 0.0)));
-	}
-    }
-  }
-  else if ((a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL) ||
-	   (a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat_complex =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex scalar =
-      (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0.0) : gsl_complex_rect(1.0, 0.0);
-
-    size_t rows = mat_complex->size1, cols = mat_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    if (a->type == TYPE_MATRIX_COMPLEX) {
-      // Complex matrix ÷ real scalar
-      gsl_matrix_complex_memcpy(result.matrix_complex, mat_complex);
-      gsl_matrix_complex_scale(result.matrix_complex, gsl_complex_rect(1.0 / b->real, 0.0));
-    } else {
-      // Real scalar ÷ complex matrix
-      for (size_t i = 0; i < rows; ++i)
-	for (size_t j = 0; j < cols; ++j) {
-	  gsl_complex val = gsl_matrix_complex_get(mat_complex, i, j);
-	  gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(scalar, val));
-	}
+static int real_matrix_power(stack_element* a, stack_element* b,
+			     stack_element* result, const binary_op* op) {
+  (void)op;
+  long long k = matrix_exponent(a, b);
+  if (k < 0) return -1;
+  size_t n = a->matrix_real->size1;
+
+  gsl_matrix* acc = pool_matrix_alloc(n, n);
+  gsl_matrix* spare = pool_matrix_alloc(n, n);
+  gsl_matrix* base = NULL;
+  if (acc && spare && b->real < 0) {
+    // The inverse comes from the LU factors, built in spare
+    gsl_permutation* p = gsl_permutation_alloc(n);
+    base = pool_matrix_alloc(n, n);
+    if (p && base) {
+      int signum;
+      gsl_matrix_memcpy(spare, a->matrix_real);
+      gsl_linalg_LU_decomp(spare, p, &signum);
+      if (gsl_linalg_LU_det(spare, signum) == 0.0) {
+	fprintf(stderr, "Matrix is singular; it has no negative powers.\n");
+	pool_matrix_free(acc);
+	pool_matrix_free(spare);
+	pool_matrix_free(base);
+	gsl_permutation_free(p);
+	return -1;
+      }
+      gsl_linalg_LU_invert(spare, p, base);
+    } else if (base) {
+      pool_matrix_free(base);
+      base = NULL;
     }
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX) {
-    // ---- Complex matrix ÷ complex scalar ----
-    result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex val = gsl_matrix_complex_get(a->matrix_complex, i, j);
-	gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(val, b->complex_val));
+    if (p) gsl_permutation_free(p);
+  } else if (acc && spare) {
+    // Squared in place if nothing else holds the operand
+    base = take_matrix_real(a);
+    if (!base && (base = pool_matrix_alloc(n, n))) gsl_matrix_memcpy(base, a->matrix_real);
+  }
+  if (!acc || !spare || !base) {
+    fprintf(stderr, "Memory allocation failed\n");
+    if (acc) pool_matrix_free(acc);
+    if (spare) pool_matrix_free(spare);
+    if (base) pool_matrix_free(base);
+    return -1;
+  }
+
+  int identity = 1;               // acc holds the product of no factors yet
+  for (;;) {
+    if (k & 1) {
+      if (identity) {
+	gsl_matrix_memcpy(acc, base);
+	identity = 0;
+      } else {
+	gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, acc, base, 0.0, spare);
+	gsl_matrix* t = acc; acc = spare; spare = t;
       }
+    }
+    k >>= 1;
+    if (k == 0) break;
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, base, base, 0.0, spare);
+    gsl_matrix* t = base; base = spare; spare = t;
   }
+  if (identity) gsl_matrix_set_identity(acc);
 
-  // ---- Matrix ÷ Matrix (A * inv(B)) ----
-  else if ((a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) ||
-	   (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX)) {
-
-    if ((b->type == TYPE_MATRIX_REAL && b->matrix_real->size1 != b->matrix_real->size2) ||
-	(b->type == TYPE_MATRIX_COMPLEX && b->matrix_complex->size1 != b->matrix_complex->size2)) {
-      fprintf(stderr, "Matrix divisor must be square for inversion.\n");
-      return;
-    }
+  result->type = TYPE_MATRIX_REAL;
+  result->matrix_real = acc;
+  pool_matrix_free(base);
+  pool_matrix_free(spare);
+  return 0;
+}
 
-    if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-      gsl_matrix* binv = gsl_matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
-      gsl_permutation* p = gsl_permutation_alloc(b->matrix_real->size1);
+static int complex_matrix_power(stack_element* a, stack_element* b,
+				stack_element* result, const binary_op* op) {
+  (void)op;
+  long long k = matrix_exponent(a, b);
+  if (k < 0) return -1;
+  size_t n = a->matrix_complex->size1;
+
+  gsl_matrix_complex* acc = pool_matrix_complex_alloc(n, n);
+  gsl_matrix_complex* spare = pool_matrix_complex_alloc(n, n);
+  gsl_matrix_complex* base = NULL;
+  if (acc && spare && b->real < 0) {
+    gsl_permutation* p = gsl_permutation_alloc(n);
+    base = pool_matrix_complex_alloc(n, n);
+    if (p && base) {
       int signum;
-      gsl_matrix* bcopy = gsl_matrix_alloc(b->matrix_real->size1, b->matrix_real->size2);
-      gsl_matrix_memcpy(bcopy, b->matrix_real);
-      gsl_linalg_LU_decomp(bcopy, p, &signum);
-      gsl_linalg_LU_invert(bcopy, p, binv);
-
-      result.type = TYPE_MATRIX_REAL;
-      result.matrix_real = gsl_matrix_alloc(a->matrix_real->size1, binv->size2);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a->matrix_real, binv, 0.0, result.matrix_real);
-
-      gsl_matrix_free(binv);
-      gsl_matrix_free(bcopy);
-      gsl_permutation_free(p);
+      gsl_matrix_complex_memcpy(spare, a->matrix_complex);
+      gsl_linalg_complex_LU_decomp(spare, p, &signum);
+      if (gsl_complex_abs(gsl_linalg_complex_LU_det(spare, signum)) == 0.0) {
+	fprintf(stderr, "Matrix is singular; it has no negative powers.\n");
+	pool_matrix_complex_free(acc);
+	pool_matrix_complex_free(spare);
+	pool_matrix_complex_free(base);
+	gsl_permutation_free(p);
+	return -1;
+      }
+      gsl_linalg_complex_LU_invert(spare, p, base);
+    } else if (base) {
+      pool_matrix_complex_free(base);
+      base = NULL;
     }
-    else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-      gsl_matrix_complex* binv =
-	gsl_matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
-      gsl_permutation* p = gsl_permutation_alloc(b->matrix_complex->size1);
-      int signum;
-      gsl_matrix_complex* bcopy =
-	gsl_matrix_complex_alloc(b->matrix_complex->size1, b->matrix_complex->size2);
-      gsl_matrix_complex_memcpy(bcopy, b->matrix_complex);
-      gsl_linalg_complex_LU_decomp(bcopy, p, &signum);
-      gsl_linalg_complex_LU_invert(bcopy, p, binv);
-
-      result.type = TYPE_MATRIX_COMPLEX;
-      result.matrix_complex = gsl_matrix_complex_alloc(a->matrix_complex->size1, binv->size2);
-      gsl_blas_zgemm(CblasNoTrans, CblasNoTrans,
-		     GSL_COMPLEX_ONE, a->matrix_complex, binv,
-		     GSL_COMPLEX_ZERO, result.matrix_complex);
-
-      gsl_matrix_complex_free(binv);
-      gsl_matrix_complex_free(bcopy);
-      gsl_permutation_free(p);
+    if (p) gsl_permutation_free(p);
+  } else if (acc && spare) {
+    base = take_matrix_complex(a);
+    if (!base && (base = pool_matrix_complex_alloc(n, n)))
+      gsl_matrix_complex_memcpy(base, a->matrix_complex);
+  }
+  if (!acc || !spare || !base) {
+    fprintf(stderr, "Memory allocation failed\n");
+    if (acc) pool_matrix_complex_free(acc);
+    if (spare) pool_matrix_complex_free(spare);
+    if (base) pool_matrix_complex_free(base);
+    return -1;
+  }
+
+  int identity = 1;
+  for (;;) {
+    if (k & 1) {
+      if (identity) {
+	gsl_matrix_complex_memcpy(acc, base);
+	identity = 0;
+      } else {
+	gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE,
+		       acc, base, GSL_COMPLEX_ZERO, spare);
+	gsl_matrix_complex* t = acc; acc = spare; spare = t;
+      }
     }
-  }
-
-  else {
-    fprintf(stderr, "Unsupported operand types in div_top_two.\n");
-    return;
-  }
-
-  // ---- Cleanup and finalize ----
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
-
-  *a = result;
-  stack->top--;
+    k >>= 1;
+    if (k == 0) break;
+    gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE,
+		   base, base, GSL_COMPLEX_ZERO, spare);
+    gsl_matrix_complex* t = base; base = spare; spare = t;
+  }
+  if (identity) gsl_matrix_complex_set_identity(acc);
+
+  result->type = TYPE_MATRIX_COMPLEX;
+  result->matrix_complex = acc;
+  pool_matrix_complex_free(base);
+  pool_matrix_complex_free(spare);
+  return 0;
 }
 
-void pow_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in pow_top_two.\n");
-    return;
-  }
-
-  stack_element* a = &stack->items[stack->top - 1]; // base
-  stack_element* b = &stack->items[stack->top];     // exponent
-  stack_element result = {0};
-
-  // ---- Scalar power ----
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = pow(a->real, b->real);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_REAL) ||
-	   (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX)) {
-    gsl_complex base = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0) : a->complex_val;
-    gsl_complex exp = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0) : b->complex_val;
-    gsl_complex log_base = gsl_complex_log(base);
-    gsl_complex scale = gsl_complex_mul(log_base, exp);
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_exp(scale);
-  }
-
-  // ---- Matrix ^ integer ----
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL) {
-    int n = (int)b->real;
-    if (n < 0 || a->matrix_real->size1 != a->matrix_real->size2) {
-      fprintf(stderr, "Matrix exponent must be non-negative and square.\n");
-      return;
-    }
-    gsl_matrix* res = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_set_identity(res);
+// ---- Tables ----
+// Rows and columns follow value_type: real, complex, string, real matrix,
+// complex matrix. Strings take part in no arithmetic.
+#define SCALAR_ROWS							\
+  { real_scalars, complex_scalars, NULL, real_matrix_scalar, complex_matrix_scalar }, \
+  { complex_scalars, complex_scalars, NULL, complex_matrix_scalar, complex_matrix_scalar }, \
+  { NULL, NULL, NULL, NULL, NULL }
+
+#define MATRIX_ROWS(real_pair, complex_pair)				\
+  { real_matrix_scalar, complex_matrix_scalar, NULL, real_pair, NULL }, \
+  { complex_matrix_scalar, complex_matrix_scalar, NULL, NULL, complex_pair }
+
+static const binary_op add_op = {
+  "add_top_two", real_add, gsl_complex_add, SIMD_ADD,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrices, complex_matrices) }
+};
+
+static const binary_op sub_op = {
+  "sub_top_two", real_sub, gsl_complex_sub, SIMD_SUB,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrices, complex_matrices) }
+};
+
+static const binary_op mul_op = {
+  "mul_top_two", real_mul, gsl_complex_mul, SIMD_MUL,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrix_product, complex_matrix_product) }
+};
+
+static const binary_op div_op = {
+  "div_top_two", real_div, gsl_complex_div, SIMD_DIV,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrix_quotient, complex_matrix_quotient) }
+};
+
+// Only a matrix raised to a real (integer, possibly negative) power
+static const binary_op pow_op = {
+  "pow_top_two", pow, complex_pow_log, SIMD_POW,
+  {
+    { real_scalars, complex_scalars, NULL, NULL, NULL },
+    { complex_scalars, complex_scalars, NULL, NULL, NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+    { real_matrix_power, NULL, NULL, NULL, NULL },
+    { complex_matrix_power, NULL, NULL, NULL, NULL },
+  }
+};
+
+static const binary_op dot_mul_op = {
+  "dot_mult_top_two", real_mul, gsl_complex_mul, SIMD_MUL,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrices, complex_matrices) }
+};
+
+static const binary_op dot_div_op = {
+  "dot_div_top_two", real_div, gsl_complex_div, SIMD_DIV,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrices, complex_matrices) }
+};
+
+static const binary_op dot_pow_op = {
+  "dot_pow_top_two", pow, gsl_complex_pow, SIMD_POW,
+  { SCALAR_ROWS, MATRIX_ROWS(real_matrices, complex_matrices) }
+};
+
+// ---- Entry points ----
+void add_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x + y);
+  apply_binary_op(stack, &add_op);
+}
 
-    gsl_matrix* temp = gsl_matrix_alloc(a->matrix_real->size1, a->matrix_real->size2);
-    gsl_matrix_memcpy(temp, a->matrix_real);
+void sub_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x - y);
+  apply_binary_op(stack, &sub_op);
+}
 
-    for (int i = 0; i < n; i++) {
-      gsl_matrix* temp_res = gsl_matrix_alloc(res->size1, temp->size2);
-      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, res, temp, 0.0, temp_res);
-      gsl_matrix_free(res);
-      res = temp_res;
-    }
+void mul_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x * y);
+  apply_binary_op(stack, &mul_op);
+}
 
-    result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = res;
-    gsl_matrix_free(temp);
-  }
+void div_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x / y);
+  apply_binary_op(stack, &div_op);
+}
 
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL) {
-    int n = (int)b->real;
-    if (n < 0 || a->matrix_complex->size1 != a->matrix_complex->size2) {
-      fprintf(stderr, "Matrix exponent must be non-negative and square.\n");
-      return;
-    }
-    gsl_matrix_complex* res =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_set_identity(res);
-
-    gsl_matrix_complex* temp =
-      gsl_matrix_complex_alloc(a->matrix_complex->size1, a->matrix_complex->size2);
-    gsl_matrix_complex_memcpy(temp, a->matrix_complex);
-
-    for (int i = 0; i < n; i++) {
-      gsl_matrix_complex* temp_res = gsl_matrix_complex_alloc(res->size1, temp->size2);
-      gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE,
-		     res, temp, GSL_COMPLEX_ZERO, temp_res);
-      gsl_matrix_complex_free(res);
-      res = temp_res;
-    }
+void pow_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, pow(x, y));
+  apply_binary_op(stack, &pow_op);
+}
 
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = res;
-    gsl_matrix_complex_free(temp);
-  }
+void dot_mult_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x * y);
+  apply_binary_op(stack, &dot_mul_op);
+}
 
-  // ---- Unsupported case ----
-  else {
-    fprintf(stderr, "Unsupported types in pow_top_two.\n");
-    return;
-  }
+void dot_div_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, x / y);
+  apply_binary_op(stack, &dot_div_op);
+}
 
-  // Free a’s previous data
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
+void dot_pow_top_two(Stack* stack) {
+  REAL_FAST_PATH(stack, x, y, pow(x, y));
+  apply_binary_op(stack, &dot_pow_op);
+}
 
-  // Store result in a and pop b
-  *a = result;
-  stack->top--;
+// j2r: x and y are the re and im planes of out
+static void join_slice(size_t begin, size_t end, void* arg) {
+  const buffer_job* job = arg;
+  simd_join(job->x + begin, job->y + begin, job->out + 2 * begin, end - begin);
 }
 
 void join_2_reals(Stack *s) {
@@ -955,10 +918,7 @@ void join_2_reals(Stack *s) {
     s->top -= 2;
 
     // Push complex scalar
-    if (s->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Error: stack overflow when pushing complex scalar.\n");
-      return;
-    }
+    if (stack_reserve(s, 1) != 0) return;
 
     s->top++;
     stack_element *dest = &s->items[s->top];
@@ -985,32 +945,36 @@ void join_2_reals(Stack *s) {
     size_t rows = real_mat->size1;
     size_t cols = real_mat->size2;
 
-    gsl_matrix_complex *complex_mat = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex *complex_mat = pool_matrix_complex_alloc(rows, cols);
     if (!complex_mat) {
       fprintf(stderr, "Error: failed to allocate complex matrix.\n");
       return;
     }
 
-    for (size_t i = 0; i < rows; i++) {
-      for (size_t j = 0; j < cols; j++) {
-	double real_part = gsl_matrix_get(real_mat, i, j);
-	double imag_part = gsl_matrix_get(imag_mat, i, j);
-	gsl_complex z = gsl_complex_rect(real_part, imag_part);
-	gsl_matrix_complex_set(complex_mat, i, j, z);
+    if (real_mat->tda == cols && imag_mat->tda == cols) {
+      buffer_job job = { .x = real_mat->data, .y = imag_mat->data, .out = complex_mat->data };
+      parallel_for(rows * cols, PARALLEL_GRAIN, join_slice, &job);
+    } else {
+      for (size_t i = 0; i < rows; i++) {
+	for (size_t j = 0; j < cols; j++) {
+	  double real_part = gsl_matrix_get(real_mat, i, j);
+	  double imag_part = gsl_matrix_get(imag_mat, i, j);
+	  gsl_complex z = gsl_complex_rect(real_part, imag_part);
+	  gsl_matrix_complex_set(complex_mat, i, j, z);
+	}
       }
     }
 
     // Free the old real matrices
-    gsl_matrix_free(real_mat);
-    gsl_matrix_free(imag_mat);
+    matrix_release(real_mat);
+    matrix_release(imag_mat);
 
     // Pop imag and real matrices
     s->top -= 2;
 
     // Push complex matrix
-    if (s->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Error: stack overflow when pushing complex matrix.\n");
-      gsl_matrix_complex_free(complex_mat);
+    if (stack_reserve(s, 1) != 0) {
+      pool_matrix_complex_free(complex_mat);
       return;
     }
 
@@ -1027,515 +991,99 @@ void join_2_reals(Stack *s) {
 }
 
 
-int kronecker_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in kronecker_top_two.\n");
-    return 1;
-  }
-
-  stack_element* a = &stack->items[stack->top - 1]; // first matrix
-  stack_element* b = &stack->items[stack->top];     // second matrix
-  stack_element result = {0};
-
-  // Real × Real matrices
-  if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    size_t a_rows = a->matrix_real->size1;
-    size_t a_cols = a->matrix_real->size2;
-    size_t b_rows = b->matrix_real->size1;
-    size_t b_cols = b->matrix_real->size2;
-
-    result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(a_rows * b_rows, a_cols * b_cols);
-
-    for (size_t i = 0; i < a_rows; ++i) {
-      for (size_t j = 0; j < a_cols; ++j) {
-	double a_ij = gsl_matrix_get(a->matrix_real, i, j);
-	for (size_t k = 0; k < b_rows; ++k) {
-	  for (size_t l = 0; l < b_cols; ++l) {
-	    double b_kl = gsl_matrix_get(b->matrix_real, k, l);
-	    gsl_matrix_set(result.matrix_real, i * b_rows + k, j * b_cols + l, a_ij * b_kl);
-	  }
-	}
-      }
+// **************** Kronecker product ****************
+// Row i*br + k of A ⊗ B is row k of B scaled by A[i,0], A[i,1], ... side by
+// side, so each block of an output row is a contiguous scaled copy of a row
+// of B, made by the simd_kernels loops. Output rows are split across the
+// thread pool. A real operand meeting a complex one is widened to (x, 0).
+typedef struct {
+  const stack_element* a;
+  const stack_element* b;
+  stack_element* out;
+} kron_job;
+
+static void kron_rows(size_t begin, size_t end, void* arg) {
+  const kron_job* job = arg;
+  const stack_element* a = job->a;
+  const stack_element* b = job->b;
+  size_t a_rows, a_cols, b_rows, b_cols;
+  matrix_dims(a, &a_rows, &a_cols);
+  matrix_dims(b, &b_rows, &b_cols);
+  size_t out_cols = a_cols * b_cols;
+
+  for (size_t r = begin / out_cols; r < end / out_cols; r++) {
+    size_t i = r / b_rows, k = r % b_rows;
+    if (job->out->type == TYPE_MATRIX_REAL) {
+      const double* b_row = gsl_matrix_const_ptr(b->matrix_real, k, 0);
+      double* dst = gsl_matrix_ptr(job->out->matrix_real, r, 0);
+      for (size_t j = 0; j < a_cols; j++, dst += b_cols)
+	simd_real_scalar(SIMD_MUL, b_row, gsl_matrix_get(a->matrix_real, i, j), dst, b_cols, 1);
+      continue;
     }
-  }
-
-  // Complex × Complex matrices
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    size_t a_rows = a->matrix_complex->size1;
-    size_t a_cols = a->matrix_complex->size2;
-    size_t b_rows = b->matrix_complex->size1;
-    size_t b_cols = b->matrix_complex->size2;
-
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
-
-    for (size_t i = 0; i < a_rows; ++i) {
-      for (size_t j = 0; j < a_cols; ++j) {
-	gsl_complex a_ij = gsl_matrix_complex_get(a->matrix_complex, i, j);
-	for (size_t k = 0; k < b_rows; ++k) {
-	  for (size_t l = 0; l < b_cols; ++l) {
-	    gsl_complex b_kl = gsl_matrix_complex_get(b->matrix_complex, k, l);
-	    gsl_matrix_complex_set(result.matrix_complex,
-				   i * b_rows + k,
-				   j * b_cols + l,
-				   gsl_complex_mul(a_ij, b_kl));
-	  }
-	}
+    double* dst = (double*)gsl_matrix_complex_ptr(job->out->matrix_complex, r, 0);
+    for (size_t j = 0; j < a_cols; j++, dst += 2 * b_cols) {
+      gsl_complex a_ij = matrix_element_complex(a, i, j);
+      if (b->type == TYPE_MATRIX_REAL) {
+	simd_real_to_complex(gsl_matrix_const_ptr(b->matrix_real, k, 0), dst, b_cols);
+	simd_complex_scalar(SIMD_MUL, dst, a_ij, dst, b_cols, 1);
+      } else {
+	const double* b_row = (const double*)gsl_matrix_complex_const_ptr(b->matrix_complex, k, 0);
+	simd_complex_scalar(SIMD_MUL, b_row, a_ij, dst, b_cols, 1);
       }
     }
   }
-
-  // Real × Complex matrix → promote real to complex
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_COMPLEX) {
-    size_t a_rows = a->matrix_real->size1;
-    size_t a_cols = a->matrix_real->size2;
-    size_t b_rows = b->matrix_complex->size1;
-    size_t b_cols = b->matrix_complex->size2;
-
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
-
-    for (size_t i = 0; i < a_rows; ++i) {
-      for (size_t j = 0; j < a_cols; ++j) {
-	double a_ij = gsl_matrix_get(a->matrix_real, i, j);
-	gsl_complex a_complex = gsl_complex_rect(a_ij, 0.0);
-	for (size_t k = 0; k < b_rows; ++k) {
-	  for (size_t l = 0; l < b_cols; ++l) {
-	    gsl_complex b_kl = gsl_matrix_complex_get(b->matrix_complex, k, l);
-	    gsl_matrix_complex_set(result.matrix_complex,
-				   i * b_rows + k,
-				   j * b_cols + l,
-				   gsl_complex_mul(a_complex, b_kl));
-	  }
-	}
-      }
-    }
-  }
-
-  // Complex × Real matrix → promote real to complex
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_REAL) {
-    size_t a_rows = a->matrix_complex->size1;
-    size_t a_cols = a->matrix_complex->size2;
-    size_t b_rows = b->matrix_real->size1;
-    size_t b_cols = b->matrix_real->size2;
-
-    result.type = TYPE_MATRIX_COMPLEX;
-    result.matrix_complex = gsl_matrix_complex_alloc(a_rows * b_rows, a_cols * b_cols);
-
-    for (size_t i = 0; i < a_rows; ++i) {
-      for (size_t j = 0; j < a_cols; ++j) {
-	gsl_complex a_ij = gsl_matrix_complex_get(a->matrix_complex, i, j);
-	for (size_t k = 0; k < b_rows; ++k) {
-	  for (size_t l = 0; l < b_cols; ++l) {
-	    double b_kl = gsl_matrix_get(b->matrix_real, k, l);
-	    gsl_complex b_complex = gsl_complex_rect(b_kl, 0.0);
-	    gsl_matrix_complex_set(result.matrix_complex,
-				   i * b_rows + k,
-				   j * b_cols + l,
-				   gsl_complex_mul(a_ij, b_complex));
-	  }
-	}
-      }
-    }
-  }
-
-  else {
-    fprintf(stderr, "Unsupported operand types for kronecker product.\n");
-    return 1;
-  }
-
-  // Cleanup: free first matrix if allocated
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
-
-  *a = result;
-  stack->top--;
-  return 0;
 }
 
-void dot_div_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in dot_div_top_two.\n");
-    return;
-  }
-
-  stack_element* a = &stack->items[stack->top - 1]; // second from top (numerator)
-  stack_element* b = &stack->items[stack->top];     // top (denominator)
-  stack_element result = {0};
+static int kronecker(const stack_element* a, const stack_element* b, stack_element* result) {
+  size_t a_rows, a_cols, b_rows, b_cols;
+  matrix_dims(a, &a_rows, &a_cols);
+  matrix_dims(b, &b_rows, &b_cols);
+  size_t rows = a_rows * b_rows, cols = a_cols * b_cols;
 
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real / b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-           (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_COMPLEX;
-    gsl_complex za = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0) : a->complex_val;
-    gsl_complex zb = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0) : b->complex_val;
-    result.complex_val = gsl_complex_div(za, zb);
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_div(a->complex_val, b->complex_val);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double m = gsl_matrix_get(mat, i, j);
-        double r = scalar_first ? val / m : m / val;
-        gsl_matrix_set(result.matrix_real, i, j, r);
-      }
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
-           (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-           (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
-  }
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size1 != b->matrix_real->size1 ||
-        a->matrix_real->size2 != b->matrix_real->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_div_top_two (real).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j,
-                       gsl_matrix_get(a->matrix_real, i, j) /
-                       gsl_matrix_get(b->matrix_real, i, j));
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
-        a->matrix_complex->size2 != b->matrix_complex->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_div_top_two (complex).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_div(z1, z2));
-      }
+  if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
+    result->type = TYPE_MATRIX_REAL;
+    result->matrix_real = pool_matrix_alloc(rows, cols);
+  } else {
+    result->type = TYPE_MATRIX_COMPLEX;
+    result->matrix_complex = pool_matrix_complex_alloc(rows, cols);
   }
-  else {
-    fprintf(stderr, "Unsupported operand types in dot_div_top_two.\n");
-    return;
+  if (result->type == TYPE_MATRIX_REAL ? !result->matrix_real : !result->matrix_complex) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
   }
-
-  // Free memory in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  kron_job job = { a, b, result };
+  parallel_for(rows * cols, cols, kron_rows, &job);
+  return 0;
 }
 
-void dot_mult_top_two(Stack* stack) {
-  if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in dot_mult_top_two.\n");
-    return;
-  }
-
-  stack_element* a = &stack->items[stack->top - 1]; // second from top
-  stack_element* b = &stack->items[stack->top];     // top
+gsl_matrix* kronecker_real(const gsl_matrix* a, const gsl_matrix* b) {
+  stack_element ea = { .type = TYPE_MATRIX_REAL, .matrix_real = (gsl_matrix*)a };
+  stack_element eb = { .type = TYPE_MATRIX_REAL, .matrix_real = (gsl_matrix*)b };
   stack_element result = {0};
-
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = a->real * b->real;
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_COMPLEX) ||
-           (a->type == TYPE_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_COMPLEX;
-    gsl_complex za =
-      (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0.0) : a->complex_val;
-    gsl_complex zb =
-      (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0.0) : b->complex_val;
-    result.complex_val = gsl_complex_mul(za, zb);
-  }
-  else if (a->type == TYPE_COMPLEX && b->type == TYPE_COMPLEX) {
-    result.type = TYPE_COMPLEX;
-    result.complex_val = gsl_complex_mul(a->complex_val, b->complex_val);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat =
-      (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j, val * gsl_matrix_get(mat, i, j));
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_COMPLEX) ||
-           (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z =
-      gsl_complex_rect((a->type == TYPE_REAL) ? a->real : b->real, 0.0);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real =
-      (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-           (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex v = gsl_matrix_complex_get(mat, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z, v));
-      }
-  }
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size1 != b->matrix_real->size1 ||
-        a->matrix_real->size2 != b->matrix_real->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_mult_top_two (real).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j)
-        gsl_matrix_set(result.matrix_real, i, j,
-                       gsl_matrix_get(a->matrix_real, i, j) *
-                       gsl_matrix_get(b->matrix_real, i, j));
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
-        a->matrix_complex->size2 != b->matrix_complex->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_mult_top_two (complex).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_mul(z1, z2));
-      }
-  }
-  else {
-    fprintf(stderr, "Unsupported operand types in dot_mult_top_two.\n");
-    return;
-  }
-
-  // Free memory in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
-  stack_element_free(a);
-  stack_element_free(b);
-
-  // Store result and pop
-  *a = result;
-  stack->top--;
+  return kronecker(&ea, &eb, &result) == 0 ? result.matrix_real : NULL;
 }
 
-void dot_pow_top_two(Stack* stack) {
+int kronecker_top_two(Stack* stack) {
   if (stack->top < 1) {
-    fprintf(stderr, "Stack underflow in dot_pow_top_two.\n");
-    return;
+    fprintf(stderr, "Stack underflow in kronecker_top_two.\n");
+    return 1;
   }
 
-  stack_element* a = &stack->items[stack->top - 1]; // second from top (base)
-  stack_element* b = &stack->items[stack->top];     // top (exponent)
+  stack_element* a = &stack->items[stack->top - 1]; // first matrix
+  stack_element* b = &stack->items[stack->top];     // second matrix
   stack_element result = {0};
 
-  if (a->type == TYPE_REAL && b->type == TYPE_REAL) {
-    result.type = TYPE_REAL;
-    result.real = pow(a->real, b->real);
-  }
-  else if ((a->type == TYPE_REAL || a->type == TYPE_COMPLEX) &&
-           (b->type == TYPE_REAL || b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_COMPLEX;
-    gsl_complex base = (a->type == TYPE_REAL) ? gsl_complex_rect(a->real, 0.0) : a->complex_val;
-    gsl_complex exp  = (b->type == TYPE_REAL) ? gsl_complex_rect(b->real, 0.0) : b->complex_val;
-    result.complex_val = gsl_complex_pow(base, exp);
-  }
-  else if ((a->type == TYPE_REAL && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_REAL)) {
-    result.type = TYPE_MATRIX_REAL;
-    gsl_matrix* mat = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    double val = (a->type == TYPE_REAL) ? a->real : b->real;
-    int scalar_first = (a->type == TYPE_REAL);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double base = scalar_first ? val : gsl_matrix_get(mat, i, j);
-        double expo = scalar_first ? gsl_matrix_get(mat, i, j) : val;
-        gsl_matrix_set(result.matrix_real, i, j, pow(base, expo));
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_REAL) ||
-           (a->type == TYPE_MATRIX_REAL && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix* mat_real = (a->type == TYPE_MATRIX_REAL) ? a->matrix_real : b->matrix_real;
-    gsl_complex tmp = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    gsl_complex z = gsl_complex_rect(GSL_REAL(tmp), GSL_IMAG(tmp));
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat_real->size1, cols = mat_real->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex d = gsl_complex_rect(gsl_matrix_get(mat_real, i, j), 0.0);
-        gsl_complex r = scalar_first ? gsl_complex_pow(z, d) : gsl_complex_pow(d, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
-  }
-  else if ((a->type == TYPE_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) ||
-           (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_COMPLEX)) {
-    result.type = TYPE_MATRIX_COMPLEX;
-    gsl_matrix_complex* mat =
-      (a->type == TYPE_MATRIX_COMPLEX) ? a->matrix_complex : b->matrix_complex;
-    gsl_complex z = (a->type == TYPE_COMPLEX) ? a->complex_val : b->complex_val;
-    int scalar_first = (a->type == TYPE_COMPLEX);
-    size_t rows = mat->size1, cols = mat->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex w = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex r = scalar_first ? gsl_complex_pow(z, w)
-	  : gsl_complex_pow(w, z);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, r);
-      }
-  }
-  else if (a->type == TYPE_MATRIX_REAL && b->type == TYPE_MATRIX_REAL) {
-    if (a->matrix_real->size1 != b->matrix_real->size1 ||
-        a->matrix_real->size2 != b->matrix_real->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_pow_top_two (real).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_REAL;
-    size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double base = gsl_matrix_get(a->matrix_real, i, j);
-        double exp  = gsl_matrix_get(b->matrix_real, i, j);
-        gsl_matrix_set(result.matrix_real, i, j, pow(base, exp));
-      }
-  }
-  else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
-    if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
-        a->matrix_complex->size2 != b->matrix_complex->size2) {
-      fprintf(stderr, "Matrix size mismatch in dot_pow_top_two (complex).\n");
-      return;
-    }
-    result.type = TYPE_MATRIX_COMPLEX;
-    size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
-    result.matrix_complex = gsl_matrix_complex_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex z1 = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex z2 = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_complex_set(result.matrix_complex, i, j, gsl_complex_pow(z1, z2));
-      }
-  }
-  else {
-    fprintf(stderr, "Unsupported operand types in dot_pow_top_two.\n");
-    return;
+  if ((a->type != TYPE_MATRIX_REAL && a->type != TYPE_MATRIX_COMPLEX) ||
+      (b->type != TYPE_MATRIX_REAL && b->type != TYPE_MATRIX_COMPLEX)) {
+    fprintf(stderr, "Unsupported operand types for kronecker product.\n");
+    return 1;
   }
+  if (kronecker(a, b, &result) != 0) return 1;
 
-  // Free memory in a
-  // Release BOTH consumed operands. The old code freed only 'a';
-  // 'b' (the top) was dropped by stack->top-- and its matrix leaked.
   stack_element_free(a);
   stack_element_free(b);
 
-  // Store result and pop
   *a = result;
   stack->top--;
+  return 0;
 }
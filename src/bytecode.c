@@ -0,0 +1,484 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Compiled lines: a line of RPN text is lexed once into an array of
+// pre-resolved instructions (opcodes, parsed literals, pre-built matrix
+// constants) which can then be executed any number of times. Batch files
+// and programs replay the same lines over and over, so they go through a
+// small LRU cache of compiled lines keyed by the line text.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>           // for isspace
+#include <stdint.h>          // for uint32_t
+#include <stdio.h>           // for fprintf, stderr
+#include <stdlib.h>          // for free, malloc, realloc
+#include <string.h>          // for strcmp, strdup
+#include "bytecode.h"        // for compiled_line, compiled_instr, CODE_*
+#include "binary_fun.h"      // for add_top_two, sub_top_two, ...
+#include "eval_fun.h"        // for builtin_handler, builtin_reach, builtin_lazy_depth, ...
+#include "lazy.h"            // for lazy_binary, lazy_product, lazy_live
+#include "math_parsers.h"    // for read_complex, parse_inline_matrix
+#include "numconv.h"         // for parse_double
+#include "peephole.h"        // for optimize_compiled_line, run_fusion, fusion_reach
+#include "symbols.h"         // for SYMBOL_NONE, symbol_macro, symbol_word
+#include "undo.h"            // for undo_save, undo_unsaved
+#include "words.h"           // for user_word
+
+// **************** Compiler ****************
+static compiled_instr* emit(compiled_line* cl, code_type type) {
+  if (cl->count == cl->capacity) {
+    int cap = cl->capacity ? 2 * cl->capacity : 8;
+    compiled_instr* code = realloc(cl->code, (size_t)cap * sizeof(compiled_instr));
+    if (!code) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return NULL;
+    }
+    cl->code = code;
+    cl->capacity = cap;
+  }
+  compiled_instr* in = &cl->code[cl->count++];
+  memset(in, 0, sizeof(*in));
+  in->type = type;
+  in->opcode = OPCODE_NONE;
+  return in;
+}
+
+static void emit_constant(compiled_line* cl, stack_element constant) {
+  compiled_instr* in = emit(cl, CODE_PUSH_CONST);
+  if (in) in->constant = constant;
+  else stack_element_free(&constant);
+}
+
+// Stored tokens outlive the line they were lexed from, so they get their
+// own copy of the text
+static void emit_token(compiled_line* cl, const Token* tok) {
+  Token* copy = malloc(sizeof(Token));
+  if (!copy) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return;
+  }
+  *copy = *tok;
+  copy->owned = token_strdup(tok);
+  copy->text = copy->owned;
+  compiled_instr* in = emit(cl, CODE_TOKEN);
+  if (copy->owned && in) {
+    in->token = copy;
+  } else {
+    if (!copy->owned) fprintf(stderr, "Memory allocation failed\n");
+    if (in) cl->count--;
+    free_token(copy);
+    free(copy);
+  }
+}
+
+static double token_to_double(const Token* tok) {
+  double x = 0.0;
+  parse_double(tok->text, tok->text + tok->len, &x);
+  return x;
+}
+
+compiled_line* compile_line(const char* line) {
+  compiled_line* cl = calloc(1, sizeof(compiled_line));
+  if (!cl) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return NULL;
+  }
+  cl->refs = 1;
+
+  Lexer lexer = (Lexer){ .input = line, .pos = 0 };
+  Token tok;
+  for (tok = next_token(&lexer); tok.type != TOK_EOF; free_token(&tok), tok = next_token(&lexer)) {
+    compiled_instr* in;
+    char* text;
+    switch (tok.type) {
+    case TOK_NUMBER:
+      if ((in = emit(cl, CODE_PUSH_REAL))) in->real = token_to_double(&tok);
+      break;
+    case TOK_COMPLEX: {
+      stack_element c = { .type = TYPE_COMPLEX };
+      if (!(text = token_strdup(&tok))) break;
+      if (read_complex(text, &c.complex_val)) emit_constant(cl, c);
+      free(text);
+      break;
+    }
+    case TOK_STRING: {
+      stack_element s = { .type = TYPE_STRING, .string = token_strdup(&tok) };
+      if (s.string) emit_constant(cl, s);
+      else fprintf(stderr, "Memory allocation failed\n");
+      break;
+    }
+    case TOK_MATRIX_INLINE_REAL:
+    case TOK_MATRIX_INLINE_COMPLEX:
+    case TOK_MATRIX_INLINE_MIXED: {
+      // A literal that fails to parse becomes a NULL real matrix, so running
+      // the line reports the error through push_matrix_real as before.
+      stack_element m;
+      parse_inline_matrix(tok.text, tok.len, &m);
+      emit_constant(cl, m);
+      break;
+    }
+    case TOK_PLUS:
+    case TOK_MINUS:
+    case TOK_STAR:
+    case TOK_SLASH:
+    case TOK_CARET:
+    case TOK_DOT_STAR:
+    case TOK_DOT_SLASH:
+    case TOK_DOT_CARET:
+      if ((in = emit(cl, CODE_BINARY))) in->op = tok.type;
+      break;
+    case TOK_FUNCTION: {
+      builtin_func f = builtin_handler(tok.opcode);
+      if (!f) break;   // names with no evaluator handler are no-ops
+      if ((in = emit(cl, CODE_BUILTIN))) {
+        in->opcode = tok.opcode;
+        in->func = f;
+      }
+      break;
+    }
+    case TOK_IDENTIFIER:
+      if (tok.symbol == SYMBOL_NONE) {
+        fprintf(stderr, "Memory allocation failed\n");
+        break;
+      }
+      if ((in = emit(cl, CODE_CALL))) in->symbol = tok.symbol;
+      break;
+    default:
+      // Matrix files are read when the line runs; punctuation and illegal
+      // tokens keep their diagnostics.
+      emit_token(cl, &tok);
+      break;
+    }
+  }
+  return cl;
+}
+
+compiled_line* retain_compiled_line(compiled_line* cl) {
+  if (cl) cl->refs++;
+  return cl;
+}
+
+// Drops one reference; the code is released with the last one
+void free_compiled_line(compiled_line* cl) {
+  if (!cl || --cl->refs > 0) return;
+  for (int i = 0; i < cl->count; i++) {
+    compiled_instr* in = &cl->code[i];
+    switch (in->type) {
+    case CODE_PUSH_CONST: stack_element_free(&in->constant); break;
+    case CODE_TOKEN:      free_token(in->token); free(in->token); break;
+    default: break;
+    }
+  }
+  free(cl->code);
+  free(cl);
+}
+
+// **************** Execution ****************
+// Literal strings and matrices are shared with the compiled line, so a loop
+// pushing the same literal does not copy it every time
+static void push_constant(Stack* stack, const stack_element* c) {
+  // A literal that failed to parse: push_matrix_real reports it, pushing nothing
+  if (c->type == TYPE_MATRIX_REAL && !c->matrix_real) {
+    push_matrix_real(stack, NULL);
+    return;
+  }
+  if (stack_reserve(stack, 1) != 0) return;
+  if (stack_element_clone(&stack->items[stack->top + 1], c) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return;
+  }
+  stack->top++;
+}
+
+// Only here, not in add_top_two and friends, may an operator leave its
+// result lazy: builtins that call those expect a value back. The same goes
+// for ' and tran, whose views execute_compiled makes through lazy_builtin.
+static void apply_binary(Stack* stack, token_type op) {
+  if (lazy_mode && lazy_binary(stack, op)) return;
+  if (lazy_live > 0 && lazy_product(stack, op)) return;
+  if (lazy_live > 0) lazy_force_top(stack, 2);
+  switch (op) {
+  case TOK_PLUS:      add_top_two(stack); return;
+  case TOK_MINUS:     sub_top_two(stack); return;
+  case TOK_STAR:      mul_top_two(stack); return;
+  case TOK_SLASH:     div_top_two(stack); return;
+  case TOK_CARET:     pow_top_two(stack); return;
+  case TOK_DOT_STAR:  dot_mult_top_two(stack); return;
+  case TOK_DOT_SLASH: dot_div_top_two(stack); return;
+  case TOK_DOT_CARET: dot_pow_top_two(stack); return;
+  default: return;
+  }
+}
+
+// The symbol always points at the current definition, so a call needs no
+// re-linking when words are defined, deleted or reloaded. Macros win.
+static user_word* link_call(const compiled_instr* in) {
+  user_word* w = symbol_macro(in->symbol);
+  return w ? w : symbol_word(in->symbol);
+}
+
+// Bodies that failed to compile when they were stored get another try here
+static compiled_line* word_code(user_word* w) {
+  if (!w->code) {
+    w->code = compile_line(w->body);
+    optimize_compiled_line(w->code);
+  }
+  return w->code;
+}
+
+void run_user_word(Stack* stack, user_word* w) {
+  if (word_code(w)) execute_compiled(stack, w->code);
+}
+
+// **************** Return stack ****************
+// Word calls do not recurse in C. Each running body is a frame on one
+// shared return stack, and a call in tail position reuses the caller's
+// frame, so tail-recursive words run in constant space. A nested run (eval,
+// integrate, ...) stacks its frames above the current ones and unwinds back
+// to where it started. Frames hold a reference to their code, so a body may
+// delete or reload words while it runs.
+
+#define RETURN_STACK_MAX 100000
+
+typedef struct {
+  compiled_line* code;
+  int ip;               // next instruction
+} frame;
+
+static frame* rstack = NULL;
+static int rdepth = 0;
+static int rcapacity = 0;
+
+static int push_frame(compiled_line* code) {
+  if (rdepth == rcapacity) {
+    if (rcapacity >= RETURN_STACK_MAX) {
+      fprintf(stderr, "Return stack overflow: words nested too deeply\n");
+      return -1;
+    }
+    int cap = rcapacity ? 2 * rcapacity : 64;
+    if (cap > RETURN_STACK_MAX) cap = RETURN_STACK_MAX;
+    frame* bigger = realloc(rstack, (size_t)cap * sizeof(frame));
+    if (!bigger) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return -1;
+    }
+    rstack = bigger;
+    rcapacity = cap;
+  }
+  rstack[rdepth++] = (frame){ code, 0 };
+  return 0;
+}
+
+static void unwind_to(int base) {
+  while (rdepth > base) free_compiled_line(rstack[--rdepth].code);
+}
+
+// Enters w from the current frame; returns -1 if the run has to stop
+static int call_word(user_word* w) {
+  if (!word_code(w)) return 0;
+  compiled_line* callee = retain_compiled_line(w->code);
+  frame* f = &rstack[rdepth - 1];
+  if (f->ip == f->code->count) {
+    free_compiled_line(f->code);
+    *f = (frame){ callee, 0 };
+    return 0;
+  }
+  if (push_frame(callee) != 0) {
+    free_compiled_line(callee);
+    return -1;
+  }
+  return 0;
+}
+
+// How many elements from the top an instruction may pop or overwrite, -1
+// for any. A call reaches nothing itself; the word's instructions say more.
+static int instr_reach(const compiled_instr* in) {
+  switch (in->type) {
+  case CODE_PUSH_REAL:
+  case CODE_PUSH_CONST:
+  case CODE_CALL:    return 0;
+  case CODE_BINARY:  return 2;
+  case CODE_BUILTIN: return builtin_reach(in->opcode);
+  case CODE_FUSED:   return fusion_reach(in->fusion);
+  default:           return -1;
+  }
+}
+
+void execute_compiled(Stack* stack, compiled_line* cl) {
+  int base = rdepth;
+  if (push_frame(retain_compiled_line(cl)) != 0) {
+    free_compiled_line(cl);
+    return;
+  }
+  while (rdepth > base) {
+    // Builtins may run nested lines that grow the return stack, so the
+    // frame is looked up again on every step
+    frame* f = &rstack[rdepth - 1];
+    if (f->ip == f->code->count) {
+      free_compiled_line(f->code);
+      rdepth--;
+      continue;
+    }
+    compiled_instr* in = &f->code->code[f->ip++];
+    if (undo_unsaved > 0) undo_save(stack, instr_reach(in));
+    // Anything but an operator, a literal, a call or a builtin known to
+    // stay near the top may look at any depth
+    if (lazy_live > 0 && in->type != CODE_BINARY && in->type != CODE_PUSH_REAL &&
+        in->type != CODE_PUSH_CONST && in->type != CODE_CALL) {
+      int depth = (in->type == CODE_BUILTIN) ? builtin_lazy_depth(in->opcode) : -1;
+      lazy_force_top(stack, depth < 0 ? stack->top + 1 : depth);
+    }
+    switch (in->type) {
+    case CODE_PUSH_REAL:  push_real(stack, in->real); break;
+    case CODE_PUSH_CONST: push_constant(stack, &in->constant); break;
+    case CODE_BUILTIN:
+      if (!lazy_builtin(stack, in->opcode)) in->func(stack);
+      break;
+    case CODE_BINARY:     apply_binary(stack, in->op); break;
+    case CODE_CALL: {
+      user_word* w = link_call(in);
+      if (!w) printf("Unknown identifier!\n");
+      else if (call_word(w) != 0) unwind_to(base);
+      break;
+    }
+    case CODE_FUSED:      run_fusion(stack, in->fusion); break;
+    case CODE_TOKEN:      evaluate_one_token(stack, in->token); break;
+    }
+  }
+  // The end of a line, or of a word run by a builtin, needs values
+  if (lazy_live > 0) lazy_force_top(stack, stack->top + 1);
+}
+
+// **************** LRU cache of compiled lines ****************
+// Entries live in a chained hash table for lookup and in a doubly linked
+// list ordered by recency for eviction. A running line holds its own
+// reference to the compiled code, so a nested batch that evicts it from the
+// cache cannot free it underneath the caller.
+
+#define LINE_CACHE_BUCKETS (2 * LINE_CACHE_SIZE)
+
+typedef struct cache_entry {
+  char* text;
+  uint32_t hash;
+  compiled_line* code;    // NULL for word definitions
+  struct cache_entry* chain;
+  struct cache_entry* newer;
+  struct cache_entry* older;
+} cache_entry;
+
+static cache_entry* buckets[LINE_CACHE_BUCKETS];
+static cache_entry* newest = NULL;
+static cache_entry* oldest = NULL;
+static int cache_count = 0;
+
+static uint32_t hash_line(const char* s) {
+  uint32_t h = 2166136261u;  // FNV-1a
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void unlink_lru(cache_entry* e) {
+  if (e->newer) e->newer->older = e->older; else newest = e->older;
+  if (e->older) e->older->newer = e->newer; else oldest = e->newer;
+  e->newer = e->older = NULL;
+}
+
+static void link_newest(cache_entry* e) {
+  e->older = newest;
+  e->newer = NULL;
+  if (newest) newest->newer = e;
+  newest = e;
+  if (!oldest) oldest = e;
+}
+
+static void destroy_entry(cache_entry* e) {
+  cache_entry** p = &buckets[e->hash % LINE_CACHE_BUCKETS];
+  while (*p != e) p = &(*p)->chain;
+  *p = e->chain;
+  unlink_lru(e);
+  free_compiled_line(e->code);
+  free(e->text);
+  free(e);
+  cache_count--;
+}
+
+static void evict_if_full(void) {
+  while (cache_count >= LINE_CACHE_SIZE && oldest) destroy_entry(oldest);
+}
+
+static bool is_definition_line(const char* s) {
+  while (isspace((unsigned char)*s)) s++;
+  return *s == ':';
+}
+
+static cache_entry* lookup_or_compile(const char* line) {
+  uint32_t h = hash_line(line);
+  for (cache_entry* e = buckets[h % LINE_CACHE_BUCKETS]; e; e = e->chain) {
+    if (e->hash == h && strcmp(e->text, line) == 0) {
+      unlink_lru(e);
+      link_newest(e);
+      return e;
+    }
+  }
+
+  evict_if_full();
+  cache_entry* e = calloc(1, sizeof(cache_entry));
+  if (!e) return NULL;
+  e->text = strdup(line);
+  if (!e->text) {
+    free(e);
+    return NULL;
+  }
+  e->hash = h;
+  if (!is_definition_line(line)) {
+    e->code = compile_line(line);
+    if (!e->code) {
+      free(e->text);
+      free(e);
+      return NULL;
+    }
+  }
+  e->chain = buckets[h % LINE_CACHE_BUCKETS];
+  buckets[h % LINE_CACHE_BUCKETS] = e;
+  link_newest(e);
+  cache_count++;
+  return e;
+}
+
+void run_line_cached(Stack* stack, const char* line) {
+  cache_entry* e = lookup_or_compile(line);
+  if (!e || !e->code) {
+    // Definitions have side effects on every run; failed compiles fall
+    // back to the uncached path.
+    char* copy = strdup(line);
+    if (copy) evaluate_line(stack, copy);
+    free(copy);
+    return;
+  }
+  compiled_line* cl = retain_compiled_line(e->code);
+  execute_compiled(stack, cl);
+  free_compiled_line(cl);
+}
+
+void clear_line_cache(void) {
+  while (oldest) destroy_entry(oldest);
+}
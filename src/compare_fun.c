@@ -22,6 +22,8 @@
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_get
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix_alloc, gsl_mat...
 #include <stdio.h>                          // for size_t, fprintf, stderr
+#include "parallel.h"                       // for parallel_for, PARALLEL_GRAIN
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "compare_fun.h"                    // for comparison_op, CMP_AND
 
@@ -45,6 +47,67 @@ static int cmp_complex(gsl_complex a, gsl_complex b, comparison_op op) {
   return cmp_real(abs_a, abs_b, op);  // compare magnitudes
 }
 
+// An elementwise comparison for parallel_for; slices index the result row
+// by row. The operands the stack held are saved here before the result
+// takes one's matrix, which only ever rewrites the element just read.
+typedef struct {
+  comparison_op op;
+  const gsl_matrix* real_a;
+  const gsl_matrix* real_b;
+  const gsl_matrix_complex* complex_a;
+  const gsl_matrix_complex* complex_b;
+  double s;
+  gsl_complex z;
+  int scalar_first;
+  gsl_matrix* out;
+} cmp_job;
+
+static void real_scalar_slice(size_t begin, size_t end, void* arg) {
+  const cmp_job* job = arg;
+  size_t cols = job->out->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    double m = gsl_matrix_get(job->real_a, i, j);
+    double left = job->scalar_first ? job->s : m;
+    double right = job->scalar_first ? m : job->s;
+    gsl_matrix_set(job->out, i, j, cmp_real(left, right, job->op));
+  }
+}
+
+static void complex_scalar_slice(size_t begin, size_t end, void* arg) {
+  const cmp_job* job = arg;
+  size_t cols = job->out->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    gsl_complex w = gsl_matrix_complex_get(job->complex_a, i, j);
+    gsl_complex lhs = job->scalar_first ? job->z : w;
+    gsl_complex rhs = job->scalar_first ? w : job->z;
+    gsl_matrix_set(job->out, i, j, cmp_complex(lhs, rhs, job->op));
+  }
+}
+
+static void real_matrices_slice(size_t begin, size_t end, void* arg) {
+  const cmp_job* job = arg;
+  size_t cols = job->out->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    double x = gsl_matrix_get(job->real_a, i, j);
+    double y = gsl_matrix_get(job->real_b, i, j);
+    gsl_matrix_set(job->out, i, j, cmp_real(x, y, job->op));
+  }
+}
+
+static void complex_matrices_slice(size_t begin, size_t end, void* arg) {
+  const cmp_job* job = arg;
+  size_t cols = job->out->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    gsl_complex x = gsl_matrix_complex_get(job->complex_a, i, j);
+    gsl_complex y = gsl_matrix_complex_get(job->complex_b, i, j);
+    gsl_matrix_set(job->out, i, j, cmp_complex(x, y, job->op));
+  }
+}
+
 void dot_cmp_top_two(Stack* stack, comparison_op op) {
   if (stack->top < 1) {
     fprintf(stderr, "Stack underflow in dot_cmp_top_two.\n");
@@ -75,15 +138,17 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     double val = (a->type == TYPE_REAL) ? a->real : b->real;
     int scalar_first = (a->type == TYPE_REAL);
     size_t rows = mat->size1, cols = mat->size2;
+    // The 0/1 results can overwrite the matrix if nothing else holds it
+    gsl_matrix* dst = take_matrix_real(scalar_first ? b : a);
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double m = gsl_matrix_get(mat, i, j);
-        double left = scalar_first ? val : m;
-        double right = scalar_first ? m : val;
-        gsl_matrix_set(result.matrix_real, i, j, cmp_real(left, right, op));
-      }
+    result.matrix_real = dst ? dst : pool_matrix_alloc(rows, cols);
+    if (!result.matrix_real) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    cmp_job job = { .op = op, .real_a = mat, .s = val, .scalar_first = scalar_first,
+                    .out = result.matrix_real };
+    parallel_for(rows * cols, PARALLEL_GRAIN, real_scalar_slice, &job);
   }
 
   // Scalar vs Matrix (Complex)
@@ -95,14 +160,14 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     int scalar_first = (a->type == TYPE_COMPLEX);
     size_t rows = mat->size1, cols = mat->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);  // comparisons return real (0/1)
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex w = gsl_matrix_complex_get(mat, i, j);
-        gsl_complex lhs = scalar_first ? z : w;
-        gsl_complex rhs = scalar_first ? w : z;
-        gsl_matrix_set(result.matrix_real, i, j, cmp_complex(lhs, rhs, op));
-      }
+    result.matrix_real = pool_matrix_alloc(rows, cols);  // comparisons return real (0/1)
+    if (!result.matrix_real) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    cmp_job job = { .op = op, .complex_a = mat, .z = z, .scalar_first = scalar_first,
+                    .out = result.matrix_real };
+    parallel_for(rows * cols, PARALLEL_GRAIN, complex_scalar_slice, &job);
   }
 
   // Matrix vs Matrix
@@ -113,14 +178,18 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
       return;
     }
     size_t rows = a->matrix_real->size1, cols = a->matrix_real->size2;
+    const gsl_matrix* ma = a->matrix_real;
+    const gsl_matrix* mb = b->matrix_real;
+    gsl_matrix* dst = take_matrix_real(a);
+    if (!dst) dst = take_matrix_real(b);
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        double x = gsl_matrix_get(a->matrix_real, i, j);
-        double y = gsl_matrix_get(b->matrix_real, i, j);
-        gsl_matrix_set(result.matrix_real, i, j, cmp_real(x, y, op));
-      }
+    result.matrix_real = dst ? dst : pool_matrix_alloc(rows, cols);
+    if (!result.matrix_real) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    cmp_job job = { .op = op, .real_a = ma, .real_b = mb, .out = result.matrix_real };
+    parallel_for(rows * cols, PARALLEL_GRAIN, real_matrices_slice, &job);
   }
   else if (a->type == TYPE_MATRIX_COMPLEX && b->type == TYPE_MATRIX_COMPLEX) {
     if (a->matrix_complex->size1 != b->matrix_complex->size1 ||
@@ -130,24 +199,23 @@ void dot_cmp_top_two(Stack* stack, comparison_op op) {
     }
     size_t rows = a->matrix_complex->size1, cols = a->matrix_complex->size2;
     result.type = TYPE_MATRIX_REAL;
-    result.matrix_real = gsl_matrix_alloc(rows, cols);  // comparison result: 0.0 or 1.0
-    for (size_t i = 0; i < rows; ++i)
-      for (size_t j = 0; j < cols; ++j) {
-        gsl_complex x = gsl_matrix_complex_get(a->matrix_complex, i, j);
-        gsl_complex y = gsl_matrix_complex_get(b->matrix_complex, i, j);
-        gsl_matrix_set(result.matrix_real, i, j, cmp_complex(x, y, op));
-      }
+    result.matrix_real = pool_matrix_alloc(rows, cols);  // comparison result: 0.0 or 1.0
+    if (!result.matrix_real) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    cmp_job job = { .op = op, .complex_a = a->matrix_complex, .complex_b = b->matrix_complex,
+                    .out = result.matrix_real };
+    parallel_for(rows * cols, PARALLEL_GRAIN, complex_matrices_slice, &job);
   }
   else {
     fprintf(stderr, "Unsupported types in dot_cmp_top_two.\n");
     return;
   }
 
-  // Free old memory
-  if (a->type == TYPE_MATRIX_REAL && a->matrix_real)
-    gsl_matrix_free(a->matrix_real);
-  if (a->type == TYPE_MATRIX_COMPLEX && a->matrix_complex)
-    gsl_matrix_complex_free(a->matrix_complex);
+  // Release both operands; one whose matrix holds the result has none left
+  stack_element_free(a);
+  stack_element_free(b);
 
   *a = result;
   stack->top--;
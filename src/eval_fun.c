@@ -49,89 +49,440 @@
 #include "integration_and_zeros.h"
 #include "globals.h"
 #include "my_astronomy.h"
+#include "numconv.h"
+#include "bytecode.h"
+#include "peephole.h"
+#include "pool.h"
+#include "undo.h"
+#include "lazy.h"
 
-typedef void (*unary_func)(Stack *stack);
+// **************** Builtin function table ****************
+// Every builtin word is a void(Stack*) handler. Functions with a different
+// signature get a one-line adapter generated by DEFINE_OP. The name table
+// below is resolved once against the opcode registry in function_list.c, and
+// evaluate_one_token then dispatches through a jump table indexed by opcode.
+// Each entry also says how far down the stack its handler may pop or
+// overwrite elements, so the undo journal only has to save that much, and
+// lazy mode only has to force that much. Stack shuffles, marked WHOLE,
+// move, copy and free elements without looking at their values, so a lazy
+// expression they pass around stays lazy. ' and tran are WHOLE too: from
+// compiled code they take their operand through lazy_builtin, which turns a
+// transposed view back into its matrix and forces any other lazy operand.
 
-typedef struct {
-  const char* name;
-  unary_func func;
-} immutable_unary_op;
-
-static const immutable_unary_op immutable_unary_ops[] = {
-  {"sin",   sin_wrapper},
-  {"cos",   cos_wrapper},
-  {"tan",   tan_wrapper},
-  {"asin",  asin_wrapper},
-  {"acos",  acos_wrapper},
-  {"atan",  atan_wrapper},
-  {"sinh",  sinh_wrapper},
-  {"cosh",  cosh_wrapper},
-  {"tanh",  tanh_wrapper},
-  {"asinh", asinh_wrapper},
-  {"acosh", acosh_wrapper},
-  {"atanh", atanh_wrapper},
-  {"exp",   exp_wrapper},
-  {"chs",   chs_wrapper},
-  {"inv",   inv_wrapper},
-  {NULL,    NULL}
-};
+#define TOP(n) ((n) + 1)    // at most the top n elements
+#define DEEP   0            // anywhere, e.g. a nested line or a file load
+#define WHOLE  0x100        // reads no values, lazy elements may stay lazy
 
 typedef struct {
   const char* name;
-  const char* axis;
-  const char* operation;
-} matrix_reduce_op;
-
-static const matrix_reduce_op reduce_ops[] = {
-  {"cmean", "col", "mean"},
-  {"rmean", "row", "mean"},
-  {"csum",  "col", "sum"},
-  {"rsum",  "row", "sum"},
-  {"cvar",  "col", "var"},
-  {"rvar",  "row", "var"},
-  {"cmin", "col", "min"},
-  {"rmin", "row", "min"},
-  {"cmax",  "col", "max"},
-  {"rmax",  "row", "max"},
-  {NULL, NULL, NULL}
-};
+  builtin_func func;
+  int reach;                // TOP(n) or DEEP, possibly | WHOLE
+} builtin_op;
 
-typedef int (*matrix_func)(Stack*);
+#define DEFINE_OP(fn, call) \
+  static void fn(Stack *stack) { (void)stack; call; }
 
-typedef struct {
-  const char* name;
-  matrix_func func;
-} matrix_op;
-
-static const matrix_op matrix_ops[] = {
-  {"minv",    matrix_inverse},
-  {"pinv",    matrix_pseudoinverse},
-  {"det",     matrix_determinant},
-  {"eig",     matrix_eigen_decompose},
-  {"tran",    matrix_transpose},
-  {"'",       matrix_transpose},
-  {"reshape", reshape_matrix},
-  {"get_aij", select_matrix_element},
-  {"set_aij", set_matrix_element},
-  {"kron",    kronecker_top_two},
-  {"diag",    matrix_extract_diagonal},
-  {"to_diag", make_diag_matrix},
-  {"chol",    matrix_cholesky},
-  {"svd",     matrix_svd},
-  {"dim",     matrix_dimensions},
-  {"eye",     make_unit_matrix},
-  {"ones",    make_matrix_of_ones},
-  {"rrange",  make_row_range},
-  {"zeroes",  make_matrix_of_zeroes},
-  {"rand",    make_random_matrix},
-  {"randn",   make_gaussian_random_matrix},
-  {"join_v",  stack_join_matrix_vertical},
-  {"join_h",  stack_join_matrix_horizontal},
-  {"cumsum_r",matrix_cumsum_rows},
-  {"cumsum_c",matrix_cumsum_cols},
-  {NULL,      NULL}
+#define DEFINE_REDUCE_OP(fn, axis, op) \
+  static void fn(Stack *stack) { matrix_reduce(stack, axis, op); }
+
+#define DEFINE_CMP_OP(fn, cmp) \
+  static void fn(Stack *stack) { dot_cmp_top_two(stack, cmp); }
+
+// Meta level
+static void bi_eval(Stack *stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: nothing to evaluate.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else evaluate_line(stack, t.string);
+  if (t.type == TYPE_STRING) string_release(t.string);
+}
+
+static void bi_batch(Stack *stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: no batch to run.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else run_batch(stack, t.string);
+  if (t.type == TYPE_STRING) string_release(t.string);
+}
+
+static void bi_run(Stack *stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Stack is empty: no program to run.\n");
+    return;
+  }
+  stack_element t = pop(stack);
+  if (t.type != TYPE_STRING) {
+    fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
+  } else {
+    Program prog = {.count = 0, .label_count = 0};
+    if (!load_program_from_file(t.string, &prog)) {
+      fprintf(stderr, "Failed to load program.\n");
+      free_program(&prog);   // load may have strdup'd args before failing
+      string_release(t.string);
+      return;
+    }
+    list_program(&prog);
+    run_RPN_code(stack, &prog);
+    free_program(&prog);
+  }
+  if (t.type == TYPE_STRING) string_release(t.string);
+}
+
+// Constants
+DEFINE_OP(bi_gravity, push_real(stack, 9.81))
+DEFINE_OP(bi_pi, push_real(stack, M_PI))
+DEFINE_OP(bi_e, push_real(stack, exp(1.0)))
+DEFINE_OP(bi_inf, push_real(stack, INFINITY))
+DEFINE_OP(bi_nan, push_real(stack, NAN))
+
+// Misc
+DEFINE_OP(bi_help, help_menu())
+DEFINE_OP(bi_listfcns, list_all_functions_sorted())
+DEFINE_OP(bi_clrhist, clear_history(); clear_undo_journal())
+DEFINE_OP(bi_usage, op_usage(stack))
+DEFINE_OP(bi_fuck, whose_place())
+
+// Utility functions
+DEFINE_OP(bi_pm, print_matrix(stack); skip_stack_printing = true)
+DEFINE_OP(bi_ps, print_stack(stack, NULL))
+DEFINE_OP(bi_sfs, swap_fixed_scientific())
+DEFINE_OP(bi_print, print_top_scalar(stack))
+DEFINE_OP(bi_setprec, set_print_precision(stack))
+DEFINE_OP(bi_setthreads, set_thread_count(stack))
+DEFINE_OP(bi_lazy, toggle_lazy_mode())
+
+// Date and time functions
+DEFINE_OP(bi_days2eoy, days_to_end_of_year(stack))
+DEFINE_OP(bi_num2date, make_date_string(stack))
+DEFINE_OP(bi_ddays, delta_days_strings(stack))
+DEFINE_OP(bi_today, push_today_date(stack))
+DEFINE_OP(bi_dow, push_weekday_name_from_date_string(stack))
+DEFINE_OP(bi_dateplus, date_plus_days(stack))
+DEFINE_OP(bi_edmy, extract_day_month_year(stack))
+
+// Astronomy functions
+DEFINE_OP(bi_sunrise, sunrise(stack))
+DEFINE_OP(bi_sunset, sunset(stack))
+DEFINE_OP(bi_dawn, dawn(stack))
+DEFINE_OP(bi_dusk, dusk(stack))
+
+// Stack functions
+DEFINE_OP(bi_drop, pop_and_free(stack))
+DEFINE_OP(bi_dup, stack_dup(stack))
+DEFINE_OP(bi_clst, free_stack(stack))
+DEFINE_OP(bi_roll, stack_roll(stack, 2))
+DEFINE_OP(bi_savestack, save_stack_to_file(stack, STACK_PATH))
+DEFINE_OP(bi_loadstack, load_stack_from_file(stack, STACK_PATH))
+
+// Comparison and logic functions
+DEFINE_CMP_OP(bi_eq, CMP_EQ)
+DEFINE_CMP_OP(bi_neq, CMP_NE)
+DEFINE_CMP_OP(bi_lt, CMP_LT)
+DEFINE_CMP_OP(bi_leq, CMP_LE)
+DEFINE_CMP_OP(bi_gt, CMP_GT)
+DEFINE_CMP_OP(bi_geq, CMP_GE)
+DEFINE_CMP_OP(bi_and, CMP_AND)
+DEFINE_CMP_OP(bi_or, CMP_OR)
+
+// Register functions
+DEFINE_OP(bi_pr, show_registers_status())
+DEFINE_OP(bi_saveregs, save_registers_to_file(REGISTERS_PATH))
+DEFINE_OP(bi_loadregs, load_registers_from_file(REGISTERS_PATH))
+DEFINE_OP(bi_clregs, free_all_registers())
+
+// String functions
+DEFINE_OP(bi_substr, my_substring(stack))
+
+// Macros and user defined word functions
+DEFINE_OP(bi_listmacros, list_macros())
+DEFINE_OP(bi_listwords, list_words())
+DEFINE_OP(bi_listfusions, list_fusions())
+DEFINE_OP(bi_poolstats, print_pool_stats())
+DEFINE_OP(bi_loadwords, load_words_from_file())
+DEFINE_OP(bi_savewords, save_words_to_file())
+DEFINE_OP(bi_clrwords, clear_words())
+
+// Matrix operations (these return a status code nobody looks at)
+DEFINE_OP(bi_minv, matrix_inverse(stack))
+DEFINE_OP(bi_pinv, matrix_pseudoinverse(stack))
+DEFINE_OP(bi_det, matrix_determinant(stack))
+DEFINE_OP(bi_eig, matrix_eigen_decompose(stack))
+DEFINE_OP(bi_tran, matrix_transpose(stack))
+DEFINE_OP(bi_reshape, reshape_matrix(stack))
+DEFINE_OP(bi_get_aij, select_matrix_element(stack))
+DEFINE_OP(bi_set_aij, set_matrix_element(stack))
+DEFINE_OP(bi_kron, if (!(lazy_mode && lazy_kron(stack))) kronecker_top_two(stack))
+DEFINE_OP(bi_diag, matrix_extract_diagonal(stack))
+DEFINE_OP(bi_to_diag, make_diag_matrix(stack))
+DEFINE_OP(bi_chol, matrix_cholesky(stack))
+DEFINE_OP(bi_svd, matrix_svd(stack))
+DEFINE_OP(bi_dim, matrix_dimensions(stack))
+DEFINE_OP(bi_eye, make_unit_matrix(stack))
+DEFINE_OP(bi_ones, make_matrix_of_ones(stack))
+DEFINE_OP(bi_rrange, make_row_range(stack))
+DEFINE_OP(bi_zeroes, make_matrix_of_zeroes(stack))
+DEFINE_OP(bi_rand, make_random_matrix(stack))
+DEFINE_OP(bi_randn, make_gaussian_random_matrix(stack))
+DEFINE_OP(bi_join_v, stack_join_matrix_vertical(stack))
+DEFINE_OP(bi_join_h, stack_join_matrix_horizontal(stack))
+DEFINE_OP(bi_cumsum_r, matrix_cumsum_rows(stack))
+DEFINE_OP(bi_cumsum_c, matrix_cumsum_cols(stack))
+DEFINE_OP(bi_split_mat, split_matrix(stack))
+
+// Matrix reduction functions
+DEFINE_REDUCE_OP(bi_cmean, "col", "mean")
+DEFINE_REDUCE_OP(bi_rmean, "row", "mean")
+DEFINE_REDUCE_OP(bi_csum,  "col", "sum")
+DEFINE_REDUCE_OP(bi_rsum,  "row", "sum")
+DEFINE_REDUCE_OP(bi_cvar,  "col", "var")
+DEFINE_REDUCE_OP(bi_rvar,  "row", "var")
+DEFINE_REDUCE_OP(bi_cmin,  "col", "min")
+DEFINE_REDUCE_OP(bi_rmin,  "row", "min")
+DEFINE_REDUCE_OP(bi_cmax,  "col", "max")
+DEFINE_REDUCE_OP(bi_rmax,  "row", "max")
+
+static const builtin_op builtin_ops[] = {
+  // Meta level
+  {"eval",      bi_eval,                   DEEP},
+  {"batch",     bi_batch,                  DEEP},
+  {"run",       bi_run,                    DEEP},
+
+  // Constants
+  {"gravity",   bi_gravity,                TOP(0)},
+  {"pi",        bi_pi,                     TOP(0)},
+  {"e",         bi_e,                      TOP(0)},
+  {"inf",       bi_inf,                    TOP(0)},
+  {"nan",       bi_nan,                    TOP(0)},
+
+  // Misc
+  {"help",      bi_help,                   TOP(0)},
+  {"usage",     bi_usage,                  DEEP},
+  {"listfcns",  bi_listfcns,               TOP(0)},
+  {"clrhist",   bi_clrhist,                TOP(0)},
+  {"fuck",      bi_fuck,                   TOP(0)},
+
+  // Utility functions
+  {"pm",        bi_pm,                     TOP(1)},
+  {"ps",        bi_ps,                     DEEP},
+  {"print",     bi_print,                  TOP(1)},
+  {"setprec",   bi_setprec,                TOP(1)},
+  {"setthreads", bi_setthreads,            TOP(1)},
+  {"lazy",      bi_lazy,                   TOP(0)},
+  {"sfs",       bi_sfs,                    TOP(0)},
+
+  // Date and time functions
+  {"days2eoy",  bi_days2eoy,               DEEP},
+  {"num2date",  bi_num2date,               DEEP},
+  {"ddays",     bi_ddays,                  DEEP},
+  {"today",     bi_today,                  DEEP},
+  {"dow",       bi_dow,                    DEEP},
+  {"dateplus",  bi_dateplus,               DEEP},
+  {"edmy",      bi_edmy,                   DEEP},
+
+  // Astronomy functions
+  {"sunrise",   bi_sunrise,                DEEP},
+  {"sunset",    bi_sunset,                 DEEP},
+  {"dawn",      bi_dawn,                   DEEP},
+  {"dusk",      bi_dusk,                   DEEP},
+
+  // Stack functions
+  {"drop",      bi_drop,                   TOP(1) | WHOLE},
+  {"clst",      bi_clst,                   DEEP | WHOLE},
+  {"swap",      swap,                      TOP(2) | WHOLE},
+  {"dup",       bi_dup,                    TOP(1) | WHOLE},
+  {"nip",       stack_nip,                 TOP(2) | WHOLE},
+  {"tuck",      stack_tuck,                TOP(2) | WHOLE},
+  {"roll",      bi_roll,                   TOP(3) | WHOLE},
+  {"over",      stack_over,                TOP(2) | WHOLE},
+  {"savestack", bi_savestack,              DEEP},
+  {"loadstack", bi_loadstack,              DEEP},
+
+  // Polynomial functions
+  {"roots",     poly_roots,                DEEP},
+  {"pval",      poly_eval,                 DEEP},
+
+  // Integration and zeros
+  {"integrate",    integrate,              DEEP},
+  {"fzero",        find_zero,              DEEP},
+  {"set_intg_tol", set_integration_precision, DEEP},
+  {"set_f0_tol",   set_f0_precision,       DEEP},
+
+  // Comparison and logic functions
+  {"eq",        bi_eq,                     TOP(2)},
+  {"neq",       bi_neq,                    TOP(2)},
+  {"lt",        bi_lt,                     TOP(2)},
+  {"leq",       bi_leq,                    TOP(2)},
+  {"gt",        bi_gt,                     TOP(2)},
+  {"geq",       bi_geq,                    TOP(2)},
+  {"and",       bi_and,                    TOP(2)},
+  {"or",        bi_or,                     TOP(2)},
+  {"not",       logical_not_wrapper,       TOP(1)},
+
+  // Special math functions
+  {"npdf",      npdf_wrapper,              TOP(1)},
+  {"ncdf",      ncdf_wrapper,              TOP(1)},
+  {"nquant",    nquant_wrapper,            TOP(1)},
+  {"gamma",     gamma_wrapper,             TOP(1)},
+  {"ln_gamma",  ln_gamma_wrapper,          TOP(1)},
+  {"beta",      beta_wrapper,              TOP(2)},
+  {"ln_beta",   ln_beta_wrapper,           TOP(2)},
+
+  // Parts of numbers
+  {"frac",      frac_wrapper,              TOP(1)},
+  {"intg",      intg_wrapper,              TOP(1)},
+
+  // Register functions
+  {"ffr",       find_first_free_register,  TOP(0)},
+  {"rcl",       recall_from_register,      TOP(1)},
+  {"sto",       store_to_register,         TOP(2)},
+  {"pr",        bi_pr,                     TOP(0)},
+  {"saveregs",  bi_saveregs,               TOP(0)},
+  {"loadregs",  bi_loadregs,               TOP(0)},
+  {"clregs",    bi_clregs,                 TOP(0)},
+
+  // String functions
+  {"substr",    bi_substr,                 TOP(3)},
+  {"scon",      concatenate,               TOP(2)},
+  {"s2l",       to_lower,                  TOP(1)},
+  {"s2u",       to_upper,                  TOP(1)},
+  {"slen",      string_length,             TOP(1)},
+  {"srev",      string_reverse,            TOP(1)},
+  {"int2str",   top_to_string,             TOP(1)},
+
+  // Macros and user defined word functions
+  {"listmacros", bi_listmacros,            TOP(0)},
+  {"listwords", bi_listwords,              TOP(0)},
+  {"listfusions", bi_listfusions,          TOP(0)},
+  {"poolstats", bi_poolstats,              TOP(0)},
+  {"loadwords", bi_loadwords,              TOP(0)},
+  {"savewords", bi_savewords,              TOP(0)},
+  {"clrwords",  bi_clrwords,               TOP(0)},
+  {"selword",   word_select,               DEEP},
+  {"delword",   delete_word,               TOP(1)},
+
+  // Matrix operations
+  {"minv",      bi_minv,                   TOP(1)},
+  {"pinv",      bi_pinv,                   TOP(1)},
+  {"det",       bi_det,                    TOP(1)},
+  {"eig",       bi_eig,                    TOP(1)},
+  {"tran",      bi_tran,                   TOP(1) | WHOLE},
+  {"'",         bi_tran,                   TOP(1) | WHOLE},
+  {"reshape",   bi_reshape,                TOP(3)},
+  {"get_aij",   bi_get_aij,                TOP(3)},
+  {"set_aij",   bi_set_aij,                TOP(4)},
+  {"kron",      bi_kron,                   TOP(2)},
+  {"diag",      bi_diag,                   TOP(1)},
+  {"to_diag",   bi_to_diag,                TOP(1)},
+  {"chol",      bi_chol,                   TOP(1)},
+  {"svd",       bi_svd,                    TOP(1)},
+  {"dim",       bi_dim,                    TOP(1)},
+  {"eye",       bi_eye,                    TOP(1)},
+  {"ones",      bi_ones,                   TOP(2)},
+  {"rrange",    bi_rrange,                 TOP(2)},
+  {"zeroes",    bi_zeroes,                 TOP(2)},
+  {"rand",      bi_rand,                   TOP(2)},
+  {"randn",     bi_randn,                  TOP(2)},
+  {"join_v",    bi_join_v,                 TOP(2)},
+  {"join_h",    bi_join_h,                 TOP(2)},
+  {"cumsum_r",  bi_cumsum_r,               TOP(1)},
+  {"cumsum_c",  bi_cumsum_c,               TOP(1)},
+  {"split_mat", bi_split_mat,              TOP(1)},
+
+  // Immutable unary functions
+  {"sin",       sin_wrapper,               TOP(1)},
+  {"cos",       cos_wrapper,               TOP(1)},
+  {"tan",       tan_wrapper,               TOP(1)},
+  {"asin",      asin_wrapper,              TOP(1)},
+  {"acos",      acos_wrapper,              TOP(1)},
+  {"atan",      atan_wrapper,              TOP(1)},
+  {"sinh",      sinh_wrapper,              TOP(1)},
+  {"cosh",      cosh_wrapper,              TOP(1)},
+  {"tanh",      tanh_wrapper,              TOP(1)},
+  {"asinh",     asinh_wrapper,             TOP(1)},
+  {"acosh",     acosh_wrapper,             TOP(1)},
+  {"atanh",     atanh_wrapper,             TOP(1)},
+  {"exp",       exp_wrapper,               TOP(1)},
+  {"chs",       chs_wrapper,               TOP(1)},
+  {"inv",       inv_wrapper,               TOP(1)},
+
+  // Mutable unary operations
+  {"split_c",   split_complex,             TOP(1)},
+  {"abs",       abs_wrapper,               TOP(1)},
+  {"re",        re_wrapper,                TOP(1)},
+  {"im",        im_wrapper,                TOP(1)},
+  {"arg",       arg_wrapper,               TOP(1)},
+  {"re2c",      real2complex,              TOP(1)},
+  {"j2r",       join_2_reals,              TOP(2)},
+  {"ln",        ln_wrapper,                TOP(1)},
+  {"log",       log_wrapper,               TOP(1)},
+  {"sqrt",      sqrt_wrapper,              TOP(1)},
+
+  // Matrix reduction functions
+  {"cmean",     bi_cmean,                  TOP(1)},
+  {"rmean",     bi_rmean,                  TOP(1)},
+  {"csum",      bi_csum,                   TOP(1)},
+  {"rsum",      bi_rsum,                   TOP(1)},
+  {"cvar",      bi_cvar,                   TOP(1)},
+  {"rvar",      bi_rvar,                   TOP(1)},
+  {"cmin",      bi_cmin,                   TOP(1)},
+  {"rmin",      bi_rmin,                   TOP(1)},
+  {"cmax",      bi_cmax,                   TOP(1)},
+  {"rmax",      bi_rmax,                   TOP(1)},
+  {"describe",  matrix_describe,           TOP(1)},
+  {NULL,        NULL,                      DEEP}
 };
 
+// Jump table indexed by opcode; NULL for names the evaluator does not
+// handle itself (program-only instructions such as lbl or goto)
+static const builtin_op** dispatch_table = NULL;
+
+static void build_dispatch_table(void) {
+  dispatch_table = calloc((size_t)function_count(), sizeof(builtin_op*));
+  if (!dispatch_table) {
+    fprintf(stderr, "Failed to allocate dispatch table.\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; builtin_ops[i].name != NULL; ++i) {
+    int op = function_opcode(builtin_ops[i].name);
+    if (op == OPCODE_NONE) {
+      fprintf(stderr, "Builtin '%s' is missing from function_names.\n", builtin_ops[i].name);
+      continue;
+    }
+    dispatch_table[op] = &builtin_ops[i];
+  }
+}
+
+// Handler for an opcode, or NULL if it has none
+builtin_func builtin_handler(int opcode) {
+  if (opcode < 0) return NULL;
+  if (!dispatch_table) build_dispatch_table();
+  return dispatch_table[opcode] ? dispatch_table[opcode]->func : NULL;
+}
+
+int builtin_reach(int opcode) {
+  if (opcode < 0) return -1;
+  if (!dispatch_table) build_dispatch_table();
+  const builtin_op* b = dispatch_table[opcode];
+  int reach = b ? b->reach & ~WHOLE : DEEP;
+  return reach != DEEP ? reach - 1 : -1;
+}
+
+int builtin_lazy_depth(int opcode) {
+  if (opcode < 0) return -1;
+  if (!dispatch_table) build_dispatch_table();
+  const builtin_op* b = dispatch_table[opcode];
+  if (b && (b->reach & WHOLE)) return 0;
+  return builtin_reach(opcode);
+}
+
 // **************** The main loop in this file ****************
 void evaluate_line(Stack *stack, char* line) {
   int def = is_word_definition(line);
@@ -139,53 +490,75 @@ void evaluate_line(Stack *stack, char* line) {
     // definition line (accepted or rejected) is already handled; do not lex it
     return;
   }
-  
-  Lexer lexer = (Lexer){ .input = line, .pos = 0 };
-  Token tok;
-  do {
-    tok = next_token(&lexer);
-    evaluate_one_token(stack, tok);
-  } while (tok.type != TOK_EOF);
-}
 
-/* void evaluate_line(Stack *stack, char* line) { */
-/*   Lexer lexer = {line, 0}; */
-/*   Token tok; */
+  compiled_line* cl = compile_line(line);
+  if (!cl) return;
+  execute_compiled(stack, cl);
+  free_compiled_line(cl);
+}
 
-/*   if (!is_word_definition(line))   // Check if a new word; insert  if it is */
-/*     do {   // The lexer loop */
-/*       tok = next_token(&lexer); */
-/*       evaluate_one_token(stack, tok);     */
-/*     } while (tok.type != TOK_EOF); */
-/* } */
+// **************** Run a macro or user word ****************
+void evaluate_identifier(Stack *stack, const char* name) {
+  user_word *w = find_macro((char*)name);
+  if (w == NULL) w = find_word((char*)name);
+  if (w == NULL)
+    printf("Unknown identifier!\n");
+  else
+    run_user_word(stack, w);
+}
 
 // **************** Process one token ****************
-void evaluate_one_token(Stack *stack, Token tok) {
-  switch (tok.type) {
-  case TOK_EOF:
-    return;
+// Tokens that carry text need it NUL-terminated for the parsers
+static void evaluate_text_token(Stack *stack, token_type type, char* text) {
+  switch (type) {
   case TOK_NUMBER:
-    push_real(stack, atof(tok.text));
+    push_real(stack, str_to_double(text, NULL));
     return;
   case TOK_COMPLEX: {
     gsl_complex z;
-    if (read_complex(tok.text, &z)) push_complex(stack,z);
+    if (read_complex(text, &z)) push_complex(stack,z);
     return;}
   case TOK_STRING:
-    push_string(stack, tok.text);
+    push_string(stack, text);
     return;
   case TOK_MATRIX_FILE:
-    read_matrix_from_file(stack, tok.text);
+    read_matrix_from_file(stack, text);
     return;
-  case TOK_MATRIX_INLINE_REAL:
-    push_matrix_real(stack,parse_matrix_literal(tok.text));
+  case TOK_IDENTIFIER:
+    evaluate_identifier(stack, text);
     return;
-  case TOK_MATRIX_INLINE_COMPLEX:
-    push_matrix_complex(stack,parse_complex_matrix_literal(tok.text));
+  default:
+    return;
+  }
+}
+
+void evaluate_one_token(Stack *stack, const Token* tok) {
+  switch (tok->type) {
+  case TOK_EOF:
+    return;
+  case TOK_NUMBER:
+  case TOK_COMPLEX:
+  case TOK_STRING:
+  case TOK_MATRIX_FILE:
+  case TOK_IDENTIFIER: {
+    char* text = token_strdup(tok);
+    if (!text) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    evaluate_text_token(stack, tok->type, text);
+    free(text);
     return;
-  case TOK_MATRIX_INLINE_MIXED:
-    push_matrix_complex(stack,parse_complex_matrix_literal(tok.text));
+  }
+  case TOK_MATRIX_INLINE_REAL:
+  case TOK_MATRIX_INLINE_COMPLEX:
+  case TOK_MATRIX_INLINE_MIXED: {
+    stack_element m;
+    parse_inline_matrix(tok->text, tok->len, &m);
+    if (m.type == TYPE_MATRIX_COMPLEX) push_matrix_complex(stack, m.matrix_complex);
+    else push_matrix_real(stack, m.matrix_real);
     return;
+  }
   case TOK_PLUS:
     add_top_two(stack);
     return;
@@ -222,245 +595,19 @@ void evaluate_one_token(Stack *stack, Token tok) {
   case TOK_SEMICOLON:
     printf("; \n");
     return;
-  case TOK_IDENTIFIER: {
-    user_word *m=find_macro(tok.text);
-    if (m!=NULL) {
-      char *sub_line = strdup(m->body);
-      Lexer sub_lexer = {sub_line, 0};
-      Token sub_tok;
-      do {   // The lexer loop
-	sub_tok = next_token(&sub_lexer);
-	evaluate_one_token(stack, sub_tok);    
-      } while (sub_tok.type != TOK_EOF);
-      free(sub_line);
-      return;
-    }
-    
-    user_word *w=find_word(tok.text);
-    if (w==NULL)
-      printf("Unknown identifier!\n");
-    else {
-      char *sub_line = strdup(w->body);
-      Lexer sub_lexer = {sub_line, 0};
-      Token sub_tok;
-      do {   // The lexer loop
-	sub_tok = next_token(&sub_lexer);
-	evaluate_one_token(stack, sub_tok);    
-      } while (sub_tok.type != TOK_EOF);
-      free(sub_line);
-    }
-    return;
-  }
   case TOK_FUNCTION: {
-
-    // Meta level
-    if (!strcmp("eval",tok.text)) {
-      if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: nothing to evaluate.\n");
-        return;
-      }
-      stack_element t = pop(stack);
-      if (t.type != TYPE_STRING) {
-        fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-      } else evaluate_line(stack, t.string);
-      if (t.type == TYPE_STRING) free(t.string);
-      return;
-    }
-
-    if (!strcmp("batch",tok.text)) {
-      if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: no batch to run.\n");
-        return;
-      }
-      stack_element t = pop(stack);
-      if (t.type != TYPE_STRING) {
-        fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-      } else run_batch(stack, t.string);
-      if (t.type == TYPE_STRING) free(t.string);
-      return;
-    }
-    
-    if (!strcmp("run",tok.text)) {
-      if (stack->top < 0) {
-        fprintf(stderr, "Stack is empty: no program to run.\n");
-        return;
-      }
-      stack_element t = pop(stack);
-      if (t.type != TYPE_STRING) {
-	fprintf(stderr, "Top of stack is not a string: cannot evaluate.\n");
-      } else {
-	Program prog = {.count = 0, .label_count = 0};
-	if (!load_program_from_file(t.string, &prog)) {
-	  fprintf(stderr, "Failed to load program.\n");
-	  free_program(&prog);   // load may have strdup'd args before failing
-	  free(t.string);
-	  return;
-	}
-	list_program(&prog);
-	run_RPN_code(stack, &prog);
-	free_program(&prog);
-      }
-      if (t.type == TYPE_STRING) free(t.string);
-      return;
-    }
-
-    // ++++++++++++++++ Nullary functions ++++++++++++++++
-    // Constants
-    if (!strcmp("gravity",tok.text)) {push_real(stack,9.81); return; }
-    if (!strcmp("pi",tok.text)) { push_real(stack,M_PI); return; }
-    if (!strcmp("e",tok.text)) { push_real(stack,exp(1.0)); return; }
-    if (!strcmp("inf",tok.text)) { push_real(stack,INFINITY); return; }
-    if (!strcmp("nan",tok.text)) { push_real(stack,NAN); return; }
-
-    // Misc
-    if (!strcmp("help",tok.text)) { help_menu(); return; }
-    if (!strcmp("usage",tok.text)) { op_usage(stack); return; }
-    if (!strcmp("listfcns",tok.text)) { list_all_functions_sorted(); return; }
-    if (!strcmp("clrhist",tok.text)) { clear_history(); return; }
-    if (!strcmp("fuck",tok.text)) { whose_place(); return; }
-    
-    // Utility functions
-    if (!strcmp("pm",tok.text)) {print_matrix(stack); skip_stack_printing = true; return;}
-    if (!strcmp("ps",tok.text)) {print_stack(stack,NULL); return;}
-    if (!strcmp("print",tok.text)) {print_top_scalar(stack); return;}
-    if (!strcmp("setprec",tok.text)) {set_print_precision(stack); return;}
-    if (!strcmp("sfs",tok.text)) {swap_fixed_scientific(); return;}
-    
-    // Date and time functions
-    if (!strcmp("days2eoy",tok.text)) {days_to_end_of_year(stack); return; } 
-    if (!strcmp("num2date",tok.text)) {make_date_string(stack); return; }
-    if (!strcmp("ddays",tok.text)) { delta_days_strings(stack); return; }
-    if (!strcmp("today",tok.text)) { push_today_date(stack); return; }
-    if (!strcmp("dow",tok.text)) { push_weekday_name_from_date_string(stack); return; }
-    if (!strcmp("dateplus",tok.text)) { date_plus_days(stack); return; }
-    if (!strcmp("edmy",tok.text)) {  extract_day_month_year(stack); return; }
-
-    // Astronomy functions
-    if (!strcmp("sunrise",tok.text)) {sunrise(stack); return; } 
-    if (!strcmp("sunset",tok.text)) {sunset(stack); return; } 
-    if (!strcmp("dawn",tok.text)) {dawn(stack); return; } 
-    if (!strcmp("dusk",tok.text)) {dusk(stack); return; } 
-    
-    // Stack functions
-    if (!strcmp("drop",tok.text)) { pop_and_free(stack); return; }
-    if (!strcmp("clst",tok.text)) { free_stack(stack); return; }
-    if (!strcmp("swap",tok.text)) { swap(stack); return; }
-    if (!strcmp("dup",tok.text)) { stack_dup(stack); return; }
-    if (!strcmp("nip",tok.text)) { stack_nip(stack); return; }
-    if (!strcmp("tuck",tok.text)) { stack_tuck(stack); return; }
-    if (!strcmp("roll",tok.text)) { stack_roll(stack,2); return; }
-    if (!strcmp("over",tok.text)) { stack_over(stack); return; }
-    if (!strcmp("savestack",tok.text)) { save_stack_to_file(stack, STACK_PATH); return; }
-    if (!strcmp("loadstack",tok.text)) { load_stack_from_file(stack, STACK_PATH); return; }
-
-    // Polynomial functions
-    if (!strcmp("roots",tok.text)) { poly_roots(stack); return;}
-    if (!strcmp("pval",tok.text)) { poly_eval(stack); return; }
-
-    // Integration and zeros
-    if (!strcmp("integrate",tok.text)) { integrate(stack); return;}
-    if (!strcmp("fzero",tok.text)) { find_zero(stack); return; }
-    if (!strcmp("set_intg_tol",tok.text)) { set_integration_precision(stack); return; }
-    if (!strcmp("set_f0_tol",tok.text))  { set_f0_precision(stack); return; }
- 
-    // Comparison and logic functions
-    if (!strcmp("eq",tok.text)) { dot_cmp_top_two(stack, CMP_EQ); return; }
-    if (!strcmp("neq",tok.text)) { dot_cmp_top_two(stack, CMP_NE); return; }
-    if (!strcmp("lt",tok.text)) { dot_cmp_top_two(stack, CMP_LT); return; }
-    if (!strcmp("leq",tok.text)) { dot_cmp_top_two(stack, CMP_LE); return; }
-    if (!strcmp("gt",tok.text)) { dot_cmp_top_two(stack, CMP_GT); return; }
-    if (!strcmp("geq",tok.text)) { dot_cmp_top_two(stack, CMP_GE); return; } 
-    if (!strcmp("and",tok.text)) { dot_cmp_top_two(stack, CMP_AND); return; } 
-    if (!strcmp("or",tok.text)) { dot_cmp_top_two(stack, CMP_OR); return; } 
-    if (!strcmp("not",tok.text)) { logical_not_wrapper(stack); return; } 
-    
-    // Special math functions
-    if (!strcmp("npdf",tok.text)) { npdf_wrapper(stack); return; }
-    if (!strcmp("ncdf",tok.text)) { ncdf_wrapper(stack); return; }
-    if (!strcmp("nquant",tok.text)) { nquant_wrapper(stack); return; }
-    if (!strcmp("gamma",tok.text)) { gamma_wrapper(stack); return; }
-    if (!strcmp("ln_gamma",tok.text)) { ln_gamma_wrapper(stack); return; }
-    if (!strcmp("beta",tok.text)) { beta_wrapper(stack); return; }
-    if (!strcmp("ln_beta",tok.text)) { ln_beta_wrapper(stack); return; }
-
-    // Parts of numbers
-    if (!strcmp("frac",tok.text)) { frac_wrapper(stack); return; }
-    if (!strcmp("intg",tok.text)) { intg_wrapper(stack); return; }
-    
-    // Register functions
-    if (!strcmp("ffr",tok.text)) {  find_first_free_register(stack); return; }
-    if (!strcmp("rcl",tok.text)) { recall_from_register(stack); return; }
-    if (!strcmp("sto",tok.text)) { store_to_register(stack); return; }
-    if (!strcmp("pr",tok.text)) { show_registers_status(); return; }
-    if (!strcmp("saveregs",tok.text)) { save_registers_to_file(REGISTERS_PATH); return; }
-    if (!strcmp("loadregs",tok.text)) { load_registers_from_file(REGISTERS_PATH); return; }
-    if (!strcmp("clregs",tok.text)) { free_all_registers(); return; }
-
-    // **************** String functions ****************
-    if (!strcmp("substr",tok.text)) {my_substring(stack); return;}
-    if (!strcmp("scon",tok.text)) {concatenate(stack); return;}
-    if (!strcmp("s2l",tok.text)) { to_lower(stack); return; }
-    if (!strcmp("s2u",tok.text)) { to_upper(stack); return; }
-    if (!strcmp("slen",tok.text)) { string_length(stack); return; }
-    if (!strcmp("srev",tok.text)) { string_reverse(stack); return; }       
-    if (!strcmp("int2str",tok.text)) { top_to_string(stack); return; }       
-
-    // **************** Macros and user defined word functions ****************
-    if (!strcmp("listmacros",tok.text)) {list_macros(); return;}
-    if (!strcmp("listwords",tok.text)) {list_words(); return;}
-    if (!strcmp("loadwords",tok.text)) {load_words_from_file(); return;}
-    if (!strcmp("savewords",tok.text)) {save_words_to_file(); return;}
-    if (!strcmp("clrwords",tok.text)) {clear_words(); return;}
-    if (!strcmp("selword",tok.text)) {word_select(stack); return;}
-    if (!strcmp("delword",tok.text)) {delete_word(stack); return;}
-    
-    // **************** Matrix operations ****************
-    for (int i = 0; matrix_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, matrix_ops[i].name)) {
-	matrix_ops[i].func(stack);
-	return;
-      }
-    }
-
-    if (!strcmp("split_mat",tok.text)) {split_matrix(stack); return; }
-    
-    // **************** Immutable unary functions ****************      
-    for (int i = 0; immutable_unary_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, immutable_unary_ops[i].name)) {
-	immutable_unary_ops[i].func(stack);
-	return;
-      }
-    }
-    // **************** Mutable unary operations ****************     
-    if (!strcmp(tok.text, "split_c")) { split_complex(stack); return; }    
-    if (!strcmp(tok.text, "abs")) { abs_wrapper(stack); return; }
-    if (!strcmp(tok.text, "re")) { re_wrapper(stack); return; }
-    if (!strcmp(tok.text, "im")) { im_wrapper(stack); return; }
-    if (!strcmp(tok.text, "arg")) { arg_wrapper(stack); return; }
-    if (!strcmp(tok.text, "re2c")) { real2complex(stack); return; }
-    if (!strcmp(tok.text, "j2r")) {  join_2_reals(stack); return; }
-    if (!strcmp(tok.text, "ln")) { ln_wrapper(stack); return; }
-    if (!strcmp(tok.text, "log")) { log_wrapper(stack); return; }
-    if (!strcmp(tok.text, "sqrt")) { sqrt_wrapper(stack); return; }   
-    
-    // Matrix reduction functions
-    for (int i = 0; reduce_ops[i].name != NULL; ++i) {
-      if (!strcmp(tok.text, reduce_ops[i].name)) {
-        matrix_reduce(stack, reduce_ops[i].axis, reduce_ops[i].operation);
-        return;
-      }
-    }
-    return;  
-    case TOK_VERTICAL:
-      printf("| \n");
-      return;
-      case TOK_UNKNOWN:
-	printf("Illegal token.\n");
-	return;
-	default:
-	  printf("Unhandled token type.\n");
-	  return;
+    builtin_func f = builtin_handler(tok->opcode);
+    if (f) f(stack);
+    return;
   }
+  case TOK_VERTICAL:
+    printf("| \n");
+    return;
+  case TOK_UNKNOWN:
+    printf("Illegal token.\n");
+    return;
+  default:
+    printf("Unhandled token type.\n");
+    return;
   }
 }
-
@@ -16,7 +16,9 @@
  * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include <string.h>
+#include <string.h>         // for strlen
+#include "function_list.h"
+#include "symbols.h"        // for lookup_symbol, symbol_opcode
 
 const char* const function_names[] = {
   "sin", "cos", "tan", "asin", "acos", "atan",
@@ -35,14 +37,14 @@ const char* const function_names[] = {
   "join_v", "join_h", "cumsum_r", "cumsum_c",
   "ones", "zeroes", "rand", "randn", "rrange",
   "cmean", "rmean", "csum", "rsum", "cvar", "rvar",
-  "cmin", "cmax", "rmin", "rmax",
+  "cmin", "cmax", "rmin", "rmax", "describe",
   "roots", "pval", "integrate", "fzero", "set_intg_tol", "set_f0_tol",
   "rcl", "sto","pr","saveregs","loadregs","clregs","ffr",
-  "print", "pm", "ps", "setprec","sfs","undo",
+  "print", "pm", "ps", "setprec","setthreads","lazy","sfs","undo","redo",
   ".*", "./", ".^",
   "eq","leq","lt","gt","geq","neq","and","or","not",
   "ddays","today","dateplus","dow","edmy","num2date","days2eoy",
-  "listwords",  "loadwords", "savewords", "delword", "selword","clrwords", "listmacros",
+  "listwords",  "loadwords", "savewords", "delword", "selword","clrwords", "listmacros", "listfusions", "poolstats",
   "clrhist",
   "top_eq0?", "top_ge0?",  "top_gt0?", "top_le0?",  "top_lt0?",
   "top_eg?", "top_ge?",  "top_gt?", "top_le?",  "top_lt?",
@@ -53,3 +55,22 @@ const char* const function_names[] = {
   "sunrise","sunset","dawn","dusk",
   NULL
 };
+
+// **************** Name -> opcode registry ****************
+// The opcode of a builtin is its index in function_names. Names are
+// resolved through the symbol table, which interns every builtin up front.
+
+int function_count(void) {
+  static int count = -1;
+  if (count < 0)
+    for (count = 0; function_names[count] != NULL; count++) {}
+  return count;
+}
+
+int function_opcode_n(const char* name, size_t len) {
+  return symbol_opcode(lookup_symbol(name, len));
+}
+
+int function_opcode(const char* name) {
+  return function_opcode_n(name, strlen(name));
+}
@@ -35,6 +35,10 @@ double fsolve_tolerance = 1.0e-6;
 #include <stdio.h>            // for fprintf, fclose, fopen, perror, stderr
 #include <stdlib.h>           // for atoi
 #include <string.h>           // for strcmp, strchr, strcspn, strncpy
+#include "lazy.h"             // for lazy_mode
+#include "parallel.h"         // for thread_count, parallel_min_elements
+#include "pool.h"             // for pool_retain_mb
+#include "undo.h"             // for undo_budget_mb, undo_levels
 
 int set_print_precision(Stack* stack) {
   if (stack->top < 0) {
@@ -64,6 +68,35 @@ int set_print_precision(Stack* stack) {
   return 0;
 }
 
+int set_thread_count(Stack* stack) {
+  if (stack->top < 0) {
+    fprintf(stderr, "Error: Stack underflow. Expected number of threads\n");
+    return 1;
+  }
+
+  stack_element elem = stack->items[stack->top--];
+  int threads;
+  if (elem.type == TYPE_REAL) {
+    threads = (int)elem.real;
+  } else if (elem.type == TYPE_COMPLEX) {
+    if (GSL_IMAG(elem.complex_val) != 0.0) {
+      fprintf(stderr, "Error: Complex value must be real to set threads\n");
+      return 1;
+    }
+    threads = (int)GSL_REAL(elem.complex_val);
+  } else {
+    fprintf(stderr, "Error: Expected number on stack to set threads\n");
+    return 1;
+  }
+  if (threads < 0 || threads > PARALLEL_MAX_THREADS) {
+    fprintf(stderr, "Error: Thread count %d is out of valid range (0–%d, 0 = one per core)\n",
+            threads, PARALLEL_MAX_THREADS);
+    return 1;
+  }
+  thread_count = threads;
+  return 0;
+}
+
 void swap_fixed_scientific(void) {
   fixed_point = !fixed_point;
 }
@@ -79,6 +112,14 @@ void save_config(const char* filename) {
   fprintf(f, "fixed_point = %d\n", fixed_point);
   fprintf(f, "verbose_mode = %d\n", verbose_mode);
   fprintf(f, "selected_function = %d\n", selected_function);
+  fprintf(f, "stack_soft_limit = %d\n", stack_soft_limit);
+  fprintf(f, "stack_hard_limit = %d\n", stack_hard_limit);
+  fprintf(f, "undo_levels = %d\n", undo_levels);
+  fprintf(f, "undo_budget_mb = %d\n", undo_budget_mb);
+  fprintf(f, "pool_retain_mb = %d\n", pool_retain_mb);
+  fprintf(f, "threads = %d\n", thread_count);
+  fprintf(f, "parallel_min_elements = %d\n", parallel_min_elements);
+  fprintf(f, "lazy_mode = %d\n", lazy_mode);
 
   fclose(f);
 }
@@ -103,8 +144,10 @@ int load_config(const char* filename) {
     char* key = line;
     char* value = equal_sign + 1;
 
-    // Trim leading spaces from value
+    // Trim leading spaces from value, and the spaces save_config writes
+    // before the '=' from the key
     while (*value == ' ') value++;
+    for (char* end = equal_sign; end > key && end[-1] == ' '; ) *--end = '\0';
 
     if (strcmp(key, "print_precision") == 0) {
       print_precision = atoi(value);
@@ -114,6 +157,22 @@ int load_config(const char* filename) {
       verbose_mode = atoi(value);
     } else if (strcmp(key, "selected_function") == 0) {
       selected_function = atoi(value);
+    } else if (strcmp(key, "stack_soft_limit") == 0) {
+      if (atoi(value) > 0) stack_soft_limit = atoi(value);
+    } else if (strcmp(key, "stack_hard_limit") == 0) {
+      if (atoi(value) >= STACK_INITIAL_CAPACITY) stack_hard_limit = atoi(value);
+    } else if (strcmp(key, "undo_levels") == 0) {
+      if (atoi(value) >= 0) undo_levels = atoi(value);
+    } else if (strcmp(key, "undo_budget_mb") == 0) {
+      if (atoi(value) >= 0) undo_budget_mb = atoi(value);
+    } else if (strcmp(key, "pool_retain_mb") == 0) {
+      if (atoi(value) >= 0) pool_retain_mb = atoi(value);
+    } else if (strcmp(key, "threads") == 0) {
+      if (atoi(value) >= 0 && atoi(value) <= PARALLEL_MAX_THREADS) thread_count = atoi(value);
+    } else if (strcmp(key, "parallel_min_elements") == 0) {
+      if (atoi(value) > 0) parallel_min_elements = atoi(value);
+    } else if (strcmp(key, "lazy_mode") == 0) {
+      lazy_mode = atoi(value);
     } else if (strcmp(key, "path_to_data_and_programs") == 0) {
       strncpy(path_to_data_and_programs, value, MAX_PATH - 1);
       path_to_data_and_programs[MAX_PATH - 1] = '\0';
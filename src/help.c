@@ -37,7 +37,7 @@ void help_menu(void) {
   printf("    Enter inline matrices as in J language [#rows #cols $ values]. \n");
   printf("    Example: [2 2 $ -1 2 5 1]. Matrix entries can be real or complex.\n");
   printf("    Read matrix from file as [#rows, #cols, \"filename\"].\n");
-  printf("    You can undo the last line entry with undo.\n");
+  printf("    You can undo line entries with undo and redo them with redo.\n");
   subtitle("Stack manipulations");
   printf("    drop, dup, swap, clst, nip, tuck, roll, over, savestack, loadstack\n");
   subtitle("Math functions");
@@ -61,7 +61,7 @@ void help_menu(void) {
   printf("    Manipulation: reshape, diag, to_diag, split_mat, join_h, join_v \n");
   printf("    Cummulative sums and products: cumsum_r, cumsum_c, cumprod_r, cumprod_c \n");  
   printf("    Basic matrix statistics: csum, rsum, cmean, rmean, cvar, rvar\n");  
-  printf("    Matrix min and max: cmin, rmin, cmax, rmax\n");  
+  printf("    Matrix min and max: cmin, rmin, cmax, rmax, describe {all column statistics}\n");  
   printf("    Linear algebra: tran, {also '}, det, minv, pinv, chol, eig, svd\n");  
   subtitle("Register functions");
   printf("    sto, rcl, pr {print registers}, saveregs, load, ffr {1st free register} \n");
@@ -75,6 +75,10 @@ void help_menu(void) {
   printf("    listfcns {list built in functions}\n");
   printf("    listmacros {list predefined macros}\n");
   printf("    listwords {list user-defined words}\n");
+  printf("    listfusions {list fused instruction sequences}\n");
+  printf("    poolstats {matrix pool hit rate and retained memory}\n");
+  printf("    setthreads {threads for large matrix operations, 0 = one per core}\n");
+  printf("    lazy {fuse chains of elementwise matrix operators on/off}\n");
   printf("    new words start with : end with ;\n");
   printf("    Example to compute square : sq dup * ;\n");
   printf("\n");
@@ -214,11 +218,11 @@ const HelpEntry help_table[] = {
       "(1,2) im   (→ 2)" },
 
     { "abs",    "z -- |z|",
-      "Absolute value (magnitude for complex).",
+      "Absolute value (magnitude for complex), element by element for matrices.",
       "3 abs      (→ 3)" },
 
     { "arg",    "z -- arg(z)",
-      "Complex argument (phase) in radians.",
+      "Complex argument (phase) in radians, element by element for complex matrices.",
       "(0,1) arg  (→ pi/2)" },
 
     { "conj",   "z -- conj(z)",
@@ -399,7 +403,7 @@ const HelpEntry help_table[] = {
       "A eig      (→ V Λ)" },
 
     { "tran",   "A -- A^T",
-      "Matrix transpose.",
+      "Matrix transpose. Times a matrix, the transpose is passed to BLAS without being copied, so A tran B * and A tran A * cost no more than the product. This holds whether or not lazy mode is on.",
       "A tran" },
 
     { "reshape","A rows cols -- B",
@@ -419,11 +423,11 @@ const HelpEntry help_table[] = {
       "A split_mat" },
 
     { "'",      "A -- A^T",
-      "Matrix transpose (short form).",
+      "Matrix transpose (short form). X ' y * and X ' X * never copy X, with or without lazy mode.",
       "A '" },
 
     { "kron",   "A B -- A ⊗ B",
-      "Kronecker product of two matrices.",
+      "Kronecker product of two matrices. In lazy mode, (A ⊗ B) X is computed from A and B without forming A ⊗ B.",
       "A B kron" },
 
     { "diag",   "v -- D   or   A -- diag(v)",
@@ -475,11 +479,11 @@ const HelpEntry help_table[] = {
       "2 3 zeroes" },
 
     { "rand",   "rows cols -- A",
-      "Matrix of uniform(0,1) randoms.",
+      "Matrix of uniform(0,1) randoms. Beyond 65536 elements each chunk draws from its own generator seeded off the main one.",
       "2 2 rand" },
 
     { "randn",  "rows cols -- A",
-      "Matrix of standard normal randoms.",
+      "Matrix of standard normal randoms. Beyond 65536 elements each chunk draws from its own generator seeded off the main one.",
       "2 2 randn" },
 
     { "rrange", "start step end -- v",
@@ -526,6 +530,10 @@ const HelpEntry help_table[] = {
       "Maximum of each row.",
       "A rmax" },
 
+    { "describe", "A -- A stats",
+      "Sum, mean, variance, min and max of each column in one pass, as the rows of a 5 x n matrix.",
+      "A describe" },
+
     /* --- Polynomials / integration / roots --- */
     { "roots",  "coeffs -- r1 r2 ...",
       "Roots of polynomial with given coefficients.",
@@ -597,14 +605,26 @@ const HelpEntry help_table[] = {
       "Set number of digits for printing.",
       "10 setprec" },
 
+    { "setthreads","n --",
+      "Set the threads large elementwise matrix operations and random fills share; 0 uses one per core.",
+      "4 setthreads" },
+
+    { "lazy",   "--",
+      "Toggle lazy mode: chains of + - * / .* ./ .^ on real matrices and scalars are computed in one pass when their value is needed. Transposes stay uncopied views in either mode.",
+      "lazy A 2 .^ 3 .* 1 +" },
+
     { "sfs",    "n --",
       "Set field width/significant figures (see your printing code).",
       "15 sfs" },
 
     { "undo",   "--",
-      "Undo last stack operation (if history enabled).",
+      "Undo the last line that changed the stack; repeat to go further back.",
       "undo" },
 
+    { "redo",   "--",
+      "Redo the last undone line.",
+      "redo" },
+
     /* --- Element-wise array ops --- */
     { ".*",     "A B -- C",
       "Element-wise (Hadamard) product of matrices/vectors.",
@@ -713,8 +733,16 @@ const HelpEntry help_table[] = {
       "List available macros/programs.",
       "listmacros" },
 
+    { "listfusions","--",
+      "List sequences fused into single instructions in words and macros.",
+      "listfusions" },
+
+    { "poolstats","--",
+      "Show matrix pool requests, hit rate and memory kept on the free lists.",
+      "poolstats" },
+
     { "clrhist","--",
-      "Clear command/history buffer (and/or undo history).",
+      "Clear command history and undo history.",
       "clrhist" },
 
     /* --- Top / counter tests (conditionals) --- */
@@ -948,7 +976,7 @@ int op_usage(Stack *stack)
 
     if (name[0] == '\0') {
         fprintf(stderr, "usage: empty string is not a valid word name.\n");
-        free(e.string);
+        string_release(e.string);
         return 0;
     }
 
@@ -960,7 +988,7 @@ int op_usage(Stack *stack)
     skip_stack_printing = true;
 
     /* We own the string memory, so free it after use */
-    free(e.string);
+    string_release(e.string);
 
     return 1;
 }
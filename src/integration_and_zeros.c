@@ -22,7 +22,7 @@
 #include <math.h>                   // for fabs, pow
 #include <stdbool.h>                // for false, bool, true
 #include <stdio.h>                  // for fprintf, stderr
-#include "eval_fun.h"               // for evaluate_line
+#include "bytecode.h"               // for run_user_word
 #include "globals.h"                // for fsolve_tolerance, intg_tolerance
 #include "integration_and_zeros.h"  // for bisection, find_zero, integrate
 #include "stack.h"                  // for (anonymous struct)::(anonymous), pop
@@ -137,8 +137,9 @@ double stack_helper(double x) {
 
   init_stack(&integration_stack);
   push_real(&integration_stack,x);
-  evaluate_line(&integration_stack, words[selected_function].name);
+  run_user_word(&integration_stack, &words[selected_function]);
   stack_element a = pop(&integration_stack);
+  free_stack(&integration_stack);
   return a.real;
 }
 
@@ -0,0 +1,493 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// A lazy expression is a small RPN program: operand steps push a matrix or
+// a scalar, operator steps combine the top two, just as the calculator
+// would. Appending one expression to another is how `A B +` combines them.
+// Forcing runs the program a block of elements at a time, so the partial
+// results live in cache-sized scratch buffers instead of full temporary
+// matrices, and every operator uses the same simd_kernels loop the eager
+// path does, giving the same bits.
+//
+// A Kronecker product A ⊗ B is another kind of lazy expression. It is
+// kept as its two factors, and times a matrix X it is computed from them
+// without ever forming A ⊗ B.
+//
+// A transpose Xᵀ is the third: a view of X that the product hands to BLAS
+// as CblasTrans, so `X' X` and `X' y` never copy X. Only a view something
+// other than a product needs is materialized, with the blocked transpose.
+
+#include <gsl/gsl_blas.h>      // for gsl_blas_dgemm
+#include <gsl/gsl_matrix_double.h>  // for gsl_matrix_view_array, gsl_matrix_column
+#include <gsl/gsl_vector_double.h>  // for gsl_vector_view_array, gsl_vector_memcpy
+#include <stdio.h>              // for fprintf, stderr
+#include <stdlib.h>             // for malloc, free
+#include <string.h>             // for memcpy
+#include "lazy.h"
+#include "binary_fun.h"         // for kronecker_real
+#include "function_list.h"      // for function_opcode, OPCODE_NONE
+#include "linear_algebra.h"     // for transpose_real
+#include "parallel.h"           // for parallel_for
+#include "pool.h"               // for pool_matrix_alloc
+#include "refcount.h"           // for payload_retain, payload_shared
+#include "simd_kernels.h"       // for simd_real, simd_real_scalar, simd_op
+
+// Elements per block; LAZY_MAX_STEPS scratch blocks of this many doubles
+// fit in the level 1 cache of most CPUs
+#define LAZY_BLOCK 256
+
+bool lazy_mode = false;
+int lazy_live = 0;
+
+typedef enum {
+  STEP_MATRIX,                  // owns one reference to m
+  STEP_SCALAR,
+  STEP_OP
+} step_kind;
+
+typedef struct {
+  step_kind kind;
+  simd_op op;
+  double s;
+  gsl_matrix* m;
+} lazy_step;
+
+typedef enum {
+  LAZY_CHAIN,                   // steps
+  LAZY_KRON,                    // factor[0] ⊗ factor[1]
+  LAZY_TRANSPOSE                // factor[0]ᵀ
+} lazy_kind;
+
+struct lazy_expr {
+  lazy_kind kind;
+  size_t rows, cols;
+  int count;                    // steps; 0 unless a chain
+  gsl_matrix* factor[2];        // each owning a reference, or NULL
+  lazy_step steps[LAZY_MAX_STEPS];
+};
+
+void toggle_lazy_mode(void) {
+  lazy_mode = !lazy_mode;
+}
+
+// **************** Lifetime ****************
+void lazy_free(lazy_expr* e) {
+  if (!e) return;
+  for (int k = 0; k < e->count; k++)
+    if (e->steps[k].kind == STEP_MATRIX) matrix_release(e->steps[k].m);
+  for (int k = 0; k < 2; k++)
+    if (e->kind != LAZY_CHAIN && e->factor[k]) matrix_release(e->factor[k]);
+  free(e);
+  lazy_live--;
+}
+
+lazy_expr* lazy_clone(const lazy_expr* e) {
+  lazy_expr* copy = malloc(sizeof(lazy_expr));
+  if (!copy) return NULL;
+  *copy = *e;
+  if (copy->kind != LAZY_CHAIN) {
+    if (payload_retain(copy->factor[0]) != 0) {
+      free(copy);
+      return NULL;
+    }
+    if (copy->factor[1] && payload_retain(copy->factor[1]) != 0) {
+      matrix_release(copy->factor[0]);
+      free(copy);
+      return NULL;
+    }
+  }
+  for (int k = 0; k < copy->count; k++)
+    if (copy->steps[k].kind == STEP_MATRIX && payload_retain(copy->steps[k].m) != 0) {
+      copy->count = k;          // release what was retained so far
+      lazy_live++;
+      lazy_free(copy);
+      return NULL;
+    }
+  lazy_live++;
+  return copy;
+}
+
+// **************** Building ****************
+// Steps an operand adds to an expression, with its shape (0 x 0 for a
+// scalar), or 0 if it cannot be part of one
+static int operand_steps(const stack_element* e, size_t* rows, size_t* cols) {
+  switch (e->type) {
+  case TYPE_REAL:
+    *rows = *cols = 0;
+    return 1;
+  case TYPE_MATRIX_REAL:
+    if (e->matrix_real->tda != e->matrix_real->size2) return 0;
+    *rows = e->matrix_real->size1;
+    *cols = e->matrix_real->size2;
+    return 1;
+  case TYPE_LAZY:               // only a chain has steps
+    *rows = e->lazy->rows;
+    *cols = e->lazy->cols;
+    return e->lazy->count;
+  default:
+    return 0;
+  }
+}
+
+// Moves e's steps, and its matrix reference, to the end of x
+static void append_operand(lazy_expr* x, stack_element* e) {
+  switch (e->type) {
+  case TYPE_REAL:
+    x->steps[x->count++] = (lazy_step){ .kind = STEP_SCALAR, .s = e->real };
+    break;
+  case TYPE_MATRIX_REAL:
+    x->steps[x->count++] = (lazy_step){ .kind = STEP_MATRIX, .m = e->matrix_real };
+    break;
+  case TYPE_LAZY:
+    if (e->lazy != x) {
+      memcpy(&x->steps[x->count], e->lazy->steps, (size_t)e->lazy->count * sizeof(lazy_step));
+      x->count += e->lazy->count;
+      free(e->lazy);
+      lazy_live--;
+    }
+    break;
+  default:
+    return;
+  }
+  *e = (stack_element){ .type = TYPE_REAL, .real = 0.0 };
+}
+
+// **************** Kronecker products ****************
+int lazy_kron(Stack* stack) {
+  if (stack->top < 1) return 0;
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+  if (a->type != TYPE_MATRIX_REAL || b->type != TYPE_MATRIX_REAL) return 0;
+
+  lazy_expr* x = malloc(sizeof(lazy_expr));
+  if (!x) return 0;
+  lazy_live++;
+  x->kind = LAZY_KRON;
+  x->rows = a->matrix_real->size1 * b->matrix_real->size1;
+  x->cols = a->matrix_real->size2 * b->matrix_real->size2;
+  x->count = 0;
+  x->factor[0] = a->matrix_real;  // the references move from the stack
+  x->factor[1] = b->matrix_real;
+
+  a->type = TYPE_LAZY;
+  a->lazy = x;
+  stack->top--;
+  return 1;
+}
+
+// (A ⊗ B) X for the A ⊗ B and X on top of the stack. Column c of X, read
+// row by row as an A-columns x B-columns matrix Xc, maps to A Xc Bᵀ, which
+// read row by row is column c of the result: two small products per column
+// instead of one with the rows x columns of A ⊗ B. Returns 0, or -1 with
+// the stack untouched.
+static int kron_times(Stack* stack) {
+  stack_element* k = &stack->items[stack->top - 1];
+  stack_element* x = &stack->items[stack->top];
+  const gsl_matrix* A = k->lazy->factor[0];
+  const gsl_matrix* B = k->lazy->factor[1];
+  const gsl_matrix* X = x->matrix_real;
+  size_t ar = A->size1, ac = A->size2, br = B->size1, bc = B->size2;
+
+  // Column c of X, read row by row, is the ac x bc matrix Xc, and column
+  // c of the result is A Xc B^T read the same way. A single column is
+  // used in place; otherwise each column is copied through a strided view.
+  int single = X->size2 == 1 && X->tda == 1;
+  gsl_matrix* out = pool_matrix_alloc(ar * br, X->size2);
+  gsl_matrix* xc = single ? NULL : pool_matrix_alloc(ac, bc);
+  gsl_matrix* xbt = pool_matrix_alloc(ac, br);
+  gsl_matrix* y = single ? NULL : pool_matrix_alloc(ar, br);
+  int status = (out && xbt && (single || (xc && y))) ? 0 : -1;
+  if (status == 0 && single) {
+    gsl_matrix_const_view xv = gsl_matrix_const_view_array(X->data, ac, bc);
+    gsl_matrix_view yv = gsl_matrix_view_array(out->data, ar, br);
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, &xv.matrix, B, 0.0, xbt);
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, A, xbt, 0.0, &yv.matrix);
+  } else if (status == 0) {
+    gsl_vector_view xc_flat = gsl_vector_view_array(xc->data, ac * bc);
+    gsl_vector_view y_flat = gsl_vector_view_array(y->data, ar * br);
+    for (size_t c = 0; c < X->size2; c++) {
+      gsl_vector_const_view column = gsl_matrix_const_column(X, c);
+      gsl_vector_memcpy(&xc_flat.vector, &column.vector);
+      gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, xc, B, 0.0, xbt);
+      gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, A, xbt, 0.0, y);
+      gsl_vector_view out_column = gsl_matrix_column(out, c);
+      gsl_vector_memcpy(&out_column.vector, &y_flat.vector);
+    }
+  } else {
+    fprintf(stderr, "Memory allocation failed\n");
+    if (out) pool_matrix_free(out);
+  }
+  if (xc) pool_matrix_free(xc);
+  if (xbt) pool_matrix_free(xbt);
+  if (y) pool_matrix_free(y);
+  if (status != 0) return -1;
+
+  stack_element_free(k);
+  stack_element_free(x);
+  *k = (stack_element){ .type = TYPE_MATRIX_REAL, .matrix_real = out };
+  stack->top--;
+  return 0;
+}
+
+int lazy_binary(Stack* stack, token_type tok) {
+  simd_op op;
+  int matrix_pair = 1;          // whether two matrices combine elementwise
+  switch (tok) {
+  case TOK_PLUS:      op = SIMD_ADD; break;
+  case TOK_MINUS:     op = SIMD_SUB; break;
+  case TOK_STAR:      op = SIMD_MUL; matrix_pair = 0; break;   // matrix product
+  case TOK_SLASH:     op = SIMD_DIV; matrix_pair = 0; break;   // times the inverse
+  case TOK_DOT_STAR:  op = SIMD_MUL; break;
+  case TOK_DOT_SLASH: op = SIMD_DIV; break;
+  case TOK_DOT_CARET: op = SIMD_POW; break;
+  default: return 0;            // ^ of a matrix is a matrix power
+  }
+  if (stack->top < 1) return 0;
+
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+  size_t ar, ac, br, bc;
+  int an = operand_steps(a, &ar, &ac);
+  int bn = operand_steps(b, &br, &bc);
+  if (an == 0 || bn == 0) return 0;
+  if (ar == 0 && br == 0) return 0;                     // two scalars
+  if (ar != 0 && br != 0 && (!matrix_pair || ar != br || ac != bc)) return 0;
+
+  // A chain too long for one expression carries on from its value
+  if (an + bn + 1 > LAZY_MAX_STEPS && a->type == TYPE_LAZY) {
+    if (lazy_force(a) != 0) return 0;
+    an = 1;
+  }
+  if (an + bn + 1 > LAZY_MAX_STEPS && b->type == TYPE_LAZY) {
+    if (lazy_force(b) != 0) return 0;
+    bn = 1;
+  }
+
+  lazy_expr* x = (a->type == TYPE_LAZY) ? a->lazy : NULL;
+  if (!x) {
+    x = malloc(sizeof(lazy_expr));
+    if (!x) return 0;
+    x->kind = LAZY_CHAIN;
+    x->rows = ar ? ar : br;
+    x->cols = ar ? ac : bc;
+    x->count = 0;
+    lazy_live++;
+  }
+  append_operand(x, a);
+  append_operand(x, b);
+  x->steps[x->count++] = (lazy_step){ .kind = STEP_OP, .op = op };
+
+  a->type = TYPE_LAZY;
+  a->lazy = x;
+  stack->top--;
+  return 1;
+}
+
+// **************** Transposes ****************
+static int lazy_transpose(Stack* stack) {
+  if (stack->top < 0) return 0;
+  stack_element* e = &stack->items[stack->top];
+
+  // (Xᵀ)ᵀ is X again
+  if (e->type == TYPE_LAZY && e->lazy->kind == LAZY_TRANSPOSE) {
+    gsl_matrix* m = e->lazy->factor[0];
+    e->lazy->factor[0] = NULL;        // the reference moves to the stack
+    lazy_free(e->lazy);
+    *e = (stack_element){ .type = TYPE_MATRIX_REAL, .matrix_real = m };
+    return 1;
+  }
+  if (e->type == TYPE_LAZY && lazy_force(e) != 0) return 0;
+  if (e->type != TYPE_MATRIX_REAL) return 0;
+
+  lazy_expr* x = malloc(sizeof(lazy_expr));
+  if (!x) return 0;
+  lazy_live++;
+  x->kind = LAZY_TRANSPOSE;
+  x->rows = e->matrix_real->size2;
+  x->cols = e->matrix_real->size1;
+  x->count = 0;
+  x->factor[0] = e->matrix_real;
+  x->factor[1] = NULL;
+  e->type = TYPE_LAZY;
+  e->lazy = x;
+  return 1;
+}
+
+// A product operand as BLAS takes it, or NULL if it is neither a real
+// matrix nor a transposed one
+static const gsl_matrix* blas_operand(const stack_element* e, CBLAS_TRANSPOSE_t* trans) {
+  if (e->type == TYPE_MATRIX_REAL) {
+    *trans = CblasNoTrans;
+    return e->matrix_real;
+  }
+  if (e->type == TYPE_LAZY && e->lazy->kind == LAZY_TRANSPOSE) {
+    *trans = CblasTrans;
+    return e->lazy->factor[0];
+  }
+  return NULL;
+}
+
+// Xᵀ X or X Xᵀ: dsyrk computes the upper triangle, half the work of dgemm,
+// and the lower one is copied from it
+static void gram(const gsl_matrix* x, CBLAS_TRANSPOSE_t trans, gsl_matrix* out) {
+  gsl_blas_dsyrk(CblasUpper, trans, 1.0, x, 0.0, out);
+  for (size_t i = 0; i < out->size1; i++)
+    for (size_t j = 0; j < i; j++)
+      out->data[i * out->tda + j] = out->data[j * out->tda + i];
+}
+
+// The product of the top two when either is a transposed real matrix and
+// the other a real one, straight from the matrices the views hold.
+// Returns 0, or -1 with the stack untouched.
+static int transpose_times(Stack* stack) {
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+  CBLAS_TRANSPOSE_t ta, tb;
+  const gsl_matrix* A = blas_operand(a, &ta);
+  const gsl_matrix* B = blas_operand(b, &tb);
+  size_t rows = (ta == CblasTrans) ? A->size2 : A->size1;
+  size_t cols = (tb == CblasTrans) ? B->size1 : B->size2;
+
+  gsl_matrix* out = pool_matrix_alloc(rows, cols);
+  if (!out) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+  if (A == B && ta != tb) gram(A, ta, out);
+  else gsl_blas_dgemm(ta, tb, 1.0, A, B, 0.0, out);
+
+  stack_element_free(a);
+  stack_element_free(b);
+  *a = (stack_element){ .type = TYPE_MATRIX_REAL, .matrix_real = out };
+  stack->top--;
+  return 0;
+}
+
+int lazy_product(Stack* stack, token_type tok) {
+  if (tok != TOK_STAR || stack->top < 1) return 0;
+  stack_element* a = &stack->items[stack->top - 1];
+  stack_element* b = &stack->items[stack->top];
+
+  if (a->type == TYPE_LAZY && a->lazy->kind == LAZY_KRON)
+    return b->type == TYPE_MATRIX_REAL && b->matrix_real->size1 == a->lazy->cols &&
+           kron_times(stack) == 0;
+
+  CBLAS_TRANSPOSE_t ta, tb;
+  const gsl_matrix* A = blas_operand(a, &ta);
+  const gsl_matrix* B = blas_operand(b, &tb);
+  if (!A || !B || (ta == CblasNoTrans && tb == CblasNoTrans)) return 0;
+  // Shapes that do not fit are left for the eager product to report
+  size_t inner_a = (ta == CblasTrans) ? A->size1 : A->size2;
+  size_t inner_b = (tb == CblasTrans) ? B->size2 : B->size1;
+  if (inner_a != inner_b) return 0;
+  return transpose_times(stack) == 0;
+}
+
+int lazy_builtin(Stack* stack, int opcode) {
+  static int tran = OPCODE_NONE, quote = OPCODE_NONE, ready = 0;
+  if (!ready) {
+    tran = function_opcode("tran");
+    quote = function_opcode("'");
+    ready = 1;
+  }
+  if (opcode != OPCODE_NONE && (opcode == tran || opcode == quote))
+    return lazy_transpose(stack);
+  return 0;
+}
+
+// **************** Forcing ****************
+typedef struct {
+  const lazy_expr* x;
+  double* out;
+} force_job;
+
+typedef struct {
+  const double* v;              // NULL for a scalar
+  double s;
+} slot;
+
+static void force_slice(size_t begin, size_t end, void* arg) {
+  const force_job* job = arg;
+  const lazy_expr* x = job->x;
+  double scratch[LAZY_MAX_STEPS][LAZY_BLOCK];
+  slot operands[LAZY_MAX_STEPS];
+
+  for (size_t at = begin; at < end; at += LAZY_BLOCK) {
+    size_t n = end - at < LAZY_BLOCK ? end - at : LAZY_BLOCK;
+    int sp = 0;
+    for (int k = 0; k < x->count; k++) {
+      const lazy_step* st = &x->steps[k];
+      if (st->kind == STEP_MATRIX) {
+        operands[sp++] = (slot){ st->m->data + at, 0.0 };
+        continue;
+      }
+      if (st->kind == STEP_SCALAR) {
+        operands[sp++] = (slot){ NULL, st->s };
+        continue;
+      }
+      slot y = operands[--sp];
+      slot l = operands[--sp];
+      // The last operator writes the result block; operands are all read
+      // by then, so out may be one of them
+      double* o = (k == x->count - 1) ? job->out + at : scratch[sp];
+      if (!l.v) simd_real_scalar(st->op, y.v, l.s, o, n, 1);
+      else if (!y.v) simd_real_scalar(st->op, l.v, y.s, o, n, 0);
+      else simd_real(st->op, l.v, y.v, o, n);
+      operands[sp++] = (slot){ o, 0.0 };
+    }
+  }
+}
+
+int lazy_force(stack_element* e) {
+  if (e->type != TYPE_LAZY) return 0;
+  lazy_expr* x = e->lazy;
+
+  if (x->kind != LAZY_CHAIN) {
+    gsl_matrix* product = (x->kind == LAZY_KRON) ? kronecker_real(x->factor[0], x->factor[1])
+                                                 : transpose_real(x->factor[0]);
+    if (!product) return -1;
+    lazy_free(x);
+    e->type = TYPE_MATRIX_REAL;
+    e->matrix_real = product;
+    return 0;
+  }
+
+  // Write over an operand's matrix if nothing else holds it
+  int reuse = -1;
+  for (int k = 0; k < x->count && reuse < 0; k++)
+    if (x->steps[k].kind == STEP_MATRIX && !payload_shared(x->steps[k].m)) reuse = k;
+  gsl_matrix* out = (reuse >= 0) ? x->steps[reuse].m : pool_matrix_alloc(x->rows, x->cols);
+  if (!out) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return -1;
+  }
+
+  force_job job = { x, out->data };
+  parallel_for(x->rows * x->cols, LAZY_BLOCK, force_slice, &job);
+
+  if (reuse >= 0) x->steps[reuse].kind = STEP_SCALAR;   // keep it from lazy_free
+  lazy_free(x);
+  e->type = TYPE_MATRIX_REAL;
+  e->matrix_real = out;
+  return 0;
+}
+
+void lazy_force_top(Stack* stack, int n) {
+  for (int i = stack->top; i >= 0 && i > stack->top - n; i--)
+    lazy_force(&stack->items[i]);
+}
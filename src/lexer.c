@@ -20,11 +20,10 @@
 #include <stdbool.h>        // for true, bool, false
 #include <stdio.h>          // for size_t, snprintf, fprintf, stderr
 #include <stdlib.h>         // for free, calloc, realloc
-#include <string.h>         // for strncpy, memcpy, strcmp
-#include "function_list.h"  // for function_names
-#include "lexer.h"          // for Token, MAX_TOKEN_LEN, TOK_UNKNOWN, Lexer
-
-#define TEMP_BUF_SIZE (MAX_TOKEN_LEN * 4 - 1)
+#include <string.h>         // for memcpy, strlen
+#include "function_list.h"  // for function_opcode_n
+#include "symbols.h"        // for intern_symbol, lookup_symbol, symbol_opcode
+#include "lexer.h"          // for Token, TOK_UNKNOWN, Lexer
 
 void skip_whitespace(Lexer* lexer) {
   while (isspace((unsigned char)lexer->input[lexer->pos])) lexer->pos++;
@@ -89,19 +88,37 @@ static bool starts_number(const Lexer *lx)
   return false;
 }
 
-Token make_token(token_type type, const char* text) {
+Token make_slice(token_type type, const char* start, size_t len) {
   Token token;
-  strncpy(token.text, text, MAX_TOKEN_LEN - 1);
-  token.text[MAX_TOKEN_LEN - 1] = '\0';
   token.type = type;
+  token.text = start;
+  token.len = len;
+  token.owned = NULL;
+  token.symbol = (type == TOK_FUNCTION) ? lookup_symbol(start, len) : SYMBOL_NONE;
+  token.opcode = symbol_opcode(token.symbol);
   return token;
 }
 
+Token make_token(token_type type, const char* text) {
+  return make_slice(type, text, strlen(text));
+}
+
+// NUL-terminated heap copy of the token text; the caller frees it
+char* token_strdup(const Token* tok) {
+  char* s = malloc(tok->len + 1);
+  if (!s) return NULL;
+  memcpy(s, tok->text, tok->len);
+  s[tok->len] = '\0';
+  return s;
+}
+
+void free_token(Token* tok) {
+  free(tok->owned);
+  tok->owned = NULL;
+}
+
 bool is_function_name(const char* name) {
-  for (int i = 0; function_names[i]; i++) {
-    if (strcmp(name, function_names[i]) == 0) return true;
-  }
-  return false;
+  return function_opcode_n(name, strlen(name)) != OPCODE_NONE;
 }
 
 Token lex_number(Lexer* lexer) {
@@ -123,28 +140,20 @@ Token lex_number(Lexer* lexer) {
     while (isdigit((unsigned char)peek(lexer))) advance(lexer);
   }
 
-  size_t len = lexer->pos - start;
-
-  char buf[MAX_TOKEN_LEN] = {0};
-  size_t copy_len = (len >= (MAX_TOKEN_LEN - 1)) ? (MAX_TOKEN_LEN - 1) : len;
-  strncpy(buf, &lexer->input[start], copy_len);
-  buf[copy_len] = '\0';
-
-  return make_token(TOK_NUMBER, buf);
+  return make_slice(TOK_NUMBER, &lexer->input[start], lexer->pos - start);
 }
 
 Token lex_identifier(Lexer* lexer) {
   size_t start = lexer->pos;
   while (isalnum((unsigned char)peek(lexer)) || peek(lexer) == '_') advance(lexer);
 
+  // Interned here so everything downstream works with the symbol id
   size_t len = lexer->pos - start;
-
-  char buf[MAX_TOKEN_LEN] = {0};
-  size_t copy_len = (len >= (MAX_TOKEN_LEN - 1)) ? (MAX_TOKEN_LEN - 1) : len;
-  strncpy(buf, &lexer->input[start], copy_len);
-  buf[copy_len] = '\0';
-
-  return make_token(is_function_name(buf) ? TOK_FUNCTION : TOK_IDENTIFIER, buf);
+  Token tok = make_slice(TOK_IDENTIFIER, &lexer->input[start], len);
+  tok.symbol = intern_symbol(tok.text, len);
+  tok.opcode = symbol_opcode(tok.symbol);
+  if (tok.opcode != OPCODE_NONE) tok.type = TOK_FUNCTION;
+  return tok;
 }
 
 Token lex_string(Lexer* lexer) {
@@ -152,15 +161,9 @@ Token lex_string(Lexer* lexer) {
   size_t start = lexer->pos;
   while (peek(lexer) != '"' && peek(lexer) != '\0') advance(lexer);
 
-  size_t len = lexer->pos - start;
-
-  char buf[MAX_TOKEN_LEN] = {0};
-  size_t copy_len = (len >= (MAX_TOKEN_LEN - 1)) ? (MAX_TOKEN_LEN - 1) : len;
-  strncpy(buf, &lexer->input[start], copy_len);
-  buf[copy_len] = '\0';
-
+  Token tok = make_slice(TOK_STRING, &lexer->input[start], lexer->pos - start);
   match(lexer, '"');
-  return make_token(TOK_STRING, buf);
+  return tok;
 }
 
 Token lex_complex(Lexer* lexer) {
@@ -168,42 +171,38 @@ Token lex_complex(Lexer* lexer) {
 
   if (!match(lexer, '(')) return make_token(TOK_UNKNOWN, "(");
 
-  Token real = lex_number(lexer);
+  lex_number(lexer);
 
   if (!match(lexer, ',')) {
     lexer->pos = start_pos;
     return make_token(TOK_UNKNOWN, "(");
   }
 
-  Token imag = lex_number(lexer);
+  lex_number(lexer);
 
   if (!match(lexer, ')')) {
     lexer->pos = start_pos;
     return make_token(TOK_UNKNOWN, "(");
   }
 
-  char temp_buf[TEMP_BUF_SIZE];
-  snprintf(temp_buf, sizeof(temp_buf), "(%s,%s)", real.text, imag.text);
-
-  return make_token(TOK_COMPLEX, temp_buf);
+  // "(re,im)" exactly as written
+  return make_slice(TOK_COMPLEX, &lexer->input[start_pos], lexer->pos - start_pos);
 }
 
 Token lex_matrix_file(Lexer* lexer) {
   size_t start_pos = lexer->pos;
 
-  Token row = lex_number(lexer);
+  lex_number(lexer);
   if (!match(lexer, ',')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
 
-  Token col = lex_number(lexer);
+  lex_number(lexer);
   if (!match(lexer, ',')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
 
-  Token str = lex_string(lexer);
+  lex_string(lexer);
   if (!match(lexer, ']')) { lexer->pos = start_pos; return make_token(TOK_UNKNOWN, "["); }
 
-  char temp_buf[TEMP_BUF_SIZE];
-  snprintf(temp_buf, sizeof(temp_buf), "[%s,%s,\"%s\"]", row.text, col.text, str.text);
-
-  return make_token(TOK_MATRIX_FILE, temp_buf);
+  // "[rows,cols,"file"]" including the opening bracket eaten by next_token
+  return make_slice(TOK_MATRIX_FILE, &lexer->input[start_pos - 1], lexer->pos - start_pos + 1);
 }
 
 static Token lex_matrix_inline_j(Lexer* lexer) {
@@ -233,66 +232,29 @@ static Token lex_matrix_inline_j(Lexer* lexer) {
 
   skip_whitespace(lexer);
 
-  // Dynamic buffer for accumulating matrix content
-  size_t cap = 256;
-  size_t len = 0;
-  char* buf = calloc(cap, 1);
-  if (!buf) return make_token(TOK_UNKNOWN, "["); // Allocation failed
-
-  // Prepend "rows cols $"
-  int written = snprintf(buf, cap, "%s %s $", rows.text, cols.text);
-  if (written < 0 || (size_t)written >= cap) {
-    free(buf);
-    return make_token(TOK_UNKNOWN, "[");
-  }
-  len = (size_t)written;
-
+  // Scan and classify the elements; parse_inline_matrix converts them later
+  // straight from the input, so nothing is copied here.
   bool has_real = false;
   bool has_complex = false;
-  char temp[MAX_TOKEN_LEN * 2];
 
   while (peek(lexer) != '\0' && peek(lexer) != ']') {
     skip_whitespace(lexer);
 
-    Token t;
     if (peek(lexer) == '(') {
-      t = lex_complex(lexer);
+      Token t = lex_complex(lexer);
+      if (t.type != TOK_COMPLEX) break;   // lex_complex did not advance
       has_complex = true;
     } else if (starts_number(lexer)) {
-      t = lex_number(lexer);
+      lex_number(lexer);
       has_real = true;
     } else {
       break;
     }
 
-    written = snprintf(temp, sizeof(temp), " %s", t.text);
-    if (written < 0 || (size_t)written >= sizeof(temp)) {
-      fprintf(stderr, "token too long to format\n");
-      continue;
-    }
-
-    if (len + (size_t)written + 1 >= cap) {
-      // Loop, not a single doubling: one token can be larger than 2*cap
-      // (a long numeric literal), in which case a single doubling still
-      // overflows the following memcpy.
-      while (len + (size_t)written + 1 >= cap)
-        cap *= 2;
-      char* new_buf = realloc(buf, cap);
-      if (!new_buf) {
-        free(buf);
-        return make_token(TOK_UNKNOWN, "[");
-      }
-      buf = new_buf;
-    }
-
-    memcpy(buf + len, temp, (size_t)written + 1);
-    len += (size_t)written;
-
     skip_whitespace(lexer);
   }
 
   if (!match(lexer, ']')) {
-    free(buf);
     lexer->pos = start_pos;
     return make_token(TOK_UNKNOWN, "[");
   }
@@ -301,9 +263,8 @@ static Token lex_matrix_inline_j(Lexer* lexer) {
     : has_complex          ? TOK_MATRIX_INLINE_COMPLEX
     :                        TOK_MATRIX_INLINE_REAL;
 
-  Token result = make_token(type, buf);
-  free(buf);
-  return result;
+  // "rows cols $ e1 e2 ..." without the brackets
+  return make_slice(type, &lexer->input[start_pos], lexer->pos - 1 - start_pos);
 }
 
 Token next_token(Lexer* lexer) {
@@ -313,7 +274,11 @@ Token next_token(Lexer* lexer) {
   if (c == '\0') return make_token(TOK_EOF, "<EOF>");
 
   if (starts_number(lexer)) return lex_number(lexer);
-  if (c == '(') return lex_complex(lexer);
+  if (c == '(') {
+    Token t = lex_complex(lexer);
+    if (t.type != TOK_COMPLEX) advance(lexer);   // skip the stray '('
+    return t;
+  }
 
   if (c == '[') {
     size_t start_pos = lexer->pos;
@@ -31,6 +31,9 @@
 #include <gsl/gsl_vector_double.h>          // for gsl_vector_free, gsl_vect...
 #include <math.h>                           // for fabs, isnan
 #include <stdio.h>                          // for fprintf, stderr, size_t
+#include "parallel.h"                       // for parallel_for
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_kernels.h"                   // for simd_transpose
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "linear_algebra.h"                 // for matrix_cholesky, matrix_d...
 
@@ -49,8 +52,8 @@ int matrix_inverse(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix* inv = gsl_matrix_alloc(n, n);
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* inv = pool_matrix_alloc(n, n);
+    gsl_matrix* tmp = pool_matrix_alloc(n, n);
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
@@ -59,10 +62,10 @@ int matrix_inverse(Stack* stack) {
     int status = gsl_linalg_LU_decomp(tmp, p, &signum);
     if (status != GSL_SUCCESS) {
       fprintf(stderr, "LU decomposition failed\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      pool_matrix_free(inv);
+      pool_matrix_free(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real);
+      matrix_release(m.matrix_real);
       return 1;
     }
 
@@ -70,25 +73,25 @@ int matrix_inverse(Stack* stack) {
     double det = gsl_linalg_LU_det(tmp, signum);
     if ((det == 0.0) || (isnan(det))) {
       fprintf(stderr,"Matrix is singular, cannot invert\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      pool_matrix_free(inv);
+      pool_matrix_free(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real); // free popped matrix
+      matrix_release(m.matrix_real); // free popped matrix
       return 1;
     }
 
     // Now safe to invert
     if (gsl_linalg_LU_invert(tmp, p, inv) != 0) {
       fprintf(stderr,"Matrix inversion failed\n");
-      gsl_matrix_free(inv);
-      gsl_matrix_free(tmp);
+      pool_matrix_free(inv);
+      pool_matrix_free(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_free(m.matrix_real);
+      matrix_release(m.matrix_real);
     }
 
-    gsl_matrix_free(tmp);
+    pool_matrix_free(tmp);
     gsl_permutation_free(p);
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     push_matrix_real(stack, inv);
     return 0;
 
@@ -99,8 +102,8 @@ int matrix_inverse(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix_complex* inv = gsl_matrix_complex_alloc(n, n);
-    gsl_matrix_complex* tmp = gsl_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* inv = pool_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* tmp = pool_matrix_complex_alloc(n, n);
     gsl_matrix_complex_memcpy(tmp, m.matrix_complex);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
@@ -112,25 +115,25 @@ int matrix_inverse(Stack* stack) {
     gsl_complex det = gsl_linalg_complex_LU_det(tmp, signum);
     if (GSL_REAL(det) == 0.0 && GSL_IMAG(det) == 0.0) {
       fprintf(stderr,"Complex matrix is singular, cannot invert\n");
-      gsl_matrix_complex_free(inv);
-      gsl_matrix_complex_free(tmp);
+      pool_matrix_complex_free(inv);
+      pool_matrix_complex_free(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_complex_free(m.matrix_complex);
+      matrix_complex_release(m.matrix_complex);
       return 1;
     }
 
     // Safe to invert
     if (gsl_linalg_complex_LU_invert(tmp, p, inv) != 0) {
       fprintf(stderr,"Complex matrix inversion failed\n");
-      gsl_matrix_complex_free(inv);
-      gsl_matrix_complex_free(tmp);
+      pool_matrix_complex_free(inv);
+      pool_matrix_complex_free(tmp);
       gsl_permutation_free(p);
-      gsl_matrix_complex_free(m.matrix_complex);
+      matrix_complex_release(m.matrix_complex);
     }
 
-    gsl_matrix_complex_free(tmp);
+    pool_matrix_complex_free(tmp);
     gsl_permutation_free(p);
-    gsl_matrix_complex_free(m.matrix_complex);
+    matrix_complex_release(m.matrix_complex);
     push_matrix_complex(stack, inv);
     return 0;
 
@@ -155,20 +158,20 @@ int matrix_determinant(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* tmp = pool_matrix_alloc(n, n);
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
 
     if (gsl_linalg_LU_decomp(tmp, p, &signum) != 0) {
       fprintf(stderr,"Matrix decomposition failed\n");
-      gsl_matrix_free(tmp);
+      pool_matrix_free(tmp);
       gsl_permutation_free(p);
       return 1;
     }
 
     double det = gsl_linalg_LU_det(tmp, signum);
-    gsl_matrix_free(tmp);
+    pool_matrix_free(tmp);
     gsl_permutation_free(p);
     push_real(stack, det);
 
@@ -179,19 +182,19 @@ int matrix_determinant(Stack* stack) {
       return 1;
     }
 
-    gsl_matrix_complex* tmp = gsl_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* tmp = pool_matrix_complex_alloc(n, n);
     gsl_matrix_complex_memcpy(tmp, m.matrix_complex);
     gsl_permutation* p = gsl_permutation_alloc(n);
     int signum;
 
     if (gsl_linalg_complex_LU_decomp(tmp, p, &signum) != 0) {
       fprintf(stderr,"Complex matrix decomposition failed\n");
-      gsl_matrix_complex_free(tmp);
+      pool_matrix_complex_free(tmp);
       gsl_permutation_free(p);
       return 1;
     }
     gsl_complex det = gsl_linalg_complex_LU_det(tmp, signum);
-    gsl_matrix_complex_free(tmp);
+    pool_matrix_complex_free(tmp);
     gsl_permutation_free(p);
     push_complex(stack, det);
     return 0;
@@ -219,7 +222,7 @@ int solve_linear_system(Stack* stack) {
     }
 
     size_t n = a.matrix_real->size1;
-    gsl_matrix* A = gsl_matrix_alloc(n, n);
+    gsl_matrix* A = pool_matrix_alloc(n, n);
     gsl_matrix_memcpy(A, a.matrix_real);
     gsl_vector* B = gsl_vector_alloc(n);
     for (size_t i = 0; i < n; ++i)
@@ -232,12 +235,12 @@ int solve_linear_system(Stack* stack) {
     gsl_linalg_LU_decomp(A, p, &signum);
     gsl_linalg_LU_solve(A, p, B, X);
 
-    gsl_matrix* result = gsl_matrix_alloc(n, 1);
+    gsl_matrix* result = pool_matrix_alloc(n, 1);
     for (size_t i = 0; i < n; ++i)
       gsl_matrix_set(result, i, 0, gsl_vector_get(X, i));
 
     push_matrix_real(stack, result);
-    gsl_matrix_free(A);
+    pool_matrix_free(A);
     gsl_vector_free(B);
     gsl_vector_free(X);
     gsl_permutation_free(p);
@@ -264,29 +267,29 @@ int matrix_eigen_decompose(Stack* stack) {
     }
 
     // Allocate workspace and result containers
-    gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+    gsl_matrix* tmp = pool_matrix_alloc(n, n);
     gsl_matrix_memcpy(tmp, m.matrix_real);
     gsl_vector_complex* eval = gsl_vector_complex_alloc(n);
-    gsl_matrix_complex* evec = gsl_matrix_complex_alloc(n, n);
+    gsl_matrix_complex* evec = pool_matrix_complex_alloc(n, n);
     gsl_eigen_nonsymmv_workspace* w = gsl_eigen_nonsymmv_alloc(n);
 
     if (gsl_eigen_nonsymmv(tmp, eval, evec, w) != 0) {
       fprintf(stderr,"Eigen decomposition failed\n");
-      gsl_matrix_free(tmp);
+      pool_matrix_free(tmp);
       gsl_vector_complex_free(eval);
-      gsl_matrix_complex_free(evec);
+      pool_matrix_complex_free(evec);
       gsl_eigen_nonsymmv_free(w);
       return 1;
     }
 
     gsl_eigen_nonsymmv_free(w);
-    gsl_matrix_free(tmp);
+    pool_matrix_free(tmp);
 
     // Push results to the stack
     push_matrix_complex(stack, evec);
 
     // Convert eigenvalues (vector) to a diagonal matrix
-    gsl_matrix_complex* eval_matrix = gsl_matrix_complex_calloc(n, n);
+    gsl_matrix_complex* eval_matrix = pool_matrix_complex_calloc(n, n);
     for (size_t i = 0; i < n; ++i) {
       gsl_complex z = gsl_vector_complex_get(eval, i);
       gsl_matrix_complex_set(eval_matrix, i, i, z);
@@ -301,54 +304,105 @@ int matrix_eigen_decompose(Stack* stack) {
   }
 }
 
-int matrix_transpose(Stack* stack) {
-  if (stack->top < 0) {
-    fprintf(stderr,"No matrix to transpose\n");
-    return 1;
+// **************** Transpose ****************
+// The longer side of a block is halved until the block is a tile, so at
+// every level of the recursion the source rows and destination rows being
+// read and written fit in some level of cache, whatever its size. Threads
+// take bands of whole source rows, which are bands of whole destination
+// columns.
+#define TRANSPOSE_TILE 32
+
+typedef struct {
+  const double* src;
+  size_t lds;                   // row strides, in doubles
+  double* dst;
+  size_t ldd;
+  size_t width;                 // doubles per element: 1 real, 2 complex
+  size_t cols;
+} transpose_job;
+
+static void transpose_tile(const transpose_job* t, size_t r0, size_t r1, size_t c0, size_t c1) {
+  const double* src = t->src + r0 * t->lds + c0 * t->width;
+  double* dst = t->dst + c0 * t->ldd + r0 * t->width;
+  if (t->width == 1) {
+    simd_transpose(src, t->lds, dst, t->ldd, r1 - r0, c1 - c0);
+    return;
   }
+  for (size_t i = 0; i < r1 - r0; i++)
+    for (size_t j = 0; j < c1 - c0; j++) {
+      dst[j * t->ldd + 2 * i] = src[i * t->lds + 2 * j];
+      dst[j * t->ldd + 2 * i + 1] = src[i * t->lds + 2 * j + 1];
+    }
+}
 
-  stack_element m = pop(stack);
+// Halves stay multiples of the tile, so only the last tile of a side is ragged
+static void transpose_block(const transpose_job* t, size_t r0, size_t r1, size_t c0, size_t c1) {
+  size_t rows = r1 - r0, cols = c1 - c0;
+  if (rows <= TRANSPOSE_TILE && cols <= TRANSPOSE_TILE) {
+    transpose_tile(t, r0, r1, c0, c1);
+  } else if (rows >= cols) {
+    size_t half = (rows / 2 + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE * TRANSPOSE_TILE;
+    transpose_block(t, r0, r0 + half, c0, c1);
+    transpose_block(t, r0 + half, r1, c0, c1);
+  } else {
+    size_t half = (cols / 2 + TRANSPOSE_TILE - 1) / TRANSPOSE_TILE * TRANSPOSE_TILE;
+    transpose_block(t, r0, r1, c0, c0 + half);
+    transpose_block(t, r0, r1, c0 + half, c1);
+  }
+}
 
-  if (m.type == TYPE_MATRIX_REAL) {
-    size_t rows = m.matrix_real->size1;
-    size_t cols = m.matrix_real->size2;
+// Slices are whole multiples of TRANSPOSE_TILE rows
+static void transpose_slice(size_t begin, size_t end, void* arg) {
+  const transpose_job* t = arg;
+  transpose_block(t, begin / t->cols, end / t->cols, 0, t->cols);
+}
 
-    gsl_matrix* transposed = gsl_matrix_alloc(cols, rows);
-    if (!transposed) {
-      fprintf(stderr,"Memory allocation failed for transposed matrix\n");
-      return 1;
-    }
+static void transpose_data(transpose_job* t, size_t rows) {
+  if (rows == 0 || t->cols == 0) return;
+  parallel_for(rows * t->cols, t->cols * TRANSPOSE_TILE, transpose_slice, t);
+}
 
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	double val = gsl_matrix_get(m.matrix_real, i, j);
-	gsl_matrix_set(transposed, j, i, val);
-      }
-    }
+gsl_matrix* transpose_real(const gsl_matrix* m) {
+  gsl_matrix* out = pool_matrix_alloc(m->size2, m->size1);
+  if (!out) {
+    fprintf(stderr,"Memory allocation failed for transposed matrix\n");
+    return NULL;
+  }
+  transpose_job t = { m->data, m->tda, out->data, out->tda, 1, m->size2 };
+  transpose_data(&t, m->size1);
+  return out;
+}
 
-    push_matrix_real(stack, transposed);
-    gsl_matrix_free(m.matrix_real);
+static gsl_matrix_complex* transpose_complex(const gsl_matrix_complex* m) {
+  gsl_matrix_complex* out = pool_matrix_complex_alloc(m->size2, m->size1);
+  if (!out) {
+    fprintf(stderr,"Memory allocation failed for transposed complex matrix\n");
+    return NULL;
   }
-  else if (m.type == TYPE_MATRIX_COMPLEX) {
-    size_t rows = m.matrix_complex->size1;
-    size_t cols = m.matrix_complex->size2;
+  transpose_job t = { m->data, 2 * m->tda, out->data, 2 * out->tda, 2, m->size2 };
+  transpose_data(&t, m->size1);
+  return out;
+}
 
-    gsl_matrix_complex* transposed = gsl_matrix_complex_alloc(cols, rows);
-    if (!transposed) {
-      fprintf(stderr,"Memory allocation failed for transposed complex matrix\n");
-      return 1;
-    }
+int matrix_transpose(Stack* stack) {
+  if (stack->top < 0) {
+    fprintf(stderr,"No matrix to transpose\n");
+    return 1;
+  }
 
-    for (size_t i = 0; i < rows; ++i) {
-      for (size_t j = 0; j < cols; ++j) {
-	gsl_complex val = gsl_matrix_complex_get(m.matrix_complex, i, j);
-	gsl_matrix_complex_set(transposed, j, i, val);
-      }
-    }
+  stack_element* m = &stack->items[stack->top];
 
-    push_matrix_complex(stack, transposed);
-    gsl_matrix_complex_free(m.matrix_complex);
-    return 0;
+  if (m->type == TYPE_MATRIX_REAL) {
+    gsl_matrix* transposed = transpose_real(m->matrix_real);
+    if (!transposed) return 1;
+    matrix_release(m->matrix_real);
+    m->matrix_real = transposed;
+  }
+  else if (m->type == TYPE_MATRIX_COMPLEX) {
+    gsl_matrix_complex* transposed = transpose_complex(m->matrix_complex);
+    if (!transposed) return 1;
+    matrix_complex_release(m->matrix_complex);
+    m->matrix_complex = transposed;
   }
   else {
     fprintf(stderr,"Only real or complex matrices can be transposed\n");
@@ -393,13 +447,13 @@ int matrix_cholesky(Stack* stack) {
     }
   }
 
-  gsl_matrix* tmp = gsl_matrix_alloc(n, n);
+  gsl_matrix* tmp = pool_matrix_alloc(n, n);
   gsl_matrix_memcpy(tmp, m.matrix_real);
 
   int status = gsl_linalg_cholesky_decomp(tmp);
   if (status != 0) {
     fprintf(stderr,"Cholesky decomposition failed (matrix may not be positive definite)\n");
-    gsl_matrix_free(tmp);
+    pool_matrix_free(tmp);
     return 1;
   }
 
@@ -410,12 +464,15 @@ int matrix_cholesky(Stack* stack) {
     }
   }
 
-  gsl_matrix_free(m.matrix_real); // Free original
+  matrix_release(m.matrix_real); // Free original
   push_matrix_real(stack, tmp);
   return 0;
 }
 
-int matrix_svd(Stack* stack) {
+// Pops a real matrix and runs the SVD on a copy of it. On success A holds
+// U in its leading columns, V the right singular vectors and S the
+// singular values.
+static int svd_decompose(Stack* stack, gsl_matrix** A, gsl_matrix** V, gsl_vector** S) {
   if (stack->top < 0) {
     fprintf(stderr,"No matrix on stack for SVD\n");
     return 1;
@@ -425,60 +482,85 @@ int matrix_svd(Stack* stack) {
 
   if (m.type != TYPE_MATRIX_REAL) {
     fprintf(stderr,"SVD is only implemented for real matrices\n");
+    stack_element_free(&m);
     return 1;
   }
 
   size_t m_rows = m.matrix_real->size1;
   size_t m_cols = m.matrix_real->size2;
-
-  gsl_matrix* A = gsl_matrix_alloc(m_rows, m_cols);
-  gsl_matrix_memcpy(A, m.matrix_real);
-
   size_t min_dim = (m_rows < m_cols) ? m_rows : m_cols;
 
-  gsl_vector* S = gsl_vector_alloc(min_dim);            // Singular values
-  gsl_matrix* V = gsl_matrix_alloc(m_cols, m_cols);     // Right singular vectors
-  gsl_vector* work = gsl_vector_alloc(min_dim);         // Workspace
+  *A = pool_matrix_alloc(m_rows, m_cols);
+  gsl_matrix_memcpy(*A, m.matrix_real);
+  matrix_release(m.matrix_real);
 
-  int status = gsl_linalg_SV_decomp(A, V, S, work);
+  *S = gsl_vector_alloc(min_dim);                 // Singular values
+  *V = pool_matrix_alloc(m_cols, m_cols);          // Right singular vectors
+  gsl_vector* work = gsl_vector_alloc(min_dim);   // Workspace
+
+  int status = gsl_linalg_SV_decomp(*A, *V, *S, work);
+  gsl_vector_free(work);
 
   if (status != 0) {
     fprintf(stderr,"SVD decomposition failed\n");
-    gsl_matrix_free(A);
-    gsl_matrix_free(V);
-    gsl_vector_free(S);
-    gsl_vector_free(work);
+    pool_matrix_free(*A);
+    pool_matrix_free(*V);
+    gsl_vector_free(*S);
     return 1;
   }
+  return 0;
+}
+
+// Singular values as a rows x cols diagonal matrix
+static gsl_matrix* singular_value_matrix(const gsl_matrix* A, const gsl_matrix* V, const gsl_vector* S) {
+  gsl_matrix* S_mat = pool_matrix_calloc(A->size1, V->size1);
+  for (size_t i = 0; i < S->size; ++i) {
+    gsl_matrix_set(S_mat, i, i, gsl_vector_get(S, i));
+  }
+  return S_mat;
+}
+
+int matrix_svd(Stack* stack) {
+  gsl_matrix *A, *V;
+  gsl_vector* S;
+  if (svd_decompose(stack, &A, &V, &S) != 0) return 1;
 
   // Extract U from overwritten A
-  gsl_matrix* U = gsl_matrix_alloc(m_rows, min_dim);
+  size_t m_rows = A->size1, min_dim = S->size;
+  gsl_matrix* U = pool_matrix_alloc(m_rows, min_dim);
   for (size_t i = 0; i < m_rows; ++i) {
     for (size_t j = 0; j < min_dim; ++j) {
       gsl_matrix_set(U, i, j, gsl_matrix_get(A, i, j));
     }
   }
 
-  // Create diagonal matrix for S
-  gsl_matrix* S_mat = gsl_matrix_calloc(m_rows, m_cols);
-  for (size_t i = 0; i < min_dim; ++i) {
-    gsl_matrix_set(S_mat, i, i, gsl_vector_get(S, i));
-  }
-
   // Push U, S, V in that order
   push_matrix_real(stack, U);
-  push_matrix_real(stack, S_mat);
+  push_matrix_real(stack, singular_value_matrix(A, V, S));
   push_matrix_real(stack, V);
 
   // Clean up
   gsl_vector_free(S);
-  gsl_vector_free(work);
-  gsl_matrix_free(A);
-  gsl_matrix_free(m.matrix_real);
+  pool_matrix_free(A);
   
   return 0;
 }
 
+// Same as svd drop swap drop: only S is kept, so U is never extracted and
+// nothing is pushed just to be dropped again
+int matrix_singular_values(Stack* stack) {
+  gsl_matrix *A, *V;
+  gsl_vector* S;
+  if (svd_decompose(stack, &A, &V, &S) != 0) return 1;
+
+  push_matrix_real(stack, singular_value_matrix(A, V, S));
+
+  gsl_vector_free(S);
+  pool_matrix_free(A);
+  pool_matrix_free(V);
+  return 0;
+}
+
 
 /* // Computes the Frobenius norm of a GSL matrix */
 /* double gls_matrix_frobenius_norm(const gsl_matrix* A) { */
@@ -523,22 +605,22 @@ int matrix_pseudoinverse(Stack *stack) {
       return 1;
     }
 
-  gsl_matrix *U = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *U = pool_matrix_alloc(rows, cols);
   gsl_matrix_memcpy(U, m.matrix_real);
 
-  gsl_matrix *V = gsl_matrix_alloc(cols, cols);
+  gsl_matrix *V = pool_matrix_alloc(cols, cols);
   gsl_vector *S = gsl_vector_alloc(cols);
   gsl_vector *work = gsl_vector_alloc(cols);
 
   if (gsl_linalg_SV_decomp(U, V, S, work) != 0) {
     fprintf(stderr,"SVD decomposition failed\n");
-    gsl_matrix_free(U); gsl_matrix_free(V);
+    pool_matrix_free(U); pool_matrix_free(V);
     gsl_vector_free(S); gsl_vector_free(work);
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     return 1;
   }
 
-  gsl_matrix *S_pinv = gsl_matrix_calloc(cols, rows);
+  gsl_matrix *S_pinv = pool_matrix_calloc(cols, rows);
   for (size_t i = 0; i < cols; ++i) {
     double s = gsl_vector_get(S, i);
     if (s > tol) {
@@ -546,20 +628,20 @@ int matrix_pseudoinverse(Stack *stack) {
     }
   }
 
-  gsl_matrix *VS_pinv = gsl_matrix_alloc(cols, rows);
+  gsl_matrix *VS_pinv = pool_matrix_alloc(cols, rows);
   gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, V, S_pinv, 0.0, VS_pinv);
 
   gsl_matrix_transpose(U);
-  gsl_matrix *A_pinv = gsl_matrix_alloc(cols, rows);
+  gsl_matrix *A_pinv = pool_matrix_alloc(cols, rows);
   gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, VS_pinv, U, 0.0, A_pinv);
 
-  gsl_matrix_free(U);
-  gsl_matrix_free(V);
+  pool_matrix_free(U);
+  pool_matrix_free(V);
   gsl_vector_free(S);
   gsl_vector_free(work);
-  gsl_matrix_free(S_pinv);
-  gsl_matrix_free(VS_pinv);
-  gsl_matrix_free(m.matrix_real);  // free popped matrix
+  pool_matrix_free(S_pinv);
+  pool_matrix_free(VS_pinv);
+  matrix_release(m.matrix_real);  // free popped matrix
 
   push_matrix_real(stack, A_pinv);
   return 0;
@@ -48,13 +48,19 @@
 #include <string.h>             // for strcmp
 #include <ctype.h>              // for isspace
 #include <errno.h>              // for errno
+#include "bytecode.h"           // for clear_line_cache
 #include "eval_fun.h"           // for evaluate_line
 #include "globals.h"            // for CONFIG_PATH, HISTORY_PATH, completed_...
+#include "parallel.h"           // for free_parallel
 #include "print_fun.h"          // for print_stack
+#include "pool.h"               // for free_pool
 #include "registers.h"          // for free_all_registers, init_registers
+#include "refcount.h"           // for free_payload_refs
 #include "splash.h"             // for splash_screen
-#include "stack.h"              // for copy_stack, free_stack, init_stack
+#include "stack.h"              // for free_stack, init_stack, stack_trim
+#include "symbols.h"            // for free_symbols
 #include "tab_completion.h"     // for function_name_completion
+#include "undo.h"               // for undo_begin_line, undo_end_line, undo_line
 #include "words.h"              // for list_macros, load_macros_from_file
 
 // Globals
@@ -114,12 +120,10 @@ static char *capture_command_output(const char *cmd, int *wait_status_out) {
 int repl(void) {
 
   Stack stack;
-  Stack old_stack;
 
   // Initialize everything needed
   splash_screen();
   init_stack(&stack);
-  init_stack(&old_stack);
   init_registers();
   load_macros_from_file();
   if (verbose_mode) list_macros();
@@ -149,7 +153,9 @@ int repl(void) {
       if (!out) {
 	perror("popen/capture_command_output");
       } else {
+	undo_begin_line(&stack);
 	push_string(&stack, out);
+	undo_end_line(&stack);
 	if (WIFEXITED(st) && WEXITSTATUS(st) != 0) {
 	  fprintf(stderr, "Command exited with status %d\n", WEXITSTATUS(st));
 	} else if (!WIFEXITED(st)) {
@@ -161,12 +167,16 @@ int repl(void) {
       continue;
     }
    
-    if (!strcmp(line, "undo")) // Restore the old stack
-      { copy_stack(&stack, &old_stack);
-      } else {
-      copy_stack(&old_stack, &stack);  // Preserve the stack
+    if (!strcmp(line, "undo")) {
+      undo_line(&stack);
+    } else if (!strcmp(line, "redo")) {
+      redo_line(&stack);
+    } else {
+      undo_begin_line(&stack);
       evaluate_line(&stack, line);
+      undo_end_line(&stack);
     }
+    stack_trim(&stack);
     if (completed_batch)
       completed_batch = false;
     else
@@ -178,9 +188,14 @@ int repl(void) {
   // Save config, history, and cleanup
   save_config(CONFIG_PATH);
   write_history(HISTORY_PATH);
-  free_stack(&old_stack);
+  clear_undo_journal();
   free_stack(&stack);
   free_all_registers();
+  clear_line_cache();
+  free_symbols();
+  free_payload_refs();
+  free_pool();
+  free_parallel();
   return 0;
 }
 
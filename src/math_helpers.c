@@ -25,6 +25,9 @@
 #include <stdbool.h>                        // for bool, false, true
 #include <stdio.h>                          // for fprintf, stderr, size_t
 #include "math_helpers.h"                   // for abs_wrapper, acos_wrapper
+#include "parallel.h"                       // for parallel_for, PARALLEL_GRAIN
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_math.h"                      // for simd_math_real, MATH_LN, MATH_LOG10
 #include "spec_fun.h"                       // for gamma_function, ln_gamma_...
 #include "stack.h"                          // for stack_top_type, pop, (ano...
 #include "stat_fun.h"                       // for standard_normal_cdf, stan...
@@ -261,8 +264,7 @@ void abs_wrapper(Stack *stack) {
     apply_real_matrix_unary_inplace(stack, fabs);
     return; 
   } else if (a == TYPE_MATRIX_COMPLEX)
-    // to do complex abs element by element
-    return;
+    complex_matrix_abs_by_element(stack);
   else
     fprintf(stderr,"abs: unsupported type\n");
   return;
@@ -281,13 +283,47 @@ void arg_wrapper(Stack *stack) {
     // To do: push a matrix of zeroes
     return; 
   } else if (a == TYPE_MATRIX_COMPLEX)
-    // to do complex arg element by element
-    return;
+    complex_matrix_arg_by_element(stack);
   else
     fprintf(stderr,"arg: unsupported type\n");
   return;
 }
 
+typedef struct {
+  simd_math_fn fn;
+  const double* x;
+  double* out;
+} math_job;
+
+static void math_slice(size_t begin, size_t end, void* arg) {
+  const math_job* job = arg;
+  simd_math_real(job->fn, job->x + begin, job->out + begin, end - begin);
+}
+
+// ln, log or sqrt of a real matrix with no negative entries, written over
+// the operand's own matrix when nothing else holds it
+static gsl_matrix* real_matrix_math(stack_element* a, simd_math_fn fn, double (*func)(double)) {
+  gsl_matrix* m = a->matrix_real;
+  size_t rows = m->size1;
+  size_t cols = m->size2;
+
+  if (m->tda == cols) {
+    gsl_matrix* rm = take_matrix_real(a);
+    if (!rm) rm = pool_matrix_alloc(rows, cols);
+    if (rm) {
+      math_job job = { fn, m->data, rm->data };
+      parallel_for(rows * cols, PARALLEL_GRAIN, math_slice, &job);
+    }
+    return rm;
+  }
+  gsl_matrix* rm = pool_matrix_alloc(rows, cols);
+  if (!rm) return NULL;
+  for (size_t i = 0; i < rows; ++i)
+    for (size_t j = 0; j < cols; ++j)
+      gsl_matrix_set(rm, i, j, func(gsl_matrix_get(m, i, j)));
+  return rm;
+}
+
 void ln_wrapper(Stack *stack) {
   stack_element a = pop(stack);
 
@@ -321,7 +357,7 @@ void ln_wrapper(Stack *stack) {
 
     if (has_negative) {
       // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
+      gsl_matrix_complex* cm = pool_matrix_complex_alloc(rows, cols);
       for (size_t i = 0; i < rows; ++i) {
 	for (size_t j = 0; j < cols; ++j) {
 	  double x = gsl_matrix_get(m, i, j);
@@ -332,15 +368,11 @@ void ln_wrapper(Stack *stack) {
       push_matrix_complex(stack, cm);
     } else {
       // Stay real
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, log(x));
-	}
-      }
-      push_matrix_real(stack, rm);
+      gsl_matrix* rm = real_matrix_math(&a, MATH_LN, log);
+      if (rm) push_matrix_real(stack, rm);
+      else fprintf(stderr, "Memory allocation failed\n");
     }
+    stack_element_free(&a);
   }
 
   else if (a.type == TYPE_MATRIX_COMPLEX) {
@@ -348,7 +380,7 @@ void ln_wrapper(Stack *stack) {
     size_t rows = m->size1;
     size_t cols = m->size2;
 
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex* result = pool_matrix_complex_alloc(rows, cols);
     for (size_t i = 0; i < rows; ++i) {
       for (size_t j = 0; j < cols; ++j) {
 	gsl_complex z = gsl_matrix_complex_get(m, i, j);
@@ -356,6 +388,7 @@ void ln_wrapper(Stack *stack) {
       }
     }
     push_matrix_complex(stack, result);
+    stack_element_free(&a);
   }
   else {
     fprintf(stderr, "ln: unsupported type\n");
@@ -401,7 +434,7 @@ void log_wrapper(Stack *stack) {
 
     if (has_negative) {
       // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
+      gsl_matrix_complex* cm = pool_matrix_complex_alloc(rows, cols);
       for (size_t i = 0; i < rows; ++i) {
 	for (size_t j = 0; j < cols; ++j) {
 	  double x = gsl_matrix_get(m, i, j);
@@ -414,15 +447,11 @@ void log_wrapper(Stack *stack) {
       push_matrix_complex(stack, cm);
     } else {
       // Stay real
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, log10(x));
-	}
-      }
-      push_matrix_real(stack, rm);
+      gsl_matrix* rm = real_matrix_math(&a, MATH_LOG10, log10);
+      if (rm) push_matrix_real(stack, rm);
+      else fprintf(stderr, "Memory allocation failed\n");
     }
+    stack_element_free(&a);
   }
 
   else if (a.type == TYPE_MATRIX_COMPLEX) {
@@ -430,7 +459,7 @@ void log_wrapper(Stack *stack) {
     size_t rows = m->size1;
     size_t cols = m->size2;
 
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex* result = pool_matrix_complex_alloc(rows, cols);
     for (size_t i = 0; i < rows; ++i) {
       for (size_t j = 0; j < cols; ++j) {
 	gsl_complex z = gsl_matrix_complex_get(m, i, j);
@@ -439,6 +468,7 @@ void log_wrapper(Stack *stack) {
       }
     }
     push_matrix_complex(stack, result);
+    stack_element_free(&a);
   }
   else {
     fprintf(stderr, "log: unsupported type\n");
@@ -478,7 +508,7 @@ void sqrt_wrapper(Stack *stack) {
 
     if (has_negative) {
       // Promote to complex
-      gsl_matrix_complex* cm = gsl_matrix_complex_alloc(rows, cols);
+      gsl_matrix_complex* cm = pool_matrix_complex_alloc(rows, cols);
       for (size_t i = 0; i < rows; ++i) {
 	for (size_t j = 0; j < cols; ++j) {
 	  double x = gsl_matrix_get(m, i, j);
@@ -488,15 +518,11 @@ void sqrt_wrapper(Stack *stack) {
       }
       push_matrix_complex(stack, cm);
     } else {
-      gsl_matrix* rm = gsl_matrix_alloc(rows, cols);
-      for (size_t i = 0; i < rows; ++i) {
-	for (size_t j = 0; j < cols; ++j) {
-	  double x = gsl_matrix_get(m, i, j);
-	  gsl_matrix_set(rm, i, j, sqrt(x));
-	}
-      }
-      push_matrix_real(stack, rm);
+      gsl_matrix* rm = real_matrix_math(&a, MATH_SQRT, sqrt);
+      if (rm) push_matrix_real(stack, rm);
+      else fprintf(stderr, "Memory allocation failed\n");
     }
+    stack_element_free(&a);
   }
 
   else if (a.type == TYPE_MATRIX_COMPLEX) {
@@ -504,7 +530,7 @@ void sqrt_wrapper(Stack *stack) {
     size_t rows = m->size1;
     size_t cols = m->size2;
 
-    gsl_matrix_complex* result = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex* result = pool_matrix_complex_alloc(rows, cols);
     for (size_t i = 0; i < rows; ++i) {
       for (size_t j = 0; j < cols; ++j) {
 	gsl_complex z = gsl_matrix_complex_get(m, i, j);
@@ -512,6 +538,7 @@ void sqrt_wrapper(Stack *stack) {
       }
     }
     push_matrix_complex(stack, result);
+    stack_element_free(&a);
   }
 
   else {
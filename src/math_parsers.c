@@ -22,18 +22,30 @@
 #include <gsl/gsl_complex_math.h>           // for gsl_complex_rect
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex, gsl_m...
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix, gsl_matrix_alloc
+#include <stdbool.h>                        // for bool, true, false
 #include <stdio.h>                          // for fprintf, stderr, NULL
-#include <stdlib.h>                         // for free, strtod, strtoul
-#include "math_parsers.h"                   // for parse_complex_matrix_literal
+#include <string.h>                         // for strlen
+#include "math_parsers.h"                   // for parse_inline_matrix
+#include "numconv.h"                        // for parse_double
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
 #include "stack.h"                          // for load_matrix_from_file
 
 int read_complex(const char* input, gsl_complex* z) {
+  const char* end = input + strlen(input);
+  const char* p = input;
   double real, imag;
-  if (sscanf(input, " ( %lf , %lf ) ", &real, &imag) == 2) {
-    *z = gsl_complex_rect(real, imag);
-    return 1; // success
-  }
-  return 0; // failure
+
+  while (isspace((unsigned char)*p)) p++;
+  if (*p++ != '(') return 0;
+  if (!(p = parse_double(p, end, &real))) return 0;
+  while (isspace((unsigned char)*p)) p++;
+  if (*p++ != ',') return 0;
+  if (!(p = parse_double(p, end, &imag))) return 0;
+  while (isspace((unsigned char)*p)) p++;
+  if (*p != ')') return 0;
+
+  *z = gsl_complex_rect(real, imag);
+  return 1; // success
 }
 
 void read_matrix_from_file(Stack *stack, char *input) {
@@ -49,192 +61,150 @@ void read_matrix_from_file(Stack *stack, char *input) {
   push_matrix_real(stack,load_matrix_from_file(rows, cols, filename));
 }
 
-// Parse real matrices: rows cols $ list of real numbers
-gsl_matrix* parse_matrix_literal(const char* input) {
-  const char* p = input;
-  while (isspace(*p)) p++;
-
-  char* endptr;
-  size_t rows = strtoul(p, &endptr, 10);
-  if (p == endptr) {
-    fprintf(stderr, "Expected number of rows\n");
-    return NULL;
-  }
-  p = endptr;
-
-  while (isspace(*p)) p++;
-
-  size_t cols = strtoul(p, &endptr, 10);
-  if (p == endptr) {
-    fprintf(stderr, "Expected number of columns\n");
-    return NULL;
-  }
-  p = endptr;
-
-  while (isspace(*p)) p++;
-
-  if (*p != '$') {
-    fprintf(stderr, "Expected '$' after rows and columns\n");
-    return NULL;
-  }
-  p++; // skip '$'
-
-  double* data = malloc(rows * cols * sizeof(double));
-  if (!data) {
-    fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
-  }
-
-  size_t count = 0;
-  while (count < rows * cols && *p) {
-    while (isspace(*p)) p++;
-
-    double val = strtod(p, &endptr);
-    if (p == endptr) {
-      fprintf(stderr, "Invalid real number at entry %zu\n", count);
-      free(data);
-      return NULL;
-    }
-    p = endptr;
-    data[count++] = val;
-  }
+// **************** Inline matrix literals ****************
+// One pass over the text between the brackets of "[rows cols $ e1 e2 ...]".
+// Elements are written straight into the block of a matrix allocated up
+// front. The matrix starts out real; the first "(re,im)" element promotes
+// it to complex by widening the entries read so far, after which parsing
+// continues in the complex block.
 
-  if (count != rows * cols) {
-    fprintf(stderr, "Matrix element count mismatch: expected %zu, got %zu\n", rows * cols, count);
-    free(data);
-    return NULL;
-  }
+static void skip_space(const char** p, const char* end) {
+  while (*p < end && isspace((unsigned char)**p)) (*p)++;
+}
 
-  gsl_matrix* m = gsl_matrix_alloc(rows, cols);
-  if (!m) {
-    fprintf(stderr, "Matrix allocation failed\n");
-    free(data);
-    return NULL;
-  }
+static bool parse_size(const char** p, const char* end, size_t* n) {
+  const char* q = *p;
+  size_t v = 0;
+  while (q < end && isdigit((unsigned char)*q)) v = 10 * v + (size_t)(*q++ - '0');
+  if (q == *p) return false;
+  *p = q;
+  *n = v;
+  return true;
+}
 
-  for (size_t i = 0; i < rows; ++i) {
-    for (size_t j = 0; j < cols; ++j) {
-      gsl_matrix_set(m, i, j, data[i * cols + j]);
-    }
-  }
+static bool parse_real(const char** p, const char* end, double* x) {
+  const char* next = parse_double(*p, end, x);
+  if (!next) return false;
+  *p = next;
+  return true;
+}
 
-  free(data);
-  return m;
+static bool parse_complex_element(const char** p, const char* end, size_t entry,
+                                  double* re, double* im) {
+  (*p)++;  // skip '('
+  skip_space(p, end);
+  if (!parse_real(p, end, re)) {
+    fprintf(stderr, "Invalid real part at entry %zu\n", entry);
+    return false;
+  }
+  skip_space(p, end);
+  if (*p >= end || **p != ',') {
+    fprintf(stderr, "Expected ',' between real and imaginary at entry %zu\n", entry);
+    return false;
+  }
+  (*p)++;
+  skip_space(p, end);
+  if (!parse_real(p, end, im)) {
+    fprintf(stderr, "Invalid imaginary part at entry %zu\n", entry);
+    return false;
+  }
+  skip_space(p, end);
+  if (*p >= end || **p != ')') {
+    fprintf(stderr, "Expected ')' after complex number at entry %zu\n", entry);
+    return false;
+  }
+  (*p)++;
+  return true;
 }
 
-// Parse mixed real/complex matrices: rows cols $ list of real and complex numbers
-gsl_matrix_complex* parse_complex_matrix_literal(const char* input) {
-  const char* p = input;
-  while (isspace(*p)) p++;
+int parse_inline_matrix(const char* text, size_t len, stack_element* out) {
+  const char* p = text;
+  const char* end = text + len;
 
-  char* endptr;
-  size_t rows = strtoul(p, &endptr, 10);
-  if (p == endptr) {
+  out->type = TYPE_MATRIX_REAL;
+  out->matrix_real = NULL;
+
+  size_t rows, cols;
+  skip_space(&p, end);
+  if (!parse_size(&p, end, &rows)) {
     fprintf(stderr, "Expected number of rows\n");
-    return NULL;
+    return -1;
   }
-  p = endptr;
-
-  while (isspace(*p)) p++;
-
-  size_t cols = strtoul(p, &endptr, 10);
-  if (p == endptr) {
+  skip_space(&p, end);
+  if (!parse_size(&p, end, &cols)) {
     fprintf(stderr, "Expected number of columns\n");
-    return NULL;
+    return -1;
   }
-  p = endptr;
-
-  while (isspace(*p)) p++;
-
-  if (*p != '$') {
+  skip_space(&p, end);
+  if (p >= end || *p != '$') {
     fprintf(stderr, "Expected '$' after rows and columns\n");
-    return NULL;
+    return -1;
   }
   p++; // skip '$'
 
-  gsl_complex* data = malloc(rows * cols * sizeof(gsl_complex));
-  if (!data) {
-    fprintf(stderr, "Memory allocation failed\n");
-    return NULL;
+  gsl_matrix* m = pool_matrix_alloc(rows, cols);
+  if (!m) {
+    fprintf(stderr, "Matrix allocation failed\n");
+    return -1;
   }
+  gsl_matrix_complex* mc = NULL;
+  double* re = m->data;      // freshly allocated: contiguous, tda == cols
+  double* zc = NULL;         // interleaved re/im once promoted
 
+  size_t total = rows * cols;
   size_t count = 0;
-  while (count < rows * cols && *p) {
-    while (isspace(*p)) p++;
-
+  skip_space(&p, end);
+  while (count < total && p < end) {
     if (*p == '(') {
-      p++; // skip '('
-      double real = strtod(p, &endptr);
-      if (p == endptr) {
-	fprintf(stderr, "Invalid real part at entry %zu\n", count);
-	free(data);
-	return NULL;
-      }
-      p = endptr;
-
-      while (isspace(*p)) p++;
-
-      if (*p != ',') {
-	fprintf(stderr, "Expected ',' between real and imaginary at entry %zu\n", count);
-	free(data);
-	return NULL;
-      }
-      p++; // skip ','
-
-      double imag = strtod(p, &endptr);
-      if (p == endptr) {
-	fprintf(stderr, "Invalid imaginary part at entry %zu\n", count);
-	free(data);
-	return NULL;
+      if (!mc) {
+        mc = pool_matrix_complex_alloc(rows, cols);
+        if (!mc) {
+          fprintf(stderr, "Matrix allocation failed\n");
+          pool_matrix_free(m);
+          return -1;
+        }
+        zc = mc->data;
+        for (size_t k = 0; k < count; k++) {
+          zc[2 * k] = re[k];
+          zc[2 * k + 1] = 0.0;
+        }
+        pool_matrix_free(m);
+        m = NULL;
       }
-      p = endptr;
-
-      while (isspace(*p)) p++;
-
-      if (*p != ')') {
-	fprintf(stderr, "Expected ')' after complex number at entry %zu\n", count);
-	free(data);
-	return NULL;
+      if (!parse_complex_element(&p, end, count, &zc[2 * count], &zc[2 * count + 1]))
+        goto fail;
+    } else {
+      double x;
+      if (!parse_real(&p, end, &x)) {
+        fprintf(stderr, "Invalid real number at entry %zu\n", count);
+        goto fail;
       }
-      p++; // skip ')'
-
-      data[count++] = gsl_complex_rect(real, imag);
-    } else if (isdigit(*p) || (*p == '-' && isdigit(*(p + 1)))) {
-      double real = strtod(p, &endptr);
-      if (p == endptr) {
-	fprintf(stderr, "Invalid real number at entry %zu\n", count);
-	free(data);
-	return NULL;
+      if (mc) {
+        zc[2 * count] = x;
+        zc[2 * count + 1] = 0.0;
+      } else {
+        re[count] = x;
       }
-      p = endptr;
-      data[count++] = gsl_complex_rect(real, 0.0);
-    } else {
-      fprintf(stderr, "Unexpected character at entry %zu: '%c'\n", count, *p);
-      free(data);
-      return NULL;
     }
+    count++;
+    skip_space(&p, end);
   }
 
-  if (count != rows * cols) {
-    fprintf(stderr, "Matrix element count mismatch: expected %zu, got %zu\n", rows * cols, count);
-    free(data);
-    return NULL;
+  if (count != total) {
+    fprintf(stderr, "Matrix element count mismatch: expected %zu, got %zu\n", total, count);
+    goto fail;
   }
 
-  gsl_matrix_complex* m = gsl_matrix_complex_alloc(rows, cols);
-  if (!m) {
-    fprintf(stderr, "Matrix allocation failed\n");
-    free(data);
-    return NULL;
-  }
-
-  for (size_t i = 0; i < rows; ++i) {
-    for (size_t j = 0; j < cols; ++j) {
-      gsl_matrix_complex_set(m, i, j, data[i * cols + j]);
-    }
+  if (mc) {
+    out->type = TYPE_MATRIX_COMPLEX;
+    out->matrix_complex = mc;
+  } else {
+    out->matrix_real = m;
   }
+  return 0;
 
-  free(data);
-  return m;
+ fail:
+  if (m) pool_matrix_free(m);
+  if (mc) pool_matrix_complex_free(mc);
+  return -1;
 }
-
@@ -25,6 +25,10 @@
 #include <gsl/gsl_rng.h>                    // for gsl_rng_uniform, gsl_rng
 #include <stdbool.h>                        // for bool
 #include <stdio.h>                          // for fprintf, stderr, size_t
+#include <stdlib.h>                         // for calloc, free
+#include "parallel.h"                       // for parallel_for
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_kernels.h"                   // for simd_real
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "matrix_fun.h"                     // for make_diag_matrix, make_ga...
 
@@ -34,58 +38,51 @@ int split_matrix(Stack *s) {
     return -1;
   }
 
-  stack_element *matrix_elem = &s->items[s->top];
+  stack_element matrix_elem = s->items[s->top];
 
-  if (matrix_elem->type == TYPE_MATRIX_REAL) {
-    gsl_matrix *matrix = matrix_elem->matrix_real;
+  if (matrix_elem.type == TYPE_MATRIX_REAL) {
+    gsl_matrix *matrix = matrix_elem.matrix_real;
     if (!matrix) {
       fprintf(stderr, "Error: null real matrix.\n");
       return -1;
     }
 
+    // Make room for every element at once; the matrix slot is reused
+    if (stack_reserve(s, (int)(matrix->size1 * matrix->size2) - 1) != 0) return -1;
+
     // Remove matrix from the stack
     s->top--;
 
     // Push all elements in row-major order
     for (size_t i = 0; i < matrix->size1; ++i) {
       for (size_t j = 0; j < matrix->size2; ++j) {
-        double val = gsl_matrix_get(matrix, i, j);
-
-        if (s->top >= STACK_SIZE - 1) {
-          fprintf(stderr, "Error: stack overflow.\n");
-          return -1;
-        }
-
         s->top++;
         s->items[s->top].type = TYPE_REAL;
-        s->items[s->top].real = val;
+        s->items[s->top].real = gsl_matrix_get(matrix, i, j);
       }
     }
-  } else if (matrix_elem->type == TYPE_MATRIX_COMPLEX) {
-    gsl_matrix_complex *matrix = matrix_elem->matrix_complex;
+    matrix_release(matrix);
+  } else if (matrix_elem.type == TYPE_MATRIX_COMPLEX) {
+    gsl_matrix_complex *matrix = matrix_elem.matrix_complex;
     if (!matrix) {
       fprintf(stderr, "Error: null complex matrix.\n");
       return -1;
     }
 
+    if (stack_reserve(s, (int)(matrix->size1 * matrix->size2) - 1) != 0) return -1;
+
     // Remove matrix from the stack
     s->top--;
 
     // Push all elements in row-major order
     for (size_t i = 0; i < matrix->size1; ++i) {
       for (size_t j = 0; j < matrix->size2; ++j) {
-        gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
-
-        if (s->top >= STACK_SIZE - 1) {
-          fprintf(stderr, "Error: stack overflow.\n");
-          return -1;
-        }
-
         s->top++;
         s->items[s->top].type = TYPE_COMPLEX;
-        s->items[s->top].complex_val = z;
+        s->items[s->top].complex_val = gsl_matrix_complex_get(matrix, i, j);
       }
     }
+    matrix_complex_release(matrix);
   } else {
     fprintf(stderr, "Error: top of stack is not a matrix.\n");
     return -1;
@@ -174,6 +171,9 @@ int set_matrix_element(Stack *s) {
   size_t row = (size_t)row_elem->real;
   size_t col = (size_t)col_elem->real;
 
+  // The matrix may be shared with a register, a dup or the undo snapshot
+  if (stack_element_unshare(matrix_elem) != 0) return -1;
+
   if (matrix_elem->type == TYPE_MATRIX_REAL) {
     gsl_matrix *matrix = matrix_elem->matrix_real;
     if (!matrix || row >= matrix->size1 || col >= matrix->size2) {
@@ -227,26 +227,26 @@ int matrix_extract_diagonal(Stack* stack) {
     size_t n =
       (m.matrix_real->size1 < m.matrix_real->size2) ? m.matrix_real->size1 : m.matrix_real->size2;
 
-    gsl_matrix* diag = gsl_matrix_calloc(1, n);
+    gsl_matrix* diag = pool_matrix_calloc(1, n);
     for (size_t i = 0; i < n; ++i) {
       double val = gsl_matrix_get(m.matrix_real, i, i);
       gsl_matrix_set(diag, 0, i, val);
     }
 
-    gsl_matrix_free(m.matrix_real);
+    matrix_release(m.matrix_real);
     push_matrix_real(stack, diag);
 
   } else if (m.type == TYPE_MATRIX_COMPLEX) {
     size_t n =
       (m.matrix_complex->size1 < m.matrix_complex->size2) ? m.matrix_complex->size1 : m.matrix_complex->size2;
 
-    gsl_matrix_complex* diag = gsl_matrix_complex_calloc(1, n);
+    gsl_matrix_complex* diag = pool_matrix_complex_calloc(1, n);
     for (size_t i = 0; i < n; ++i) {
       gsl_complex z = gsl_matrix_complex_get(m.matrix_complex, i, i);
       gsl_matrix_complex_set(diag, 0, i, z);
     }
 
-    gsl_matrix_complex_free(m.matrix_complex);
+    matrix_complex_release(m.matrix_complex);
     push_matrix_complex(stack, diag);
 
   } else {
@@ -277,7 +277,7 @@ int make_unit_matrix(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* m = gsl_matrix_calloc(n, n); // allocates and zeroes the matrix
+  gsl_matrix* m = pool_matrix_calloc(n, n); // allocates and zeroes the matrix
   if (!m) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -311,7 +311,7 @@ int make_row_range(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(1, num_cols); // allocates and zeroes the matrix
+  gsl_matrix* mat = pool_matrix_calloc(1, num_cols); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -353,7 +353,7 @@ int make_matrix_of_ones(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(n, m); // allocates and zeroes the matrix
+  gsl_matrix* mat = pool_matrix_calloc(n, m); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -395,7 +395,7 @@ int make_matrix_of_zeroes(Stack* stack) {
     return 1;
   }
 
-  gsl_matrix* mat = gsl_matrix_calloc(n, m); // allocates and zeroes the matrix
+  gsl_matrix* mat = pool_matrix_calloc(n, m); // allocates and zeroes the matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
@@ -406,6 +406,66 @@ int make_matrix_of_zeroes(Stack* stack) {
 
 extern gsl_rng* global_rng;  // Assume you initialize this elsewhere
 
+// A random matrix of more than one chunk is filled a chunk at a time in
+// parallel, each chunk from its own generator seeded off global_rng. Which
+// way a matrix is drawn depends on its size alone, never on the thread
+// count or parallel_min_elements, so a seed gives the same numbers whatever
+// the performance settings.
+#define RANDOM_CHUNK 65536
+
+typedef struct {
+  double (*draw)(const gsl_rng*);
+  gsl_rng** chunk_rng;
+  double* data;
+} random_job;
+
+static void random_slice(size_t begin, size_t end, void* arg) {
+  const random_job* job = arg;
+  for (size_t k = begin; k < end; k++)
+    job->data[k] = job->draw(job->chunk_rng[k / RANDOM_CHUNK]);
+}
+
+static double standard_gaussian(const gsl_rng* rng) {
+  return gsl_ran_gaussian(rng, 1.0);
+}
+
+static int fill_random(gsl_matrix* mat, double (*draw)(const gsl_rng*)) {
+  size_t rows = mat->size1, cols = mat->size2;
+  size_t n = rows * cols;
+
+  if (n <= RANDOM_CHUNK || mat->tda != cols) {
+    for (size_t i = 0; i < rows; ++i)
+      for (size_t j = 0; j < cols; ++j)
+        gsl_matrix_set(mat, i, j, draw(global_rng));
+    return 0;
+  }
+
+  size_t chunks = (n + RANDOM_CHUNK - 1) / RANDOM_CHUNK;
+  gsl_rng** chunk_rng = calloc(chunks, sizeof(gsl_rng*));
+  if (!chunk_rng) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return 1;
+  }
+  int status = 0;
+  for (size_t c = 0; c < chunks; c++) {
+    chunk_rng[c] = gsl_rng_alloc(gsl_rng_mt19937);
+    if (!chunk_rng[c]) {
+      fprintf(stderr, "Failed to allocate random number generator.\n");
+      status = 1;
+      break;
+    }
+    gsl_rng_set(chunk_rng[c], gsl_rng_get(global_rng));
+  }
+  if (status == 0) {
+    random_job job = { draw, chunk_rng, mat->data };
+    parallel_for(n, RANDOM_CHUNK, random_slice, &job);
+  }
+  for (size_t c = 0; c < chunks; c++)
+    if (chunk_rng[c]) gsl_rng_free(chunk_rng[c]);
+  free(chunk_rng);
+  return status;
+}
+
 int make_random_matrix(Stack* stack) {
   if (stack->top < 1) {
     fprintf(stderr, "Stack underflow: need two dimensions to create the matrix.\n");
@@ -433,17 +493,15 @@ int make_random_matrix(Stack* stack) {
 
   //    gsl_rng * rng = gsl_rng_alloc(gsl_rng_mt19937);
     
-  gsl_matrix* mat = gsl_matrix_alloc(n, m);  // Allocate uninitialized matrix
+  gsl_matrix* mat = pool_matrix_alloc(n, m);  // Allocate uninitialized matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
   }
 
-  for (int i = 0; i < n; ++i) {
-    for (int j = 0; j < m; ++j) {
-      double u = gsl_rng_uniform(global_rng); // uniform [0,1)
-      gsl_matrix_set(mat, i, j, u);
-    }
+  if (fill_random(mat, gsl_rng_uniform) != 0) {  // uniform [0,1)
+    pool_matrix_free(mat);
+    return 1;
   }
   push_matrix_real(stack, mat);
   return 0;
@@ -473,17 +531,15 @@ int make_gaussian_random_matrix(Stack* stack) {
     fprintf(stderr, "Dimensions must be positive, got %d x %d.\n", n, m);
     return 1;
   }
-  gsl_matrix* mat = gsl_matrix_alloc(n, m);  // Allocate uninitialized matrix
+  gsl_matrix* mat = pool_matrix_alloc(n, m);  // Allocate uninitialized matrix
   if (!mat) {
     fprintf(stderr, "Failed to allocate matrix.\n");
     return 1;
   }
 
-  for (int i = 0; i < n; ++i) {
-    for (int j = 0; j < m; ++j) {
-      double u = gsl_ran_gaussian(global_rng,1.0); // uniform [0,1)
-      gsl_matrix_set(mat, i, j, u);
-    }
+  if (fill_random(mat, standard_gaussian) != 0) {
+    pool_matrix_free(mat);
+    return 1;
   }
   push_matrix_real(stack, mat);
   return 0;
@@ -564,7 +620,7 @@ int reshape_matrix(Stack* stack) {
             return 1;
         }
 
-        gsl_matrix* reshaped = gsl_matrix_alloc(new_rows, new_cols);
+        gsl_matrix* reshaped = pool_matrix_alloc(new_rows, new_cols);
         if (!reshaped) {
             fprintf(stderr, "Allocation failed for reshaped matrix.\n");
             return 1;
@@ -582,7 +638,7 @@ int reshape_matrix(Stack* stack) {
         }
 
         // Replace original matrix
-        gsl_matrix_free(original);
+        matrix_release(original);
         mat_elem->matrix_real = reshaped;
 
     } else if (mat_elem->type == TYPE_MATRIX_COMPLEX) {
@@ -599,7 +655,7 @@ int reshape_matrix(Stack* stack) {
             return 1;
         }
 
-        gsl_matrix_complex* reshaped = gsl_matrix_complex_alloc(new_rows, new_cols);
+        gsl_matrix_complex* reshaped = pool_matrix_complex_alloc(new_rows, new_cols);
         if (!reshaped) {
             fprintf(stderr, "Allocation failed for reshaped complex matrix.\n");
             return 1;
@@ -615,7 +671,7 @@ int reshape_matrix(Stack* stack) {
             }
         }
 
-        gsl_matrix_complex_free(original);
+        matrix_complex_release(original);
         mat_elem->matrix_complex = reshaped;
 
     } else {
@@ -652,7 +708,7 @@ int make_diag_matrix(Stack *stack) {
         // Remove original vector from stack
         stack->top--;
 
-        gsl_matrix *diag = gsl_matrix_calloc(len, len);
+        gsl_matrix *diag = pool_matrix_calloc(len, len);
         for (size_t i = 0; i < len; ++i) {
             double val = (vec->size1 == 1)
                          ? gsl_matrix_get(vec, 0, i)
@@ -661,7 +717,7 @@ int make_diag_matrix(Stack *stack) {
         }
 
         push_matrix_real(stack, diag);
-        gsl_matrix_free(vec);
+        matrix_release(vec);
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex *vec = top->matrix_complex;
@@ -678,7 +734,7 @@ int make_diag_matrix(Stack *stack) {
 
         stack->top--;
 
-        gsl_matrix_complex *diag = gsl_matrix_complex_calloc(len, len);
+        gsl_matrix_complex *diag = pool_matrix_complex_calloc(len, len);
         for (size_t i = 0; i < len; ++i) {
             gsl_complex val = (vec->size1 == 1)
                               ? gsl_matrix_complex_get(vec, 0, i)
@@ -687,7 +743,7 @@ int make_diag_matrix(Stack *stack) {
         }
 
         push_matrix_complex(stack, diag);
-        gsl_matrix_complex_free(vec);
+        matrix_complex_release(vec);
     }
     else {
         fprintf(stderr, "Error: top of stack is not a matrix.\n");
@@ -716,10 +772,10 @@ int stack_join_matrix_vertical(Stack* stack) {
 
     if (mixed) {
         // Promote both to complex
-        gsl_matrix_complex* mc1 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc1 = pool_matrix_complex_alloc(
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size1 : second->matrix_complex->size1,
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size2 : second->matrix_complex->size2);
-        gsl_matrix_complex* mc2 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc2 = pool_matrix_complex_alloc(
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size1 : top->matrix_complex->size1,
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size2 : top->matrix_complex->size2);
 
@@ -746,13 +802,13 @@ int stack_join_matrix_vertical(Stack* stack) {
         // Check column compatibility
         if (mc1->size2 != mc2->size2) {
             fprintf(stderr, "Column sizes must match to join matrices.\n");
-            gsl_matrix_complex_free(mc1);
-            gsl_matrix_complex_free(mc2);
+            pool_matrix_complex_free(mc1);
+            pool_matrix_complex_free(mc2);
             return 1;
         }
 
         // Allocate joined matrix
-        gsl_matrix_complex* joined = gsl_matrix_complex_alloc(mc1->size1 + mc2->size1, mc1->size2);
+        gsl_matrix_complex* joined = pool_matrix_complex_alloc(mc1->size1 + mc2->size1, mc1->size2);
         gsl_matrix_complex_view top_block =
 	  gsl_matrix_complex_submatrix(joined, 0, 0, mc1->size1, mc1->size2);
         gsl_matrix_complex_view bot_block =
@@ -762,8 +818,8 @@ int stack_join_matrix_vertical(Stack* stack) {
         gsl_matrix_complex_memcpy(&bot_block.matrix, mc2);
 
         // Clean up
-        gsl_matrix_complex_free(mc1);
-        gsl_matrix_complex_free(mc2);
+        pool_matrix_complex_free(mc1);
+        pool_matrix_complex_free(mc2);
 
         // Pop both, push result
         pop(stack);
@@ -780,7 +836,7 @@ int stack_join_matrix_vertical(Stack* stack) {
         rows2 = top->matrix_real->size1;
         cols1 = second->matrix_real->size2;
 
-        gsl_matrix* joined = gsl_matrix_alloc(rows1 + rows2, cols1);
+        gsl_matrix* joined = pool_matrix_alloc(rows1 + rows2, cols1);
         gsl_matrix_view top_block = gsl_matrix_submatrix(joined, 0, 0, rows1, cols1);
         gsl_matrix_view bot_block = gsl_matrix_submatrix(joined, rows1, 0, rows2, cols1);
 
@@ -809,10 +865,10 @@ int stack_join_matrix_horizontal(Stack* stack) {
     bool mixed = top_complex || second_complex;
 
     if (mixed) {
-        gsl_matrix_complex* mc1 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc1 = pool_matrix_complex_alloc(
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size1 : second->matrix_complex->size1,
             (second->type == TYPE_MATRIX_REAL) ? second->matrix_real->size2 : second->matrix_complex->size2);
-        gsl_matrix_complex* mc2 = gsl_matrix_complex_alloc(
+        gsl_matrix_complex* mc2 = pool_matrix_complex_alloc(
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size1 : top->matrix_complex->size1,
             (top->type == TYPE_MATRIX_REAL) ? top->matrix_real->size2 : top->matrix_complex->size2);
 
@@ -838,12 +894,12 @@ int stack_join_matrix_horizontal(Stack* stack) {
         // Check row compatibility
         if (mc1->size1 != mc2->size1) {
             fprintf(stderr, "Row sizes must match to join matrices horizontally.\n");
-            gsl_matrix_complex_free(mc1);
-            gsl_matrix_complex_free(mc2);
+            pool_matrix_complex_free(mc1);
+            pool_matrix_complex_free(mc2);
             return 1;
         }
 
-        gsl_matrix_complex* joined = gsl_matrix_complex_alloc(mc1->size1, mc1->size2 + mc2->size2);
+        gsl_matrix_complex* joined = pool_matrix_complex_alloc(mc1->size1, mc1->size2 + mc2->size2);
         gsl_matrix_complex_view left =
 	  gsl_matrix_complex_submatrix(joined, 0, 0, mc1->size1, mc1->size2);
         gsl_matrix_complex_view right =
@@ -852,8 +908,8 @@ int stack_join_matrix_horizontal(Stack* stack) {
         gsl_matrix_complex_memcpy(&left.matrix, mc1);
         gsl_matrix_complex_memcpy(&right.matrix, mc2);
 
-        gsl_matrix_complex_free(mc1);
-        gsl_matrix_complex_free(mc2);
+        pool_matrix_complex_free(mc1);
+        pool_matrix_complex_free(mc2);
 
         pop(stack);
         pop(stack);
@@ -869,7 +925,7 @@ int stack_join_matrix_horizontal(Stack* stack) {
         size_t cols1 = second->matrix_real->size2;
         size_t cols2 = top->matrix_real->size2;
 
-        gsl_matrix* joined = gsl_matrix_alloc(rows, cols1 + cols2);
+        gsl_matrix* joined = pool_matrix_alloc(rows, cols1 + cols2);
         gsl_matrix_view left = gsl_matrix_submatrix(joined, 0, 0, rows, cols1);
         gsl_matrix_view right = gsl_matrix_submatrix(joined, 0, cols1, rows, cols2);
 
@@ -883,6 +939,83 @@ int stack_join_matrix_horizontal(Stack* stack) {
     return 0;
 }
 
+// **************** Cumulative sums ****************
+// cumsum_r scans each row on its own, rows split across the thread pool.
+// cumsum_c adds each row to the running row above it, a vector loop across
+// the row. On the thread pool the row parts of parallel_part_rows first
+// sum their rows; each part then starts from the sum of the parts before
+// it, added up in order, so results do not depend on the number of threads.
+typedef struct {
+  const gsl_matrix* m;
+  gsl_matrix* out;
+  size_t part_rows;
+  double* starts;     // cumsum_c: row part p starts from row p of these
+} cumsum_job;
+
+// Slices are whole rows: the grain is one row of elements
+static void cumsum_row_slice(size_t begin, size_t end, void* arg) {
+  const cumsum_job* job = arg;
+  size_t cols = job->m->size2;
+  for (size_t i = begin / cols; i < end / cols; i++) {
+    const double* x = job->m->data + i * job->m->tda;
+    double* y = job->out->data + i * job->out->tda;
+    double sum = 0.0;
+    for (size_t j = 0; j < cols; j++) {
+      sum += x[j];
+      y[j] = sum;
+    }
+  }
+}
+
+static size_t part_end(const cumsum_job* job, size_t begin) {
+  size_t rows = job->m->size1;
+  return rows - begin < job->part_rows ? rows : begin + job->part_rows;
+}
+
+// The column sums of part p, as the start of part p + 1
+static void cumsum_total_part(size_t part, void* arg) {
+  const cumsum_job* job = arg;
+  size_t cols = job->m->size2;
+  double* total = job->starts + (part + 1) * cols;
+  for (size_t j = 0; j < cols; j++) total[j] = 0.0;
+  for (size_t i = part * job->part_rows; i < part_end(job, part * job->part_rows); i++)
+    simd_real(SIMD_ADD, total, job->m->data + i * job->m->tda, total, cols);
+}
+
+static void cumsum_col_part(size_t part, void* arg) {
+  const cumsum_job* job = arg;
+  size_t cols = job->m->size2;
+  const double* above = job->starts + part * cols;
+  for (size_t i = part * job->part_rows; i < part_end(job, part * job->part_rows); i++) {
+    double* y = job->out->data + i * job->out->tda;
+    simd_real(SIMD_ADD, above, job->m->data + i * job->m->tda, y, cols);
+    above = y;
+  }
+}
+
+static int cumsum_cols_real(const gsl_matrix* m, gsl_matrix* out) {
+  size_t rows = m->size1;
+  size_t cols = m->size2;
+  size_t part_rows = parallel_part_rows(rows, cols);
+  size_t parts = rows ? (rows + part_rows - 1) / part_rows : 1;
+
+  double* starts = calloc(parts * (cols ? cols : 1), sizeof(double));
+  if (!starts) {
+    fprintf(stderr, "Failed to allocate cumulative sum buffers.\n");
+    return 1;
+  }
+  cumsum_job job = { m, out, part_rows, starts };
+  if (parts > 1) {
+    parallel_for_parts(parts - 1, part_rows * cols, cumsum_total_part, &job);
+    for (size_t part = 2; part < parts; part++)
+      simd_real(SIMD_ADD, starts + (part - 1) * cols, starts + part * cols,
+		starts + part * cols, cols);
+  }
+  parallel_for_parts(parts, part_rows * cols, cumsum_col_part, &job);
+  free(starts);
+  return 0;
+}
+
 int matrix_cumsum_rows(Stack* stack) {
     if (stack->top < 0) {
         fprintf(stderr, "Stack underflow: expected a matrix.\n");
@@ -893,22 +1026,21 @@ int matrix_cumsum_rows(Stack* stack) {
 
     if (top->type == TYPE_MATRIX_REAL) {
         gsl_matrix* m = top->matrix_real;
-        gsl_matrix* result = gsl_matrix_alloc(m->size1, m->size2);
-
-        for (size_t i = 0; i < m->size1; i++) {
-            double sum = 0.0;
-            for (size_t j = 0; j < m->size2; j++) {
-                sum += gsl_matrix_get(m, i, j);
-                gsl_matrix_set(result, i, j, sum);
-            }
+        gsl_matrix* result = pool_matrix_alloc(m->size1, m->size2);
+        if (!result) {
+            fprintf(stderr, "Failed to allocate result matrix.\n");
+            return 1;
         }
 
-        pop(stack);
+        cumsum_job job = { .m = m, .out = result };
+        parallel_for(m->size1 * m->size2, m->size2, cumsum_row_slice, &job);
+
+        pop_and_free(stack);
         push_matrix_real(stack, result);
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex* m = top->matrix_complex;
-        gsl_matrix_complex* result = gsl_matrix_complex_alloc(m->size1, m->size2);
+        gsl_matrix_complex* result = pool_matrix_complex_alloc(m->size1, m->size2);
 
         for (size_t i = 0; i < m->size1; i++) {
             gsl_complex sum = gsl_complex_rect(0.0, 0.0);
@@ -919,7 +1051,7 @@ int matrix_cumsum_rows(Stack* stack) {
             }
         }
 
-        pop(stack);
+        pop_and_free(stack);
         push_matrix_complex(stack, result);
     }
     else {
@@ -939,22 +1071,22 @@ int matrix_cumsum_cols(Stack* stack) {
 
     if (top->type == TYPE_MATRIX_REAL) {
         gsl_matrix* m = top->matrix_real;
-        gsl_matrix* result = gsl_matrix_alloc(m->size1, m->size2);
-
-        for (size_t j = 0; j < m->size2; j++) {
-            double sum = 0.0;
-            for (size_t i = 0; i < m->size1; i++) {
-                sum += gsl_matrix_get(m, i, j);
-                gsl_matrix_set(result, i, j, sum);
-            }
+        gsl_matrix* result = pool_matrix_alloc(m->size1, m->size2);
+        if (!result) {
+            fprintf(stderr, "Failed to allocate result matrix.\n");
+            return 1;
+        }
+        if (cumsum_cols_real(m, result) != 0) {
+            pool_matrix_free(result);
+            return 1;
         }
 
-        pop(stack);
+        pop_and_free(stack);
         push_matrix_real(stack, result);
     }
     else if (top->type == TYPE_MATRIX_COMPLEX) {
         gsl_matrix_complex* m = top->matrix_complex;
-        gsl_matrix_complex* result = gsl_matrix_complex_alloc(m->size1, m->size2);
+        gsl_matrix_complex* result = pool_matrix_complex_alloc(m->size1, m->size2);
 
         for (size_t j = 0; j < m->size2; j++) {
             gsl_complex sum = gsl_complex_rect(0.0, 0.0);
@@ -965,7 +1097,7 @@ int matrix_cumsum_cols(Stack* stack) {
             }
         }
 
-        pop(stack);
+        pop_and_free(stack);
         push_matrix_complex(stack, result);
     }
     else {
@@ -46,6 +46,7 @@ int extract_day_month_year(Stack* stack) {
     fprintf(stderr, "Error: Invalid date format. Expected DD.MM.YYYY\n");
     return 1;
   }
+  if (stack_reserve(stack, 3) != 0) return 1;
 
   // Push year
   stack_element y = { .type = TYPE_REAL, .real = year };
@@ -120,8 +121,7 @@ int date_plus_days(Stack* stack) {
   out.type = TYPE_STRING;
   out.string = result;
 
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr, "Error: Stack overflow\n");
+  if (stack_reserve(stack, 1) != 0) {
     free(result);
     return 1;
   }
@@ -182,8 +182,7 @@ int push_weekday_name_from_date_string(Stack* stack) {
   out.type = TYPE_STRING;
   out.string = result;
 
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr, "Error: Stack overflow\n");
+  if (stack_reserve(stack, 1) != 0) {
     free(result);
     return 1;
   }
@@ -224,8 +223,7 @@ int push_today_date(Stack* stack) {
   elem.type = TYPE_STRING;
   elem.string = date_str;
 
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr, "Error: stack overflow\n");
+  if (stack_reserve(stack, 1) != 0) {
     free(date_str);
     return 1;
   }
@@ -0,0 +1,184 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>            // for pthread_create, pthread_cond_wait
+#include <stdatomic.h>          // for atomic_size_t, atomic_fetch_add
+#include <stdio.h>              // for fprintf, stderr
+#include <unistd.h>             // for sysconf, _SC_NPROCESSORS_ONLN
+#include "parallel.h"
+
+// The workers sleep on `wake` between jobs. parallel_for publishes a job
+// under the lock, bumps the generation and broadcasts; every thread, the
+// caller included, then claims slices from an atomic cursor until none are
+// left. The last worker to finish signals `done`.
+
+int thread_count = 0;
+int parallel_min_elements = PARALLEL_MIN_ELEMENTS_DEFAULT;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+static pthread_t workers[PARALLEL_MAX_THREADS];
+static int started = 0;          // running workers, not counting the caller
+static unsigned long start_generation;  // the last job before the workers started
+
+static struct {
+  parallel_body body;
+  void* arg;
+  size_t n;
+  size_t slice;
+  atomic_size_t next;           // first element not yet claimed
+  unsigned long generation;     // bumped for every job
+  int busy;                     // workers not yet done with this job
+  int stop;
+} job;
+
+static _Thread_local int inside_body = 0;
+
+// Parts are at least this many elements, and there are at most this many
+#define PART_MIN_ELEMENTS 65536
+#define PART_MAX 64
+
+static void run_slices(void) {
+  size_t begin;
+  while ((begin = atomic_fetch_add(&job.next, job.slice)) < job.n) {
+    size_t end = job.n - begin < job.slice ? job.n : begin + job.slice;
+    job.body(begin, end, job.arg);
+  }
+}
+
+static void* worker(void* unused) {
+  (void)unused;
+  inside_body = 1;
+  pthread_mutex_lock(&lock);
+  // Not job.generation: the first job may be published before we get here
+  unsigned long seen = start_generation;
+  for (;;) {
+    while (!job.stop && job.generation == seen) pthread_cond_wait(&wake, &lock);
+    if (job.stop) break;
+    seen = job.generation;
+    pthread_mutex_unlock(&lock);
+    run_slices();
+    pthread_mutex_lock(&lock);
+    if (--job.busy == 0) pthread_cond_signal(&done);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+void free_parallel(void) {
+  pthread_mutex_lock(&lock);
+  job.stop = 1;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  for (int k = 0; k < started; k++) pthread_join(workers[k], NULL);
+  started = 0;
+  job.stop = 0;
+}
+
+// Restart the pool if the thread count changed since it was started
+static void ensure_workers(int count) {
+  if (count == started) return;
+  free_parallel();
+  start_generation = job.generation;
+  while (started < count) {
+    if (pthread_create(&workers[started], NULL, worker, NULL) != 0) {
+      fprintf(stderr, "Could not start worker thread %d; using %d\n", started + 1, started);
+      break;
+    }
+    started++;
+  }
+}
+
+int parallel_threads(void) {
+  static int cores = 0;
+  if (thread_count > 0)
+    return thread_count < PARALLEL_MAX_THREADS ? thread_count : PARALLEL_MAX_THREADS;
+  if (cores == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    cores = online < 1 ? 1 : online > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int)online;
+  }
+  return cores;
+}
+
+void parallel_for(size_t n, size_t grain, parallel_body body, void* arg) {
+  if (n == 0) return;
+  int threads = parallel_threads();
+  if (inside_body || threads < 2 || n < (size_t)parallel_min_elements) {
+    body(0, n, arg);
+    return;
+  }
+  ensure_workers(threads - 1);
+  if (started == 0) {
+    body(0, n, arg);
+    return;
+  }
+
+  // Four slices a thread even out threads that start late or run slow
+  if (grain == 0) grain = 1;
+  size_t slice = n / ((size_t)(started + 1) * 4);
+  slice = (slice + grain - 1) / grain * grain;
+  if (slice < grain) slice = grain;
+
+  pthread_mutex_lock(&lock);
+  job.body = body;
+  job.arg = arg;
+  job.n = n;
+  job.slice = slice;
+  atomic_store(&job.next, 0);
+  job.busy = started;
+  job.generation++;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  inside_body = 1;
+  run_slices();
+  inside_body = 0;
+
+  pthread_mutex_lock(&lock);
+  while (job.busy > 0) pthread_cond_wait(&done, &lock);
+  pthread_mutex_unlock(&lock);
+}
+
+size_t parallel_part_rows(size_t rows, size_t cols) {
+  size_t parts = rows * cols / PART_MIN_ELEMENTS;
+  if (parts > PART_MAX) parts = PART_MAX;
+  if (parts < 1) parts = 1;
+  size_t part_rows = (rows + parts - 1) / parts;
+  return part_rows ? part_rows : 1;
+}
+
+typedef struct {
+  parallel_part_body body;
+  void* arg;
+  size_t weight;
+} part_job;
+
+// Slices start on a multiple of the grain, which is one part
+static void part_slice(size_t begin, size_t end, void* arg) {
+  const part_job* job = arg;
+  for (size_t part = begin / job->weight; part * job->weight < end; part++)
+    job->body(part, job->arg);
+}
+
+void parallel_for_parts(size_t parts, size_t weight, parallel_part_body body, void* arg) {
+  if (weight == 0) weight = 1;
+  part_job job = { body, arg, weight };
+  parallel_for(parts * weight, weight, part_slice, &job);
+}
@@ -0,0 +1,264 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Peephole pass over compiled word and macro bodies. Short RPN idioms that
+// the predefined macros use all the time (dup *, dup ' swap *, svd drop swap
+// drop, ...) are replaced by one superinstruction that does the same work
+// without the intermediate copies. Each superinstruction only takes its fast
+// path for the operand types it knows; anything else replays the original
+// sequence, so results and error messages stay exactly the same.
+
+#include <gsl/gsl_blas.h>    // for gsl_blas_dgemm, gsl_blas_zgemm, gsl_blas_dsyrk
+#include <stdio.h>           // for printf
+#include <string.h>          // for strcmp
+#include "bytecode.h"        // for compiled_line, compiled_instr, CODE_FUSED
+#include "binary_fun.h"      // for add_top_two, sub_top_two, mul_top_two, ...
+#include "eval_fun.h"        // for builtin_handler, builtin_reach
+#include "function_list.h"   // for function_names, function_opcode
+#include "linear_algebra.h"  // for matrix_singular_values
+#include "pool.h"           // for pool_matrix_alloc, pool_matrix_complex_alloc
+#include "peephole.h"
+
+#define MAX_FUSION_LEN 4
+
+// Arithmetic operators compile to CODE_BINARY rather than CODE_BUILTIN
+static const struct {
+  const char* name;
+  token_type op;
+  builtin_func func;
+} binary_ops[] = {
+  {"+", TOK_PLUS,  add_top_two},
+  {"-", TOK_MINUS, sub_top_two},
+  {"*", TOK_STAR,  mul_top_two},
+  {"/", TOK_SLASH, div_top_two},
+  {"^", TOK_CARET, pow_top_two},
+};
+
+#define BINARY_OP_COUNT ((int)(sizeof(binary_ops) / sizeof(binary_ops[0])))
+
+typedef struct {
+  const char* name;
+  const char* pattern[MAX_FUSION_LEN + 1];   // NULL-terminated
+  int (*fast)(Stack* stack);                 // 0 if it handled the operands,
+                                             // -1 if it left them alone, 1 if
+                                             // its first step failed
+  int length;
+  builtin_func steps[MAX_FUSION_LEN];        // the original sequence
+  int reach;                                 // stack depth the steps may touch
+  int sites;                                 // places it was fused
+  long runs;
+  long fast_runs;
+} fusion;
+
+// **************** Superinstructions ****************
+// dup * : square the top in place instead of copying it first
+static int fast_square(Stack* stack) {
+  if (stack->top < 0) return -1;
+  stack_element* x = &stack->items[stack->top];
+  switch (x->type) {
+  case TYPE_REAL:
+    x->real *= x->real;
+    return 0;
+  case TYPE_COMPLEX:
+    x->complex_val = gsl_complex_mul(x->complex_val, x->complex_val);
+    return 0;
+  case TYPE_MATRIX_REAL: {
+    gsl_matrix* a = x->matrix_real;
+    if (a->size1 != a->size2) return -1;
+    gsl_matrix* result = pool_matrix_alloc(a->size1, a->size2);
+    if (!result) return -1;
+    gsl_blas_dgemm(CblasNoTrans, CblasNoTrans, 1.0, a, a, 0.0, result);
+    matrix_release(a);
+    x->matrix_real = result;
+    return 0;
+  }
+  case TYPE_MATRIX_COMPLEX: {
+    gsl_matrix_complex* a = x->matrix_complex;
+    if (a->size1 != a->size2) return -1;
+    gsl_matrix_complex* result = pool_matrix_complex_alloc(a->size1, a->size2);
+    if (!result) return -1;
+    gsl_blas_zgemm(CblasNoTrans, CblasNoTrans, GSL_COMPLEX_ONE, a, a,
+                   GSL_COMPLEX_ZERO, result);
+    matrix_complex_release(a);
+    x->matrix_complex = result;
+    return 0;
+  }
+  default:
+    return -1;
+  }
+}
+
+// dup ' swap * : X'X is symmetric, so a rank-k update (syrk) computes one
+// triangle without materializing the transpose
+static int fast_gram(Stack* stack) {
+  if (stack->top < 0) return -1;
+  stack_element* x = &stack->items[stack->top];
+  if (x->type != TYPE_MATRIX_REAL) return -1;
+  gsl_matrix* a = x->matrix_real;
+  size_t n = a->size2;
+  gsl_matrix* result = pool_matrix_alloc(n, n);
+  if (!result) return -1;
+  gsl_blas_dsyrk(CblasUpper, CblasTrans, 1.0, a, 0.0, result);
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = 0; j < i; j++)
+      gsl_matrix_set(result, i, j, gsl_matrix_get(result, j, i));
+  matrix_release(a);
+  x->matrix_real = result;
+  return 0;
+}
+
+// svd drop swap drop : only the singular values survive
+static int fast_singular_values(Stack* stack) {
+  if (stack->top < 0 || stack->items[stack->top].type != TYPE_MATRIX_REAL) return -1;
+  // A failed SVD has already popped the matrix, just as svd would have
+  return matrix_singular_values(stack);
+}
+
+// swap - and swap / on two real scalars
+static int fast_reverse_sub(Stack* stack) {
+  if (stack->top < 1 || stack->items[stack->top - 1].type != TYPE_REAL ||
+      stack->items[stack->top].type != TYPE_REAL) return -1;
+  double b = pop(stack).real;
+  stack_element* a = &stack->items[stack->top];
+  a->real = b - a->real;
+  return 0;
+}
+
+static int fast_reverse_div(Stack* stack) {
+  if (stack->top < 1 || stack->items[stack->top - 1].type != TYPE_REAL ||
+      stack->items[stack->top].type != TYPE_REAL) return -1;
+  double b = pop(stack).real;
+  stack_element* a = &stack->items[stack->top];
+  a->real = b / a->real;
+  return 0;
+}
+
+static fusion fusions[] = {
+  {"square",          {"dup", "*", NULL},                   fast_square,          0, {0}, 0, 0, 0, 0},
+  {"gram",            {"dup", "'", "swap", "*", NULL},      fast_gram,            0, {0}, 0, 0, 0, 0},
+  {"singular_values", {"svd", "drop", "swap", "drop", NULL}, fast_singular_values, 0, {0}, 0, 0, 0, 0},
+  {"reverse_sub",     {"swap", "-", NULL},                  fast_reverse_sub,     0, {0}, 0, 0, 0, 0},
+  {"reverse_div",     {"swap", "/", NULL},                  fast_reverse_div,     0, {0}, 0, 0, 0, 0},
+};
+
+#define FUSION_COUNT ((int)(sizeof(fusions) / sizeof(fusions[0])))
+
+static builtin_func step_handler(const char* name) {
+  for (int i = 0; i < BINARY_OP_COUNT; i++)
+    if (strcmp(binary_ops[i].name, name) == 0) return binary_ops[i].func;
+  return builtin_handler(function_opcode(name));
+}
+
+static int step_reach(const char* name) {
+  for (int i = 0; i < BINARY_OP_COUNT; i++)
+    if (strcmp(binary_ops[i].name, name) == 0) return 2;
+  return builtin_reach(function_opcode(name));
+}
+
+// Resolves every pattern once; a pattern naming an unknown word never fires
+static void init_fusions(void) {
+  static int ready = 0;
+  if (ready) return;
+  ready = 1;
+  for (int f = 0; f < FUSION_COUNT; f++) {
+    int n = 0;
+    while (fusions[f].pattern[n]) {
+      fusions[f].steps[n] = step_handler(fusions[f].pattern[n]);
+      if (!fusions[f].steps[n]) fusions[f].fast = NULL;
+      // Each step may start where the one before left off when it failed,
+      // so the reaches add up
+      int r = step_reach(fusions[f].pattern[n]);
+      fusions[f].reach = (r < 0 || fusions[f].reach < 0) ? -1 : fusions[f].reach + r;
+      n++;
+    }
+    fusions[f].length = n;
+  }
+}
+
+// **************** The pass ****************
+static const char* instr_name(const compiled_instr* in) {
+  if (in->type == CODE_BUILTIN && in->opcode >= 0) return function_names[in->opcode];
+  if (in->type == CODE_BINARY)
+    for (int i = 0; i < BINARY_OP_COUNT; i++)
+      if (binary_ops[i].op == in->op) return binary_ops[i].name;
+  return NULL;
+}
+
+static int match_fusion(const compiled_line* cl, int at) {
+  for (int f = 0; f < FUSION_COUNT; f++) {
+    if (!fusions[f].fast || at + fusions[f].length > cl->count) continue;
+    int k = 0;
+    for (; k < fusions[f].length; k++) {
+      const char* name = instr_name(&cl->code[at + k]);
+      if (!name || strcmp(name, fusions[f].pattern[k]) != 0) break;
+    }
+    if (k == fusions[f].length) return f;
+  }
+  return -1;
+}
+
+void optimize_compiled_line(compiled_line* cl) {
+  if (!cl) return;
+  init_fusions();
+  int out = 0;
+  for (int i = 0; i < cl->count; ) {
+    int f = match_fusion(cl, i);
+    if (f < 0) {
+      cl->code[out++] = cl->code[i++];
+      continue;
+    }
+    // The fused instructions are builtins and operators, which own nothing
+    cl->code[out++] = (compiled_instr){ .type = CODE_FUSED, .opcode = OPCODE_NONE, .fusion = f };
+    i += fusions[f].length;
+    fusions[f].sites++;
+  }
+  cl->count = out;
+}
+
+void run_fusion(Stack* stack, int f) {
+  fusion* fu = &fusions[f];
+  fu->runs++;
+  int status = fu->fast(stack);
+  if (status == 0) {
+    fu->fast_runs++;
+    return;
+  }
+  // A positive status means the first step ran and failed with its own
+  // message; the rest then runs just as it would have unfused
+  for (int k = status > 0 ? 1 : 0; k < fu->length; k++) fu->steps[k](stack);
+}
+
+int fusion_reach(int f) {
+  init_fusions();
+  return fusions[f].reach;
+}
+
+void list_fusions(void) {
+  init_fusions();
+  printf("Fused sequences (sites fused, runs, fast-path runs):\n");
+  for (int f = 0; f < FUSION_COUNT; f++) {
+    printf("  %-16s", fusions[f].name);
+    char pattern[64] = "";
+    for (int k = 0; k < fusions[f].length; k++) {
+      if (k) strncat(pattern, " ", sizeof(pattern) - strlen(pattern) - 1);
+      strncat(pattern, fusions[f].pattern[k], sizeof(pattern) - strlen(pattern) - 1);
+    }
+    printf("%-22s %4d %8ld %8ld\n", pattern, fusions[f].sites,
+           fusions[f].runs, fusions[f].fast_runs);
+  }
+}
@@ -25,6 +25,7 @@
 #include <stdbool.h>                        // for bool
 #include <stdio.h>                          // for fprintf, stderr, size_t
 #include <stdlib.h>                         // for free, malloc
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "poly_fun.h"                       // for poly_eval, poly_roots
 
@@ -117,7 +118,7 @@ void poly_roots(Stack* stack) {
     return;
   }
 
-  gsl_matrix_complex* result = gsl_matrix_complex_alloc(1, n - 1);
+  gsl_matrix_complex* result = pool_matrix_complex_alloc(1, n - 1);
   for (size_t i = 0; i < n - 1; ++i) {
     double re = z[2 * i];
     double im = z[2 * i + 1];
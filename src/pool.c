@@ -0,0 +1,261 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Size-class pool for matrix temporaries. Every operator allocates its
+// result (and often a scratch matrix or two) and frees its operands, so a
+// loop over medium-size matrices keeps asking malloc for the same few sizes.
+// Here a freed matrix keeps its header, block and data together on a free
+// list for its class and the next request of that class takes it back as
+// is. The link to the next free matrix is kept in the first bytes of the
+// data block, so the lists cost no memory of their own.
+//
+// A matrix is only taken into the pool if it owns a 64-byte aligned block
+// whose size is exactly a class size. Anything else, including matrices
+// GSL allocated itself, goes back to gsl_matrix_free. The pool is not
+// thread safe; only the interpreter thread allocates stack matrices.
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>    // for uintptr_t, SIZE_MAX
+#include <stdio.h>     // for printf
+#include <stdlib.h>    // for malloc, free, posix_memalign
+#include <string.h>    // for memset
+#include "pool.h"
+
+#define POOL_ALIGN 64
+#define POOL_MIN_SHIFT 6      // smallest class is 64 bytes
+#define POOL_STEPS 4          // classes per doubling, so at most 25% slack
+#define POOL_CLASSES 77       // largest is 32 MiB; bigger ones bypass the pool
+
+int pool_retain_mb = POOL_RETAIN_MB_DEFAULT;
+
+typedef struct {
+  void* matrix;               // gsl_matrix or gsl_matrix_complex
+  double* data;               // its data, which holds the next link
+} pool_link;
+
+typedef struct {
+  pool_link head;
+  size_t count;
+} free_list;
+
+static free_list real_lists[POOL_CLASSES];
+static free_list complex_lists[POOL_CLASSES];
+
+static size_t retained_bytes = 0;
+static size_t peak_retained = 0;
+
+static struct {
+  unsigned long requests;     // allocations the pool could serve
+  unsigned long hits;         // ... and served from a free list
+  unsigned long bypassed;     // too big, empty or failed: went to GSL
+  unsigned long returned;     // frees kept on a free list
+  unsigned long released;     // frees handed back to GSL
+} stats;
+
+// **************** Size classes ****************
+// Four classes per power of two: 64, 80, 96, 112, 128, 160, ... bytes. With
+// plain powers of two a matrix just over one would take twice its size.
+static size_t class_bytes(int k) {
+  size_t octave = (size_t)1 << (POOL_MIN_SHIFT + k / POOL_STEPS);
+  return octave / POOL_STEPS * (size_t)(POOL_STEPS + k % POOL_STEPS);
+}
+
+// Smallest class holding n1 x n2 elements of elem_size bytes, or -1
+static int class_for(size_t n1, size_t n2, size_t elem_size) {
+  if (n1 == 0 || n2 == 0) return -1;   // let GSL report the bad size
+  if (n1 > SIZE_MAX / n2 / elem_size) return -1;
+  size_t bytes = n1 * n2 * elem_size;
+  for (int k = 0; k < POOL_CLASSES; k++)
+    if (bytes <= class_bytes(k)) return k;
+  return -1;
+}
+
+// Class of an allocated matrix, or -1 if its block cannot be reused as one
+static int class_of(int owner, const void* data, size_t block_size,
+                    const void* block_data, size_t elem_size) {
+  if (!owner || !data || data != block_data) return -1;
+  if ((uintptr_t)data % POOL_ALIGN != 0) return -1;
+  for (int k = 0; k < POOL_CLASSES; k++)
+    if (block_size * elem_size == class_bytes(k)) return k;
+  return -1;
+}
+
+static void* pop(free_list* list, int k) {
+  pool_link top = list->head;
+  if (!top.matrix) return NULL;
+  list->head = *(pool_link*)top.data;
+  list->count--;
+  retained_bytes -= class_bytes(k);
+  return top.matrix;
+}
+
+// Keeps m on the list unless that would go over the retention limit
+static int push(free_list* list, int k, void* m, double* data) {
+  if (retained_bytes + class_bytes(k) > (size_t)pool_retain_mb << 20) return -1;
+  *(pool_link*)data = list->head;
+  list->head = (pool_link){ m, data };
+  list->count++;
+  retained_bytes += class_bytes(k);
+  if (retained_bytes > peak_retained) peak_retained = retained_bytes;
+  return 0;
+}
+
+static double* aligned_data(int k) {
+  void* data = NULL;
+  if (posix_memalign(&data, POOL_ALIGN, class_bytes(k)) != 0) return NULL;
+  return data;
+}
+
+// **************** Real matrices ****************
+static gsl_matrix* new_matrix(int k) {
+  gsl_matrix* m = malloc(sizeof(gsl_matrix));
+  gsl_block* b = malloc(sizeof(gsl_block));
+  double* data = aligned_data(k);
+  if (!m || !b || !data) {
+    free(m);
+    free(b);
+    free(data);
+    return NULL;
+  }
+  b->size = class_bytes(k) / sizeof(double);
+  b->data = data;
+  m->data = data;
+  m->block = b;
+  m->owner = 1;
+  return m;
+}
+
+gsl_matrix* pool_matrix_alloc(size_t n1, size_t n2) {
+  int k = class_for(n1, n2, sizeof(double));
+  gsl_matrix* m = NULL;
+  if (k >= 0) {
+    stats.requests++;
+    m = pop(&real_lists[k], k);
+    if (m) stats.hits++;
+    else m = new_matrix(k);
+  }
+  if (!m) {
+    stats.bypassed++;
+    return gsl_matrix_alloc(n1, n2);
+  }
+  m->size1 = n1;
+  m->size2 = n2;
+  m->tda = n2;
+  return m;
+}
+
+gsl_matrix* pool_matrix_calloc(size_t n1, size_t n2) {
+  gsl_matrix* m = pool_matrix_alloc(n1, n2);
+  if (m) memset(m->data, 0, n1 * n2 * sizeof(double));
+  return m;
+}
+
+void pool_matrix_free(gsl_matrix* m) {
+  if (!m) return;
+  int k = m->block ? class_of(m->owner, m->data, m->block->size, m->block->data,
+                              sizeof(double))
+                   : -1;
+  if (k >= 0 && push(&real_lists[k], k, m, m->data) == 0) {
+    stats.returned++;
+    return;
+  }
+  stats.released++;
+  gsl_matrix_free(m);
+}
+
+// **************** Complex matrices ****************
+static gsl_matrix_complex* new_matrix_complex(int k) {
+  gsl_matrix_complex* m = malloc(sizeof(gsl_matrix_complex));
+  gsl_block_complex* b = malloc(sizeof(gsl_block_complex));
+  double* data = aligned_data(k);
+  if (!m || !b || !data) {
+    free(m);
+    free(b);
+    free(data);
+    return NULL;
+  }
+  b->size = class_bytes(k) / (2 * sizeof(double));
+  b->data = data;
+  m->data = data;
+  m->block = b;
+  m->owner = 1;
+  return m;
+}
+
+gsl_matrix_complex* pool_matrix_complex_alloc(size_t n1, size_t n2) {
+  int k = class_for(n1, n2, 2 * sizeof(double));
+  gsl_matrix_complex* m = NULL;
+  if (k >= 0) {
+    stats.requests++;
+    m = pop(&complex_lists[k], k);
+    if (m) stats.hits++;
+    else m = new_matrix_complex(k);
+  }
+  if (!m) {
+    stats.bypassed++;
+    return gsl_matrix_complex_alloc(n1, n2);
+  }
+  m->size1 = n1;
+  m->size2 = n2;
+  m->tda = n2;
+  return m;
+}
+
+gsl_matrix_complex* pool_matrix_complex_calloc(size_t n1, size_t n2) {
+  gsl_matrix_complex* m = pool_matrix_complex_alloc(n1, n2);
+  if (m) memset(m->data, 0, n1 * n2 * 2 * sizeof(double));
+  return m;
+}
+
+void pool_matrix_complex_free(gsl_matrix_complex* m) {
+  if (!m) return;
+  int k = m->block ? class_of(m->owner, m->data, m->block->size, m->block->data,
+                              2 * sizeof(double))
+                   : -1;
+  if (k >= 0 && push(&complex_lists[k], k, m, m->data) == 0) {
+    stats.returned++;
+    return;
+  }
+  stats.released++;
+  gsl_matrix_complex_free(m);
+}
+
+// **************** Statistics and cleanup ****************
+void print_pool_stats(void) {
+  double rate = stats.requests ? 100.0 * (double)stats.hits / (double)stats.requests : 0.0;
+  printf("Matrix pool: %lu requests, %lu hits (%.1f%%), %lu bypassed\n",
+         stats.requests, stats.hits, rate, stats.bypassed);
+  printf("  frees: %lu kept, %lu released\n", stats.returned, stats.released);
+  printf("  retained: %zu bytes (peak %zu, limit %d MB)\n",
+         retained_bytes, peak_retained, pool_retain_mb);
+  for (int k = 0; k < POOL_CLASSES; k++) {
+    if (!real_lists[k].count && !complex_lists[k].count) continue;
+    printf("  %10zu bytes: %zu real, %zu complex\n", class_bytes(k),
+           real_lists[k].count, complex_lists[k].count);
+  }
+}
+
+void free_pool(void) {
+  for (int k = 0; k < POOL_CLASSES; k++) {
+    gsl_matrix* m;
+    while ((m = pop(&real_lists[k], k))) gsl_matrix_free(m);
+    gsl_matrix_complex* mc;
+    while ((mc = pop(&complex_lists[k], k))) gsl_matrix_complex_free(mc);
+  }
+}
@@ -100,6 +100,9 @@ void print_stack(const Stack* stack, char *title) {
 	     stack->items[i].matrix_complex->size1,
 	     stack->items[i].matrix_complex->size2);
       break;
+    case TYPE_LAZY:
+      printf("[%d] Mℝ: pending expression\n", i);
+      break;
     }
   }
 }
@@ -0,0 +1,115 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>    // for uintptr_t, uint32_t
+#include <stdlib.h>    // for calloc, free
+#include "refcount.h"
+
+// **************** Shared payload table ****************
+// Open addressing on the payload address. An entry exists only while the
+// payload has more than one owner, so the table stays as small as the
+// amount of actual sharing and an empty table costs one compare per free.
+
+typedef struct {
+  const void* key;     // NULL = empty
+  int extra;           // owners beyond the first
+} ref_entry;
+
+static ref_entry* table = NULL;
+static uint32_t table_size = 0;   // power of two
+static uint32_t entry_count = 0;
+
+static uint32_t hash_pointer(const void* p) {
+  uintptr_t x = (uintptr_t)p >> 4;   // allocations are at least 16-aligned
+  return (uint32_t)(x * 2654435761u);
+}
+
+static ref_entry* find_entry(const void* p) {
+  if (entry_count == 0) return NULL;
+  for (uint32_t i = hash_pointer(p) & (table_size - 1); table[i].key;
+       i = (i + 1) & (table_size - 1))
+    if (table[i].key == p) return &table[i];
+  return NULL;
+}
+
+static void insert_entry(ref_entry e) {
+  uint32_t i = hash_pointer(e.key) & (table_size - 1);
+  while (table[i].key) i = (i + 1) & (table_size - 1);
+  table[i] = e;
+}
+
+static int grow_table(void) {
+  uint32_t n = table_size ? 2 * table_size : 256;
+  ref_entry* bigger = calloc(n, sizeof(ref_entry));
+  if (!bigger) return -1;
+  ref_entry* old = table;
+  uint32_t old_size = table_size;
+  table = bigger;
+  table_size = n;
+  for (uint32_t i = 0; i < old_size; i++)
+    if (old[i].key) insert_entry(old[i]);
+  free(old);
+  return 0;
+}
+
+// Backward-shift delete keeps probe chains intact without tombstones
+static void remove_entry(ref_entry* e) {
+  uint32_t i = (uint32_t)(e - table);
+  table[i].key = NULL;
+  for (uint32_t j = (i + 1) & (table_size - 1); table[j].key;
+       j = (j + 1) & (table_size - 1)) {
+    uint32_t home = hash_pointer(table[j].key) & (table_size - 1);
+    // Move j into the hole if its home slot is not between the hole and j
+    if (((j - home) & (table_size - 1)) >= ((j - i) & (table_size - 1))) {
+      table[i] = table[j];
+      table[j].key = NULL;
+      i = j;
+    }
+  }
+  entry_count--;
+}
+
+int payload_retain(const void* p) {
+  if (!p) return 0;
+  ref_entry* e = find_entry(p);
+  if (e) {
+    e->extra++;
+    return 0;
+  }
+  if (2 * (entry_count + 1) > table_size && grow_table() != 0) return -1;
+  insert_entry((ref_entry){ p, 1 });
+  entry_count++;
+  return 0;
+}
+
+int payload_shared(const void* p) {
+  return find_entry(p) != NULL;
+}
+
+int payload_release(const void* p) {
+  ref_entry* e = find_entry(p);
+  if (!e) return 1;
+  if (--e->extra == 0) remove_entry(e);
+  return 0;
+}
+
+void free_payload_refs(void) {
+  free(table);
+  table = NULL;
+  table_size = entry_count = 0;
+}
@@ -22,52 +22,23 @@
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_alloc
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix_alloc, gsl_mat...
 #include <stdbool.h>                        // for false, true
-#include <stdio.h>                          // for fprintf, printf, sscanf
+#include <stdio.h>                          // for fprintf, printf, sscanf, getline
 #include <stdlib.h>                         // for size_t, NULL, free
 #include <string.h>                         // for strchr, strcmp, strdup
+#include <sys/types.h>                      // for ssize_t
+#include "numconv.h"                        // for format_double, parse_double
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "registers.h"                      // for registers, MAX_REG, Register
 
+// Registers share matrix and string payloads with the stack (see stack.h)
 stack_element copy_element(const stack_element* src) {
   stack_element copy;
-  copy.type = src->type;
-
-  switch (src->type) {
-  case TYPE_REAL:
-    copy.real = src->real;
-    break;
-
-  case TYPE_COMPLEX:
-    copy.complex_val = src->complex_val;
-    break;
-
-  case TYPE_STRING:
-    copy.string = strdup(src->string);
-    break;
-
-  case TYPE_MATRIX_REAL:
-    if (src->matrix_real) {
-      size_t r = src->matrix_real->size1;
-      size_t c = src->matrix_real->size2;
-      copy.matrix_real = gsl_matrix_alloc(r, c);
-      gsl_matrix_memcpy(copy.matrix_real, src->matrix_real);
-    } else {
-      copy.matrix_real = NULL;
-    }
-    break;
-
-  case TYPE_MATRIX_COMPLEX:
-    if (src->matrix_complex) {
-      size_t r = src->matrix_complex->size1;
-      size_t c = src->matrix_complex->size2;
-      copy.matrix_complex = gsl_matrix_complex_alloc(r, c);
-      gsl_matrix_complex_memcpy(copy.matrix_complex, src->matrix_complex);
-    } else {
-      copy.matrix_complex = NULL;
-    }
-    break;
+  if (stack_element_clone(&copy, src) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
+    copy.type = TYPE_REAL;
+    copy.real = 0.0;
   }
-
   return copy;
 }
 
@@ -75,13 +46,13 @@ stack_element copy_element(const stack_element* src) {
 void free_element(stack_element* el) {
   switch (el->type) {
   case TYPE_STRING:
-    free(el->string);
+    string_release(el->string);
     break;
   case TYPE_MATRIX_REAL:
-    gsl_matrix_free(el->matrix_real);
+    matrix_release(el->matrix_real);
     break;
   case TYPE_MATRIX_COMPLEX:
-    gsl_matrix_complex_free(el->matrix_complex);
+    matrix_complex_release(el->matrix_complex);
     break;
   default:
     break;
@@ -116,7 +87,8 @@ void store_to_register(Stack* stack) {
     free_element(&registers[reg_index].value);
   }
 
-  registers[reg_index].value = copy_element(value_elem);
+  // The value leaves the stack, so the register takes it over as is
+  registers[reg_index].value = *value_elem;
   registers[reg_index].occupied = true;
 
   stack->top -= 2;  // remove reg index and value
@@ -146,12 +118,9 @@ void recall_from_register(Stack* stack) {
     return;
   }
 
-  stack_element copy = copy_element(&registers[reg_index].value);
+  if (stack_reserve(stack, 1) != 0) return;
 
-  if (stack->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "Stack overflow.\n");
-    return;
-  }
+  stack_element copy = copy_element(&registers[reg_index].value);
 
   stack->items[++stack->top] = copy;
 }
@@ -184,6 +153,14 @@ void free_all_registers(void) {
   }
 }
 
+// Round-trip text for x, so saved registers reload bit for bit
+static void write_double(FILE* f, const char* prefix, double x) {
+  char buf[DOUBLE_BUF_SIZE];
+  format_double(x, buf);
+  fputs(prefix, f);
+  fputs(buf, f);
+}
+
 void save_registers_to_file(const char* filename) {
   FILE* f = fopen(filename, "w");
   if (!f) {
@@ -199,10 +176,13 @@ void save_registers_to_file(const char* filename) {
 
     switch (el->type) {
     case TYPE_REAL:
-      fprintf(f, "REAL %.17g\n", el->real);
+      write_double(f, "REAL ", el->real);
+      fputc('\n', f);
       break;
     case TYPE_COMPLEX:
-      fprintf(f, "COMPLEX (%.17g,%.17g)\n", GSL_REAL(el->complex_val), GSL_IMAG(el->complex_val));
+      write_double(f, "COMPLEX (", GSL_REAL(el->complex_val));
+      write_double(f, ",", GSL_IMAG(el->complex_val));
+      fputs(")\n", f);
       break;
     case TYPE_STRING:
       fprintf(f, "STRING \"%s\"\n", el->string);
@@ -211,7 +191,7 @@ void save_registers_to_file(const char* filename) {
       gsl_matrix* m = el->matrix_real;
       fprintf(f, "MATRIX_REAL %zu %zu", m->size1, m->size2);
       for (size_t i_cnt = 0; i_cnt < m->size1 * m->size2; ++i_cnt) {
-	fprintf(f, " %.17g", m->data[i_cnt]);
+	write_double(f, " ", m->data[i_cnt]);
       }
       fprintf(f, "\n");
       break;
@@ -222,16 +202,32 @@ void save_registers_to_file(const char* filename) {
       for (size_t i_cnt = 0; i_cnt < m->size1; ++i_cnt) {
         for (size_t j = 0; j < m->size2; ++j) {
 	  gsl_complex z = gsl_matrix_complex_get(m, i_cnt, j);
-	  fprintf(f, " (%.17g,%.17g)", GSL_REAL(z), GSL_IMAG(z));
+	  write_double(f, " (", GSL_REAL(z));
+	  write_double(f, ",", GSL_IMAG(z));
+	  fputc(')', f);
         }
       }
+      fputc('\n', f);
+      break;
     }
+    case TYPE_LAZY:             // sto forces its operand, so never stored
+      fputc('\n', f);
+      break;
     }
   }
   fclose(f);
   printf("Registers saved to %s\n", filename);
 }
 
+// "(re,im)" at p; returns the position after ')' or NULL
+static const char* read_complex_pair(const char* p, const char* end, double* re, double* im) {
+  while (p < end && *p != '(') p++;
+  if (p >= end) return NULL;
+  if (!(p = parse_double(p + 1, end, re)) || p >= end || *p != ',') return NULL;
+  if (!(p = parse_double(p + 1, end, im)) || p >= end || *p != ')') return NULL;
+  return p + 1;
+}
+
 void load_registers_from_file(const char* filename) {
   FILE* f = fopen(filename, "r");
   if (!f) {
@@ -242,64 +238,59 @@ void load_registers_from_file(const char* filename) {
   // Clear all first
   free_all_registers();
 
-  char line[4096];
-  while (fgets(line, sizeof(line), f)) {
+  // Matrix registers are one line each, so lines can be arbitrarily long
+  char* line = NULL;
+  size_t line_cap = 0;
+  ssize_t line_len;
+  while ((line_len = getline(&line, &line_cap, f)) != -1) {
     int index;
     char type[32];
+    int offset;
+    const char* end = line + line_len;
 
-    if (sscanf(line, "REG %d %31s", &index, type) != 2) continue;
+    if (sscanf(line, "REG %d %31s %n", &index, type, &offset) != 2) continue;
     if (index < 0 || index >= MAX_REG) continue;
+    const char* ptr = line + offset;
 
     stack_element el;
     if (strcmp(type, "REAL") == 0) {
-      double val;
-      sscanf(line, "REG %*d %*s %lf", &val);
+      double val = 0;
+      parse_double(ptr, end, &val);
       el.type = TYPE_REAL;
       el.real = val;
     } else if (strcmp(type, "COMPLEX") == 0) {
-      double re, im;
-      sscanf(line, "REG %*d %*s (%lf,%lf)", &re, &im);
+      double re = 0, im = 0;
+      read_complex_pair(ptr, end, &re, &im);
       el.type = TYPE_COMPLEX;
       el.complex_val = gsl_complex_rect(re,im);
     } else if (strcmp(type, "STRING") == 0) {
       char* start = strchr(line, '"');
-      char* end = strrchr(line, '"');
-      if (!start || !end || start == end) continue;
-      *end = '\0';
+      char* last = strrchr(line, '"');
+      if (!start || !last || start == last) continue;
+      *last = '\0';
       el.type = TYPE_STRING;
       el.string = strdup(start + 1);
     } else if (strcmp(type, "MATRIX_REAL") == 0) {
       size_t r, c;
-      char* ptr = strchr(line, ' ') + 1; // skip "REG"
-      ptr = strchr(ptr, ' ') + 1; // skip index
-      ptr = strchr(ptr, ' ') + 1; // skip type
-      sscanf(ptr, "%zu %zu", &r, &c);
+      int n;
+      if (sscanf(ptr, "%zu %zu%n", &r, &c, &n) != 2) continue;
+      ptr += n;
       el.type = TYPE_MATRIX_REAL;
-      el.matrix_real = gsl_matrix_alloc(r, c);
-      ptr = strchr(ptr, ' ') + 1; // skip rows
-      ptr = strchr(ptr, ' ') + 1; // skip cols
-      for (size_t i = 0; i < r * c; ++i) {
-	double val;
-	sscanf(ptr, "%lf", &val);
-	el.matrix_real->data[i] = val;
-	ptr = strchr(ptr, ' ');
-	if (ptr) ptr++;
+      el.matrix_real = pool_matrix_calloc(r, c);
+      for (size_t i = 0; i < r * c && ptr; ++i) {
+	ptr = parse_double(ptr, end, &el.matrix_real->data[i]);
       }
     } else if (strcmp(type, "MATRIX_COMPLEX") == 0) {
       size_t r, c;
-      char* ptr = strchr(line, ' ') + 1;
-      ptr = strchr(ptr, ' ') + 1;
-      ptr = strchr(ptr, ' ') + 1;
-      sscanf(ptr, "%zu %zu", &r, &c);
+      int n;
+      if (sscanf(ptr, "%zu %zu%n", &r, &c, &n) != 2) continue;
+      ptr += n;
       el.type = TYPE_MATRIX_COMPLEX;
-      el.matrix_complex = gsl_matrix_complex_alloc(r, c);
-      ptr = strchr(ptr, ' ') + 1;
-      ptr = strchr(ptr, ' ') + 1;
-      for (size_t i = 0; i < r * c; ++i) {
+      el.matrix_complex = pool_matrix_complex_calloc(r, c);
+      for (size_t i = 0; i < r * c && ptr; ++i) {
 	double re = 0, im = 0;
-	sscanf(ptr, " (%lf,%lf)", &re, &im);
+	ptr = read_complex_pair(ptr, end, &re, &im);
 	gsl_matrix_complex_set(el.matrix_complex, i / c, i % c, gsl_complex_rect(re, im));
-	ptr = strchr(ptr + 1, '(');
       }
     } else {
       continue;
@@ -309,6 +300,7 @@ void load_registers_from_file(const char* filename) {
     registers[index].occupied = true;
   }
 
+  free(line);
   fclose(f);
   printf("Registers loaded from %s\n", filename);
 }
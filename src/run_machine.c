@@ -22,7 +22,7 @@
 #include <stdio.h>        // for fclose, fprintf, NULL, stderr, printf, fopen
 #include <stdlib.h>       // for free
 #include <string.h>       // for strcmp, strdup, strncmp, strcspn, strchr
-#include "eval_fun.h"     // for evaluate_line
+#include "bytecode.h"     // for run_line_cached
 #include "globals.h"      // for completed_batch
 #include "run_machine.h"  // for Program, INSTR_GOSUB, INSTR_GOTO, INSTR_LABEL
 #include "stack.h"        // for (anonymous struct)::(anonymous), TYPE_REAL
@@ -229,7 +229,7 @@ int run_batch(Stack *stack, char *fname) {
   while (getline(&line, &len, f) != -1) {
     // Remove trailing newline
     line[strcspn(line, "\r\n")] = '\0';
-    evaluate_line(stack, line);
+    run_line_cached(stack, line);
   }
   free(line);
   fclose(f);
@@ -371,7 +371,7 @@ void run_RPN_code(Stack* stack, Program* prog) {
     Instruction instr = prog->program[pc];
     switch (instr.type) {
     case INSTR_WORD:
-      evaluate_line(stack, instr.arg);
+      run_line_cached(stack, instr.arg);
       pc++;
       break;
     case INSTR_LABEL:
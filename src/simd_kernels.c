@@ -0,0 +1,544 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Vector loops behind the elementwise matrix operators. Every instruction
+// set provides the same primitives: buffer op buffer, buffer op a
+// repeating (p0, p1) pair (a real scalar is the pair (s, s), a complex one
+// (re, im)), complex multiplication by a buffer or by a pair, the split
+// and join between an interleaved buffer and separate re and im planes,
+// and the transpose of a cache-sized block. Complex + and - are plain buffer or pair operations on the
+// interleaved doubles; complex / and both powers go through GSL one element
+// at a time so that the overflow-safe formulas stay exactly GSL's.
+//
+// The x86 versions are compiled with target attributes, so the build needs
+// no -m flags and one binary runs everywhere; the best set the CPU reports
+// is chosen the first time a kernel runs. Elsewhere the portable loops are
+// left to the compiler's own vectorizer.
+
+#include <gsl/gsl_complex_math.h>   // for gsl_complex_div, gsl_complex_pow
+#include <math.h>                   // for pow
+#include <string.h>                 // for strcmp
+#include "simd_kernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+typedef struct {
+  const char* name;
+  void (*binary)(simd_op op, const double* x, const double* y, double* out, size_t n);
+  void (*pair)(simd_op op, const double* x, const double* p, double* out, size_t n,
+               int pair_first);
+  void (*cmul)(const double* x, const double* y, double* out, size_t n);
+  void (*cmul_pair)(const double* x, const double* p, double* out, size_t n);
+  void (*split)(const double* z, double* re, double* im, size_t n);
+  void (*join)(const double* re, const double* im, double* z, size_t n);
+  void (*transpose)(const double* src, size_t lds, double* dst, size_t ldd,
+                    size_t rows, size_t cols);
+} simd_isa;
+
+// **************** Portable loops ****************
+// Also the tails of the vector versions, which hand over at an even index
+// so the pair phase carries on unchanged
+
+static double scalar_apply(simd_op op, double a, double b) {
+  switch (op) {
+  case SIMD_ADD: return a + b;
+  case SIMD_SUB: return a - b;
+  case SIMD_MUL: return a * b;
+  case SIMD_DIV: return a / b;
+  case SIMD_MIN: return a < b ? a : b;
+  case SIMD_MAX: return a > b ? a : b;
+  default:       return pow(a, b);
+  }
+}
+
+static void scalar_binary(simd_op op, const double* x, const double* y, double* out,
+                          size_t n) {
+  switch (op) {
+  case SIMD_ADD: for (size_t i = 0; i < n; i++) out[i] = x[i] + y[i]; break;
+  case SIMD_SUB: for (size_t i = 0; i < n; i++) out[i] = x[i] - y[i]; break;
+  case SIMD_MUL: for (size_t i = 0; i < n; i++) out[i] = x[i] * y[i]; break;
+  case SIMD_DIV: for (size_t i = 0; i < n; i++) out[i] = x[i] / y[i]; break;
+  case SIMD_MIN: for (size_t i = 0; i < n; i++) out[i] = x[i] < y[i] ? x[i] : y[i]; break;
+  case SIMD_MAX: for (size_t i = 0; i < n; i++) out[i] = x[i] > y[i] ? x[i] : y[i]; break;
+  default:       for (size_t i = 0; i < n; i++) out[i] = pow(x[i], y[i]); break;
+  }
+}
+
+static void scalar_pair(simd_op op, const double* x, const double* p, double* out,
+                        size_t n, int pair_first) {
+  for (size_t i = 0; i < n; i++)
+    out[i] = pair_first ? scalar_apply(op, p[i & 1], x[i]) : scalar_apply(op, x[i], p[i & 1]);
+}
+
+// (a + bi)(c + di) as gsl_complex_mul computes it
+static void scalar_cmul(const double* x, const double* y, double* out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double ar = x[2 * i], ai = x[2 * i + 1];
+    double br = y[2 * i], bi = y[2 * i + 1];
+    out[2 * i] = ar * br - ai * bi;
+    out[2 * i + 1] = ar * bi + ai * br;
+  }
+}
+
+static void scalar_cmul_pair(const double* x, const double* p, double* out, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double ar = x[2 * i], ai = x[2 * i + 1];
+    out[2 * i] = ar * p[0] - ai * p[1];
+    out[2 * i + 1] = ar * p[1] + ai * p[0];
+  }
+}
+
+static void scalar_split(const double* z, double* re, double* im, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    re[i] = z[2 * i];
+    im[i] = z[2 * i + 1];
+  }
+}
+
+static void scalar_join(const double* re, const double* im, double* z, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    z[2 * i] = re[i];
+    z[2 * i + 1] = im[i];
+  }
+}
+
+static void scalar_transpose(const double* src, size_t lds, double* dst, size_t ldd,
+                             size_t rows, size_t cols) {
+  for (size_t i = 0; i < rows; i++)
+    for (size_t j = 0; j < cols; j++)
+      dst[j * ldd + i] = src[i * lds + j];
+}
+
+static const simd_isa isa_scalar = {
+  "scalar", scalar_binary, scalar_pair, scalar_cmul, scalar_cmul_pair,
+  scalar_split, scalar_join, scalar_transpose
+};
+
+#ifdef SIMD_X86
+// Each vector loop covers whole registers and leaves the rest to the
+// portable loop. ADD/SUB/MUL/DIV/MIN/MAX map to one instruction (min and
+// max return the second operand when either is NaN, as the portable loop
+// does); POW never gets here.
+#define BINARY_LOOPS(W, LOAD, STORE, ADD, SUB, MUL, DIV, MIN, MAX)           \
+  size_t i = 0;                                                             \
+  switch (op) {                                                             \
+  case SIMD_ADD: for (; i + W <= n; i += W) STORE(out + i, ADD(LOAD(x + i), LOAD(y + i))); break; \
+  case SIMD_SUB: for (; i + W <= n; i += W) STORE(out + i, SUB(LOAD(x + i), LOAD(y + i))); break; \
+  case SIMD_MUL: for (; i + W <= n; i += W) STORE(out + i, MUL(LOAD(x + i), LOAD(y + i))); break; \
+  case SIMD_DIV: for (; i + W <= n; i += W) STORE(out + i, DIV(LOAD(x + i), LOAD(y + i))); break; \
+  case SIMD_MIN: for (; i + W <= n; i += W) STORE(out + i, MIN(LOAD(x + i), LOAD(y + i))); break; \
+  case SIMD_MAX: for (; i + W <= n; i += W) STORE(out + i, MAX(LOAD(x + i), LOAD(y + i))); break; \
+  default: break;                                                           \
+  }                                                                         \
+  scalar_binary(op, x + i, y + i, out + i, n - i)
+
+#define PAIR_LOOPS(W, PV, LOAD, STORE, ADD, SUB, MUL, DIV)                   \
+  size_t i = 0;                                                             \
+  switch (op) {                                                             \
+  case SIMD_ADD: for (; i + W <= n; i += W) STORE(out + i, ADD(LOAD(x + i), PV)); break; \
+  case SIMD_MUL: for (; i + W <= n; i += W) STORE(out + i, MUL(LOAD(x + i), PV)); break; \
+  case SIMD_SUB:                                                            \
+    if (pair_first) for (; i + W <= n; i += W) STORE(out + i, SUB(PV, LOAD(x + i))); \
+    else            for (; i + W <= n; i += W) STORE(out + i, SUB(LOAD(x + i), PV)); \
+    break;                                                                  \
+  case SIMD_DIV:                                                            \
+    if (pair_first) for (; i + W <= n; i += W) STORE(out + i, DIV(PV, LOAD(x + i))); \
+    else            for (; i + W <= n; i += W) STORE(out + i, DIV(LOAD(x + i), PV)); \
+    break;                                                                  \
+  default: break;                                                           \
+  }                                                                         \
+  scalar_pair(op, x + i, p, out + i, n - i, pair_first)
+
+// **************** SSE2 ****************
+// Complex multiply: [ar*br, ai*br] + [-(ai*bi), ar*bi]; flipping a sign
+// bit and adding rounds exactly like the subtraction in scalar_cmul
+__attribute__((target("sse2")))
+static void sse2_binary(simd_op op, const double* x, const double* y, double* out, size_t n) {
+  BINARY_LOOPS(2, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd,
+               _mm_min_pd, _mm_max_pd);
+}
+
+__attribute__((target("sse2")))
+static void sse2_pair(simd_op op, const double* x, const double* p, double* out, size_t n,
+                      int pair_first) {
+  __m128d pv = _mm_set_pd(p[1], p[0]);
+  PAIR_LOOPS(2, pv, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, _mm_sub_pd, _mm_mul_pd, _mm_div_pd);
+}
+
+__attribute__((target("sse2")))
+static inline __m128d sse2_cmul1(__m128d a, __m128d b) {
+  const __m128d neg_lo = _mm_set_pd(0.0, -0.0);
+  __m128d br = _mm_unpacklo_pd(b, b);
+  __m128d bi = _mm_unpackhi_pd(b, b);
+  __m128d swapped = _mm_shuffle_pd(a, a, 1);                 // [ai, ar]
+  __m128d cross = _mm_xor_pd(_mm_mul_pd(swapped, bi), neg_lo);
+  return _mm_add_pd(_mm_mul_pd(a, br), cross);
+}
+
+__attribute__((target("sse2")))
+static void sse2_cmul(const double* x, const double* y, double* out, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    _mm_storeu_pd(out + 2 * i, sse2_cmul1(_mm_loadu_pd(x + 2 * i), _mm_loadu_pd(y + 2 * i)));
+}
+
+__attribute__((target("sse2")))
+static void sse2_cmul_pair(const double* x, const double* p, double* out, size_t n) {
+  __m128d pv = _mm_set_pd(p[1], p[0]);
+  for (size_t i = 0; i < n; i++)
+    _mm_storeu_pd(out + 2 * i, sse2_cmul1(_mm_loadu_pd(x + 2 * i), pv));
+}
+
+// Two complex numbers in, one register of each plane out
+__attribute__((target("sse2")))
+static void sse2_split(const double* z, double* re, double* im, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d a = _mm_loadu_pd(z + 2 * i), b = _mm_loadu_pd(z + 2 * i + 2);
+    _mm_storeu_pd(re + i, _mm_unpacklo_pd(a, b));
+    _mm_storeu_pd(im + i, _mm_unpackhi_pd(a, b));
+  }
+  scalar_split(z + 2 * i, re + i, im + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void sse2_join(const double* re, const double* im, double* z, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d r = _mm_loadu_pd(re + i), m = _mm_loadu_pd(im + i);
+    _mm_storeu_pd(z + 2 * i, _mm_unpacklo_pd(r, m));
+    _mm_storeu_pd(z + 2 * i + 2, _mm_unpackhi_pd(r, m));
+  }
+  scalar_join(re + i, im + i, z + 2 * i, n - i);
+}
+
+// 2 x 2 squares, each an unpack of two source rows; the odd last row and
+// column go through the portable loop
+__attribute__((target("sse2")))
+static void sse2_transpose(const double* src, size_t lds, double* dst, size_t ldd,
+                           size_t rows, size_t cols) {
+  size_t i = 0;
+  for (; i + 2 <= rows; i += 2) {
+    size_t j = 0;
+    for (; j + 2 <= cols; j += 2) {
+      __m128d r0 = _mm_loadu_pd(src + i * lds + j);
+      __m128d r1 = _mm_loadu_pd(src + (i + 1) * lds + j);
+      _mm_storeu_pd(dst + j * ldd + i, _mm_unpacklo_pd(r0, r1));
+      _mm_storeu_pd(dst + (j + 1) * ldd + i, _mm_unpackhi_pd(r0, r1));
+    }
+    scalar_transpose(src + i * lds + j, lds, dst + j * ldd + i, ldd, 2, cols - j);
+  }
+  scalar_transpose(src + i * lds, lds, dst + i, ldd, rows - i, cols);
+}
+
+static const simd_isa isa_sse2 = {
+  "sse2", sse2_binary, sse2_pair, sse2_cmul, sse2_cmul_pair, sse2_split, sse2_join,
+  sse2_transpose
+};
+
+// **************** AVX2 ****************
+__attribute__((target("avx2")))
+static void avx2_binary(simd_op op, const double* x, const double* y, double* out, size_t n) {
+  BINARY_LOOPS(4, _mm256_loadu_pd, _mm256_storeu_pd,
+               _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd,
+               _mm256_min_pd, _mm256_max_pd);
+}
+
+__attribute__((target("avx2")))
+static void avx2_pair(simd_op op, const double* x, const double* p, double* out, size_t n,
+                      int pair_first) {
+  __m256d pv = _mm256_set_pd(p[1], p[0], p[1], p[0]);
+  PAIR_LOOPS(4, pv, _mm256_loadu_pd, _mm256_storeu_pd,
+             _mm256_add_pd, _mm256_sub_pd, _mm256_mul_pd, _mm256_div_pd);
+}
+
+// Two complex numbers per register; addsub subtracts in the real lanes
+// and adds in the imaginary ones
+__attribute__((target("avx2")))
+static inline __m256d avx2_cmul2(__m256d a, __m256d b) {
+  __m256d br = _mm256_movedup_pd(b);                         // [br, br, ...]
+  __m256d bi = _mm256_permute_pd(b, 0xF);                    // [bi, bi, ...]
+  __m256d swapped = _mm256_permute_pd(a, 0x5);               // [ai, ar, ...]
+  return _mm256_addsub_pd(_mm256_mul_pd(a, br), _mm256_mul_pd(swapped, bi));
+}
+
+__attribute__((target("avx2")))
+static void avx2_cmul(const double* x, const double* y, double* out, size_t n) {
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm256_storeu_pd(out + 2 * i,
+                     avx2_cmul2(_mm256_loadu_pd(x + 2 * i), _mm256_loadu_pd(y + 2 * i)));
+  scalar_cmul(x + 2 * i, y + 2 * i, out + 2 * i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_cmul_pair(const double* x, const double* p, double* out, size_t n) {
+  __m256d pv = _mm256_set_pd(p[1], p[0], p[1], p[0]);
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    _mm256_storeu_pd(out + 2 * i, avx2_cmul2(_mm256_loadu_pd(x + 2 * i), pv));
+  scalar_cmul_pair(x + 2 * i, p, out + 2 * i, n - i);
+}
+
+// unpack works within 128-bit lanes, leaving [r0, r2, r1, r3]; the
+// permute (lanes 0, 2, 1, 3) puts the elements back in order, and undoes
+// it before a join
+__attribute__((target("avx2")))
+static void avx2_split(const double* z, double* re, double* im, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d a = _mm256_loadu_pd(z + 2 * i), b = _mm256_loadu_pd(z + 2 * i + 4);
+    _mm256_storeu_pd(re + i, _mm256_permute4x64_pd(_mm256_unpacklo_pd(a, b), 0xD8));
+    _mm256_storeu_pd(im + i, _mm256_permute4x64_pd(_mm256_unpackhi_pd(a, b), 0xD8));
+  }
+  scalar_split(z + 2 * i, re + i, im + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void avx2_join(const double* re, const double* im, double* z, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d r = _mm256_permute4x64_pd(_mm256_loadu_pd(re + i), 0xD8);
+    __m256d m = _mm256_permute4x64_pd(_mm256_loadu_pd(im + i), 0xD8);
+    _mm256_storeu_pd(z + 2 * i, _mm256_unpacklo_pd(r, m));
+    _mm256_storeu_pd(z + 2 * i + 4, _mm256_unpackhi_pd(r, m));
+  }
+  scalar_join(re + i, im + i, z + 2 * i, n - i);
+}
+
+// 4 x 4 squares: unpack pairs rows 0-1 and 2-3 within each 128-bit lane,
+// then permute2f128 swaps the lanes across, as in the SSE2 version twice
+__attribute__((target("avx2")))
+static void avx2_transpose(const double* src, size_t lds, double* dst, size_t ldd,
+                           size_t rows, size_t cols) {
+  size_t i = 0;
+  for (; i + 4 <= rows; i += 4) {
+    size_t j = 0;
+    for (; j + 4 <= cols; j += 4) {
+      const double* s = src + i * lds + j;
+      __m256d r0 = _mm256_loadu_pd(s), r1 = _mm256_loadu_pd(s + lds);
+      __m256d r2 = _mm256_loadu_pd(s + 2 * lds), r3 = _mm256_loadu_pd(s + 3 * lds);
+      __m256d lo01 = _mm256_unpacklo_pd(r0, r1), hi01 = _mm256_unpackhi_pd(r0, r1);
+      __m256d lo23 = _mm256_unpacklo_pd(r2, r3), hi23 = _mm256_unpackhi_pd(r2, r3);
+      double* d = dst + j * ldd + i;
+      _mm256_storeu_pd(d, _mm256_permute2f128_pd(lo01, lo23, 0x20));
+      _mm256_storeu_pd(d + ldd, _mm256_permute2f128_pd(hi01, hi23, 0x20));
+      _mm256_storeu_pd(d + 2 * ldd, _mm256_permute2f128_pd(lo01, lo23, 0x31));
+      _mm256_storeu_pd(d + 3 * ldd, _mm256_permute2f128_pd(hi01, hi23, 0x31));
+    }
+    scalar_transpose(src + i * lds + j, lds, dst + j * ldd + i, ldd, 4, cols - j);
+  }
+  scalar_transpose(src + i * lds, lds, dst + i, ldd, rows - i, cols);
+}
+
+static const simd_isa isa_avx2 = {
+  "avx2", avx2_binary, avx2_pair, avx2_cmul, avx2_cmul_pair, avx2_split, avx2_join,
+  avx2_transpose
+};
+
+// **************** AVX-512 ****************
+__attribute__((target("avx512f")))
+static void avx512_binary(simd_op op, const double* x, const double* y, double* out, size_t n) {
+  BINARY_LOOPS(8, _mm512_loadu_pd, _mm512_storeu_pd,
+               _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd,
+               _mm512_min_pd, _mm512_max_pd);
+}
+
+__attribute__((target("avx512f")))
+static void avx512_pair(simd_op op, const double* x, const double* p, double* out, size_t n,
+                        int pair_first) {
+  __m512d pv = _mm512_set_pd(p[1], p[0], p[1], p[0], p[1], p[0], p[1], p[0]);
+  PAIR_LOOPS(8, pv, _mm512_loadu_pd, _mm512_storeu_pd,
+             _mm512_add_pd, _mm512_sub_pd, _mm512_mul_pd, _mm512_div_pd);
+}
+
+// No addsub in AVX-512F: add everywhere, then redo the real lanes (the
+// even ones, mask 0x55) as a subtraction
+__attribute__((target("avx512f")))
+static inline __m512d avx512_cmul4(__m512d a, __m512d b) {
+  __m512d br = _mm512_movedup_pd(b);
+  __m512d bi = _mm512_permute_pd(b, 0xFF);
+  __m512d swapped = _mm512_permute_pd(a, 0x55);
+  __m512d t1 = _mm512_mul_pd(a, br);
+  __m512d t2 = _mm512_mul_pd(swapped, bi);
+  return _mm512_mask_sub_pd(_mm512_add_pd(t1, t2), 0x55, t1, t2);
+}
+
+__attribute__((target("avx512f")))
+static void avx512_cmul(const double* x, const double* y, double* out, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm512_storeu_pd(out + 2 * i,
+                     avx512_cmul4(_mm512_loadu_pd(x + 2 * i), _mm512_loadu_pd(y + 2 * i)));
+  scalar_cmul(x + 2 * i, y + 2 * i, out + 2 * i, n - i);
+}
+
+__attribute__((target("avx512f")))
+static void avx512_cmul_pair(const double* x, const double* p, double* out, size_t n) {
+  __m512d pv = _mm512_set_pd(p[1], p[0], p[1], p[0], p[1], p[0], p[1], p[0]);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm512_storeu_pd(out + 2 * i, avx512_cmul4(_mm512_loadu_pd(x + 2 * i), pv));
+  scalar_cmul_pair(x + 2 * i, p, out + 2 * i, n - i);
+}
+
+// Split, join and transpose are memory bound; the AVX2 versions serve here too
+static const simd_isa isa_avx512 = {
+  "avx512", avx512_binary, avx512_pair, avx512_cmul, avx512_cmul_pair, avx2_split, avx2_join,
+  avx2_transpose
+};
+#endif // SIMD_X86
+
+// **************** Dispatch ****************
+// Atomic because the kernels also run on parallel_for's worker threads
+static _Atomic(const simd_isa*) isa = NULL;
+
+static const simd_isa* best_isa(void) {
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return &isa_avx512;
+  if (__builtin_cpu_supports("avx2")) return &isa_avx2;
+  if (__builtin_cpu_supports("sse2")) return &isa_sse2;
+#endif
+  return &isa_scalar;
+}
+
+static const simd_isa* current(void) {
+  if (!isa) isa = best_isa();
+  return isa;
+}
+
+const char* simd_isa_name(void) {
+  return current()->name;
+}
+
+int simd_select(const char* name) {
+  const simd_isa* candidates[] = {
+#ifdef SIMD_X86
+    &isa_avx512, &isa_avx2, &isa_sse2,
+#endif
+    &isa_scalar
+  };
+  const simd_isa* best = best_isa();
+  int usable = 0;   // candidates run from widest to narrowest
+  for (size_t k = 0; k < sizeof(candidates) / sizeof(candidates[0]); k++) {
+    if (candidates[k] == best) usable = 1;
+    if (usable && strcmp(candidates[k]->name, name) == 0) {
+      isa = candidates[k];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// **************** Entry points ****************
+void simd_real(simd_op op, const double* x, const double* y, double* out, size_t n) {
+  if (op == SIMD_POW) scalar_binary(op, x, y, out, n);
+  else current()->binary(op, x, y, out, n);
+}
+
+void simd_real_scalar(simd_op op, const double* x, double s, double* out, size_t n,
+                      int scalar_first) {
+  const double p[2] = { s, s };
+  if (op == SIMD_POW) scalar_pair(op, x, p, out, n, scalar_first);
+  else current()->pair(op, x, p, out, n, scalar_first);
+}
+
+void simd_complex(simd_op op, const double* x, const double* y, double* out, size_t n) {
+  switch (op) {
+  case SIMD_ADD:
+  case SIMD_SUB:
+    current()->binary(op, x, y, out, 2 * n);
+    break;
+  case SIMD_MUL:
+    current()->cmul(x, y, out, n);
+    break;
+  default:
+    for (size_t i = 0; i < n; i++) {
+      gsl_complex a = gsl_complex_rect(x[2 * i], x[2 * i + 1]);
+      gsl_complex b = gsl_complex_rect(y[2 * i], y[2 * i + 1]);
+      gsl_complex r = (op == SIMD_DIV) ? gsl_complex_div(a, b) : gsl_complex_pow(a, b);
+      out[2 * i] = GSL_REAL(r);
+      out[2 * i + 1] = GSL_IMAG(r);
+    }
+    break;
+  }
+}
+
+void simd_complex_scalar(simd_op op, const double* x, gsl_complex z, double* out,
+                         size_t n, int scalar_first) {
+  const double p[2] = { GSL_REAL(z), GSL_IMAG(z) };
+  switch (op) {
+  case SIMD_ADD:
+  case SIMD_SUB:
+    current()->pair(op, x, p, out, 2 * n, scalar_first);
+    break;
+  case SIMD_MUL:
+    current()->cmul_pair(x, p, out, n);   // both orders round the same
+    break;
+  default:
+    for (size_t i = 0; i < n; i++) {
+      gsl_complex v = gsl_complex_rect(x[2 * i], x[2 * i + 1]);
+      gsl_complex r;
+      if (op == SIMD_DIV)
+        r = scalar_first ? gsl_complex_div(z, v) : gsl_complex_div(v, z);
+      else
+        r = scalar_first ? gsl_complex_pow(z, v) : gsl_complex_pow(v, z);
+      out[2 * i] = GSL_REAL(r);
+      out[2 * i + 1] = GSL_IMAG(r);
+    }
+    break;
+  }
+}
+
+void simd_split(const double* z, double* re, double* im, size_t n) {
+  if (re && im) {
+    current()->split(z, re, im, n);
+    return;
+  }
+  double* plane = re ? re : im;
+  const double* src = re ? z : z + 1;
+  if (plane)
+    for (size_t i = 0; i < n; i++) plane[i] = src[2 * i];
+}
+
+void simd_join(const double* re, const double* im, double* z, size_t n) {
+  if (im) {
+    current()->join(re, im, z, n);
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    z[2 * i] = re[i];
+    z[2 * i + 1] = 0.0;
+  }
+}
+
+void simd_transpose(const double* src, size_t lds, double* dst, size_t ldd,
+                    size_t rows, size_t cols) {
+  current()->transpose(src, lds, dst, ldd, rows, cols);
+}
+
+void simd_real_to_complex(const double* x, double* out, size_t n) {
+  // Backwards, so x and out may start at the same address
+  for (size_t i = n; i-- > 0; ) {
+    out[2 * i + 1] = 0.0;
+    out[2 * i] = x[i];
+  }
+}
@@ -0,0 +1,300 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <float.h>              // for DBL_MIN, DBL_MAX
+#include <gsl/gsl_cdf.h>        // for gsl_cdf_ugaussian_P
+#include <gsl/gsl_randist.h>    // for gsl_ran_gaussian_pdf
+#include <limits.h>             // for LLONG_MAX, LLONG_MIN
+#include <math.h>               // for sin, cos, exp, log, sqrt
+#include <string.h>             // for memcpy, strcmp
+#include "simd_kernels.h"       // for simd_isa_name
+#include "simd_math.h"
+
+// The kernels are written once, in simd_math.inc, on GCC vector types and
+// compiled for each instruction set with a target attribute. Every set
+// runs the same operations in the same order, so the results do not
+// depend on which one the CPU has.
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>          // for _mm_sqrt_pd, _mm256_sqrt_pd, _mm512_sqrt_pd
+#endif
+
+typedef void (*math_loop)(const double* x, double* out, size_t n);
+
+typedef struct {
+  const char* name;             // as simd_isa_name reports it
+  math_loop loop[MATH_COUNT];
+} math_isa;
+
+// **************** Constants ****************
+
+// x + ROUND_MAGIC rounds x to an integer held in the low mantissa bits
+#define ROUND_MAGIC 0x1.8p52
+#define ROUND_BITS 0x4338000000000000LL
+
+#define INV_LN2   1.44269504088896338700e+00
+#define LN2_HI    6.93147180369123816490e-01    // low 32 bits zero
+#define LN2_LO    1.90821492927058770002e-10
+#define INV_LN10  4.34294481903251827651e-01
+
+#define EXP_P1    1.66666666666666019037e-01
+#define EXP_P2   -2.77777777770155933842e-03
+#define EXP_P3    6.61375632143793436117e-05
+#define EXP_P4   -1.65339022054652515390e-06
+#define EXP_P5    4.13813679705723846039e-08
+
+#define LG1 6.666666666666735130e-01
+#define LG2 3.999999999940941908e-01
+#define LG3 2.857142874366239149e-01
+#define LG4 2.222219843214978396e-01
+#define LG5 1.818357216161805012e-01
+#define LG6 1.531383769920937332e-01
+#define LG7 1.479819860511658591e-01
+
+#define INV_PIO2  6.36619772367581382433e-01
+#define PIO2_1    1.57079632673412561417e+00
+#define PIO2_2    6.07710050630396597660e-11
+#define PIO2_3    2.02226624871116645580e-21
+#define PIO2_3T   8.47842766036889956997e-32
+
+#define SIN_S1   -1.66666666666666324348e-01
+#define SIN_S2    8.33333333332248946124e-03
+#define SIN_S3   -1.98412698298579493134e-04
+#define SIN_S4    2.75573137070700676789e-06
+#define SIN_S5   -2.50507602534068634195e-08
+#define SIN_S6    1.58969099521155010221e-10
+
+#define COS_C1    4.16666666666666019037e-02
+#define COS_C2   -1.38888888888741095749e-03
+#define COS_C3    2.48015872894767294178e-05
+#define COS_C4   -2.75573143513906633035e-07
+#define COS_C5    2.08757232129817482790e-09
+#define COS_C6   -1.13596475577881948265e-11
+
+#define SINH_T3   (1.0 / 6.0)
+#define SINH_T5   (1.0 / 120.0)
+#define SINH_T7   (1.0 / 5040.0)
+#define SINH_T9   (1.0 / 362880.0)
+#define SINH_T11  (1.0 / 39916800.0)
+#define SINH_T13  (1.0 / 6227020800.0)
+#define SINH_T15  (1.0 / 1307674368000.0)
+#define SINH_T17  (1.0 / 355687428096000.0)
+#define SINH_T19  (1.0 / 121645100408832000.0)
+
+#define INV_SQRT_2PI 0.398942280401432677939946059934
+
+// Cody's normal cdf, coefficients and ranges from GSL's cdf/gauss.c
+#define NCDF_EPSILON (DBL_EPSILON / 2)
+#define NCDF_SMALL   0.66291
+#define NCDF_MEDIUM  5.65685424949238019520      // sqrt(32)
+#define NCDF_UPPER   8.572
+#define NCDF_LOWER  -37.519
+
+static const double NCDF_A[5] = {
+  2.2352520354606839287, 161.02823106855587881, 1067.6894854603709582,
+  18154.981253343561249, 0.065682337918207449113
+};
+static const double NCDF_B[4] = {
+  47.20258190468824187, 976.09855173777669322, 10260.932208618978205,
+  45507.789335026729956
+};
+static const double NCDF_C[9] = {
+  0.39894151208813466764, 8.8831497943883759412, 93.506656132177855979,
+  597.27027639480026226, 2494.5375852903726711, 6848.1904505362823326,
+  11602.651437647350124, 9842.7148383839780218, 1.0765576773720192317e-8
+};
+static const double NCDF_D[8] = {
+  22.266688044328115691, 235.38790178262499861, 1519.377599407554805,
+  6485.558298266760755, 18615.571640885098091, 34900.952721145977266,
+  38912.003286093271411, 19685.429676859990727
+};
+static const double NCDF_P[6] = {
+  0.21589853405795699, 0.1274011611602473639, 0.022235277870649807,
+  0.001421619193227893466, 2.9112874951168792e-5, 0.02307344176494017303
+};
+static const double NCDF_Q[5] = {
+  1.28426009614491121, 0.468238212480865118, 0.0659881378689285515,
+  0.00378239633202758244, 7.29751555083966205e-5
+};
+
+// **************** Scalar reference ****************
+
+// What the functions did before, and what a block falls back to
+static double npdf_ref(double x) { return gsl_ran_gaussian_pdf(x, 1.0); }
+static double ncdf_ref(double x) { return gsl_cdf_ugaussian_P(x); }
+
+#define SCALAR_LOOP(name, REF)                                       \
+  static void name(const double* x, double* out, size_t n) {         \
+    for (size_t i = 0; i < n; i++) out[i] = REF(x[i]);               \
+  }
+
+SCALAR_LOOP(scalar_sin, sin)
+SCALAR_LOOP(scalar_cos, cos)
+SCALAR_LOOP(scalar_tan, tan)
+SCALAR_LOOP(scalar_exp, exp)
+SCALAR_LOOP(scalar_ln, log)
+SCALAR_LOOP(scalar_log10, log10)
+SCALAR_LOOP(scalar_sqrt, sqrt)
+SCALAR_LOOP(scalar_sinh, sinh)
+SCALAR_LOOP(scalar_cosh, cosh)
+SCALAR_LOOP(scalar_tanh, tanh)
+SCALAR_LOOP(scalar_npdf, npdf_ref)
+SCALAR_LOOP(scalar_ncdf, ncdf_ref)
+
+static const math_isa isa_scalar = {
+  "scalar",
+  { scalar_sin, scalar_cos, scalar_tan, scalar_exp, scalar_ln, scalar_log10,
+    scalar_sqrt, scalar_sinh, scalar_cosh, scalar_tanh, scalar_npdf, scalar_ncdf }
+};
+
+// **************** Vector kernels ****************
+
+#ifdef SIMD_X86
+#define CAT_(a, b) a##_##b
+#define CAT(a, b) CAT_(a, b)
+#define FN(name) CAT(name, MATH_ISA)
+#define STR_(a) #a
+#define STR(a) STR_(a)
+
+#define MATH_ISA sse2
+#define MATH_VBYTES 16
+#define MATH_TARGET __attribute__((target("sse2")))
+#define MATH_VSQRT(v) ((VD)_mm_sqrt_pd((__m128d)(v)))
+#define MATH_MASK(m) _mm_movemask_pd((__m128d)(m))
+#include "simd_math.inc"
+#undef MATH_ISA
+#undef MATH_VBYTES
+#undef MATH_TARGET
+#undef MATH_VSQRT
+#undef MATH_MASK
+
+#define MATH_ISA avx2
+#define MATH_VBYTES 32
+#define MATH_TARGET __attribute__((target("avx2")))
+#define MATH_VSQRT(v) ((VD)_mm256_sqrt_pd((__m256d)(v)))
+#define MATH_MASK(m) _mm256_movemask_pd((__m256d)(m))
+#include "simd_math.inc"
+#undef MATH_ISA
+#undef MATH_VBYTES
+#undef MATH_TARGET
+#undef MATH_VSQRT
+#undef MATH_MASK
+
+#define MATH_ISA avx512
+#define MATH_VBYTES 64
+#define MATH_TARGET __attribute__((target("avx512f")))
+#define MATH_VSQRT(v) ((VD)_mm512_sqrt_pd((__m512d)(v)))
+#define MATH_MASK(m) ((int)_mm512_test_epi64_mask((__m512i)(m), (__m512i)(m)))
+#include "simd_math.inc"
+#undef MATH_ISA
+#undef MATH_VBYTES
+#undef MATH_TARGET
+#undef MATH_VSQRT
+#undef MATH_MASK
+#endif // SIMD_X86
+
+// **************** Dispatch ****************
+
+// Follows simd_kernels' choice, looked up again only when it changes.
+// Atomic because the kernels also run on parallel_for's worker threads.
+static const math_isa* current(void) {
+  static _Atomic(const math_isa*) isa = NULL;
+  const char* name = simd_isa_name();
+  const math_isa* cached = isa;
+  if (cached && strcmp(cached->name, name) == 0) return cached;
+  const math_isa* candidates[] = {
+#ifdef SIMD_X86
+    &isa_avx512, &isa_avx2, &isa_sse2,
+#endif
+    &isa_scalar
+  };
+  cached = &isa_scalar;
+  for (size_t k = 0; k < sizeof(candidates) / sizeof(candidates[0]); k++)
+    if (strcmp(candidates[k]->name, name) == 0) {
+      cached = candidates[k];
+      break;
+    }
+  isa = cached;
+  return cached;
+}
+
+void simd_math_real(simd_math_fn fn, const double* x, double* out, size_t n) {
+  current()->loop[fn](x, out, n);
+}
+
+#define COMPLEX_CHUNK 128
+
+int simd_math_complex(simd_math_fn fn, const double* x, double* out, size_t n) {
+  if (fn != MATH_EXP && fn != MATH_SIN && fn != MATH_COS && fn != MATH_SINH && fn != MATH_COSH)
+    return -1;
+  const math_isa* isa = current();
+  double re[COMPLEX_CHUNK], im[COMPLEX_CHUNK];
+  double a[COMPLEX_CHUNK], b[COMPLEX_CHUNK], c[COMPLEX_CHUNK], d[COMPLEX_CHUNK];
+
+  for (size_t start = 0; start < n; start += COMPLEX_CHUNK) {
+    size_t len = n - start < COMPLEX_CHUNK ? n - start : COMPLEX_CHUNK;
+    const double* src = x + 2 * start;
+    double* dst = out + 2 * start;
+    for (size_t k = 0; k < len; k++) {
+      re[k] = src[2 * k];
+      im[k] = src[2 * k + 1];
+    }
+    // (a c, b d), as gsl_complex_exp, _sin, _cos, _sinh and _cosh build it
+    switch (fn) {
+    case MATH_EXP:
+      isa->loop[MATH_EXP](re, a, len);
+      memcpy(b, a, len * sizeof(double));
+      isa->loop[MATH_COS](im, c, len);
+      isa->loop[MATH_SIN](im, d, len);
+      break;
+    case MATH_SIN:
+      isa->loop[MATH_SIN](re, a, len);
+      isa->loop[MATH_COS](re, b, len);
+      isa->loop[MATH_COSH](im, c, len);
+      isa->loop[MATH_SINH](im, d, len);
+      break;
+    case MATH_COS:
+      isa->loop[MATH_COS](re, a, len);
+      isa->loop[MATH_SIN](re, b, len);
+      isa->loop[MATH_COSH](im, c, len);
+      isa->loop[MATH_SINH](im, d, len);
+      for (size_t k = 0; k < len; k++) d[k] = -d[k];     // sinh(-I)
+      break;
+    case MATH_SINH:
+      isa->loop[MATH_SINH](re, a, len);
+      isa->loop[MATH_COSH](re, b, len);
+      isa->loop[MATH_COS](im, c, len);
+      isa->loop[MATH_SIN](im, d, len);
+      break;
+    default:
+      isa->loop[MATH_COSH](re, a, len);
+      isa->loop[MATH_SINH](re, b, len);
+      isa->loop[MATH_COS](im, c, len);
+      isa->loop[MATH_SIN](im, d, len);
+      break;
+    }
+    // GSL's sin and cos give a real argument a +0 imaginary part
+    int zero_imag = fn == MATH_SIN || fn == MATH_COS;
+    for (size_t k = 0; k < len; k++) {
+      dst[2 * k] = a[k] * c[k];
+      dst[2 * k + 1] = (zero_imag && im[k] == 0.0) ? 0.0 : b[k] * d[k];
+    }
+  }
+  return 0;
+}
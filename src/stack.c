@@ -24,64 +24,186 @@
 #include <gsl/gsl_complex.h>                // for gsl_complex
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_alloc
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix_alloc, gsl_mat...
-#include <stdio.h>                          // for fclose, fprintf, perror
-#include <stdlib.h>                         // for free, malloc
+#include <stdio.h>                          // for fclose, fprintf, perror, fread
+#include <stdlib.h>                         // for free, malloc, realloc
 #include <string.h>                         // for strdup, strlen
+#include "lazy.h"                           // for lazy_free, lazy_clone
+#include "numconv.h"                        // for parse_double
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "refcount.h"                       // for payload_release, payload_retain
 #include "stack.h"                          // for (anonymous struct)::(anon...
 
+void matrix_release(gsl_matrix* m) {
+  if (m && payload_release(m)) pool_matrix_free(m);
+}
+
+void matrix_complex_release(gsl_matrix_complex* m) {
+  if (m && payload_release(m)) pool_matrix_complex_free(m);
+}
+
+void string_release(char* s) {
+  if (s && payload_release(s)) free(s);
+}
+
 void stack_element_free(stack_element* e) {
   switch (e->type) {
   case TYPE_STRING:
-    free(e->string);
+    string_release(e->string);
     e->string = NULL;
     break;
   case TYPE_MATRIX_REAL:
-    if (e->matrix_real) gsl_matrix_free(e->matrix_real);
+    matrix_release(e->matrix_real);
     e->matrix_real = NULL;
     break;
   case TYPE_MATRIX_COMPLEX:
-    if (e->matrix_complex) gsl_matrix_complex_free(e->matrix_complex);
+    matrix_complex_release(e->matrix_complex);
     e->matrix_complex = NULL;
     break;
+  case TYPE_LAZY:
+    lazy_free(e->lazy);
+    e->lazy = NULL;
+    break;
   default:
     break;
   }
 }
 
-int stack_element_clone(stack_element* dst, const stack_element* src) {
-  dst->type = src->type;
+static const void* payload_of(const stack_element* e) {
+  switch (e->type) {
+  case TYPE_STRING:         return e->string;
+  case TYPE_MATRIX_REAL:    return e->matrix_real;
+  case TYPE_MATRIX_COMPLEX: return e->matrix_complex;
+  default:                  return NULL;
+  }
+}
+
+// Independent copy of the payload of src, for writers of shared payloads
+static int deep_copy(stack_element* dst, const stack_element* src) {
+  *dst = *src;
+  if (!payload_of(src)) return 0;
   switch (src->type) {
-  case TYPE_REAL:
-    dst->real = src->real;
-    return 0;
-  case TYPE_COMPLEX:
-    dst->complex_val = src->complex_val;
-    return 0;
   case TYPE_STRING:
-    if (!src->string) { dst->string = NULL; return 0; }
     dst->string = strdup(src->string);
     return dst->string ? 0 : -1;
   case TYPE_MATRIX_REAL:
-    if (!src->matrix_real) { dst->matrix_real = NULL; return 0; }
-    dst->matrix_real = gsl_matrix_alloc(src->matrix_real->size1,
+    dst->matrix_real = pool_matrix_alloc(src->matrix_real->size1,
 					src->matrix_real->size2);
     if (!dst->matrix_real) return -1;
     gsl_matrix_memcpy(dst->matrix_real, src->matrix_real);
     return 0;
   case TYPE_MATRIX_COMPLEX:
-    if (!src->matrix_complex) { dst->matrix_complex = NULL; return 0; }
-    dst->matrix_complex = gsl_matrix_complex_alloc(src->matrix_complex->size1,
+    dst->matrix_complex = pool_matrix_complex_alloc(src->matrix_complex->size1,
 						   src->matrix_complex->size2);
     if (!dst->matrix_complex) return -1;
     gsl_matrix_complex_memcpy(dst->matrix_complex, src->matrix_complex);
     return 0;
   default:
+    return 0;
+  }
+}
+
+int stack_element_clone(stack_element* dst, const stack_element* src) {
+  switch (src->type) {
+  case TYPE_REAL:
+  case TYPE_COMPLEX:
+    *dst = *src;
+    return 0;
+  case TYPE_STRING:
+  case TYPE_MATRIX_REAL:
+  case TYPE_MATRIX_COMPLEX:
+    // A full refcount table degrades to copying rather than failing
+    if (payload_retain(payload_of(src)) != 0) return deep_copy(dst, src);
+    *dst = *src;
+    return 0;
+  case TYPE_LAZY:
+    dst->type = TYPE_LAZY;
+    dst->lazy = lazy_clone(src->lazy);
+    return dst->lazy ? 0 : -1;
+  default:
+    dst->type = src->type;
+    return -1;
+  }
+}
+
+int stack_element_unshare(stack_element* e) {
+  const void* p = payload_of(e);
+  if (!p || !payload_shared(p)) return 0;
+  stack_element copy;
+  if (deep_copy(&copy, e) != 0) {
+    fprintf(stderr, "Memory allocation failed\n");
     return -1;
   }
+  payload_release(p);   // still has other owners, nothing to free
+  *e = copy;
+  return 0;
+}
+
+gsl_matrix* take_matrix_real(stack_element* e) {
+  if (e->type != TYPE_MATRIX_REAL || !e->matrix_real || payload_shared(e->matrix_real))
+    return NULL;
+  gsl_matrix* m = e->matrix_real;
+  e->matrix_real = NULL;
+  return m;
 }
 
+gsl_matrix_complex* take_matrix_complex(stack_element* e) {
+  if (e->type != TYPE_MATRIX_COMPLEX || !e->matrix_complex ||
+      payload_shared(e->matrix_complex))
+    return NULL;
+  gsl_matrix_complex* m = e->matrix_complex;
+  e->matrix_complex = NULL;
+  return m;
+}
+
+int stack_soft_limit = STACK_SOFT_LIMIT_DEFAULT;
+int stack_hard_limit = STACK_HARD_LIMIT_DEFAULT;
+
 void init_stack(Stack* stack) {
+  stack->items = NULL;
   stack->top = -1;
+  stack->capacity = 0;
+  stack->warned = 0;
+}
+
+static int resize_stack(Stack* stack, int capacity) {
+  stack_element* items = realloc(stack->items, (size_t)capacity * sizeof(stack_element));
+  if (!items) return -1;
+  stack->items = items;
+  stack->capacity = capacity;
+  return 0;
+}
+
+int stack_reserve(Stack* stack, int n) {
+  int needed = stack->top + 1 + n;
+  if (needed <= stack->capacity) return 0;
+  if (needed > stack_hard_limit) {
+    fprintf(stderr, "Stack overflow (hard limit %d elements)\n", stack_hard_limit);
+    return -1;
+  }
+  if (needed > stack_soft_limit && !stack->warned) {
+    fprintf(stderr, "Warning: stack holds more than %d elements\n", stack_soft_limit);
+    stack->warned = 1;
+  }
+  // Doubling keeps pushes amortized O(1)
+  int capacity = stack->capacity ? stack->capacity : STACK_INITIAL_CAPACITY;
+  while (capacity < needed)
+    capacity = capacity > stack_hard_limit / 2 ? stack_hard_limit : 2 * capacity;
+  if (resize_stack(stack, capacity) != 0) {
+    fprintf(stderr, "Stack overflow (out of memory)\n");
+    return -1;
+  }
+  return 0;
+}
+
+void stack_trim(Stack* stack) {
+  int depth = stack->top + 1;
+  if (depth <= stack_soft_limit) stack->warned = 0;
+  // Shrink only after the stack has dropped to a quarter of its capacity,
+  // and then to twice the depth, so push/pop at the boundary cannot thrash
+  if (stack->capacity <= STACK_INITIAL_CAPACITY || depth > stack->capacity / 4) return;
+  int capacity = 2 * depth;
+  if (capacity < STACK_INITIAL_CAPACITY) capacity = STACK_INITIAL_CAPACITY;
+  resize_stack(stack, capacity);   // on failure the old block stays valid
 }
 
 int stack_size(const Stack* stack) {
@@ -89,30 +211,21 @@ int stack_size(const Stack* stack) {
 }
 
 void push_real(Stack* stack, double value) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
+  if (stack_reserve(stack, 1) != 0) return;
   stack->top++;
   stack->items[stack->top].type = TYPE_REAL;
   stack->items[stack->top].real = value;
 }
 
 void push_complex(Stack* stack, gsl_complex value) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
+  if (stack_reserve(stack, 1) != 0) return;
   stack->top++;
   stack->items[stack->top].type = TYPE_COMPLEX;
   stack->items[stack->top].complex_val = value;
 }
 
 void push_string(Stack* stack, const char* str) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
+  if (stack_reserve(stack, 1) != 0) return;
   stack->top++;
   stack->items[stack->top].type = TYPE_STRING;
   stack->items[stack->top].string = strdup(str);
@@ -123,10 +236,7 @@ void push_string(Stack* stack, const char* str) {
 }
 
 void push_matrix_real(Stack* stack, gsl_matrix* matrix) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
+  if (stack_reserve(stack, 1) != 0) return;
   if (NULL == matrix) {
     fprintf(stderr,"NULL pointer to matrix, exiting!\n");
     return;
@@ -137,10 +247,7 @@ void push_matrix_real(Stack* stack, gsl_matrix* matrix) {
 }
 
 void push_matrix_complex(Stack* stack, gsl_matrix_complex* matrix) {
-  if (stack->top >= STACK_SIZE - 1) {
-    fprintf(stderr,"Stack overflow\n");
-    return;
-  }
+  if (stack_reserve(stack, 1) != 0) return;
   stack->top++;
   stack->items[stack->top].type = TYPE_MATRIX_COMPLEX;
   stack->items[stack->top].matrix_complex = matrix;
@@ -175,10 +282,7 @@ int stack_dup(Stack* stack) {
     fprintf(stderr,"Stack is empty! Cannot duplicate.\n");
     return -1; // Error
   }
-  if (stack->top + 1 >= STACK_SIZE) {
-    fprintf(stderr,"Stack overflow! Cannot duplicate.\n");
-    return -1; // Error
-  }
+  if (stack_reserve(stack, 1) != 0) return -1; // Error
   if (stack_element_clone(&stack->items[stack->top + 1],
 		    &stack->items[stack->top]) != 0) {
     fprintf(stderr, "dup: failed to duplicate element\n");
@@ -226,6 +330,27 @@ void free_stack(Stack* stack) {
     stack_element_free(&stack->items[stack->top]);
     stack->top--;
   }
+  free(stack->items);
+  init_stack(stack);
+}
+
+// Whole file in one NUL-terminated buffer, so the numbers can be parsed in
+// place instead of one fscanf call at a time
+static char* read_whole_file(FILE* f, size_t* len) {
+  size_t cap = 1 << 16, n = 0;
+  char* buf = malloc(cap);
+  if (!buf) return NULL;
+  for (;;) {
+    n += fread(buf + n, 1, cap - n - 1, f);
+    if (n < cap - 1) break;
+    char* bigger = realloc(buf, 2 * cap);
+    if (!bigger) { free(buf); return NULL; }
+    buf = bigger;
+    cap *= 2;
+  }
+  buf[n] = '\0';
+  *len = n;
+  return buf;
 }
 
 gsl_matrix* load_matrix_from_file(int rows, int cols, const char* filename) {
@@ -235,27 +360,37 @@ gsl_matrix* load_matrix_from_file(int rows, int cols, const char* filename) {
     return NULL;
   }
 
-  gsl_matrix* m = gsl_matrix_alloc(rows, cols);
+  size_t len;
+  char* text = read_whole_file(f, &len);
+  fclose(f);
+  if (!text) {
+    fprintf(stderr, "Failed to read matrix file '%s'\n", filename);
+    return NULL;
+  }
+
+  gsl_matrix* m = pool_matrix_alloc(rows, cols);
   if (!m) {
-    fclose(f);
+    free(text);
     fprintf(stderr, "Failed to allocate matrix.\n");
     return NULL;
   }
 
+  const char* p = text;
+  const char* end = text + len;
   for (int i = 0; i < rows; ++i) {
     for (int j = 0; j < cols; ++j) {
       double val;
-      if (fscanf(f, "%lf", &val) != 1) {
+      if (!(p = parse_double(p, end, &val))) {
 	fprintf(stderr, "Failed to read value at [%d, %d] from file '%s'\n", i, j, filename);
-	gsl_matrix_free(m);
-	fclose(f);
+	pool_matrix_free(m);
+	free(text);
 	return NULL;
       }
       gsl_matrix_set(m, i, j, val);
     }
   }
 
-  fclose(f);
+  free(text);
   return m;
 }
 
@@ -276,9 +411,13 @@ value_type stack_next2_top_type(const Stack* stack) {
 }
 
 int copy_stack(Stack* dest, const Stack* src) {
-  // Release whatever dest currently owns; otherwise every snapshot/undo
-  // abandons the previous deep copy and leaks it.
-  free_stack(dest);          // leaves dest->top == -1
+  // Release whatever dest currently owns; otherwise every repeated copy
+  // abandons the previous one and leaks it. The block itself is kept, so
+  // copying into the same stack again does not reallocate.
+  while (dest->top >= 0)
+    stack_element_free(&dest->items[dest->top--]);
+  dest->warned = src->warned;  // the soft limit warning was already given
+  if (stack_reserve(dest, src->top + 1) != 0) return 0;
 
   for (int i = 0; i <= src->top; ++i) {
     if (stack_element_clone(&dest->items[i], &src->items[i]) != 0) {
@@ -308,8 +447,8 @@ void stack_nip(Stack* stack) {
 }
 
 void stack_tuck(Stack* stack) {
-  if (stack->top < 1 || stack->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "tuck: stack underflow or overflow\n");
+  if (stack->top < 1) {
+    fprintf(stderr, "tuck: stack underflow\n");
     return;
   }
 
@@ -318,10 +457,11 @@ void stack_tuck(Stack* stack) {
 }
 
 void stack_over(Stack* stack) {
-  if (stack->top < 1 || stack->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "over: stack underflow or overflow\n");
+  if (stack->top < 1) {
+    fprintf(stderr, "over: stack underflow\n");
     return;
   }
+  if (stack_reserve(stack, 1) != 0) return;
   // Deep copy: a shallow struct copy would alias the matrix/string pointer
   // into two slots and double-free at cleanup.
   if (stack_element_clone(&stack->items[stack->top + 1],
@@ -29,6 +29,7 @@
 #include <stdlib.h>                         // for free, malloc, mkstemp
 #include <string.h>                         // for strlen, memcpy, memcmp
 #include <unistd.h>                         // for unlink, close, fsync
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_complex_alloc
 
 /* -----------------------------
  * On-disk format (v1)
@@ -169,15 +170,15 @@ static void stack_clear_for_load(Stack *stack) {
     stack_element *e = &stack->items[i];
     switch (e->type) {
     case TYPE_STRING:
-      free(e->string);
+      string_release(e->string);
       e->string = NULL;
       break;
     case TYPE_MATRIX_REAL:
-      if (e->matrix_real) gsl_matrix_free(e->matrix_real);
+      if (e->matrix_real) matrix_release(e->matrix_real);
       e->matrix_real = NULL;
       break;
     case TYPE_MATRIX_COMPLEX:
-      if (e->matrix_complex) gsl_matrix_complex_free(e->matrix_complex);
+      if (e->matrix_complex) matrix_complex_release(e->matrix_complex);
       e->matrix_complex = NULL;
       break;
     default:
@@ -201,7 +202,7 @@ int save_stack_to_file(const Stack *stack, const char *filename) {
   }
 
   /* Validate top before writing. Your convention might differ. */
-  if (stack->top < -1 || stack->top >= STACK_SIZE) {
+  if (stack->top < -1 || stack->top >= stack->capacity) {
     fprintf(stderr, "save_stack_to_file: invalid stack->top=%d\n", stack->top);
     errno = EINVAL;
     return -1;
@@ -401,13 +402,15 @@ int load_stack_from_file(Stack *stack, const char *filename) {
   uint32_t count = 0;
   if (read_u32(file, &count, "read count") != 0) goto done;
 
-  if (count > (uint32_t)STACK_SIZE) {
-    fprintf(stderr, "load_stack_from_file: file stack too large (%u > STACK_SIZE)\n", count);
+  if (count > (uint32_t)stack_hard_limit) {
+    fprintf(stderr, "load_stack_from_file: file stack too large (%u > %d)\n",
+            count, stack_hard_limit);
     goto done;
   }
 
   /* Clear stack first to avoid leaks */
   stack_clear_for_load(stack);
+  if (stack_reserve(stack, (int)count) != 0) goto done;
 
   /* Populate */
   if (count == 0) {
@@ -469,7 +472,7 @@ int load_stack_from_file(Stack *stack, const char *filename) {
 	goto done;
       }
 
-      elem->matrix_real = gsl_matrix_alloc(rows, cols);
+      elem->matrix_real = pool_matrix_alloc(rows, cols);
       if (!elem->matrix_real) {
 	fprintf(stderr, "Failed to allocate matrix_real (%u x %u)\n", rows, cols);
 	goto done;
@@ -495,7 +498,7 @@ int load_stack_from_file(Stack *stack, const char *filename) {
 	goto done;
       }
 
-      elem->matrix_complex = gsl_matrix_complex_alloc(rows, cols);
+      elem->matrix_complex = pool_matrix_complex_alloc(rows, cols);
       if (!elem->matrix_complex) {
 	fprintf(stderr, "Failed to allocate matrix_complex (%u x %u)\n", rows, cols);
 	goto done;
@@ -26,7 +26,11 @@
 #include <stdbool.h>                        // for bool
 #include <math.h>                           // for INFINITY
 #include <stdio.h>                          // for fprintf, size_t, stderr
+#include <stdlib.h>                         // for malloc, free
 #include <string.h>                         // for strcmp
+#include "parallel.h"                       // for parallel_for, parallel_for_parts
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_kernels.h"                   // for simd_real, simd_real_scalar
 #include "stack.h"                          // for (anonymous struct)::(anon...
 #include "stat_fun.h"                       // for matrix_column_means, matr...
 
@@ -63,7 +67,7 @@ void matrix_column_means(Stack* stack) {
     size_t rows = mat->size1;
     size_t cols = mat->size2;
 
-    gsl_matrix* mean = gsl_matrix_calloc(1, cols);
+    gsl_matrix* mean = pool_matrix_calloc(1, cols);
     if (!mean) {
       fprintf(stderr, "Failed to allocate result matrix.\n");
       return;
@@ -80,9 +84,8 @@ void matrix_column_means(Stack* stack) {
     stack_element result;
     result.type = TYPE_MATRIX_REAL;
     result.matrix_real = mean;
-    if (stack->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_free(mean);
+    if (stack_reserve(stack, 1) != 0) {
+      pool_matrix_free(mean);
       return;
     }
     stack->items[++stack->top] = result;
@@ -97,7 +100,7 @@ void matrix_column_means(Stack* stack) {
     size_t rows = mat->size1;
     size_t cols = mat->size2;
 
-    gsl_matrix_complex* mean = gsl_matrix_complex_calloc(1, cols);
+    gsl_matrix_complex* mean = pool_matrix_complex_calloc(1, cols);
     if (!mean) {
       fprintf(stderr, "Failed to allocate complex result matrix.\n");
       return;
@@ -116,9 +119,8 @@ void matrix_column_means(Stack* stack) {
     stack_element result;
     result.type = TYPE_MATRIX_COMPLEX;
     result.matrix_complex = mean;
-    if (stack->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_complex_free(mean);
+    if (stack_reserve(stack, 1) != 0) {
+      pool_matrix_complex_free(mean);
       return;
     }
     stack->items[++stack->top] = result;
@@ -309,6 +311,204 @@ void matrix_column_means(Stack* stack) {
 /* } */
 
 
+// **************** Reduction engine ****************
+// Every row or column statistic comes out of one pass over the matrix that
+// gathers the sum, the sum of squared deviations from the mean (m2), the
+// minimum and the maximum, as far as the caller wants them. A row is read
+// straight through; for m2 it is read a second time, from cache, once its
+// mean is known. Columns are read the same way, a row at a time, into one
+// accumulator per column kept in planes, with Welford's running mean for
+// m2, so the matrix is never walked with stride tda and every update is a
+// simd_kernels loop across the row.
+//
+// Large matrices are spread over the thread pool. Rows are independent.
+// Columns are reduced in the row parts of parallel_part_rows, one set of
+// accumulators each, and the parts are merged in order with Chan et al.'s
+// pairwise update, so a result does not depend on the number of threads.
+
+typedef enum { STAT_SUM, STAT_MEAN, STAT_VAR, STAT_MIN, STAT_MAX, STAT_COUNT } stat_kind;
+
+static const char* const stat_names[STAT_COUNT] = { "sum", "mean", "var", "min", "max" };
+
+enum { WANT_SUM = 1, WANT_M2 = 2, WANT_MIN = 4, WANT_MAX = 8, WANT_ALL = 15 };
+
+static unsigned stat_wants(stat_kind kind) {
+  switch (kind) {
+  case STAT_VAR: return WANT_SUM | WANT_M2;
+  case STAT_MIN: return WANT_MIN;
+  case STAT_MAX: return WANT_MAX;
+  default:       return WANT_SUM;
+  }
+}
+
+static double stat_value(stat_kind kind, double sum, double m2, double min, double max,
+			 size_t n) {
+  switch (kind) {
+  case STAT_SUM:  return sum;
+  case STAT_MEAN: return sum / n;
+  case STAT_VAR:  return m2 / (n - 1.0);
+  case STAT_MIN:  return min;
+  default:        return max;
+  }
+}
+
+typedef struct {
+  double sum, m2, min, max;
+} row_stats;
+
+static row_stats reduce_row(const double* x, size_t n, unsigned want) {
+  row_stats s = { 0.0, 0.0, INFINITY, -INFINITY };
+  for (size_t j = 0; j < n; j++) {
+    double v = x[j];
+    s.sum += v;
+    if (v < s.min) s.min = v;
+    if (v > s.max) s.max = v;
+  }
+  if (want & WANT_M2) {
+    double mean = s.sum / n;
+    for (size_t j = 0; j < n; j++) s.m2 += (x[j] - mean) * (x[j] - mean);
+  }
+  return s;
+}
+
+// One accumulator per column, as planes of cols doubles in one block
+typedef struct {
+  double *sum, *mean, *m2, *min, *max;
+  double *delta, *scratch;
+} column_stats;
+
+static int column_stats_alloc(column_stats* c, size_t cols) {
+  double* block = malloc(7 * (cols ? cols : 1) * sizeof(double));
+  if (!block) {
+    fprintf(stderr, "Failed to allocate column accumulators.\n");
+    return -1;
+  }
+  double** planes[] = { &c->sum, &c->mean, &c->m2, &c->min, &c->max, &c->delta, &c->scratch };
+  for (size_t k = 0; k < 7; k++) *planes[k] = block + k * cols;
+  return 0;
+}
+
+static void column_stats_free(column_stats* c) {
+  free(c->sum);
+}
+
+// Fold rows [begin, end) of m into c, starting from empty accumulators
+static void reduce_columns(const gsl_matrix* m, size_t begin, size_t end, unsigned want,
+			   column_stats* c) {
+  size_t cols = m->size2;
+  for (size_t j = 0; j < cols; j++) {
+    c->sum[j] = c->mean[j] = c->m2[j] = 0.0;
+    c->min[j] = INFINITY;
+    c->max[j] = -INFINITY;
+  }
+
+  for (size_t i = begin; i < end; i++) {
+    const double* row = m->data + i * m->tda;
+    if (want & WANT_SUM) simd_real(SIMD_ADD, c->sum, row, c->sum, cols);
+    if (want & WANT_M2) {
+      double k = (double)(i - begin + 1);
+      simd_real(SIMD_SUB, row, c->mean, c->delta, cols);             // x - mean
+      simd_real_scalar(SIMD_DIV, c->delta, k, c->scratch, cols, 0);
+      simd_real(SIMD_ADD, c->mean, c->scratch, c->mean, cols);
+      simd_real(SIMD_SUB, row, c->mean, c->scratch, cols);           // x - new mean
+      simd_real(SIMD_MUL, c->delta, c->scratch, c->scratch, cols);
+      simd_real(SIMD_ADD, c->m2, c->scratch, c->m2, cols);
+    }
+    if (want & WANT_MIN) simd_real(SIMD_MIN, row, c->min, c->min, cols);
+    if (want & WANT_MAX) simd_real(SIMD_MAX, row, c->max, c->max, cols);
+  }
+}
+
+// Fold the statistics of nb rows in b into those of the na rows before them
+// in a
+static void merge_columns(column_stats* a, double na, const column_stats* b, double nb,
+			  size_t cols, unsigned want) {
+  double n = na + nb;
+  for (size_t j = 0; j < cols; j++) {
+    if (want & WANT_SUM) a->sum[j] += b->sum[j];
+    if (want & WANT_M2) {
+      double delta = b->mean[j] - a->mean[j];
+      a->mean[j] += delta * nb / n;
+      a->m2[j] += b->m2[j] + delta * delta * na * nb / n;
+    }
+    if (want & WANT_MIN && b->min[j] < a->min[j]) a->min[j] = b->min[j];
+    if (want & WANT_MAX && b->max[j] > a->max[j]) a->max[j] = b->max[j];
+  }
+}
+
+typedef struct {
+  const gsl_matrix* m;
+  size_t part_rows;
+  unsigned want;
+  column_stats* parts;
+} column_job;
+
+static void column_part(size_t part, void* arg) {
+  const column_job* job = arg;
+  size_t begin = part * job->part_rows;
+  size_t end = job->m->size1 - begin < job->part_rows ? job->m->size1 : begin + job->part_rows;
+  reduce_columns(job->m, begin, end, job->want, &job->parts[part]);
+}
+
+// All of m into c, part by part on the thread pool
+static int reduce_all_columns(const gsl_matrix* m, unsigned want, column_stats* c) {
+  size_t rows = m->size1;
+  size_t cols = m->size2;
+  size_t part_rows = parallel_part_rows(rows, cols);
+  size_t parts = rows ? (rows + part_rows - 1) / part_rows : 1;
+
+  column_stats* stats = malloc(parts * sizeof(column_stats));
+  if (!stats) {
+    fprintf(stderr, "Failed to allocate column accumulators.\n");
+    return -1;
+  }
+  stats[0] = *c;
+  size_t ready = 1;
+  while (ready < parts && column_stats_alloc(&stats[ready], cols) == 0) ready++;
+  if (ready < parts) {
+    while (--ready > 0) column_stats_free(&stats[ready]);
+    free(stats);
+    return -1;
+  }
+
+  column_job job = { m, part_rows, want, stats };
+  parallel_for_parts(parts, part_rows * cols, column_part, &job);
+  for (size_t part = 1; part < parts; part++) {
+    size_t before = part * part_rows;
+    size_t count = rows - before < part_rows ? rows - before : part_rows;
+    merge_columns(c, before, &stats[part], count, cols, want);
+    column_stats_free(&stats[part]);
+  }
+  free(stats);
+  return 0;
+}
+
+typedef struct {
+  const gsl_matrix* m;
+  stat_kind kind;
+  unsigned want;
+  gsl_matrix* result;
+} row_job;
+
+// Slices are whole rows: the grain is one row of elements
+static void row_slice(size_t begin, size_t end, void* arg) {
+  const row_job* job = arg;
+  size_t cols = job->m->size2;
+  for (size_t i = begin / cols; i < end / cols; i++) {
+    row_stats st = reduce_row(job->m->data + i * job->m->tda, cols, job->want);
+    job->result->data[i * job->result->tda] =
+      stat_value(job->kind, st.sum, st.m2, st.min, st.max, cols);
+  }
+}
+
+// Welford's update for complex data; m2 gathers |z - mean|^2
+static void complex_welford(gsl_complex val, size_t k, gsl_complex* mean, double* m2) {
+  gsl_complex delta = gsl_complex_sub(val, *mean);
+  *mean = gsl_complex_add(*mean, gsl_complex_div_real(delta, (double)k));
+  gsl_complex after = gsl_complex_sub(val, *mean);
+  *m2 += GSL_REAL(delta) * GSL_REAL(after) + GSL_IMAG(delta) * GSL_IMAG(after);
+}
+
 void matrix_reduce(Stack* stack, const char* axis, const char* op) {
   if (stack->top < 0) {
     fprintf(stderr, "Stack underflow: need a matrix to compute reduction.\n");
@@ -347,60 +547,38 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     }
     size_t rows = mat->size1;
     size_t cols = mat->size2;
-    gsl_matrix* result = NULL;
+    stat_kind kind = STAT_SUM;
+    while (strcmp(op, stat_names[kind]) != 0) kind++;
+    unsigned want = stat_wants(kind);
+
+    gsl_matrix* result = compute_rows ? pool_matrix_alloc(rows, 1) : pool_matrix_alloc(1, cols);
+    if (!result) {
+      fprintf(stderr, "Failed to allocate result matrix.\n");
+      return;
+    }
 
     if (compute_rows) {
-      result = gsl_matrix_calloc(rows, 1);
-      for (size_t i = 0; i < rows; ++i) {
-        double acc = 0.0, acc_sq = 0.0;
-        double extreme = do_max ? -INFINITY : INFINITY;
-        for (size_t j = 0; j < cols; ++j) {
-          double val = gsl_matrix_get(mat, i, j);
-          acc += val;
-          acc_sq += val * val;
-          if (do_min && val < extreme) extreme = val;
-          if (do_max && val > extreme) extreme = val;
-        }
-        double res = 0.0;
-        if (do_sum) res = acc;
-        else if (do_mean) res = acc / cols;
-        else if (do_var) {
-          double mean = acc / cols;
-          res = (acc_sq - cols * mean * mean) / (cols - 1);
-        } else if (do_min || do_max) {
-          res = extreme;
-        }
-        gsl_matrix_set(result, i, 0, res);
-      }
+      row_job job = { mat, kind, want, result };
+      parallel_for(rows * cols, cols, row_slice, &job);
     } else if (compute_cols) {
-      result = gsl_matrix_calloc(1, cols);
-      for (size_t j = 0; j < cols; ++j) {
-        double acc = 0.0, acc_sq = 0.0;
-        double extreme = do_max ? -INFINITY : INFINITY;
-        for (size_t i = 0; i < rows; ++i) {
-          double val = gsl_matrix_get(mat, i, j);
-          acc += val;
-          acc_sq += val * val;
-          if (do_min && val < extreme) extreme = val;
-          if (do_max && val > extreme) extreme = val;
-        }
-        double res = 0.0;
-        if (do_sum) res = acc;
-        else if (do_mean) res = acc / rows;
-        else if (do_var) {
-          double mean = acc / rows;
-          res = (acc_sq - rows * mean * mean) / (rows - 1);
-        } else if (do_min || do_max) {
-          res = extreme;
-        }
-        gsl_matrix_set(result, 0, j, res);
+      column_stats c;
+      if (column_stats_alloc(&c, cols) != 0) {
+	pool_matrix_free(result);
+	return;
+      }
+      if (reduce_all_columns(mat, want, &c) != 0) {
+	column_stats_free(&c);
+	pool_matrix_free(result);
+	return;
       }
+      for (size_t j = 0; j < cols; ++j)
+	result->data[j] = stat_value(kind, c.sum[j], c.m2[j], c.min[j], c.max[j], rows);
+      column_stats_free(&c);
     }
 
     stack_element out = {.type = TYPE_MATRIX_REAL, .matrix_real = result};
-    if (stack->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_free(result);
+    if (stack_reserve(stack, 1) != 0) {
+      pool_matrix_free(result);
       return;
     }
     stack->items[++stack->top] = out;
@@ -416,18 +594,22 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     gsl_matrix_complex* result = NULL;
 
     if (compute_rows) {
-      result = gsl_matrix_complex_calloc(rows, 1);
+      result = pool_matrix_complex_calloc(rows, 1);
+      if (!result) {
+        fprintf(stderr, "Failed to allocate complex result matrix.\n");
+        return;
+      }
       for (size_t i = 0; i < rows; ++i) {
         gsl_complex acc = gsl_complex_rect(0.0, 0.0);
-        gsl_complex acc_sq = gsl_complex_rect(0.0, 0.0);
+        gsl_complex mean = gsl_complex_rect(0.0, 0.0);
+        double m2 = 0.0;
         double maxabs = -INFINITY, minabs = INFINITY;
         gsl_complex maxz = gsl_complex_rect(0, 0), minz = gsl_complex_rect(0, 0);
 
         for (size_t j = 0; j < cols; ++j) {
           gsl_complex val = gsl_matrix_complex_get(mat, i, j);
           acc = gsl_complex_add(acc, val);
-          gsl_complex val_sq = gsl_complex_mul(val, gsl_complex_conjugate(val));
-          acc_sq = gsl_complex_add(acc_sq, val_sq);
+          if (do_var) complex_welford(val, j + 1, &mean, &m2);
 
           double absval = gsl_complex_abs(val);
           if (do_max && absval > maxabs) { maxabs = absval; maxz = val; }
@@ -437,27 +619,29 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
         if (do_sum) res = acc;
         else if (do_mean) res = gsl_complex_div_real(acc, (double)cols);
         else if (do_var) {
-          double mean_norm = gsl_complex_abs(acc) / cols;
-          double acc_sq_real = GSL_REAL(acc_sq);
-          res = gsl_complex_rect((acc_sq_real - cols * mean_norm * mean_norm) / (cols - 1), 0.0);
+          res = gsl_complex_rect(m2 / (cols - 1.0), 0.0);
         } else if (do_max) res = maxz;
         else if (do_min) res = minz;
 
         gsl_matrix_complex_set(result, i, 0, res);
       }
     } else if (compute_cols) {
-      result = gsl_matrix_complex_calloc(1, cols);
+      result = pool_matrix_complex_calloc(1, cols);
+      if (!result) {
+        fprintf(stderr, "Failed to allocate complex result matrix.\n");
+        return;
+      }
       for (size_t j = 0; j < cols; ++j) {
         gsl_complex acc = gsl_complex_rect(0.0, 0.0);
-        gsl_complex acc_sq = gsl_complex_rect(0.0, 0.0);
+        gsl_complex mean = gsl_complex_rect(0.0, 0.0);
+        double m2 = 0.0;
         double maxabs = -INFINITY, minabs = INFINITY;
         gsl_complex maxz = gsl_complex_rect(0, 0), minz = gsl_complex_rect(0, 0);
 
         for (size_t i = 0; i < rows; ++i) {
           gsl_complex val = gsl_matrix_complex_get(mat, i, j);
           acc = gsl_complex_add(acc, val);
-          gsl_complex val_sq = gsl_complex_mul(val, gsl_complex_conjugate(val));
-          acc_sq = gsl_complex_add(acc_sq, val_sq);
+          if (do_var) complex_welford(val, i + 1, &mean, &m2);
 
           double absval = gsl_complex_abs(val);
           if (do_max && absval > maxabs) { maxabs = absval; maxz = val; }
@@ -467,9 +651,7 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
         if (do_sum) res = acc;
         else if (do_mean) res = gsl_complex_div_real(acc, (double)rows);
         else if (do_var) {
-          double mean_norm = gsl_complex_abs(acc) / rows;
-          double acc_sq_real = GSL_REAL(acc_sq);
-          res = gsl_complex_rect((acc_sq_real - rows * mean_norm * mean_norm) / (rows - 1), 0.0);
+          res = gsl_complex_rect(m2 / (rows - 1.0), 0.0);
         } else if (do_max) res = maxz;
         else if (do_min) res = minz;
 
@@ -478,9 +660,8 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     }
 
     stack_element out = {.type = TYPE_MATRIX_COMPLEX, .matrix_complex = result};
-    if (stack->top + 1 >= STACK_SIZE) {
-      fprintf(stderr, "Stack overflow.\n");
-      gsl_matrix_complex_free(result);
+    if (stack_reserve(stack, 1) != 0) {
+      pool_matrix_complex_free(result);
       return;
     }
     stack->items[++stack->top] = out;
@@ -489,3 +670,42 @@ void matrix_reduce(Stack* stack, const char* axis, const char* op) {
     fprintf(stderr, "Type error: top stack item must be a matrix (real or complex).\n");
   }
 }
+
+void matrix_describe(Stack* stack) {
+  if (stack->top < 0 || stack->items[stack->top].type != TYPE_MATRIX_REAL) {
+    fprintf(stderr, "describe expects a real matrix.\n");
+    return;
+  }
+
+  gsl_matrix* mat = stack->items[stack->top].matrix_real;
+  size_t rows = mat->size1;
+  size_t cols = mat->size2;
+
+  gsl_matrix* result = pool_matrix_alloc(STAT_COUNT, cols);
+  if (!result) {
+    fprintf(stderr, "Failed to allocate result matrix.\n");
+    return;
+  }
+  column_stats c;
+  if (column_stats_alloc(&c, cols) != 0) {
+    pool_matrix_free(result);
+    return;
+  }
+
+  if (reduce_all_columns(mat, WANT_ALL, &c) != 0) {
+    column_stats_free(&c);
+    pool_matrix_free(result);
+    return;
+  }
+  for (stat_kind kind = STAT_SUM; kind < STAT_COUNT; kind++)
+    for (size_t j = 0; j < cols; ++j)
+      gsl_matrix_set(result, kind, j, stat_value(kind, c.sum[j], c.m2[j], c.min[j], c.max[j], rows));
+  column_stats_free(&c);
+
+  if (stack_reserve(stack, 1) != 0) {
+    pool_matrix_free(result);
+    return;
+  }
+  stack_element out = {.type = TYPE_MATRIX_REAL, .matrix_real = result};
+  stack->items[++stack->top] = out;
+}
@@ -66,8 +66,8 @@ void concatenate(Stack *stack)
     out[n1 + n2] = '\0';
 
     /* Free old strings and replace the lower one with the concatenation */
-    free(stack->items[stack->top].string);
-    free(stack->items[stack->top - 1].string);
+    string_release(stack->items[stack->top].string);
+    string_release(stack->items[stack->top - 1].string);
 
     stack->items[stack->top - 1].type = TYPE_STRING;
     stack->items[stack->top - 1].string = out;
@@ -88,7 +88,7 @@ void to_upper(Stack* stack) {
     return;
   }
   for (char* p = upper; *p; ++p) *p = toupper((unsigned char)*p);
-  free(orig);
+  string_release(orig);
   stack->items[stack->top].string = upper;
 }
 
@@ -104,7 +104,7 @@ void to_lower(Stack* stack) {
     return;
   }
   for (char* p = lower; *p; ++p) *p = tolower((unsigned char)*p);
-  free(orig);
+  string_release(orig);
   stack->items[stack->top].string = lower;
 }
 
@@ -114,7 +114,7 @@ void string_length(Stack* stack) {
     return;
   }
   size_t len = strlen(stack->items[stack->top].string);
-  free(stack->items[stack->top].string);
+  string_release(stack->items[stack->top].string);
   stack->top--;
   push_real(stack, (double)len);
 }
@@ -124,6 +124,7 @@ void string_reverse(Stack* stack) {
     fprintf(stderr,"Top item must be a string\n");
     return;
   }
+  if (stack_element_unshare(&stack->items[stack->top]) != 0) return;
   char* str = stack->items[stack->top].string;
   size_t len = strlen(str);
   for (size_t i = 0; i < len / 2; ++i) {
@@ -187,7 +188,7 @@ int my_substring(Stack* stack) {
   int start, end;
   if (!elem_to_index(&e_start, &start) || !elem_to_index(&e_end, &end)) {
     fprintf(stderr, "Error: substring indices must be non-negative integers\n");
-    free(e_str.string); /* clean up since we popped it */
+    string_release(e_str.string); /* clean up since we popped it */
     return 1;
   }
 
@@ -198,7 +199,7 @@ int my_substring(Stack* stack) {
   if ((size_t)start > len || (size_t)end > len || start > end) {
     fprintf(stderr, "Error: substring range [%d, %d) is out of bounds for length %zu\n",
             start, end, len);
-    free(e_str.string);
+    string_release(e_str.string);
     return 1;
   }
 
@@ -207,7 +208,7 @@ int my_substring(Stack* stack) {
   char* out = (char*)malloc(sublen + 1);
   if (!out) {
     fprintf(stderr, "Error: memory allocation failed\n");
-    free(e_str.string);
+    string_release(e_str.string);
     return 1;
   }
 
@@ -215,7 +216,7 @@ int my_substring(Stack* stack) {
   out[sublen] = '\0';
 
   /* We’re done with the original string */
-  free(e_str.string);
+  string_release(e_str.string);
 
   /* Push result. Assumes push_string copies the buffer. */
   push_string(stack, out);
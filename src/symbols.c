@@ -0,0 +1,227 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>         // for uint32_t
+#include <stdio.h>          // for fprintf, stderr
+#include <stdlib.h>         // for malloc, realloc, calloc, free, qsort
+#include <string.h>         // for memcpy, strcmp, strncmp, strlen
+#include "function_list.h"  // for function_names, OPCODE_NONE
+#include "symbols.h"
+#include "words.h"          // for user_word
+
+// **************** Symbol table ****************
+// Symbols are kept in a growable array indexed by id. Names are found
+// through an open-addressing hash table of ids that is doubled whenever it
+// gets half full.
+
+typedef struct {
+  char* name;
+  uint32_t hash;
+  int opcode;           // builtin opcode, or OPCODE_NONE
+  user_word* word;
+  user_word* macro;
+} symbol;
+
+static symbol* symbols = NULL;
+static int symbol_count = 0;
+static int symbol_capacity = 0;
+
+static int* slots = NULL;       // id + 1, 0 = empty
+static uint32_t slot_count = 0; // power of two
+
+// Ids in name order for prefix search; rebuilt when symbols are added
+static int* sorted = NULL;
+static int sorted_count = 0;
+
+static uint32_t hash_name(const char* name, size_t len) {
+  uint32_t h = 2166136261u;  // FNV-1a
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void insert_slot(int id) {
+  uint32_t i = symbols[id].hash & (slot_count - 1);
+  while (slots[i] != 0) i = (i + 1) & (slot_count - 1);
+  slots[i] = id + 1;
+}
+
+static int grow_slots(void) {
+  uint32_t n = slot_count ? 2 * slot_count : 1024;
+  int* bigger = calloc(n, sizeof(int));
+  if (!bigger) return -1;
+  free(slots);
+  slots = bigger;
+  slot_count = n;
+  for (int id = 0; id < symbol_count; id++) insert_slot(id);
+  return 0;
+}
+
+static int find_symbol(const char* name, size_t len, uint32_t h) {
+  if (!slots) return SYMBOL_NONE;
+  for (uint32_t i = h & (slot_count - 1); slots[i] != 0; i = (i + 1) & (slot_count - 1)) {
+    const symbol* s = &symbols[slots[i] - 1];
+    if (s->hash == h && strncmp(s->name, name, len) == 0 && s->name[len] == '\0')
+      return slots[i] - 1;
+  }
+  return SYMBOL_NONE;
+}
+
+static int add_symbol(const char* name, size_t len, uint32_t h) {
+  if (2 * (uint32_t)(symbol_count + 1) > slot_count && grow_slots() != 0)
+    return SYMBOL_NONE;
+  if (symbol_count == symbol_capacity) {
+    int cap = symbol_capacity ? 2 * symbol_capacity : 512;
+    symbol* bigger = realloc(symbols, (size_t)cap * sizeof(symbol));
+    if (!bigger) return SYMBOL_NONE;
+    symbols = bigger;
+    symbol_capacity = cap;
+  }
+  char* copy = malloc(len + 1);
+  if (!copy) return SYMBOL_NONE;
+  memcpy(copy, name, len);
+  copy[len] = '\0';
+
+  int id = symbol_count++;
+  symbols[id] = (symbol){ copy, h, OPCODE_NONE, NULL, NULL };
+  insert_slot(id);
+  return id;
+}
+
+// Builtins go in first and keep their opcode
+static void init_symbols(void) {
+  if (symbols) return;
+  for (int i = 0; function_names[i] != NULL; i++) {
+    const char* fn = function_names[i];
+    size_t len = strlen(fn);
+    uint32_t h = hash_name(fn, len);
+    if (find_symbol(fn, len, h) != SYMBOL_NONE) continue;
+    int id = add_symbol(fn, len, h);
+    if (id == SYMBOL_NONE) {
+      fprintf(stderr, "Memory allocation failed\n");
+      return;
+    }
+    symbols[id].opcode = i;
+  }
+}
+
+int intern_symbol(const char* name, size_t len) {
+  init_symbols();
+  uint32_t h = hash_name(name, len);
+  int id = find_symbol(name, len, h);
+  return id != SYMBOL_NONE ? id : add_symbol(name, len, h);
+}
+
+int lookup_symbol(const char* name, size_t len) {
+  init_symbols();
+  return find_symbol(name, len, hash_name(name, len));
+}
+
+const char* symbol_name(int id) {
+  return id >= 0 && id < symbol_count ? symbols[id].name : NULL;
+}
+
+int symbol_opcode(int id) {
+  return id >= 0 && id < symbol_count ? symbols[id].opcode : OPCODE_NONE;
+}
+
+user_word* symbol_word(int id) {
+  return id >= 0 && id < symbol_count ? symbols[id].word : NULL;
+}
+
+user_word* symbol_macro(int id) {
+  return id >= 0 && id < symbol_count ? symbols[id].macro : NULL;
+}
+
+int symbol_is_bound(int id) {
+  return symbol_opcode(id) != OPCODE_NONE || symbol_word(id) || symbol_macro(id);
+}
+
+void unbind_user_symbols(void) {
+  for (int id = 0; id < symbol_count; id++) {
+    symbols[id].word = NULL;
+    symbols[id].macro = NULL;
+  }
+}
+
+void bind_word_symbol(user_word* w) {
+  int id = intern_symbol(w->name, strlen(w->name));
+  if (id != SYMBOL_NONE) symbols[id].word = w;
+}
+
+void bind_macro_symbol(user_word* w) {
+  int id = intern_symbol(w->name, strlen(w->name));
+  if (id != SYMBOL_NONE) symbols[id].macro = w;
+}
+
+// **************** Prefix search ****************
+static int compare_ids(const void* a, const void* b) {
+  return strcmp(symbols[*(const int*)a].name, symbols[*(const int*)b].name);
+}
+
+static int sort_symbols(void) {
+  if (sorted && sorted_count == symbol_count) return 0;
+  int* ids = realloc(sorted, (size_t)symbol_count * sizeof(int));
+  if (!ids) return -1;
+  sorted = ids;
+  for (int i = 0; i < symbol_count; i++) sorted[i] = i;
+  qsort(sorted, (size_t)symbol_count, sizeof(int), compare_ids);
+  sorted_count = symbol_count;
+  return 0;
+}
+
+const char* next_symbol_with_prefix(const char* prefix, int* cursor) {
+  size_t len = strlen(prefix);
+  if (*cursor == 0) {
+    init_symbols();
+    if (sort_symbols() != 0) return NULL;
+    // First position whose name is >= prefix
+    int lo = 0, hi = sorted_count;
+    while (lo < hi) {
+      int mid = lo + (hi - lo) / 2;
+      if (strncmp(symbols[sorted[mid]].name, prefix, len) < 0) lo = mid + 1;
+      else hi = mid;
+    }
+    *cursor = lo + 1;
+  }
+  for (int i = *cursor - 1; i < sorted_count; i++) {
+    const char* name = symbols[sorted[i]].name;
+    if (strncmp(name, prefix, len) != 0) break;
+    if (symbol_is_bound(sorted[i])) {
+      *cursor = i + 2;
+      return name;
+    }
+  }
+  *cursor = sorted_count + 1;
+  return NULL;
+}
+
+void free_symbols(void) {
+  for (int id = 0; id < symbol_count; id++) free(symbols[id].name);
+  free(symbols);
+  free(slots);
+  free(sorted);
+  symbols = NULL;
+  slots = NULL;
+  sorted = NULL;
+  symbol_count = symbol_capacity = sorted_count = 0;
+  slot_count = 0;
+}
@@ -19,66 +19,18 @@
 #define _POSIX_C_SOURCE 200809L
 
 #include <readline/readline.h>  // for rl_completion_matches, rl_line_buffer
-#include <string.h>             // for strdup, strncmp, NULL, strlen
+#include <string.h>             // for strdup, NULL
+#include "symbols.h"            // for next_symbol_with_prefix
 #include "tab_completion.h"     // for function_name_completion, function_na...
-#include "words.h"              // for user_word
 
+// Builtins, user words and macros all live in the symbol table, so one
+// sorted prefix walk covers them
 char* function_name_generator(const char* text, int state) {
-  static int phase;  // 0 = builtins, 1 = user words, 2 = macros
-  static int index;
-  static int len;
+  static int cursor;
 
-  extern const char* const function_names[];
-  extern user_word words[];
-  extern int word_count;
-  extern user_word macros[];
-  extern int macro_count;
-
-  if (!state) {
-    phase = 0;
-    index = 0;
-    len = strlen(text);
-  }
-
-  while (phase < 3) {
-    const char* candidate = NULL;
-    (void) candidate;
-
-    switch (phase) {
-    case 0:
-      while (function_names[index]) {
-	const char* fn = function_names[index++];
-	if (strncmp(fn, text, len) == 0) {
-	  return strdup(fn);
-	}
-      }
-      break;
-
-    case 1:
-      while (index < word_count) {
-	const char* name = words[index++].name;
-	if (strncmp(name, text, len) == 0) {
-	  return strdup(name);
-	}
-      }
-      break;
-
-    case 2:
-      while (index < macro_count) {
-	const char* name = macros[index++].name;
-	if (strncmp(name, text, len) == 0) {
-	  return strdup(name);
-	}
-      }
-      break;
-    }
-
-    // Advance to next phase
-    phase++;
-    index = 0;
-  }
-
-  return NULL;
+  if (!state) cursor = 0;
+  const char* name = next_symbol_with_prefix(text, &cursor);
+  return name ? strdup(name) : NULL;
 }
 
 char** function_name_completion(const char* text, int start, int end) {
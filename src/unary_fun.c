@@ -17,14 +17,19 @@
  */
 
 #define _POSIX_C_SOURCE 200809L
-#include <complex.h>                        // for cabs
 #include <gsl/gsl_complex.h>                // for gsl_complex, GSL_IMAG
 #include <gsl/gsl_complex_math.h>           // for gsl_complex_rect
 #include <gsl/gsl_matrix_complex_double.h>  // for gsl_matrix_complex_get
 #include <gsl/gsl_matrix_double.h>          // for gsl_matrix_free, gsl_matr...
+#include <math.h>                           // for sin, cos, tan, exp, hypot
 #include <stdio.h>                          // for fprintf, size_t, stderr
-#include "math_helpers.h"                   // for to_double_complex
+#include "math_helpers.h"                   // for negate_real, safe_frac, my_comple...
+#include "parallel.h"                       // for parallel_for, PARALLEL_GRAIN
+#include "pool.h"                           // for pool_matrix_alloc, pool_matrix_free
+#include "simd_kernels.h"                   // for simd_split, simd_join
+#include "simd_math.h"                      // for simd_math_real, simd_math_complex
 #include "stack.h"                          // for (anonymous struct)::(anon...
+#include "stat_fun.h"                       // for standard_normal_pdf, standard_no...
 #include "unary_fun.h"                      // for apply_complex_matrix_unar...
 
 // === Unary math functions for real and complex ===
@@ -44,6 +49,95 @@ void apply_complex_unary(Stack* stack, gsl_complex (*func)(gsl_complex)) {
   stack->items[stack->top].complex_val = func(stack->items[stack->top].complex_val);
 }
 
+// The functions simd_math has vector kernels for; a dense matrix goes
+// through those instead of one call per element
+static const struct {
+  double (*func)(double);
+  simd_math_fn vector;
+} real_vector_math[] = {
+  { sin, MATH_SIN }, { cos, MATH_COS }, { tan, MATH_TAN }, { exp, MATH_EXP },
+  { log, MATH_LN }, { log10, MATH_LOG10 }, { sqrt, MATH_SQRT },
+  { sinh, MATH_SINH }, { cosh, MATH_COSH }, { tanh, MATH_TANH },
+  { standard_normal_pdf, MATH_NPDF }, { standard_normal_cdf, MATH_NCDF },
+};
+
+static const struct {
+  gsl_complex (*func)(gsl_complex);
+  simd_math_fn vector;
+} complex_vector_math[] = {
+  { gsl_complex_exp, MATH_EXP }, { gsl_complex_sin, MATH_SIN }, { gsl_complex_cos, MATH_COS },
+  { gsl_complex_sinh, MATH_SINH }, { gsl_complex_cosh, MATH_COSH },
+};
+
+// Scalar functions that may run on several threads at once: reentrant, and
+// never reporting through the GSL error handler, which is one global for
+// all threads. Anything else (gamma, the normal quantile, 1/x with its
+// division message) maps a matrix on the interpreter thread only.
+static double (*const parallel_real_funcs[])(double) = {
+  sin, cos, tan, asin, acos, atan, sinh, cosh, tanh, asinh, acosh, atanh,
+  exp, log, log10, sqrt, fabs, negate_real, safe_frac, safe_int,
+  standard_normal_pdf, standard_normal_cdf,
+};
+
+static gsl_complex (*const parallel_complex_funcs[])(gsl_complex) = {
+  gsl_complex_sin, gsl_complex_cos, gsl_complex_tan, gsl_complex_sinh,
+  gsl_complex_cosh, gsl_complex_tanh, gsl_complex_exp, my_complex_asin,
+  my_complex_acos, my_complex_atan, my_complex_asinh, my_complex_acosh,
+  my_complex_atanh, negate_complex, safe_frac_complex, safe_int_complex,
+};
+
+static int parallel_safe_real(double (*func)(double)) {
+  for (size_t k = 0; k < sizeof(parallel_real_funcs) / sizeof(parallel_real_funcs[0]); k++)
+    if (parallel_real_funcs[k] == func) return 1;
+  return 0;
+}
+
+static int parallel_safe_complex(gsl_complex (*func)(gsl_complex)) {
+  for (size_t k = 0; k < sizeof(parallel_complex_funcs) / sizeof(parallel_complex_funcs[0]); k++)
+    if (parallel_complex_funcs[k] == func) return 1;
+  return 0;
+}
+
+// A matrix map for parallel_for; slices index the elements row by row
+typedef struct {
+  gsl_matrix* real_matrix;
+  gsl_matrix_complex* complex_matrix;
+  double (*real_func)(double);
+  gsl_complex (*complex_func)(gsl_complex);
+  simd_math_fn vector;
+} unary_job;
+
+static void real_vector_slice(size_t begin, size_t end, void* arg) {
+  const unary_job* job = arg;
+  double* data = job->real_matrix->data + begin;
+  simd_math_real(job->vector, data, data, end - begin);
+}
+
+static void complex_vector_slice(size_t begin, size_t end, void* arg) {
+  const unary_job* job = arg;
+  double* data = job->complex_matrix->data + 2 * begin;
+  simd_math_complex(job->vector, data, data, end - begin);
+}
+
+static void real_element_slice(size_t begin, size_t end, void* arg) {
+  const unary_job* job = arg;
+  size_t cols = job->real_matrix->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    gsl_matrix_set(job->real_matrix, i, j, job->real_func(gsl_matrix_get(job->real_matrix, i, j)));
+  }
+}
+
+static void complex_element_slice(size_t begin, size_t end, void* arg) {
+  const unary_job* job = arg;
+  size_t cols = job->complex_matrix->size2;
+  for (size_t k = begin; k < end; k++) {
+    size_t i = k / cols, j = k % cols;
+    gsl_complex z = gsl_matrix_complex_get(job->complex_matrix, i, j);
+    gsl_matrix_complex_set(job->complex_matrix, i, j, job->complex_func(z));
+  }
+}
+
 void apply_complex_matrix_unary_inplace(Stack* stack, gsl_complex (*func)(gsl_complex)) {
   if (stack->top < 0) {
     fprintf(stderr,"Stack is empty!\n");
@@ -55,17 +149,25 @@ void apply_complex_matrix_unary_inplace(Stack* stack, gsl_complex (*func)(gsl_co
     fprintf(stderr,"Top of stack is not a complex matrix!\n");
     return;
   }
+  if (stack_element_unshare(top) != 0) return;  // copy only if shared
 
   gsl_matrix_complex* mat = top->matrix_complex;
   size_t rows = mat->size1;
   size_t cols = mat->size2;
 
-  for (size_t i = 0; i < rows; ++i) {
-    for (size_t j = 0; j < cols; ++j) {
-      gsl_complex z = gsl_matrix_complex_get(mat, i, j);
-      gsl_matrix_complex_set(mat, i, j, func(z));
-    }
-  }
+  unary_job job = { .complex_matrix = mat, .complex_func = func };
+  if (mat->tda == cols)
+    for (size_t k = 0; k < sizeof(complex_vector_math) / sizeof(complex_vector_math[0]); k++)
+      if (complex_vector_math[k].func == func) {
+        job.vector = complex_vector_math[k].vector;
+        parallel_for(rows * cols, PARALLEL_GRAIN, complex_vector_slice, &job);
+        return;
+      }
+
+  if (parallel_safe_complex(func))
+    parallel_for(rows * cols, PARALLEL_GRAIN, complex_element_slice, &job);
+  else
+    complex_element_slice(0, rows * cols, &job);
 }
 
 void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double)) {
@@ -79,71 +181,79 @@ void apply_real_matrix_unary_inplace(Stack* stack, double (*func)(double)) {
     fprintf(stderr,"Top of stack is not a real matrix!\n");
     return;
   }
+  if (stack_element_unshare(top) != 0) return;  // copy only if shared
 
   gsl_matrix* mat = top->matrix_real;
   size_t rows = mat->size1;
   size_t cols = mat->size2;
 
-  for (size_t i = 0; i < rows; ++i) {
-    for (size_t j = 0; j < cols; ++j) {
-      double val = gsl_matrix_get(mat, i, j);
-      gsl_matrix_set(mat, i, j, func(val));
-    }
-  }
-}
+  unary_job job = { .real_matrix = mat, .real_func = func };
+  if (mat->tda == cols)
+    for (size_t k = 0; k < sizeof(real_vector_math) / sizeof(real_vector_math[0]); k++)
+      if (real_vector_math[k].func == func) {
+        job.vector = real_vector_math[k].vector;
+        parallel_for(rows * cols, PARALLEL_GRAIN, real_vector_slice, &job);
+        return;
+      }
 
-void complex_matrix_real_part(Stack *s) {
-  if (s->top < 0 || s->items[s->top].type != TYPE_MATRIX_COMPLEX) {
-    fprintf(stderr, "Error: top of stack must be a complex matrix.\n");
-    return;
-  }
+  if (parallel_safe_real(func))
+    parallel_for(rows * cols, PARALLEL_GRAIN, real_element_slice, &job);
+  else
+    real_element_slice(0, rows * cols, &job);
+}
 
-  stack_element *src = &s->items[s->top];
+// **************** Split planes ****************
+// re, im, abs, arg and split_c read a complex matrix as a whole buffer, and
+// re2c writes one, so a dense matrix goes through simd_split/simd_join (or
+// one libm call an element for abs and arg) in slices across the thread
+// pool. A matrix with padded rows takes the element by element path.
+typedef struct {
+  double* z;         // interleaved complex data
+  double* re;        // the result of re, abs and arg, or split_c's planes
+  double* im;
+} plane_job;
+
+static void real_plane_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  simd_split(job->z + 2 * begin, job->re + begin, NULL, end - begin);
+}
 
-  gsl_matrix_complex *matrix = src->matrix_complex;
-  if (!matrix) {
-    fprintf(stderr, "Error: complex matrix is NULL.\n");
-    return;
-  }
+static void imag_plane_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  simd_split(job->z + 2 * begin, NULL, job->re + begin, end - begin);
+}
 
-  size_t rows = matrix->size1;
-  size_t cols = matrix->size2;
+static void both_planes_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  simd_split(job->z + 2 * begin, job->re + begin, job->im + begin, end - begin);
+}
 
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
-  if (!result) {
-    fprintf(stderr, "Error: failed to allocate result matrix.\n");
-    return;
-  }
+// re2c: the real matrix in re is joined into z
+static void join_real_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  simd_join(job->re + begin, NULL, job->z + 2 * begin, end - begin);
+}
 
-  for (size_t i = 0; i < rows; i++) {
-    for (size_t j = 0; j < cols; j++) {
-      gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
-      double real = GSL_REAL(z);
-      gsl_matrix_set(result, i, j, real);
-    }
-  }
+static void abs_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  for (size_t k = begin; k < end; k++) job->re[k] = hypot(job->z[2 * k], job->z[2 * k + 1]);
+}
 
-  // Inline stackl_pop:
-  if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
+// atan2 alone would give ±π for (-0, 0); gsl_complex_arg gives 0
+static void arg_slice(size_t begin, size_t end, void* arg) {
+  const plane_job* job = arg;
+  for (size_t k = begin; k < end; k++) {
+    double x = job->z[2 * k], y = job->z[2 * k + 1];
+    job->re[k] = (x == 0.0 && y == 0.0) ? 0.0 : atan2(y, x);
   }
-
-  //    src->type = TYPE_NONE; // Mark slot as empty
-  s->top--;
-
-  // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
-    return;
-  }
-  s->top++;
-  stack_element *dest = &s->items[s->top];
-  dest->type = TYPE_MATRIX_REAL;
-  dest->matrix_real = result;
 }
 
-void complex_matrix_imag_part(Stack *s) {
+static double real_of(gsl_complex z) { return GSL_REAL(z); }
+static double imag_of(gsl_complex z) { return GSL_IMAG(z); }
+
+// Replace the complex matrix on top of the stack with the real matrix of
+// part(z) for each element z; body computes the same from dense data
+static void complex_matrix_map_real(Stack *s, parallel_body body, double (*part)(gsl_complex)) {
   if (s->top < 0 || s->items[s->top].type != TYPE_MATRIX_COMPLEX) {
     fprintf(stderr, "Error: top of stack must be a complex matrix.\n");
     return;
@@ -160,31 +270,28 @@ void complex_matrix_imag_part(Stack *s) {
   size_t rows = matrix->size1;
   size_t cols = matrix->size2;
 
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
+  gsl_matrix *result = pool_matrix_alloc(rows, cols);
   if (!result) {
     fprintf(stderr, "Error: failed to allocate result matrix.\n");
     return;
   }
 
-  for (size_t i = 0; i < rows; i++) {
-    for (size_t j = 0; j < cols; j++) {
-      gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
-      double real = GSL_IMAG(z);
-      gsl_matrix_set(result, i, j, real);
-    }
+  if (matrix->tda == cols) {
+    plane_job job = { .z = matrix->data, .re = result->data };
+    parallel_for(rows * cols, PARALLEL_GRAIN, body, &job);
+  } else {
+    for (size_t i = 0; i < rows; i++)
+      for (size_t j = 0; j < cols; j++)
+	gsl_matrix_set(result, i, j, part(gsl_matrix_complex_get(matrix, i, j)));
   }
 
   // Inline stackl_pop:
-  if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
-  }
-  //    src->type = TYPE_NONE; // Mark slot as empty
+  matrix_complex_release(matrix);
   s->top--;
 
   // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
+  if (stack_reserve(s, 1) != 0) {
+    pool_matrix_free(result);
     return;
   }
   s->top++;
@@ -193,54 +300,20 @@ void complex_matrix_imag_part(Stack *s) {
   dest->matrix_real = result;
 }
 
-void complex_matrix_abs_by_element(Stack *s) {
-  if (s->top < 0 || s->items[s->top].type != TYPE_MATRIX_COMPLEX) {
-    fprintf(stderr, "Error: top of stack must be a complex matrix.\n");
-    return;
-  }
-
-  stack_element *src = &s->items[s->top];
-
-  gsl_matrix_complex *matrix = src->matrix_complex;
-  if (!matrix) {
-    fprintf(stderr, "Error: complex matrix is NULL.\n");
-    return;
-  }
-
-  size_t rows = matrix->size1;
-  size_t cols = matrix->size2;
-
-  gsl_matrix *result = gsl_matrix_alloc(rows, cols);
-  if (!result) {
-    fprintf(stderr, "Error: failed to allocate result matrix.\n");
-    return;
-  }
+void complex_matrix_real_part(Stack *s) {
+  complex_matrix_map_real(s, real_plane_slice, real_of);
+}
 
-  for (size_t i = 0; i < rows; i++) {
-    for (size_t j = 0; j < cols; j++) {
-      gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
-      double real = cabs(to_double_complex(z));
-      gsl_matrix_set(result, i, j, real);
-    }
-  }
+void complex_matrix_imag_part(Stack *s) {
+  complex_matrix_map_real(s, imag_plane_slice, imag_of);
+}
 
-  // Inline stackl_pop:
-  if (src->type == TYPE_MATRIX_COMPLEX && src->matrix_complex) {
-    gsl_matrix_complex_free(src->matrix_complex);
-  }
-  //    src->type = TYPE_NONE; // Mark slot as empty
-  s->top--;
+void complex_matrix_abs_by_element(Stack *s) {
+  complex_matrix_map_real(s, abs_slice, gsl_complex_abs);
+}
 
-  // Inline stackl_push_rmatrix:
-  if (s->top + 1 >= STACK_SIZE) {
-    fprintf(stderr, "Error: stack overflow when pushing result matrix.\n");
-    gsl_matrix_free(result);
-    return;
-  }
-  s->top++;
-  stack_element *dest = &s->items[s->top];
-  dest->type = TYPE_MATRIX_REAL;
-  dest->matrix_real = result;
+void complex_matrix_arg_by_element(Stack *s) {
+  complex_matrix_map_real(s, arg_slice, gsl_complex_arg);
 }
 
 void real2complex(Stack *s) {
@@ -269,22 +342,27 @@ void real2complex(Stack *s) {
     size_t rows = real_mat->size1;
     size_t cols = real_mat->size2;
 
-    gsl_matrix_complex *complex_mat = gsl_matrix_complex_alloc(rows, cols);
+    gsl_matrix_complex *complex_mat = pool_matrix_complex_alloc(rows, cols);
     if (!complex_mat) {
       fprintf(stderr, "Error: failed to allocate complex matrix.\n");
       return;
     }
 
-    for (size_t i = 0; i < rows; i++) {
-      for (size_t j = 0; j < cols; j++) {
-	double real = gsl_matrix_get(real_mat, i, j);
-	gsl_complex z = gsl_complex_rect(real, 0.0);
-	gsl_matrix_complex_set(complex_mat, i, j, z);
+    if (real_mat->tda == cols) {
+      plane_job job = { .z = complex_mat->data, .re = real_mat->data };
+      parallel_for(rows * cols, PARALLEL_GRAIN, join_real_slice, &job);
+    } else {
+      for (size_t i = 0; i < rows; i++) {
+	for (size_t j = 0; j < cols; j++) {
+	  double real = gsl_matrix_get(real_mat, i, j);
+	  gsl_complex z = gsl_complex_rect(real, 0.0);
+	  gsl_matrix_complex_set(complex_mat, i, j, z);
+	}
       }
     }
 
     // Free the old real matrix
-    gsl_matrix_free(real_mat);
+    matrix_release(real_mat);
 
     // Update the stack element
     src->type = TYPE_MATRIX_COMPLEX;
@@ -317,11 +395,8 @@ void split_complex(Stack *s) {
     double real_part = GSL_REAL(src->complex_val);
     double imag_part = GSL_IMAG(src->complex_val);
 
-    // Check space for two pushes
-    if (s->top + 2 >= STACK_SIZE) {
-      fprintf(stderr, "Error: not enough space on stack to split scalar.\n");
-      return;
-    }
+    // Popping one and pushing two needs one more slot
+    if (stack_reserve(s, 1) != 0) return;
 
     // Pop the complex scalar
     s->top--;
@@ -351,33 +426,37 @@ void split_complex(Stack *s) {
     size_t rows = matrix->size1;
     size_t cols = matrix->size2;
 
-    gsl_matrix *real_mat = gsl_matrix_alloc(rows, cols);
-    gsl_matrix *imag_mat = gsl_matrix_alloc(rows, cols);
+    gsl_matrix *real_mat = pool_matrix_alloc(rows, cols);
+    gsl_matrix *imag_mat = pool_matrix_alloc(rows, cols);
     if (!real_mat || !imag_mat) {
       fprintf(stderr, "Error: failed to allocate real/imag matrices.\n");
-      gsl_matrix_free(real_mat);
-      gsl_matrix_free(imag_mat);
+      pool_matrix_free(real_mat);
+      pool_matrix_free(imag_mat);
       return;
     }
 
-    for (size_t i = 0; i < rows; i++) {
-      for (size_t j = 0; j < cols; j++) {
-	gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
-	gsl_matrix_set(real_mat, i, j, GSL_REAL(z));
-	gsl_matrix_set(imag_mat, i, j, GSL_IMAG(z));
+    if (matrix->tda == cols) {
+      plane_job job = { .z = matrix->data, .re = real_mat->data, .im = imag_mat->data };
+      parallel_for(rows * cols, PARALLEL_GRAIN, both_planes_slice, &job);
+    } else {
+      for (size_t i = 0; i < rows; i++) {
+	for (size_t j = 0; j < cols; j++) {
+	  gsl_complex z = gsl_matrix_complex_get(matrix, i, j);
+	  gsl_matrix_set(real_mat, i, j, GSL_REAL(z));
+	  gsl_matrix_set(imag_mat, i, j, GSL_IMAG(z));
+	}
       }
     }
 
-    // Check space for two pushes
-    if (s->top + 2 >= STACK_SIZE) {
-      fprintf(stderr, "Error: not enough space on stack to split matrix.\n");
-      gsl_matrix_free(real_mat);
-      gsl_matrix_free(imag_mat);
+    // Popping one and pushing two needs one more slot
+    if (stack_reserve(s, 1) != 0) {
+      pool_matrix_free(real_mat);
+      pool_matrix_free(imag_mat);
       return;
     }
 
     // Pop the complex matrix
-    gsl_matrix_complex_free(matrix);
+    matrix_complex_release(matrix);
     s->top--;
 
     // Push real part
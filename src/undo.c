@@ -0,0 +1,295 @@
+/*
+ * This file is part of Mico's MM-15 Calculator
+ *
+ * Mico's MM-15 Calculator is free software:
+ * you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Mico's MM-15 Calculator is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Mico's MM-15 Calculator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Multi-level undo for the REPL. While a line runs, every instruction
+// first saves the elements it may pop or overwrite that are not saved yet,
+// by sharing (copy-on-write makes that a pointer copy per element). So the
+// saved part grows down from the top only as far as the line reaches, and
+// a line that works near the top of a deep stack costs nothing for the
+// elements below. After the line, the saved elements it left alone are
+// dropped and only the ones it popped or overwrote go into a journal
+// record, together with how many elements the line left in their place.
+// Undo swaps those two suffixes, which turns the record into the one redo
+// needs.
+
+#include <stdio.h>     // for fprintf, stderr
+#include <stdlib.h>    // for malloc, realloc, free
+#include <string.h>    // for memcmp, memmove, strlen
+#include "undo.h"
+
+int undo_levels = UNDO_LEVELS_DEFAULT;
+int undo_budget_mb = UNDO_BUDGET_MB_DEFAULT;
+
+typedef struct {
+  int base;                  // depth of the part the line left alone
+  stack_element* removed;    // what was above base before the line, owned
+  int removed_count;
+  int added_count;           // what is above base after it
+  size_t bytes;
+} undo_record;
+
+typedef struct {
+  undo_record* records;      // oldest first
+  int count;
+  int capacity;
+} journal;
+
+static journal undo_journal = {0};
+static journal redo_journal = {0};
+static size_t journal_bytes = 0;   // both journals together
+
+// snapshot[i] holds stack element i as it was before the line, for
+// undo_unsaved <= i < line_depth
+static stack_element* snapshot = NULL;
+static int line_depth = -1;        // stack depth before the line, -1 = not recording
+static int snapshot_capacity = 0;
+int undo_unsaved = 0;
+
+// **************** Records ****************
+static size_t element_bytes(const stack_element* e) {
+  size_t n = sizeof(stack_element);
+  switch (e->type) {
+  case TYPE_STRING:
+    if (e->string) n += strlen(e->string) + 1;
+    break;
+  case TYPE_MATRIX_REAL:
+    if (e->matrix_real) n += e->matrix_real->size1 * e->matrix_real->size2 * sizeof(double);
+    break;
+  case TYPE_MATRIX_COMPLEX:
+    if (e->matrix_complex) n += e->matrix_complex->size1 * e->matrix_complex->size2 * 2 * sizeof(double);
+    break;
+  default:
+    break;
+  }
+  return n;
+}
+
+static size_t elements_bytes(const stack_element* e, int n) {
+  size_t bytes = 0;
+  for (int i = 0; i < n; i++) bytes += element_bytes(&e[i]);
+  return bytes;
+}
+
+static void free_record(undo_record* r) {
+  for (int i = 0; i < r->removed_count; i++) stack_element_free(&r->removed[i]);
+  free(r->removed);
+  journal_bytes -= r->bytes;
+}
+
+static void drop_oldest(journal* j) {
+  free_record(&j->records[0]);
+  j->count--;
+  memmove(j->records, j->records + 1, (size_t)j->count * sizeof(undo_record));
+}
+
+static void clear_journal(journal* j) {
+  for (int i = 0; i < j->count; i++) free_record(&j->records[i]);
+  free(j->records);
+  *j = (journal){0};
+}
+
+static int push_record(journal* j, undo_record r) {
+  if (j->count == j->capacity) {
+    int cap = j->capacity ? 2 * j->capacity : 16;
+    undo_record* bigger = realloc(j->records, (size_t)cap * sizeof(undo_record));
+    if (!bigger) return -1;
+    j->records = bigger;
+    j->capacity = cap;
+  }
+  j->records[j->count++] = r;
+  journal_bytes += r.bytes;
+  return 0;
+}
+
+// Oldest undo levels go first; redo is emptied by every new line anyway
+static void enforce_limits(void) {
+  size_t budget = (size_t)undo_budget_mb << 20;
+  while (undo_journal.count > 0 &&
+         (undo_journal.count > undo_levels || journal_bytes > budget))
+    drop_oldest(&undo_journal);
+}
+
+// **************** Recording a line ****************
+static int same_element(const stack_element* a, const stack_element* b) {
+  if (a->type != b->type) return 0;
+  switch (a->type) {
+  case TYPE_REAL:           return memcmp(&a->real, &b->real, sizeof(double)) == 0;
+  case TYPE_COMPLEX:        return memcmp(&a->complex_val, &b->complex_val, sizeof(gsl_complex)) == 0;
+  case TYPE_STRING:         return a->string == b->string;
+  case TYPE_MATRIX_REAL:    return a->matrix_real == b->matrix_real;
+  case TYPE_MATRIX_COMPLEX: return a->matrix_complex == b->matrix_complex;
+  default:                  return 0;
+  }
+}
+
+static void drop_snapshot(void) {
+  for (int i = undo_unsaved; i < line_depth; i++) stack_element_free(&snapshot[i]);
+  line_depth = -1;
+  undo_unsaved = 0;
+}
+
+void undo_begin_line(const Stack* stack) {
+  int depth = stack->top + 1;
+  if (depth > snapshot_capacity) {
+    stack_element* bigger = realloc(snapshot, (size_t)depth * sizeof(stack_element));
+    if (!bigger) {
+      fprintf(stderr, "Undo: out of memory, this line cannot be undone\n");
+      return;
+    }
+    snapshot = bigger;
+    snapshot_capacity = depth;
+  }
+  line_depth = depth;
+  undo_unsaved = depth;
+}
+
+void undo_save(const Stack* stack, int reach) {
+  int low = (reach < 0) ? 0 : stack->top + 1 - reach;
+  if (low < 0) low = 0;
+  // Shares payloads; a payload written in place later in the line gets
+  // copied first, so the snapshot keeps the old value
+  while (undo_unsaved > low) {
+    int i = undo_unsaved - 1;
+    if (stack_element_clone(&snapshot[i], &stack->items[i]) != 0) {
+      fprintf(stderr, "Undo: out of memory, this line cannot be undone\n");
+      drop_snapshot();
+      return;
+    }
+    undo_unsaved = i;
+  }
+}
+
+void undo_end_line(Stack* stack) {
+  int depth = stack->top + 1;
+  if (line_depth < 0 || depth < undo_unsaved) {
+    // Nothing to compare against (or something reached below what it
+    // declared), so older records no longer line up
+    if (line_depth >= 0) drop_snapshot();
+    clear_undo_journal();
+    return;
+  }
+  int base = undo_unsaved;
+  while (base < line_depth && base < depth &&
+         same_element(&snapshot[base], &stack->items[base]))
+    base++;
+
+  int removed = line_depth - base;
+  if (removed == 0 && depth == base) {     // the line did not change the stack
+    drop_snapshot();
+    return;
+  }
+
+  undo_record r = { base, NULL, removed, depth - base, 0 };
+  if (removed > 0) {
+    r.removed = malloc((size_t)removed * sizeof(stack_element));
+    if (!r.removed) {
+      drop_snapshot();
+      clear_undo_journal();
+      return;
+    }
+    // Ownership moves from the snapshot to the record
+    memcpy(r.removed, snapshot + base, (size_t)removed * sizeof(stack_element));
+    r.bytes = elements_bytes(r.removed, removed);
+  }
+  line_depth = base;         // the rest now belongs to the record
+  drop_snapshot();
+
+  clear_journal(&redo_journal);
+  if (push_record(&undo_journal, r) != 0) {
+    for (int i = 0; i < removed; i++) stack_element_free(&r.removed[i]);
+    free(r.removed);
+    clear_undo_journal();
+    return;
+  }
+  enforce_limits();
+}
+
+// **************** Undo and redo ****************
+// Swaps the r->added_count elements above r->base for the removed ones, so
+// that r afterwards describes how to go back
+static int swap_record(Stack* stack, undo_record* r) {
+  if (stack->top + 1 != r->base + r->added_count) {
+    fprintf(stderr, "Undo: the stack no longer matches the journal\n");
+    return -1;
+  }
+  stack_element* taken = NULL;
+  if (r->added_count > 0) {
+    taken = malloc((size_t)r->added_count * sizeof(stack_element));
+    if (!taken) {
+      fprintf(stderr, "Undo: out of memory\n");
+      return -1;
+    }
+  }
+  if (r->removed_count > r->added_count &&
+      stack_reserve(stack, r->removed_count - r->added_count) != 0) {
+    free(taken);
+    return -1;
+  }
+  if (r->added_count > 0)
+    memcpy(taken, stack->items + r->base, (size_t)r->added_count * sizeof(stack_element));
+  if (r->removed_count > 0)
+    memcpy(stack->items + r->base, r->removed, (size_t)r->removed_count * sizeof(stack_element));
+  stack->top = r->base + r->removed_count - 1;
+
+  free(r->removed);
+  journal_bytes -= r->bytes;
+  r->removed = taken;
+  int n = r->added_count;
+  r->added_count = r->removed_count;
+  r->removed_count = n;
+  r->bytes = elements_bytes(taken, n);
+  journal_bytes += r->bytes;
+  return 0;
+}
+
+static int step(Stack* stack, journal* from, journal* to, const char* what) {
+  if (from->count == 0) {
+    fprintf(stderr, "Nothing to %s\n", what);
+    return -1;
+  }
+  undo_record* r = &from->records[from->count - 1];
+  if (swap_record(stack, r) != 0) {
+    clear_undo_journal();
+    return -1;
+  }
+  undo_record moved = *r;
+  from->count--;
+  journal_bytes -= moved.bytes;       // push_record counts it again
+  if (push_record(to, moved) != 0) {
+    journal_bytes += moved.bytes;
+    free_record(&moved);
+  }
+  return 0;
+}
+
+int undo_line(Stack* stack) {
+  return step(stack, &undo_journal, &redo_journal, "undo");
+}
+
+int redo_line(Stack* stack) {
+  return step(stack, &redo_journal, &undo_journal, "redo");
+}
+
+void clear_undo_journal(void) {
+  clear_journal(&undo_journal);
+  clear_journal(&redo_journal);
+  if (line_depth >= 0) drop_snapshot();
+  free(snapshot);
+  snapshot = NULL;
+  snapshot_capacity = 0;
+}
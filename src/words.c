@@ -21,8 +21,11 @@
 #include <stdbool.h>  // for false
 #include <stdio.h>    // for fprintf, stderr, fclose, fopen, perror, printf
 #include <string.h>   // for strncpy, strcmp, strlen
+#include "bytecode.h" // for compile_line, free_compiled_line
 #include "globals.h"  // for MACROS_PATH, WORDS_FILE, selected_function
+#include "peephole.h" // for optimize_compiled_line
 #include "stack.h"    // for pop, (anonymous struct)::(anonymous), Stack
+#include "symbols.h"  // for lookup_symbol, symbol_word, bind_word_symbol
 #include "words.h"    // for MAX_WORD_NAME, MAX_WORD_BODY, MAX_WORDS, user_word
 
 user_word words[MAX_WORDS];
@@ -31,6 +34,25 @@ int word_count = 0;
 user_word macros[MAX_WORDS];
 int macro_count = 0;
 
+// Compile a freshly stored body; a NULL result is compiled again on first use
+static void compile_word(user_word* w) {
+  w->code = compile_line(w->body);
+  optimize_compiled_line(w->code);
+}
+
+static void release_word(user_word* w) {
+  free_compiled_line(w->code);
+  w->code = NULL;
+}
+
+// Point every name at its current slot; called after any change to the
+// word or macro arrays
+static void rebind_symbols(void) {
+  unbind_user_symbols();
+  for (int i = 0; i < word_count; i++) bind_word_symbol(&words[i]);
+  for (int i = 0; i < macro_count; i++) bind_macro_symbol(&macros[i]);
+}
+
 // Macros files
 void list_macros(void) {
   if (macro_count > 0) {
@@ -47,6 +69,7 @@ int load_macros_from_file(void) {
     return -1;
   }
 
+  for (int i = 0; i < macro_count; i++) release_word(&macros[i]);
   macro_count = 0;
   while (macro_count < MAX_WORDS) {
     char name[MAX_WORD_NAME];
@@ -59,18 +82,17 @@ int load_macros_from_file(void) {
     macros[macro_count].name[MAX_WORD_NAME - 1] = '\0';
     strncpy(macros[macro_count].body, body, MAX_WORD_BODY);
     macros[macro_count].body[MAX_WORD_BODY - 1] = '\0';
+    compile_word(&macros[macro_count]);
     macro_count++;
   }
+  rebind_symbols();
 
   fclose(f);
   return 0;
 }
 
-user_word* find_macro(char* name) {
-  for (int i = 0; i < macro_count; i++) {
-    if (strcmp(macros[i].name, name) == 0) return &macros[i];
-  }
-  return NULL;
+user_word* find_macro(const char* name) {
+  return symbol_macro(lookup_symbol(name, strlen(name)));
 }
 
 // Words functions
@@ -103,11 +125,14 @@ int delete_word_by_index(int index) {
     return -1; // Invalid index
   }
 
+  release_word(&words[index]);
+
   // Shift elements left from index+1 onward
   for (int i = index; i < word_count - 1; i++) {
     words[i] = words[i + 1];
   }
   word_count--;
+  rebind_symbols();
   return 0;
 }
 
@@ -131,7 +156,9 @@ void word_select(Stack * stack) {
 }
 
 void clear_words(void) {
+  for (int i = 0; i < word_count; i++) release_word(&words[i]);
   word_count=0;
+  rebind_symbols();
 }
 
 int save_words_to_file(void) {
@@ -156,7 +183,7 @@ int load_words_from_file(void) {
     return -1;
   }
 
-  word_count = 0;
+  clear_words();
   while (word_count < MAX_WORDS) {
     char name[MAX_WORD_NAME];
     char body[MAX_WORD_BODY];
@@ -168,18 +195,17 @@ int load_words_from_file(void) {
     words[word_count].name[MAX_WORD_NAME - 1] = '\0';
     strncpy(words[word_count].body, body, MAX_WORD_BODY);
     words[word_count].body[MAX_WORD_BODY - 1] = '\0';
+    compile_word(&words[word_count]);
     word_count++;
   }
+  rebind_symbols();
 
   fclose(f);
   return 0;
 }
 
-user_word* find_word(char* name) {
-  for (int i = 0; i < word_count; i++) {
-    if (strcmp(words[i].name, name) == 0) return &words[i];
-  }
-  return NULL;
+user_word* find_word(const char* name) {
+  return symbol_word(lookup_symbol(name, strlen(name)));
 }
 
 int is_word_definition(const char *s) {
@@ -250,6 +276,8 @@ int is_word_definition(const char *s) {
 
   strncpy(w->body, body_start, body_len);
   w->body[body_len] = '\0';
+  compile_word(w);
+  bind_word_symbol(w);
   printf("New word %s <- %s\n",w->name,w->body);
   return 1;
 }
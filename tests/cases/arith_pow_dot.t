@@ -0,0 +1,3 @@
+# real scalar fast path of ^ .* ./ and -
+#EXPECT: 3
+2 3 ^ 4 .* 8 ./ 1 -
@@ -0,0 +1,3 @@
+# abs of a complex matrix element by element: |(3,4)| = 5
+#EXPECT: 5
+[2 2 $ 3 -1 0 2] [2 2 $ 4 0 -2 5] j2r abs 0 0 get_aij
@@ -0,0 +1,4 @@
+# Complex matrix times complex scalar: (0,3)(2,-1) = (3,6), |(3,6)| = sqrt(45)
+#TOL: 1e-5
+#EXPECT: 6.708204
+[1 3 $ (1,1) (2,0) (0,3)] (2,-1) * 0 2 get_aij abs
@@ -0,0 +1,3 @@
+# describe: rows sum, mean, var, min, max; var of column (4, 5, -3) is 19
+#EXPECT: 19
+[3 2 $ 1 4 2 5 6 -3] describe 2 1 get_aij
@@ -0,0 +1,4 @@
+# dup shares the matrix; chs must copy before negating so the original
+# [5 7] is untouched: 5 + 7
+#EXPECT: 12
+[1 2 $ 5 7] dup chs drop split_mat +
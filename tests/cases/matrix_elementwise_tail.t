@@ -0,0 +1,4 @@
+# Five elements leave a scalar tail after every vector width; the last
+# one is 5 .* 5
+#EXPECT: 25
+[1 5 $ 1 2 3 4 5] 1 * dup .* 0 4 get_aij
@@ -0,0 +1,4 @@
+# exp then ln of a real matrix round trips, tail column included
+#TOL: 1e-5
+#EXPECT: 5
+[1 5 $ 1 2 3 4 5] exp ln 0 4 get_aij
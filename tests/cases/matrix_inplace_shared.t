@@ -0,0 +1,4 @@
+# 2 * makes a private [2 4] that + and - may overwrite, but dup shares it
+# first, so 3 + must not touch the copy below: [2 4] - [5 7] = [-3 -3]
+#EXPECT: -6
+[1 2 $ 1 2] 2 * dup 3 + - split_mat +
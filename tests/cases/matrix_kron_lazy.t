@@ -0,0 +1,6 @@
+# A lazy kron times a matrix is computed from its factors, for several
+# columns and for a single one: 1276 + 1108
+#EXPECT: 2384
+lazy [2 2 $ 1 2 3 4] [2 3 $ 0 5 6 7 8 9] kron [6 2 $ 1 2 3 4 5 6 7 8 9 10 11 12] * 3 1 get_aij
+[2 2 $ 1 2 3 4] [2 3 $ 0 5 6 7 8 9] kron [6 1 $ 1 3 5 7 9 11] * 3 0 get_aij
+swap drop +
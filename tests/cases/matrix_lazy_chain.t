@@ -0,0 +1,3 @@
+# A chain of elementwise operators in lazy mode, forced by get_aij
+#EXPECT: 49
+lazy [2 2 $ 1 2 3 4] 2 .^ 3 .* 1 + 1 1 get_aij
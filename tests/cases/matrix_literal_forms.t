@@ -0,0 +1,7 @@
+# inline literal with exponents and explicit signs, read back entry by
+# entry: a00 + 10 a01 + 100 a10 + 1000 a11 = 3 - 10 + 25 + 2000
+#EXPECT: 2018
+[2 2 $ 3 -1 2.5e-1 +2] 0 0 get_aij swap
+0 1 get_aij 10 * roll + swap
+1 0 get_aij 100 * roll + swap
+1 1 get_aij 1000 * roll + swap drop
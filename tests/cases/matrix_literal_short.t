@@ -0,0 +1,5 @@
+# A literal with too few elements pushes nothing, on a line or in a word
+#EXPECT: 17
+[2 2 $ 1 2 3] 5 2 *
+: bad [2 2 $ 1 2 3] ;
+bad bad 7 +
@@ -0,0 +1,5 @@
+# Elementwise ops, maps and comparisons split across worker threads agree
+# with the serial result
+#TOL: 1e-6
+#EXPECT: 180000
+4 setthreads 300 300 ones 2 * sqrt dup .* dup 1 geq .* csum rsum 0 0 get_aij
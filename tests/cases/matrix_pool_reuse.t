@@ -0,0 +1,4 @@
+# The dropped 3x3 goes back to the pool and eye gets the same block back;
+# it must come out zeroed apart from the diagonal, so all entries sum to 3
+#EXPECT: 3
+[3 3 $ 9 9 9 9 9 9 9 9 9] drop 3 eye csum rsum 0 0 get_aij
@@ -0,0 +1,4 @@
+# A matrix power times the same negative power is the identity
+#TOL: 1e-9
+#EXPECT: 1
+[2 2 $ 1 1 1 0] 10 ^ [2 2 $ 1 1 1 0] -10 ^ * 0 0 get_aij
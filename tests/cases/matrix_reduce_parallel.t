@@ -0,0 +1,4 @@
+# Column reductions and cumulative sums split into row parts on the
+# thread pool: the column sum of 1, 2, ..., 1000 is 500500
+#EXPECT: 500500
+4 setthreads 1000 300 ones cumsum_c csum 0 299 get_aij
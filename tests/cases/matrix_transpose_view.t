@@ -0,0 +1,3 @@
+# A transposed matrix times another is computed without copying the transpose
+#EXPECT: 12
+[3 2 $ 1 2 3 4 5 6] ' [3 1 $ 1 1 1] * 1 0 get_aij
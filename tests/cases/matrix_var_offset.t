@@ -0,0 +1,3 @@
+# Column variance of data far from zero: 1, not lost to cancellation
+#EXPECT: 1
+[3 1 $ 1000000001 1000000002 1000000003] cvar 0 0 get_aij
@@ -0,0 +1,4 @@
+# split_mat of a 150-element matrix no longer overflows a fixed 100-slot stack:
+# 150 rrange is 0..149, so the two topmost elements add to 148 + 149
+#EXPECT: 297
+150 rrange split_mat +
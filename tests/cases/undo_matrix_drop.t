@@ -0,0 +1,9 @@
+# undo brings back a dropped matrix as it was before the in-place chs
+# (the journal keeps the old payload): 1 + 2
+#EXPECT: 3
+[1 2 $ 1 2]
+chs
+drop
+undo
+undo
+split_mat +
@@ -0,0 +1,8 @@
+# multi-level undo and redo: after 1, 2, 3 go back two lines, forward one
+#EXPECT: 2
+1
+2
+3
+undo
+undo
+redo
@@ -0,0 +1,5 @@
+# a word calling another word, linked through the symbol table
+#EXPECT: 81
+: sq dup * ;
+: quad sq sq ;
+3 quad
@@ -0,0 +1,6 @@
+# dup ' swap * inside a word is fused into one X'X instruction; the lower
+# triangle is mirrored from the upper one: a10 + a11 = 14 + 20
+#EXPECT: 34
+: xtx dup ' swap * ;
+[2 2 $ 1 2 3 4] xtx 1 0 get_aij swap
+1 1 get_aij roll + swap drop
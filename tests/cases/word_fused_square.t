@@ -0,0 +1,7 @@
+# dup * and swap / inside words are fused; scalars and matrices
+# a01 of [1 2; 3 4]^2 is 10, and 5 ratio divides it into 5
+#EXPECT: 0.5
+: sq dup * ;
+: ratio swap / ;
+[2 2 $ 1 2 3 4] sq 0 1 get_aij
+5 ratio
@@ -0,0 +1,5 @@
+# a matrix literal in a word is shared with every push; negating one push
+# must not change what the next call pushes: 5 + 7
+#EXPECT: 12
+: lit [1 2 $ 5 7] ;
+lit chs drop lit split_mat +
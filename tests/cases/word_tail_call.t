@@ -0,0 +1,11 @@
+# a tail call returns to the right place in the calling line, and a
+# self-recursive word runs far past the return stack limit (100000
+# frames) because each tail call reuses its frame. The countdown stops by
+# evaluating "clrwords" (a substring of length 8 * (n == 0)) at zero.
+#EXPECT: 70
+: inc 1 + ;
+: inc2 inc inc ;
+5 inc2 10 *
+: down 1 - dup 0 eq 8 * 0 swap "clrwords" substr eval down ;
+1000000 down
++